@@ -2,6 +2,7 @@
 
 #include "ConfigBuilder.hpp"
 #include "HttpRequest.hpp"
+#include "Task.hpp"
 
 #include <sys/wait.h>
 #include <cstring>
@@ -14,13 +15,22 @@ private:
 	std::string 						_scriptPath;
 	std::string 						_method; 
 	std::string 						_query;       
-	std::string 						_body;
-	std::map<std::string, std::string> 	_header;
+	RequestBody							_body;			///< In the request's buffer or spool file, which outlive the script
 	std::string 						_contentType;
 	std::string 						_serverName;
 
+	// running script, released by the destructor if execute() is cancelled
+	pid_t								_pid;
+	int									_stdinFd;
+	int									_stdoutFd;
+
+	void closeFd(int& fd);
+
 public:
 	CGI(const HttpRequest& req, const config::LocationConfig& lc);
+	CGI(const CGI& other) = delete;
+	CGI& operator=(const CGI& other) = delete;
+	~CGI();
 	bool isAllowedCgi()const;
-	std::string execute();
+	Task<std::string> execute();
 };
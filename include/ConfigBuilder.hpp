@@ -2,6 +2,8 @@
 
 #include "ConfigParser.hpp"
 
+#include <algorithm>
+#include <sched.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -53,23 +55,76 @@ namespace config
 		int 						port;				///< Port number to listen on
 		std::vector<std::string> 	serverNames;		///< Server names
 		std::map<int, std::string> 	errorPages;			///< Custom error pages
+		std::map<int, std::string>	errorPageBodies;	///< Contents of errorPages, read when the configuration is built
 		long 						clientMaxBodySize;	///< Max body size for this server
 		std::string 				root;				///< Root directory for this server
 		std::vector<std::string> 	index;				///< Default pages for this server	
 		std::vector<LocationConfig> locations;			///< Location blocks within this server
 	};
 
+	/**
+	 * @struct GlobalConfig
+	 * @brief Process-wide settings from the main context of the configuration file.
+	 *
+	 * These settings are not tied to a virtual host: they describe how the
+	 * event loops themselves are laid out and run.
+	 */
+	/// How an event loop waits for and performs socket I/O.
+	enum EventBackend {
+		BACKEND_EPOLL,			///< readiness with epoll, then recv/send/accept syscalls
+		BACKEND_IO_URING		///< completions from io_uring (multishot accept/recv, queued sends)
+	};
+
+	/// What an overloaded event loop does with new work (see overload_lag).
+	enum OverloadAction {
+		OVERLOAD_REJECT,		///< answer new requests with a prebuilt 503 and Retry-After
+		OVERLOAD_PAUSE			///< stop accepting connections until the lag is back down
+	};
+
+	struct GlobalConfig
+	{
+		int							workerThreads;		///< Number of event loops, one thread each (1 = single loop in the main thread)
+		int							workerProcesses;	///< Number of forked workers supervised by a master (1 = no fork)
+		bool						edgeTriggered;		///< Register sockets with EPOLLET and drain them until EAGAIN
+		unsigned long				headerTimeoutMs;	///< Deadline for a whole request head, from its first byte
+		unsigned long				bodyTimeoutMs;		///< Deadline between two reads of a request body
+		unsigned long				keepaliveTimeoutMs;	///< Deadline for the next request on an idle connection
+		unsigned long				sendTimeoutMs;		///< Deadline between two writes of a response
+		EventBackend				eventBackend;		///< I/O backend of the event loops (epoll is the fallback)
+		int							handlerThreads;		///< Threads running request handlers off the loops (0 = handlers run on their loop)
+		int							fsThreads;			///< Threads running blocking filesystem calls for the loops
+		int							openFileCache;		///< Static file lookups kept open, with their fd (0 = not cached)
+		int							busyPollUs;			///< Time a loop keeps polling without blocking after an event (0 = off)
+		bool						soBusyPoll;			///< Set SO_BUSY_POLL to busyPollUs on accepted sockets
+		std::vector<int>			cpuAffinity;		///< CPU of loop i is cpuAffinity[i % size] (empty = loops not pinned)
+		unsigned long				overloadLagMs;		///< Smoothed loop lag that puts a loop in overload (0 = never)
+		OverloadAction				overloadAction;		///< How an overloaded loop sheds load
+		long						bodyBufferSize;		///< Request bodies larger than this are spooled to a temporary file
+		long						headerLineSize;		///< Longest request line or header field (414 / 431 beyond)
+		long						headerSize;			///< Longest request head (431 beyond)
+		long						uriMaxSize;			///< Longest request-target (414 beyond)
+		int							headerFields;		///< Most header fields in a request (431 beyond)
+	};
+
 	class ConfigBuilder
 	{
 	private:
 		static long							defaultClientMaxBodySize();
 		static long							parseSizeLiteral(const std::string& size);
 		static std::map<int, std::string>	defaultErrorPages();
+		static std::map<int, std::string>	loadErrorPages(const std::map<int, std::string>& pages);
 		static std::vector<std::string>		defaultMethods();
+		static int							parseCountLiteral(const std::string& value, const std::string& directive, int max);
+		static bool							parseSwitchLiteral(const std::string& value, const std::string& directive);
+		static unsigned long				parseTimeLiteral(const std::string& value, const std::string& directive);
+		static EventBackend					parseBackendLiteral(const std::string& value);
+		static std::vector<int>				parseAffinityLiteral(const std::vector<std::string>& values);
+		static OverloadAction				parseOverloadActionLiteral(const std::string& value);
 
 		static ServerConfig					buildServerConfig(const ServerNode& node);
 		static LocationConfig				buildLocationConfig(const LocationNode& node, const ServerConfig& parent);
 	public:
 		static std::vector<ServerConfig>	build(const std::vector<ServerNode>& ast);
+		static GlobalConfig					buildGlobal(const GlobalNode& node);
 	};
 }	
@@ -35,11 +35,37 @@ namespace config{
 		std::vector<LocationNode> 	locations;			///< Location blocks within this server
 	};
 
+	// Represents the directives of the main context, outside any server block.
+	struct GlobalNode
+	{
+		std::string 				workerThreads;		///< Number of event loop threads
+		std::string 				workerProcesses;	///< Number of forked worker processes
+		std::string 				edgeTriggered;		///< "on" to register sockets with EPOLLET
+		std::string 				headerTimeout;		///< Time allowed to receive a request head
+		std::string 				bodyTimeout;		///< Time allowed between two reads of a request body
+		std::string 				keepaliveTimeout;	///< Time an idle keep-alive connection is kept open
+		std::string 				sendTimeout;		///< Time allowed between two writes of a response
+		std::string 				eventBackend;		///< "epoll" or "io_uring"
+		std::string 				handlerThreads;		///< Number of handler pool threads, or "off"
+		std::string 				fsThreads;			///< Number of filesystem offload threads
+		std::string 				openFileCache;		///< Entries of the open file cache, or "off"
+		std::string 				busyPollUs;			///< Microseconds an idle loop keeps polling, or "off"
+		std::string 				soBusyPoll;			///< "on" to set SO_BUSY_POLL on accepted sockets
+		std::vector<std::string>	cpuAffinity;		///< "auto", "off" or the CPU of each loop
+		std::string 				overloadLag;		///< Loop lag above which the loop sheds load, or "off"
+		std::string 				overloadAction;		///< "reject" (503) or "pause" (stop accepting)
+		std::string 				bodyBufferSize;		///< Size above which a request body is spooled to a file
+		std::vector<std::string>	headerBuffers;		///< Number and size of the buffers a request head may fill
+		std::string 				uriMaxSize;			///< Longest request-target
+		std::string 				headerFields;		///< Most header fields in a request
+	};
+
 	class Parser
 	{
 	private:
 		std::vector<Token>	_tokens;
 		std::size_t 		_pos;
+		GlobalNode			_global;
 		
 		Token	peek() const;
 		Token	get();
@@ -50,11 +76,14 @@ namespace config{
 
 		ServerNode					parseServerBlock();
 		LocationNode				parseLocationBlock();
+		void						parseGlobalDirective();
 		std::string					parseSimpleDirective(const std::string& str);
 		std::vector<std::string> 	parseVectorStringDirective(const std::string& str);
+		std::vector<std::string> 	parseValueListDirective(const std::string& str);
 
 	public:
 		Parser(const std::string& filename);
 		std::vector<ServerNode> parse();
+		const GlobalNode&		getGlobal() const	{ return _global; }
 	};
 }
@@ -0,0 +1,151 @@
+#pragma once
+
+#include "HttpRequestParser.hpp"
+#include "HttpResponse.hpp"
+#include "Reactor.hpp"
+#include "Task.hpp"
+#include "TimerWheel.hpp"
+
+#include <memory>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <vector>
+
+/**
+ * @struct WriteBuffer
+ * @brief Responses pending to be written to a client, pipelined ones one after the other.
+ *
+ * Heads and constant responses are appended to data, a buffer kept from one response
+ * to the next; each body stays the string its handler produced, moved into bodies.
+ * segments lists the ranges of both in sending order, and gather() turns the unsent
+ * ones into an iovec array: a response goes out head and body in one writev, without
+ * the body being copied behind its head.
+ * A file body (FileBody, moved into files) is a segment of its own, sent with
+ * sendfile: gather() stops before it and currentFile() gives the part left to send.
+ */
+struct WriteBuffer {
+	static constexpr size_t MAX_IOV = 16;		///< Segments sent by one writev
+
+	enum SegmentKind {
+		SEGMENT_DATA,		///< a range of data
+		SEGMENT_BODY,		///< one of bodies
+		SEGMENT_FILE		///< one of files
+	};
+
+	struct Segment {
+		SegmentKind	kind;
+		size_t		index;		///< In bodies or files
+		size_t		offset;		///< Start in data (unused otherwise)
+		size_t		length;
+	};
+
+	std::string					data;
+	std::vector<std::string>	bodies;
+	std::vector<FileBody>		files;
+	std::vector<Segment>		segments;
+	size_t		current = 0;		///< First segment not entirely sent
+	size_t		currentSent = 0;	///< Bytes of segments[current] sent
+	size_t		dataQueued = 0;		///< Bytes of data in segments
+	size_t		queued = 0;			///< Bytes of all the segments
+	size_t		sent = 0;			///< Bytes sent
+	bool		keepAlive = false;
+
+	void	append(std::string_view bytes);
+	void	commitData();
+	void	appendBody(std::string body);
+	void	appendFile(FileBody file);
+	size_t	gather(iovec* iov, size_t max, bool* beforeFile = nullptr) const;
+	const FileBody*	currentFile(off_t& offset, size_t& length) const;
+	void	consume(size_t bytes);
+	void	clear();
+
+	bool isComplete() const			{ return sent >= queued; }
+	size_t remainingToSend() const	{ return queued - sent; }
+};
+
+/// What a client that is not being answered is currently sending.
+enum ReadPhase {
+	READ_IDLE,			///< nothing of the next request received yet
+	READ_HEADERS,		///< request line / headers partially received
+	READ_BODY			///< headers complete, body partially received
+};
+
+/// What the loop is waiting for on a client; each phase has its own deadline.
+enum ClientPhase {
+	PHASE_HEADERS,		///< receiving a request head (client_header_timeout, not extended by reads)
+	PHASE_BODY,			///< receiving a request body (client_body_timeout, between two reads)
+	PHASE_IDLE,			///< keep-alive, waiting for the next request (keepalive_timeout)
+	PHASE_SEND,			///< writing a response (send_timeout, between two writes)
+	PHASE_LINGER		///< lingering close, discarding input (Webserver::closeClient)
+};
+
+/**
+ * @struct Connection
+ * @brief All the state of one client, in one place.
+ *
+ * Replaces the per-fd maps that used to be spread over Webserver (server index,
+ * last activity) and Server (parser, request count, write buffer): handling an
+ * event touches one contiguous object reached through epoll_event.data.ptr.
+ */
+struct Connection : PollSource {
+	uint32_t	generation = 0;			///< Bumped each time the slot is reused for a new client
+	bool		active = false;			///< Slot currently holds an open client
+	bool		writing = false;		///< Responses are being sent from writeBuffer
+	bool		pending = false;		///< The handler coroutine is suspended, no response yet
+	bool		retired = false;		///< Closed while its handler was away: kept until the handler is destroyed
+	bool		lingerOnClose = false;	///< Refused before its body was read: closed with a lingering close
+	bool		lingering = false;		///< Shut down for writing, its input discarded until it closes
+	uint64_t	lingerUntil = 0;		///< Monotonic ns at which the lingering close gives up
+	int			requestCount = 0;		///< Requests served on this connection
+	ClientPhase	phase = PHASE_HEADERS;	///< Deadline currently armed in timer
+	HttpParser	parser;					///< Input buffer and the request parsed from it, referenced by handler
+	WriteBuffer	writeBuffer;			///< Responses queued and not sent yet
+	Task<HttpResponse>	handler;		///< Handler of request while it is suspended
+	TimerNode	timer;					///< Link into the loop's TimerWheel
+
+	// completion-based (io_uring) loop only
+	bool		deferSend = false;		///< Queue whole responses in writeBuffer, the loop submits the send
+	bool		recvArmed = false;		///< A multishot recv is posted for this fd
+	bool		recvPaused = false;		///< Input is left in the socket until the response in progress is sent
+	bool		sendInFlight = false;	///< A send of writeBuffer is posted
+	bool		shutdownInFlight = false;	///< A shutdown linked after the last send is posted
+	bool		closing = false;		///< Shut down, the fd is closed once no operation is posted
+	std::string	pendingInput;			///< Bytes received while a response was being sent, before the recv was paused
+	iovec		sendIov[WriteBuffer::MAX_IOV];	///< Segments of the posted send
+	msghdr		sendMsg;				///< The posted send, pointing to sendIov
+
+	ReadPhase	getReadPhase() const;
+};
+
+/**
+ * @class ConnectionSlab
+ * @brief Connections indexed by fd, allocated in fixed blocks that never move.
+ *
+ * Blocks of SLOTS_PER_BLOCK connections are allocated on demand and kept for the
+ * lifetime of the loop, so a Connection's address is stable (safe to store in
+ * epoll_event.data.ptr and in the timer wheel) and neighbouring fds are neighbours
+ * in memory. A slot is reset when it is acquired for a new client.
+ */
+class ConnectionSlab {
+	private:
+		static constexpr size_t SLOTS_PER_BLOCK = 256;
+
+		std::vector<std::unique_ptr<Connection[]>>	_blocks;
+		size_t										_active = 0;
+
+	public:
+		Connection*	acquire(int fd, size_t serverIndex);
+		void		release(Connection& conn);
+		Connection*	get(int fd);
+		size_t		size(void) const	{ return _active; }
+
+		template <typename Fn>
+		void		forEachActive(Fn fn){
+			for (size_t b = 0; b < _blocks.size(); b++){
+				for (size_t i = 0; i < SLOTS_PER_BLOCK; i++){
+					if (_blocks[b][i].active)
+						fn(_blocks[b][i]);
+				}
+			}
+		}
+};
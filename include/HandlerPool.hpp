@@ -0,0 +1,74 @@
+#pragma once
+
+#include "Stats.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class Reactor;
+
+/// A coroutine to resume on the handler pool, and the event loop it belongs to.
+struct HandlerJob {
+	std::coroutine_handle<>	handle;
+	Reactor*				owner = nullptr;	///< Loop the coroutine goes back to (see onEventLoop)
+	LoopStats*				stats = nullptr;	///< Counters of that loop, may be null
+};
+
+/**
+ * @class HandlerPool
+ * @brief Work-stealing threads running request handlers away from the event loops.
+ *
+ * Event loops only receive, parse and send; a handler that co_awaits
+ * onHandlerPool() continues on one of these threads, so an expensive request
+ * (a big autoindex, a multipart extraction, parsing CGI output) does not delay
+ * the cheap ones sharing its loop.
+ *
+ * Every worker owns a deque. Loops hand jobs out round-robin; a worker takes the
+ * oldest job of its own deque and, when it is empty, steals the newest one of
+ * another worker's deque before going to sleep. Queue depth, jobs run and steals
+ * are counted in the LoopStats of the loop the job came from.
+ *
+ * @note process-wide and started on first use: a prefork master never starts it,
+ *       each forked worker gets its own threads.
+ */
+class HandlerPool {
+	private:
+		struct Worker {
+			std::mutex				mutex;
+			std::deque<HandlerJob>	jobs;
+		};
+
+		static std::atomic<size_t>			_configuredThreads;
+		static thread_local Reactor*		_home;
+
+		std::vector<std::unique_ptr<Worker>>	_workers;
+		std::atomic<size_t>						_next;		// round-robin cursor of submit()
+		std::atomic<long>						_queued;	// jobs waiting in any deque (briefly -1: taken before counted)
+		std::mutex								_idleMutex;
+		std::condition_variable					_idle;
+
+		explicit HandlerPool(size_t threads);
+
+		void	run(size_t index);
+		bool	take(size_t index, HandlerJob& job, bool& stolen);
+
+	public:
+		HandlerPool(const HandlerPool& other) = delete;
+		HandlerPool& operator=(const HandlerPool& other) = delete;
+
+		// number of threads, set from handler_threads before the loops start (0 = no pool)
+		static void			configure(size_t threads);
+		static bool			enabled(void);
+		static HandlerPool&	instance(void);
+
+		// loop of the job the calling pool thread runs, nullptr outside the pool
+		static Reactor*		home(void);
+
+		void				submit(const HandlerJob& job);
+};
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/// Request methods the server knows; any other is answered with 405.
+enum HttpMethod : uint8_t {
+    METHOD_GET,
+    METHOD_POST,
+    METHOD_DELETE,
+    METHOD_OTHER
+};
+
+enum HttpVersion : uint8_t {
+    VERSION_1_0,
+    VERSION_1_1,
+    VERSION_OTHER
+};
+
+/**
+ * @brief Header fields interned by the parser, so the server reads them by index
+ *
+ * @note HEADER_COUNT doubles as the id of every other field name.
+ */
+enum HttpHeaderId : uint8_t {
+    HEADER_HOST,
+    HEADER_CONNECTION,
+    HEADER_CONTENT_LENGTH,
+    HEADER_CONTENT_TYPE,
+    HEADER_TRANSFER_ENCODING,
+    HEADER_EXPECT,
+    HEADER_TE,
+    HEADER_UPGRADE,
+    HEADER_COOKIE,
+    HEADER_USER_AGENT,
+    HEADER_ACCEPT,
+    HEADER_ACCEPT_ENCODING,
+    HEADER_ACCEPT_LANGUAGE,
+    HEADER_AUTHORIZATION,
+    HEADER_REFERER,
+    HEADER_ORIGIN,
+    HEADER_RANGE,
+    HEADER_IF_MODIFIED_SINCE,
+    HEADER_IF_NONE_MATCH,
+    HEADER_CACHE_CONTROL,
+    HEADER_COUNT,
+    HEADER_UNKNOWN = HEADER_COUNT
+};
+
+/**
+ * @namespace httpHeaders
+ * @brief Maps field names to HttpHeaderId with a perfect hash built at compile time.
+ *
+ * The hash only looks at the length and the first and last characters of a name,
+ * folded to lowercase, so interning a name is a table load and one case-insensitive
+ * compare against the candidate: no lowercase copy, no string map. The multipliers
+ * are searched for by the compiler; adding a name they cannot separate fails the
+ * build instead of mapping two names to one slot.
+ */
+namespace httpHeaders {
+    inline constexpr std::array<std::string_view, HEADER_COUNT> NAMES = {
+        "host", "connection", "content-length", "content-type", "transfer-encoding",
+        "expect", "te", "upgrade", "cookie", "user-agent", "accept", "accept-encoding",
+        "accept-language", "authorization", "referer", "origin", "range",
+        "if-modified-since", "if-none-match", "cache-control"
+    };
+
+    inline constexpr size_t TABLE_SIZE = 64;
+
+    constexpr unsigned char foldCase(char c){
+        return (c >= 'A' && c <= 'Z') ? static_cast<unsigned char>(c | 0x20) : static_cast<unsigned char>(c);
+    }
+
+    constexpr bool equalsNoCase(std::string_view a, std::string_view b){
+        if (a.size() != b.size())
+            return false;
+        for (size_t i = 0; i < a.size(); i++){
+            if (foldCase(a[i]) != foldCase(b[i]))
+                return false;
+        }
+        return true;
+    }
+
+    struct Seed {
+        unsigned    first;
+        unsigned    last;
+    };
+
+    /// name must not be empty
+    constexpr size_t hash(std::string_view name, Seed seed){
+        return (name.size() + foldCase(name.front()) * seed.first + foldCase(name.back()) * seed.last) % TABLE_SIZE;
+    }
+
+    /// the first pair of multipliers giving every known name its own slot
+    constexpr Seed findSeed(){
+        for (unsigned first = 1; first < TABLE_SIZE; first++){
+            for (unsigned last = 1; last < TABLE_SIZE; last++){
+                std::array<bool, TABLE_SIZE> used{};
+                bool collision = false;
+                for (size_t i = 0; i < NAMES.size() && !collision; i++){
+                    size_t slot = hash(NAMES[i], Seed{first, last});
+                    collision = used[slot];
+                    used[slot] = true;
+                }
+                if (!collision)
+                    return Seed{first, last};
+            }
+        }
+        return Seed{0, 0};
+    }
+
+    inline constexpr Seed SEED = findSeed();
+    static_assert(SEED.first != 0, "no perfect hash for httpHeaders::NAMES: grow TABLE_SIZE");
+
+    constexpr std::array<HttpHeaderId, TABLE_SIZE> makeSlots(){
+        std::array<HttpHeaderId, TABLE_SIZE> slots{};
+        slots.fill(HEADER_UNKNOWN);
+        for (size_t i = 0; i < NAMES.size(); i++)
+            slots[hash(NAMES[i], SEED)] = static_cast<HttpHeaderId>(i);
+        return slots;
+    }
+
+    inline constexpr std::array<HttpHeaderId, TABLE_SIZE> SLOTS = makeSlots();
+
+    /// Id of a field name, in any case; HEADER_UNKNOWN for names the server does not intern.
+    constexpr HttpHeaderId lookup(std::string_view name){
+        if (name.empty())
+            return HEADER_UNKNOWN;
+        HttpHeaderId id = SLOTS[hash(name, SEED)];
+        if (id != HEADER_UNKNOWN && equalsNoCase(name, NAMES[id]))
+            return id;
+        return HEADER_UNKNOWN;
+    }
+
+    static_assert(lookup("Content-Length") == HEADER_CONTENT_LENGTH);
+    static_assert(lookup("X-Content-Length") == HEADER_UNKNOWN);
+}
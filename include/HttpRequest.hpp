@@ -1,17 +1,43 @@
 #pragma once
 
-#include <string>
-#include <map>
+#include "HttpHeaders.hpp"
+#include "RequestBody.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <string_view>
 
 /**
  * @class HttpRequest
  * @brief Represents a parsed HTTP request received by the server.
  *
- * This class stores the HTTP request line (method, path, version),
+ * This class stores the HTTP request line (method, target, version),
  * the request headers, and the optional message body.
  * It is used by the HTTP parser and passed into the request handlers (GET/POST/DELETE).
  *
+ * Nothing is copied out of the received bytes: every part is an offset and a length
+ * into the buffer the request was read into (the parser's), handed out as
+ * std::string_view. A request is therefore only valid as long as its parser is not
+ * reset, which a connection only does once the response has been produced.
+ * The request-target is split once into path and query. The body is the exception: a
+ * large one is read from the parser's spool file (see RequestBody).
+ *
+ * The method and version are also kept as enums, and the fields the server reads
+ * (Host, Content-Length, Connection...) are interned by the parser: each known
+ * HttpHeaderId indexes the first field with that name, so getHeader(HEADER_HOST) is
+ * a load. Other fields are only kept in the field table, in received order.
+ *
+ * The field table holds its first INLINE_HEADERS fields in the request itself, which is
+ * enough for nearly every client; the rest go to a table allocated from the request's
+ * arena the first time they are needed, sized for client_max_header_fields.
+ *
+ * The parser owns the request and handlers take it by reference; it cannot be copied,
+ * so no part of it (nor of the buffer it points into) is duplicated on the way.
+ *
  * @note The supported HTTP methods according to the project specification are: GET; POST; DELETE
+ * @note Header names are kept as received: names are compared ignoring case.
  *
  * Example request format:
  * @code
@@ -35,27 +61,85 @@
  * - Some stricter HTTP parsers will return 400 Bad Request because the request-target is required by the spec (RFC 9110).  YUXIN WANTS TO and Did FOLLOW THIS
  */
 class HttpRequest{
+public:
+    static constexpr size_t MAX_HEADERS = 128;              ///< Highest client_max_header_fields
+    static constexpr size_t INLINE_HEADERS = 16;            ///< Header fields held in the request itself
+
 private:
-    std::string                             _method;                ///< HTTP method (GET, POST, DELETE)
-    std::string                             _requestPath;           ///< URI path extracted from the request line
-    std::string                             _version;               ///< HTTP version string (e.g., "HTTP/1.1")
-    std::map<std::string, std::string>      _requestHeaders;        ///< Key-value map of request headers
-    std::string                             _body;                  ///< Optional message body (POST, some PUT, etc.)
+    /// Part of the request: offset and length in the parser's buffer.
+    struct Span {
+        uint32_t    offset = 0;
+        uint32_t    length = 0;
+    };
+    struct Field {
+        Span            name;
+        Span            value;
+        HttpHeaderId    id;
+    };
+
+    const char*                             _base = nullptr;        ///< Buffer the spans point into
+    Span                                    _method;                ///< HTTP method (GET, POST, DELETE)
+    HttpMethod                              _methodId = METHOD_OTHER;
+    HttpVersion                             _versionId = VERSION_OTHER;
+    Span                                    _target;                ///< Request-target as received, query included
+    Span                                    _path;                  ///< Target up to the '?'
+    Span                                    _query;                 ///< Target after the '?' (empty when none)
+    Span                                    _version;               ///< HTTP version string (e.g., "HTTP/1.1")
+    std::array<Field, INLINE_HEADERS>       _headers;               ///< First header fields, in received order
+    Field*                                  _moreHeaders = nullptr; ///< The following ones, in the arena (see HttpParser::parseHeaderLine)
+    size_t                                  _headerCount = 0;
+    std::array<uint8_t, HEADER_COUNT>       _known{};               ///< Per known header: 1 + index of its first field, 0 when absent
+    RequestBody                             _body;                  ///< Optional message body (POST, some PUT, etc.), in memory or spooled
+    std::pmr::memory_resource*              _arena = nullptr;       ///< The parser's RequestArena, once the request is complete
+
+    std::string_view    view(Span span) const               { return std::string_view(_base + span.offset, span.length); }
+    const Field&        field(size_t i) const               { return i < INLINE_HEADERS ? _headers[i] : _moreHeaders[i - INLINE_HEADERS]; }
+
+    friend class HttpParser;
+
 public:
     // --------------------
-    //        Getters
+    //    Constructors
     // --------------------
-    const std::string&                         getMethod() const    { return _method;}
-    const std::string&                         getPath() const      { return _requestPath;}
-    const std::string&                         getVersion() const   { return _version;}
-    const std::map<std::string, std::string>&  getHeaders() const   { return _requestHeaders;}
-    const std::string&                         getBody() const      { return _body;}
+    HttpRequest() = default;
+    HttpRequest(const HttpRequest& other) = delete;
+    HttpRequest& operator=(const HttpRequest& other) = delete;
+    HttpRequest(HttpRequest&& other) noexcept = default;
+    HttpRequest& operator=(HttpRequest&& other) noexcept = default;
     // --------------------
-    //        Setters
+    //        Getters
     // --------------------
-    void    setMethod(const std::string &m)                         { _method = m; }
-    void    setPath(const std::string &m)                           { _requestPath = m; }
-    void    setVersion(const std::string &m)                        { _version = m; }
-    void    addHeader(const std::string& k, const std::string& v)   { _requestHeaders[k] = v; }
-    void    setBody(const std::string &m)                           { _body = m; }
+    std::string_view    getMethod() const                   { return view(_method); }
+    HttpMethod          getMethodId() const                 { return _methodId; }
+    HttpVersion         getVersionId() const                { return _versionId; }
+    std::string_view    getTarget() const                   { return view(_target); }
+    std::string_view    getPath() const                     { return view(_path); }
+    std::string_view    getQuery() const                    { return view(_query); }
+    std::string_view    getVersion() const                  { return view(_version); }
+    const RequestBody&  getBody() const                     { return _body; }
+    /// Memory for what lives as long as the request (response headers, handler frames), freed with it.
+    std::pmr::memory_resource* getArena() const             { return _arena ? _arena : std::pmr::get_default_resource(); }
+    size_t              getHeaderCount() const              { return _headerCount; }
+    std::string_view    getHeaderName(size_t i) const       { return view(field(i).name); }
+    std::string_view    getHeaderValue(size_t i) const      { return view(field(i).value); }
+    HttpHeaderId        getHeaderId(size_t i) const         { return field(i).id; }
+
+    /// Value of the first known header field id, empty when absent.
+    std::string_view    getHeader(HttpHeaderId id) const {
+        return _known[id] ? view(field(_known[id] - 1).value) : std::string_view();
+    }
+
+    bool                hasHeader(HttpHeaderId id) const    { return _known[id] != 0; }
+
+    /// Value of the first header field called name (any case), empty when absent.
+    std::string_view    getHeader(std::string_view name) const {
+        HttpHeaderId id = httpHeaders::lookup(name);
+        if (id != HEADER_UNKNOWN)
+            return getHeader(id);
+        for (size_t i = 0; i < _headerCount; i++){
+            if (field(i).id == HEADER_UNKNOWN && httpHeaders::equalsNoCase(view(field(i).name), name))
+                return view(field(i).value);
+        }
+        return std::string_view();
+    }
 };
@@ -1,12 +1,12 @@
 #pragma once
 
 #include "HttpRequest.hpp"
+#include "RequestArena.hpp"
 #include "httpUtils.hpp"
 
 #include <iostream>
-#include <sstream>
-#include <set>
-#include <vector>
+#include <memory>
+#include <string>
 
 using namespace httpUtils;
 
@@ -24,57 +24,151 @@ enum State{
     ERROR           ///< Encountered malformed syntax or invalid structure.
 };
 
+/**
+ * @enum ChunkState
+ * @brief What the parser expects next in a chunked body (RFC 9112 7.1).
+ */
+enum ChunkState{
+    CHUNK_SIZE,     ///< chunk-size [ chunk-ext ] CRLF
+    CHUNK_DATA,     ///< chunk-data
+    CHUNK_DATA_END, ///< the CRLF after chunk-data
+    CHUNK_TRAILER   ///< trailer fields after the last chunk, up to an empty line
+};
+
 /**
  * @class HttpParser
  * @brief Incrementally parses raw HTTP request data using a state machine.
  *
  * @note This parser accepts raw bytes (often from non-blocking socket reads) and processes them according to HTTP request grammar.
  * @note The parser maintains an internal state machine: check state -> get input -> do a thing -> change to next state
+ * @note The parser owns the connection's input buffer: a socket read goes straight into it
+ *       (receiveBuffer/received), and the HttpRequest it produces only points into it, so
+ *       parsing a request costs no allocation once the buffer exists. The buffer is kept by
+ *       nextRequest() for the next request, unless a large body made it grow.
+ * @note Bytes following a complete request are kept by nextRequest() as the start of the
+ *       next one, so pipelined requests are parsed one after the other from the same buffer;
+ *       the space of the answered ones is only reclaimed when more room is needed.
+ * @note The head limits (setHeaderLimits) are applied as bytes arrive, to the line being
+ *       received and to the head so far: a head is refused (414, 431) as soon as it is too
+ *       long, so the buffer of a connection never holds more than one head's worth of them.
+ * @note Once the head is complete the parser stops until its body is admitted
+ *       (admitBody): the server routes the request first, and refuses it without
+ *       receiving a body it would not accept.
+ * @note A chunked body is decoded in place, in one pass: the data of each chunk is moved
+ *       down over the framing already parsed, so the decoded body follows the head in the
+ *       buffer like a Content-Length one.
+ * @note A body larger than client_body_buffer_size (setBodyBufferSize) is written to a
+ *       SpoolFile as it arrives instead of being kept: the buffer then only holds the head
+ *       and the last read, so the memory of a connection does not depend on the body size.
+ * @note What the request's handler and response allocate comes from the parser's
+ *       RequestArena (HttpRequest::getArena), released by nextRequest() and reset().
  *
  * Usage example:
  * @code
  * HttpParser parser;
  * while (parser.getState() != DONE && parser.getState() != ERROR) {
- *     parser.parseHttpRequest(rawDataChunk);
+ *     size_t room;
+ *     char* buffer = parser.receiveBuffer(room);
+ *     parser.received(recv(fd, buffer, room, 0));
+ *     parser.parseHttpRequest();
+ *     if (parser.awaitsBodyAdmission()) {
+ *         parser.admitBody(maxBodySize);
+ *         parser.parseHttpRequest();
+ *     }
  * }
- * HttpRequest req = parser.getState() == DONE ? parser.getRequest() : ...;
+ * const HttpRequest& req = parser.getRequest();
  * @endcode
  */
 class HttpParser{
 private:
+    static constexpr size_t INITIAL_CAPACITY = 8192;        ///< First buffer, enough for a typical request head
+    static constexpr size_t MIN_RECEIVE = 4096;             ///< Free room guaranteed to each read
+    static constexpr size_t MAX_IDLE_CAPACITY = 65536;      ///< Larger buffers are freed between requests
+    static constexpr size_t SPOOL_RECEIVE = 65536;          ///< Room of each read while a body is spooled
+    static constexpr size_t MAX_CHUNK_LINE = 4096;          ///< Longest chunk-size line or trailer field
+    static constexpr size_t MAX_TRAILER_SIZE = 8192;        ///< Longest trailer section
+    static constexpr size_t MAX_HEADER_NAME = 1024;         ///< Longest header field name
+
+    static size_t           _bodyBufferSize;        ///< Larger bodies are spooled (client_body_buffer_size)
+    static size_t           _maxHeaderLine;         ///< Longest request line or header field
+    static size_t           _maxHeaderSize;         ///< Longest head
+    static size_t           _maxUriSize;            ///< Longest request-target
+    static size_t           _maxHeaderFields;       ///< Most header fields, at most HttpRequest::MAX_HEADERS
+
     HttpRequest             _req;                   ///< The HttpRequest object being constructed
     int                     _errStatus = 0;         ///< HTTP error status code if parsing fails
     State                   _state = START_LINE;    ///< Current state of the parser
 
-    std::string             _buffer;                ///< The resulting parsed HttpRequest object
-    size_t                  _bodyLength;            ///< Expected length of the message body (from Content-Length header)
-    bool                    _isChunked;             ///< Whether request uses chunked transfer encoding
-    size_t                  _currentChunkSize;      ///< Size of current chunk being read
-    size_t                  _currentChunkRead;      ///< Bytes read of current chunk
+    std::unique_ptr<char[]> _buffer;                ///< Received bytes, the request points into them
+    size_t                  _capacity = 0;          ///< Size of _buffer
+    size_t                  _size = 0;              ///< Bytes received into _buffer
+    size_t                  _start = 0;             ///< Offset of the current request, the ones before were answered
+    size_t                  _pos = 0;               ///< Bytes parsed
+    size_t                  _scanned = 0;           ///< Bytes of the current line already searched for its end
+    size_t                  _bodyStart = 0;         ///< Offset of the body, right after the head
+    size_t                  _bodyLength = 0;        ///< Expected length of the message body (from Content-Length header)
+    bool                    _isChunked = false;     ///< Whether request uses chunked transfer encoding
+    bool                    _bodyAdmitted = false;  ///< The body may be received (admitBody)
+    size_t                  _bodyLimit = SIZE_MAX;  ///< Longer bodies are answered 413 (checked as chunks arrive)
+    ChunkState              _chunkState = CHUNK_SIZE;   ///< Part of the chunked body expected next
+    size_t                  _chunkRemaining = 0;    ///< Bytes of the current chunk's data still to come
+    size_t                  _bodyEnd = 0;           ///< End of the chunked body decoded in the buffer
+    size_t                  _trailerSize = 0;       ///< Bytes of trailer fields received
+    SpoolFile               _spool;                 ///< The body, when larger than _bodyBufferSize
+    std::unique_ptr<RequestArena>   _arena;         ///< Memory of the current request, created on first use
 
     // --------------------
     //  Internal Validation Methods
     // --------------------
-    bool                     set_errstatus(int code, std::string const& msg);
-    bool                     validateStartLine();
-    bool                     validateHeaders();
-    bool                     validateBody();
+    bool                    validateStartLine();
+    bool                    validateHeaders();
+    bool                    isDuplicateHeader(size_t h) const;
     // --------------------
     //  Internal Parsing Methods
     // --------------------
-    void                    parseStartLine(const std::string& startline);
-    void                    parseHeaderLine(const std::string& headerline);
-    void                    parseBody(size_t& pos);
-    void                    parseChunkedBody(size_t& pos);
+    void                    reserve(size_t size);
+    void                    compact();
+    size_t                  findLineEnd(size_t from);
+    bool                    checkHeadLimits(size_t lineEnd);
+    void                    parseStartLine(size_t start, size_t end);
+    void                    parseHeaderLine(size_t start, size_t end);
+    void                    finishHeaders();
+    void                    parseBody();
+    void                    parseChunkedBody();
+    void                    parseChunkSize(size_t start, size_t end);
+    void                    parseTrailerLine(size_t start, size_t end);
+    void                    dropChunkBytes();
+    bool                    storeChunkData(size_t len);
+    size_t                  decodedSize() const {return _spool.size() + _bodyEnd - _bodyStart; }
+    bool                    startSpool();
+    bool                    spoolData(const char* data, size_t len);
+    std::pmr::memory_resource*  arena();
 
 public:
     // --------------------
     // Public Parsing Methods
     // --------------------
-    HttpRequest             parseHttpRequest(const std::string& rawLine);
+    char*                   receiveBuffer(size_t& room);
+    void                    received(size_t len);
+    void                    append(const char* data, size_t len);
+    void                    parseHttpRequest();
+    void                    admitBody(size_t maxBodySize);
+    void                    nextRequest();
+    void                    reset();
+    static void             setBodyBufferSize(size_t size) {_bodyBufferSize = size; }
+    static void             setHeaderLimits(size_t line, size_t head, size_t uri, size_t fields);
     // --------------------
     //      Getters
     // --------------------
     int                     getState() {return _state;}
     int                     getErrStatus() {return _errStatus; }
+    HttpRequest&            getRequest() {return _req; }
+    bool                    isIdle() const {return _state == START_LINE && _size == _start; }
+    bool                    isReadingBody() const {return _state == BODY; }
+    /// The head is complete, the body is not received until admitBody() is called.
+    bool                    awaitsBodyAdmission() const {return _state == BODY && !_bodyAdmitted; }
+    /// Body length announced by Content-Length (0 when chunked).
+    size_t                  getBodyLength() const {return _isChunked ? 0 : _bodyLength; }
+    /// Some of the body was received along with the head.
+    bool                    hasBodyBytes() const {return _size > _bodyStart; }
 };
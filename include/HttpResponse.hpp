@@ -2,6 +2,41 @@
 
 #include "ConfigBuilder.hpp"
 #include "CGI.hpp"
+#include "OpenFileCache.hpp"
+
+#include <map>
+#include <memory_resource>
+#include <string>
+#include <sys/types.h>
+
+/**
+ * @class FileBody
+ * @brief A region of an open file, sent as a response body with sendfile.
+ *
+ * The file is never read into memory: the server sends it from the page cache
+ * straight to the socket, so serving a file costs the same memory whatever its size.
+ * Move-only; the fd is shared with the open file cache, and closed with its last owner.
+ */
+class FileBody{
+private:
+    std::shared_ptr<OpenFile>   _file;
+    off_t                       _offset = 0;
+    size_t                      _length = 0;
+
+public:
+    FileBody() = default;
+    FileBody(std::shared_ptr<OpenFile> file, off_t offset, size_t length)
+        : _file(std::move(file)), _offset(offset), _length(length) {}
+    FileBody(const FileBody& other) = delete;
+    FileBody& operator=(const FileBody& other) = delete;
+    FileBody(FileBody&& other) noexcept = default;
+    FileBody& operator=(FileBody&& other) noexcept = default;
+
+    bool    isOpen() const  { return _file != nullptr; }
+    int     fd() const      { return _file->fd(); }
+    off_t   offset() const  { return _offset; }
+    size_t  length() const  { return _length; }
+};
 
 /**
  * @class HttpResponse
@@ -38,17 +73,33 @@
   * @note _keepConnectionAlive:
  * - By default, HTTP/1.1 connections are persistent (keep-alive), unless the server sends Connection: close in its response.
  * - This means the TCP connection can be reused for multiple requests.
+ * @note Move-only: the body is moved in by the handler that produced it and out of
+ *       the handler's Task by the server, never copied.
+ * @note Serialized in two parts: writeHead() appends the head to a buffer the caller
+ *       reuses, and the body is moved out (releaseBody) to be sent after it with the same
+ *       writev, so the body is never concatenated to the head. Content-Length, Date and
+ *       Connection are written by writeHead: the ones a handler sets are ignored.
+ * @note Header lines that are the same for every response of a kind (setFixedHeaders)
+ *       are given as one constant block, appended as is instead of one map entry each.
+ * @note The body may instead be a region of a file (setFileBody), moved out with
+ *       releaseFile and sent with sendfile after the head.
  */
 class HttpResponse{
+public:
+    /// Header fields, allocated from the arena of the request answered (HttpRequest::getArena).
+    using Headers = std::pmr::map<std::pmr::string, std::pmr::string>;
+
 private:
     std::string                             _version;                       ///< HTTP version string (e.g., "HTTP/1.1")
-    int                                     _status;                        ///< HTTP status code (e.g., 200, 404, 500)
+    int                                     _status = 0;                    ///< HTTP status code (e.g., 200, 404, 500)
     std::string                             _reason;                        ///< Reason phrase corresponding to the status code (e.g., "OK", "Not Found")
     std::string                             _body;                          ///< Message body of the response
-    std::map<std::string, std::string>      _responseHeaders;               ///< Key-value map of response headers
+    Headers                                 _responseHeaders;               ///< Key-value map of response headers
+    std::string_view                        _fixedHeaders;                  ///< Constant header lines, each ending with CRLF (static storage)
+    FileBody                                _file;                          ///< Body sent from a file instead of _body, when open
 
     bool                                    _keepConnectionAlive = true;    ///< Whether to keep the connection alive (HTTP/1.1 default, HTTP1.1 keeps connection alive unless there is an error OR client requests comes with a Connection:close)
-    bool                                    _requestComplete;               ///< Whether the request has been completely processed
+    bool                                    _requestComplete = false;       ///< Whether the request has been completely processed
 public:
     // --------------------
     //        Getters
@@ -57,7 +108,7 @@ public:
     int                                        getStatus() const            { return _status; }
     const std::string&                         getReason() const            { return _reason; }
     const std::string&                         getBody() const              { return _body; }
-    const std::map<std::string, std::string>&  getHeaders() const           { return _responseHeaders; }
+    const Headers&                             getHeaders() const           { return _responseHeaders; }
     bool                                       isKeepAlive() const          { return _keepConnectionAlive; }
     bool                                       isRequestComplete() const    { return _requestComplete; }
     // --------------------
@@ -66,8 +117,10 @@ public:
     void        setVersion(const std::string &v)                            { _version = v; }
     void        setStatus(const int &s)                                     { _status = s; }
     void        setReason(const std::string &r)                             { _reason = r; }
-    void        setBody(const std::string &b)                               { _body = b; }
-    void        addHeader(const std::string& k, const std::string& v)       { _responseHeaders[k] = v; }
+    void        setBody(std::string b)                                      { _body = std::move(b); }
+    void        addHeader(std::string_view k, std::string_view v)           { _responseHeaders[std::pmr::string(k)] = v; }
+    void        setFixedHeaders(std::string_view block)                     { _fixedHeaders = block; }
+    void        setFileBody(FileBody file)                                  { _file = std::move(file); }
     void        setKeepAlive(const bool &alive)                             { _keepConnectionAlive = alive; }
     void        setRequestComplete(const bool &complete)                    { _requestComplete = complete; }
     // --------------------
@@ -75,24 +128,30 @@ public:
     // --------------------
     HttpResponse() {};
     HttpResponse(const std::string& version, const int& status, const std::string& reason,
-                    const std::string& body,
-                    const std::map<std::string, std::string>& responseHeaders,
+                    std::string body,
+                    Headers responseHeaders,
                     bool alive, bool complete)
-    {
-    _version = version; _status = status; _reason = reason;
-    _body = body;
-    _responseHeaders = responseHeaders;
-    _keepConnectionAlive = alive; _requestComplete = complete;}
+        // moved in at construction: a polymorphic_allocator is not propagated by move
+        // assignment, which would copy the headers out of the request's arena
+        : _version(version), _status(status), _reason(reason), _body(std::move(body)),
+          _responseHeaders(std::move(responseHeaders)),
+          _keepConnectionAlive(alive), _requestComplete(complete) {}
+    HttpResponse(const HttpResponse& other) = delete;
+    HttpResponse& operator=(const HttpResponse& other) = delete;
+    HttpResponse(HttpResponse&& other) noexcept = default;
+    HttpResponse& operator=(HttpResponse&& other) noexcept = default;
     // --------------------
     //   Serialization
     // --------------------
-    std::string buildResponseString();
+    void        writeHead(std::string& out) const;
+    std::string releaseBody()                                               { return std::move(_body); }
+    FileBody    releaseFile()                                               { return std::move(_file); }
+    static std::string_view reasonPhrase(int status);
 };
 
 // --------------------
 //   Error Response Helpers
 // --------------------
-std::string loadFile(const std::string& path);
 
 HttpResponse makeErrorResponse(int status, const config::ServerConfig* vh);
 HttpResponse makeRedirect301(const std::string& location, const config::ServerConfig* vh);
\ No newline at end of file
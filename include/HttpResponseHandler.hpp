@@ -1,6 +1,8 @@
 #pragma once
 
 #include "HttpResponse.hpp"
+#include "Reactor.hpp"
+#include "Task.hpp"
 #include "httpUtils.hpp"
 
 #include <sys/types.h>
@@ -15,10 +17,19 @@ using namespace httpUtils;
     * and the server configuration (virtual hosts, locations). It generates HttpResponse objects
     * that represent the server's response to the client's request.
  *
+ * Handlers are coroutines: CGI scripts and file reads/writes are awaited
+ * (see Reactor.hpp), so the event loop keeps serving other clients meanwhile.
+ * With `handler_threads` they run on the HandlerPool, and come back to the event
+ * loop only for CGI pipes and to finish; the handler itself is stateless.
+ * The request and the handler must outlive the returned Task.
+ *
  * Usage example:
  * @code
     * HttpResponseHandler handler;
-    * HttpResponse res = handler.handleRequest(req, vh);
+    * Task<HttpResponse> task = handler.handleRequest(req, vh);
+    * task.start();
+    * if (task.done())
+    *    HttpResponse res = task.result();
  * @endcode
  */
 class HttpResponseHandler {
@@ -26,18 +37,20 @@ private:
     // --------------------
     // Internal Utility Methods
     // --------------------
-    HttpResponse                    parseCGIOutput(const std::string& out, const HttpRequest& req, const config::ServerConfig* vh);
+    HttpResponse                    parseCGIOutput(std::string out, const HttpRequest& req, const config::ServerConfig* vh);
     HttpResponse                    generateAutoIndex(const std::string& dirPath, HttpRequest& req);
     // --------------------
     //  InternalHandlers for different HTTP methods
     // --------------------
-    HttpResponse                    handleGET(HttpRequest& req, const config::ServerConfig* vh);
-    HttpResponse                    handlePOST(HttpRequest& req, const config::ServerConfig* vh);
-    HttpResponse                    handleDELETE(HttpRequest& req, const config::ServerConfig* vh);
+    Task<HttpResponse>              handleGET(HttpRequest& req, const config::ServerConfig* vh);
+    Task<HttpResponse>              handlePOST(HttpRequest& req, const config::ServerConfig* vh);
+    Task<HttpResponse>              handleDELETE(HttpRequest& req, const config::ServerConfig* vh);
+    Task<HttpResponse>              handleMethod(HttpRequest& req, const config::ServerConfig* vh);
 
 public:
     // --------------------
     //   Public Handler Methods
     // --------------------
-    HttpResponse                    handleRequest(HttpRequest& req, const config::ServerConfig* vh);
+    Task<HttpResponse>              handleRequest(HttpRequest& req, const config::ServerConfig* vh);
+    int                             checkBody(const HttpRequest& req, const config::ServerConfig* vh, size_t& maxBodySize) const;
 };
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * @namespace httpScan
+ * @brief Byte scanning kernels for request heads: line ends, delimiters, character classes.
+ *
+ * Each kernel exists in a scalar version and, on x86-64, in SSE4.2 and AVX2
+ * versions compiled with function target attributes, so the rest of the build
+ * keeps its baseline flags. The best set the CPU supports is picked once, on
+ * first use; kernels() is what the parser calls.
+ *
+ * Every search returns the offset of the first match, or len when there is none.
+ *
+ * @note character classes follow RFC 9110: a token (method, header name) is made of
+ *       tchar; a field value of visible ASCII, SP, HTAB and obs-text (0x80-0xFF);
+ *       a request-target of visible ASCII only.
+ */
+namespace httpScan {
+    struct Kernels {
+        const char* name;
+        size_t      (*findCrlf)(const char* data, size_t len);             ///< offset of the '\r' of the first "\r\n"
+        size_t      (*findByte)(const char* data, size_t len, char c);
+        size_t      (*findNonToken)(const char* data, size_t len);
+        size_t      (*findNonVisible)(const char* data, size_t len);
+        size_t      (*findInvalidValue)(const char* data, size_t len);
+    };
+
+    const Kernels&                  kernels();
+    std::vector<const Kernels*>     supportedKernels();
+}
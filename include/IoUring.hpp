@@ -0,0 +1,88 @@
+#pragma once
+
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @class IoUring
+ * @brief Minimal io_uring ring driven through the raw syscalls (no liburing).
+ *
+ * One instance belongs to one event loop: it maps the submission and completion
+ * rings, hands out SQEs, and owns a provided buffer ring that multishot recv
+ * picks its buffers from, so a read needs neither a syscall nor a buffer posted
+ * in advance per connection.
+ *
+ * @note SQEs are only published to the kernel by submit()/submitAndWait(), so a
+ *       whole batch of completions is answered with one io_uring_enter.
+ */
+class IoUring {
+	private:
+		int				_ringFd = -1;
+
+		// submission queue
+		void*			_sqRing = nullptr;
+		size_t			_sqRingSize = 0;
+		io_uring_sqe*	_sqes = nullptr;
+		size_t			_sqesSize = 0;
+		unsigned*		_sqHead = nullptr;
+		unsigned*		_sqTail = nullptr;
+		unsigned*		_sqArray = nullptr;
+		unsigned		_sqMask = 0;
+		unsigned		_sqEntries = 0;
+		unsigned		_sqLocalTail = 0;		///< SQEs handed out, published at the next submit
+
+		// completion queue (shares _sqRing when the kernel has IORING_FEAT_SINGLE_MMAP)
+		void*			_cqRing = nullptr;
+		size_t			_cqRingSize = 0;
+		unsigned*		_cqHead = nullptr;
+		unsigned*		_cqTail = nullptr;
+		io_uring_cqe*	_cqes = nullptr;
+		unsigned		_cqMask = 0;
+
+		// provided buffers
+		io_uring_buf*	_bufRing = nullptr;
+		size_t			_bufRingSize = 0;
+		char*			_bufPool = nullptr;
+		unsigned		_bufCount = 0;
+		unsigned		_bufSize = 0;
+		uint16_t		_bufGroup = 0;
+		uint16_t		_bufTail = 0;
+
+		io_uring_sqe*	nextSqe(void);
+		void			publishSqes(void);
+		void			addBuffer(uint16_t bid);
+		void			publishBuffers(void);
+
+	public:
+		IoUring() = default;
+		IoUring(const IoUring& other) = delete;
+		IoUring& operator=(const IoUring& other) = delete;
+		~IoUring();
+
+		int				setup(unsigned entries);
+		int				setupBufferRing(uint16_t group, unsigned count, unsigned size);
+		void			close(void);
+		bool			isOpen(void) const		{ return _ringFd >= 0; }
+
+		// submission and completion
+		int				submit(void);
+		int				submitAndWait(unsigned waitNr, int timeoutMs);
+		io_uring_cqe*	peekCqe(void);
+		void			cqeSeen(void);
+
+		// provided buffers
+		const char*		bufferData(uint16_t bid) const	{ return _bufPool + static_cast<size_t>(bid) * _bufSize; }
+		void			recycleBuffer(uint16_t bid);
+
+		// operations; userData comes back untouched in the completion
+		void			prepMultishotAccept(int fd, uint64_t userData);
+		void			prepMultishotRecv(int fd, uint64_t userData);
+		void			prepSendmsg(int fd, const msghdr* msg, uint64_t userData, uint8_t sqeFlags = 0, int msgFlags = 0);
+		void			prepShutdown(int fd, int how, uint64_t userData);
+		void			prepMultishotPoll(int fd, uint32_t events, uint64_t userData);
+		void			prepPoll(int fd, uint32_t events, uint64_t userData);
+		void			prepPollRemove(uint64_t targetUserData, uint64_t userData);
+		void			prepCancel(uint64_t targetUserData, uint64_t userData);
+};
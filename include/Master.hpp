@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Webserver.hpp"
+
+#include <memory>
+#include <thread>
+
+/**
+ * @class Master
+ * @brief Lays out the event loops described by the global configuration and runs them.
+ *
+ * - `worker_threads 1` and `worker_processes 1` (default): a single Webserver
+ *   runs in the calling thread, exactly like before.
+ * - `worker_threads N`: the master builds N independent Webserver reactors — each
+ *   with its own epoll instance, its own Server listeners bound with SO_REUSEPORT
+ *   and its own per-client state — and runs each one in a dedicated thread.
+ *   Listeners are opened sequentially before any thread starts, so a bind error
+ *   is reported once and the order of every SO_REUSEPORT group matches the loop index.
+ * - `worker_processes N`: the master opens every listening socket once, then forks
+ *   N workers that each build their own epoll (listeners registered with EPOLLEXCLUSIVE)
+ *   and run their own loop. A worker that dies is respawned, so a crash in one
+ *   request path only costs the connections of that worker.
+ * - `worker_cpu_affinity`, with any of the above: each loop pins its thread to its CPU
+ *   before running; with `worker_threads`, every SO_REUSEPORT group also gets a BPF
+ *   program handing a connection to the loop on the CPU that received it.
+ * - `handler_threads N`, with any of the above: request handlers of every loop of the
+ *   process run on a shared work-stealing HandlerPool; the loops keep the socket I/O.
+ *
+ * Every loop owns a slot of a StatsTable placed in shared memory; SIGUSR1 prints
+ * the per-loop and aggregated counters, and they are printed once more at shutdown.
+ */
+class Master {
+	private:
+		config::GlobalConfig				_global;		// process-wide settings (worker_threads, ...)
+		std::vector<config::ServerConfig>	_configs;		// virtual hosts served by every loop
+		StatsTable							_stats;			// one counters slot per loop, shared with workers
+		std::vector<pid_t>					_workers;		// pid of the worker process in each slot (prefork only)
+
+		int   runSingleLoop(void);
+		int   runThreadedLoops(void);
+		int   runWorkerProcesses(void);
+
+		int   cpuOfLoop(size_t index) const;
+		void  pinLoop(Webserver& loop, size_t index);
+
+		pid_t spawnWorker(Webserver& listeners, size_t slot);
+		void  stopWorkers(void);
+
+	public:
+		Master(const config::GlobalConfig& global, const std::vector<config::ServerConfig>& configs);
+		Master(const Master& other) = delete;
+		Master& operator=(const Master& other) = delete;
+
+		int run(void);
+};
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "Stats.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct OffloadJob;
+class Reactor;
+
+/**
+ * @class OffloadExecutor
+ * @brief Bounded pool of threads running blocking filesystem work for the event loops.
+ *
+ * A job is queued by Reactor::offload() and, once its work ran, handed back to its
+ * loop through the loop's lock-free completion queue and eventfd: a slow or cold
+ * disk only delays the request that touched it.
+ *
+ * Both the number of threads (`fs_threads`) and the queue are bounded: when the
+ * queue is full, submit() refuses the job; its loop keeps it and is woken up to
+ * submit it again as soon as a thread takes a job off the queue.
+ *
+ * @note process-wide and started on first use: a prefork master never starts it,
+ *       each forked worker gets its own threads.
+ */
+class OffloadExecutor {
+	private:
+		static constexpr size_t				QUEUE_CAPACITY = 1024;
+		static std::atomic<size_t>			_configuredThreads;
+
+		std::mutex								_mutex;
+		std::condition_variable					_ready;
+		std::deque<std::shared_ptr<OffloadJob>>	_jobs;
+		std::vector<Reactor*>					_refused;	// loops a job was refused to, woken up when there is room
+
+		explicit OffloadExecutor(size_t threads);
+
+		void	run(void);
+
+	public:
+		static constexpr size_t	DEFAULT_THREADS = 4;
+
+		OffloadExecutor(const OffloadExecutor& other) = delete;
+		OffloadExecutor& operator=(const OffloadExecutor& other) = delete;
+
+		// number of threads, set from fs_threads before the loops start
+		static void				configure(size_t threads);
+		static OffloadExecutor&	instance(void);
+
+		bool					submit(std::shared_ptr<OffloadJob> job);
+		void					forget(Reactor* reactor);
+};
+
+/**
+ * @class FsTimer
+ * @brief Times one blocking filesystem operation into the LoopStats of the request's loop.
+ *
+ * Threads running work on behalf of a loop (offload executor, handler pool, or the
+ * loop itself) open a Scope naming that loop's counters; an FsTimer outside any
+ * Scope records nothing.
+ *
+ * @code
+ * {
+ *    FsTimer timer(FS_STAT);
+ *    found = stat(path.c_str(), &st) == 0;
+ * }
+ * @endcode
+ */
+class FsTimer {
+	private:
+		static thread_local LoopStats*			_target;
+
+		FsOp									_op;
+		std::chrono::steady_clock::time_point	_start;
+
+	public:
+		explicit FsTimer(FsOp op);
+		FsTimer(const FsTimer& other) = delete;
+		FsTimer& operator=(const FsTimer& other) = delete;
+		~FsTimer();
+
+		/// Counters FsTimers of the calling thread record into, until the scope ends.
+		class Scope {
+			private:
+				LoopStats*	_previous;
+
+			public:
+				explicit Scope(LoopStats* stats);
+				Scope(const Scope& other) = delete;
+				Scope& operator=(const Scope& other) = delete;
+				~Scope();
+		};
+};
+
+/// Run one filesystem call under an FsTimer and return its result.
+template <typename Fn>
+auto timedFs(FsOp op, Fn&& fn) -> decltype(fn()) {
+	FsTimer timer(op);
+	return fn();
+}
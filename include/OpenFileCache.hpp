@@ -0,0 +1,135 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * @class OpenFile
+ * @brief A file descriptor shared by the open file cache and the responses sending it.
+ *
+ * Closed with its last owner: a file dropped from the cache stays open until the
+ * responses still sending it are done with it.
+ */
+class OpenFile {
+	private:
+		int	_fd;
+
+	public:
+		explicit OpenFile(int fd) : _fd(fd) {}
+		OpenFile(const OpenFile& other) = delete;
+		OpenFile& operator=(const OpenFile& other) = delete;
+		~OpenFile();
+
+		int	fd(void) const	{ return _fd; }
+};
+
+/// What the target of a GET is on disk, as found by a lookup.
+struct FileLookup {
+	int							status = 0;				///< error to answer instead (301, 403, 404, 405), 0 when found
+	bool						listDirectory = false;	///< a directory without index file, with autoindex on
+	std::string					path;
+	struct stat					st;
+	std::shared_ptr<OpenFile>	file;					///< the file found, open (none for a directory)
+};
+
+/**
+ * @class OpenFileCache
+ * @brief Process-wide cache of static file lookups, invalidated by inotify.
+ *
+ * A lookup (path resolution, stat, index file probe, access, open) is kept under
+ * the path a request maps to in its location's root, along with the open file: a
+ * cached request makes no filesystem call, the fd is sent as is. Lookups that
+ * found nothing are kept too, so a storm of 404s costs one lookup per path.
+ *
+ * Before a lookup, the directory holding the path (the nearest existing one when
+ * it does not exist) and the path itself when it is a directory are watched with
+ * inotify; a thread reads the events and drops the entries of the directory they
+ * happened in (found by watch descriptor), so an edit under the root is seen by
+ * the next request. A watch is removed once no entry or lookup depends on it.
+ *
+ * Off unless `open_file_cache` sets its entry count; least recently used first out,
+ * each entry of a file holds its fd.
+ *
+ * @note process-wide and started on first use, as OffloadExecutor: a prefork master
+ *       never starts it, each forked worker gets its own cache and inotify thread.
+ */
+class OpenFileCache {
+	private:
+		struct Entry {
+			std::string							key;
+			const void*							owner;		///< Location the lookup was made for
+			std::shared_ptr<const FileLookup>	lookup;
+			std::vector<int>					watches;	///< Directories whose events drop the entry
+		};
+		using Lru = std::list<Entry>;
+
+		static std::atomic<size_t>	_configuredEntries;
+
+		const size_t									_capacity;
+		int												_inotifyFd = -1;
+		std::atomic<bool>								_watching{false};	///< The inotify thread runs: lookups may be cached
+		std::mutex										_mutex;
+		Lru												_lru;			///< Most recently used first
+		std::unordered_map<std::string, Lru::iterator>	_index;
+		std::unordered_map<int, std::unordered_set<const Entry*>>	_dependents;	///< Entries each watch's events drop
+		std::atomic<uint64_t>							_changes{0};	///< Batches of events handled so far
+		// inotify_add_watch and inotify_rm_watch are made under their own lock, never under _mutex
+		std::mutex										_watchMutex;
+		std::unordered_map<int, size_t>					_watchUsers;	///< Entries and lookups in progress using each watch
+
+		explicit OpenFileCache(size_t capacity);
+
+		bool	watch(const std::string& path, std::vector<int>& watches);
+		void	unwatch(const std::vector<int>& watches);
+		bool	insert(const std::string& key, const void* owner, std::shared_ptr<const FileLookup> lookup,
+					std::vector<int>& watches, uint64_t changes);
+		void	erase(Lru::iterator it, std::vector<int>& released);
+		void	dropWatched(int wd, std::vector<int>& released);
+		void	dropAll(std::vector<int>& released);
+		void	run(void);
+
+	public:
+		static constexpr size_t	DEFAULT_ENTRIES = 0;
+
+		OpenFileCache(const OpenFileCache& other) = delete;
+		OpenFileCache& operator=(const OpenFileCache& other) = delete;
+
+		// number of entries, set from open_file_cache before the loops start (0 = off)
+		static void				configure(size_t entries);
+		static bool				enabled(void);
+		static OpenFileCache&	instance(void);
+
+		std::shared_ptr<const FileLookup>	find(const std::string& key, const void* owner);
+		template <typename Fn>
+		std::shared_ptr<const FileLookup>	load(const std::string& key, const void* owner, Fn lookup);
+		void								invalidate(const std::string& directory);
+};
+
+/**
+ * @brief Look key up with lookup() and keep the result (blocking: run it through offload)
+ *
+ * @param owner the location the lookup depends on (index files, autoindex, methods)
+ * @note the watches are set before the lookup, and the result is only kept when no
+ *       event was handled meanwhile: a change racing the lookup is never cached.
+ * @note a 500 (the file could not be opened) is not kept: it may not last.
+ * @note the watches are released when the result is not kept, and with the entry otherwise.
+ */
+template <typename Fn>
+std::shared_ptr<const FileLookup> OpenFileCache::load(const std::string& key, const void* owner, Fn lookup){
+	std::vector<int> watches;
+	bool watched = watch(key, watches);
+	uint64_t changes = _changes.load(std::memory_order_acquire);
+	std::shared_ptr<const FileLookup> found = std::make_shared<const FileLookup>(lookup());
+	if (!watched || found->status == 500 || !insert(key, owner, found, watches, changes))
+		unwatch(watches);
+	return found;
+}
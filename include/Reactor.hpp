@@ -0,0 +1,255 @@
+#pragma once
+
+#include "HandlerPool.hpp"
+#include "Stats.hpp"
+#include "Task.hpp"
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include <sys/types.h>
+
+/**
+ * @struct PollSource
+ * @brief What an fd registered in epoll is, recovered from epoll_event.data.ptr.
+ *
+ * Listeners, the timer fd, clients and suspended coroutines all start with this
+ * header, so the loop dispatches an event with a single pointer dereference
+ * instead of fd lookups.
+ */
+struct PollSource {
+	enum Kind {
+		SOURCE_LISTENER,
+		SOURCE_TIMER,
+		SOURCE_CLIENT,
+		SOURCE_WAITER,		///< a Waiter: epoll holds its tagged id, never its pointer
+		SOURCE_WAKEUP,		///< the Reactor's eventfd: offloaded work completed
+		SOURCE_SIGNAL		///< the process-wide signal eventfd: only wakes the loop up
+	};
+
+	Kind	kind = SOURCE_CLIENT;
+	int		fd = -1;
+	size_t	serverIndex = 0;		///< Server owning this listener / client
+};
+
+/// A coroutine suspended until an fd becomes ready (registered one-shot).
+struct Waiter : PollSource {
+	std::coroutine_handle<>	handle;
+	uint32_t				revents = 0;	///< Events reported when it was resumed
+	uint64_t				id = 0;			///< Registration id: events find the Waiter through it, if still registered
+};
+
+class Reactor;
+
+/// Blocking work run on the offload threads, resumed on its owner's loop afterwards.
+struct OffloadJob {
+	std::function<void()>	work;
+	std::coroutine_handle<>	handle;
+	detail::TaskPromiseBase*	root = nullptr;	///< top-level task of handle, away until the job is back
+	Reactor*				owner = nullptr;
+	LoopStats*				stats = nullptr;	///< counters of the owner, for FsTimer
+	std::exception_ptr		exception;			///< thrown by work, rethrown in the awaiting coroutine
+	std::atomic<bool>		cancelled{false};	///< the awaiting coroutine was destroyed, do not resume it
+
+	// link in the owner's completion queue; self keeps the job alive while it is queued
+	OffloadJob*					next = nullptr;
+	std::shared_ptr<OffloadJob>	self;
+};
+
+/**
+ * @class Reactor
+ * @brief Event loop interface the awaitables below suspend on.
+ *
+ * The running event loop of the thread is Reactor::current(): awaitables register
+ * with it without being handed a loop explicitly. Fd readiness is implemented by
+ * each backend (watch/unwatch). Offloaded work, and coroutines coming back from
+ * the handler pool, come back through the reactor's eventfd, which the backend
+ * polls like any other fd and answers with drainOffloaded(). Finished offload
+ * jobs are queued without a lock: an intrusive stack that offload threads push
+ * onto and the loop empties at once (multi-producer, single consumer).
+ *
+ * @note while a frame of a task runs on the handler pool, or waits for offloaded work
+ *       that uses its locals and its request, the loop cannot destroy the task: a client
+ *       closed meanwhile hands its task to abandon(), and it is destroyed when it comes back.
+ * @note the offload executor's queue is bounded: a job it has no room for waits in the
+ *       loop's overflow list, submitted in order once the executor wakes the loop up.
+ */
+class Reactor {
+	private:
+		static thread_local Reactor*				_current;
+
+		using Returned = std::pair<std::coroutine_handle<>, detail::TaskPromiseBase*>;
+		/// Task of a closed client, kept until none of its frames is away.
+		struct Abandoned {
+			std::coroutine_handle<>		handle;
+			detail::TaskPromiseBase*	root;
+			std::function<void()>		release;	// frees what the task refers to, after it is destroyed
+		};
+
+		int											_wakeFd;
+		std::atomic<OffloadJob*>					_completed;		// pushed by offload threads, newest first
+		std::mutex									_returnedMutex;
+		std::vector<Returned>						_returned;		// filled by handler pool threads
+		std::atomic<size_t>							_away;			// frames sent to the handler pool or offloaded, not back yet
+		std::vector<Abandoned>						_abandoned;		// roots of tasks whose owner went away while they were
+		std::deque<std::shared_ptr<OffloadJob>>		_overflow;		// offloaded jobs the executor had no room for yet
+		bool										_refused;		// the executor has this loop on its list to wake up
+		LoopStats*									_poolStats;		// where the handler pool counts this loop's jobs
+
+		void	takeBack(const Returned& returned, bool resume);
+		void	takeCompleted(bool resume);
+		void	submitOverflow(void);
+
+	protected:
+		PollSource									_wakeSource;	// epoll data.ptr of _wakeFd
+
+		void	makeCurrent(void);
+		int		openWakeFd(void);
+		void	drainOffloaded(void);
+		int		getWakeFd(void) const				{ return _wakeFd; }
+		void	setPoolStats(LoopStats* stats)		{ _poolStats = stats; }
+
+		// hand the task of a closed client over; it is destroyed once none of its frames is away,
+		// then release() frees what it referred to (its client, its request)
+		template <typename T>
+		void	abandon(Task<T>& task, std::function<void()> release){
+			detail::TaskPromiseBase& root = task.rootPromise();
+			root.abandoned = true;
+			_abandoned.push_back(Abandoned{task.detach(), &root, std::move(release)});
+		}
+		void	settleHandlers(void);
+
+	public:
+		Reactor();
+		Reactor(const Reactor& other) = delete;
+		Reactor& operator=(const Reactor& other) = delete;
+		virtual ~Reactor();
+
+		static Reactor*	current(void);
+
+		// one-shot readiness of fd; the waiter is resumed through its handle
+		virtual void	watch(Waiter& waiter, int fd, uint32_t events) = 0;
+		virtual void	unwatch(Waiter& waiter) = 0;
+
+		// offload threads: run job->work there, resume job->handle here
+		void			offload(std::shared_ptr<OffloadJob> job);
+		void			completeOffload(std::shared_ptr<OffloadJob> job);
+		void			wakeUp(void);
+
+		// handler pool: resume a frame there (loop side), then here again (pool side)
+		void			sendToHandlerPool(std::coroutine_handle<> handle, detail::TaskPromiseBase* root);
+		void			returnFromHandlerPool(std::coroutine_handle<> handle, detail::TaskPromiseBase* root);
+};
+
+// ==========================================================
+// awaitables
+// ==========================================================
+
+/// co_await suspends until the fd reports one of the events (EPOLLIN, EPOLLOUT...).
+class FdAwaitable {
+	private:
+		Waiter		_waiter;
+		uint32_t	_events;
+		Reactor*	_reactor = nullptr;		// set while registered
+
+	public:
+		FdAwaitable(int fd, uint32_t events);
+		FdAwaitable(const FdAwaitable& other) = delete;
+		FdAwaitable& operator=(const FdAwaitable& other) = delete;
+		~FdAwaitable();
+
+		bool		await_ready() const noexcept	{ return false; }
+		void		await_suspend(std::coroutine_handle<> handle);
+		uint32_t	await_resume();
+};
+
+/**
+ * co_await suspends until either of two fds reports its events; the revents of each
+ * (0 for the one that did not) are returned, the other fd is no longer watched.
+ */
+class FdEitherAwaitable {
+	private:
+		Waiter		_first;
+		Waiter		_second;
+		uint32_t	_firstEvents;
+		uint32_t	_secondEvents;
+		Reactor*	_reactor = nullptr;		// set while registered
+
+		void		unwatchPending(void);
+
+	public:
+		FdEitherAwaitable(int firstFd, uint32_t firstEvents, int secondFd, uint32_t secondEvents);
+		FdEitherAwaitable(const FdEitherAwaitable& other) = delete;
+		FdEitherAwaitable& operator=(const FdEitherAwaitable& other) = delete;
+		~FdEitherAwaitable();
+
+		bool							await_ready() const noexcept	{ return false; }
+		void							await_suspend(std::coroutine_handle<> handle);
+		std::pair<uint32_t, uint32_t>	await_resume();
+};
+
+/**
+ * co_await suspends while work runs on an offload thread (inline when no loop runs);
+ * what the work throws is rethrown by the co_await.
+ *
+ * @note the work may use the coroutine's locals and request: the task counts as away
+ *       until the job is back, so that the loop never destroys it meanwhile (abandon).
+ */
+class OffloadAwaitable {
+	private:
+		std::shared_ptr<OffloadJob>	_job;
+		bool						_submitted = false;
+
+		void	suspend(std::coroutine_handle<> handle, detail::TaskPromiseBase* root);
+
+	public:
+		explicit OffloadAwaitable(std::function<void()> work);
+		OffloadAwaitable(const OffloadAwaitable& other) = delete;
+		OffloadAwaitable& operator=(const OffloadAwaitable& other) = delete;
+		~OffloadAwaitable();
+
+		bool	await_ready();
+		template <typename Promise>
+		void	await_suspend(std::coroutine_handle<Promise> handle){
+			suspend(handle, handle.promise().root);
+		}
+		void	await_resume() const;
+};
+
+/// co_await continues the coroutine on the handler pool (no-op when handler_threads is off).
+struct HandlerPoolAwaitable {
+	bool	await_ready() const noexcept	{ return !HandlerPool::enabled() || !Reactor::current(); }
+	template <typename Promise>
+	void	await_suspend(std::coroutine_handle<Promise> handle){
+		Reactor::current()->sendToHandlerPool(handle, handle.promise().root);
+	}
+	void	await_resume() const noexcept	{}
+};
+
+/// co_await continues the coroutine on the event loop it came from (no-op when already on it).
+struct EventLoopAwaitable {
+	bool	await_ready() const noexcept	{ return !HandlerPool::home(); }
+	template <typename Promise>
+	void	await_suspend(std::coroutine_handle<Promise> handle){
+		// the loop may resume the coroutine before this returns: nothing is touched afterwards
+		HandlerPool::home()->returnFromHandlerPool(handle, handle.promise().root);
+	}
+	void	await_resume() const noexcept	{}
+};
+
+HandlerPoolAwaitable	onHandlerPool(void);
+EventLoopAwaitable		onEventLoop(void);
+FdAwaitable				readable(int fd);
+FdAwaitable				writable(int fd);
+FdAwaitable				pipeReadable(int fd);
+FdEitherAwaitable		writableOrPipeReadable(int writeFd, int readFd);
+OffloadAwaitable		offload(std::function<void()> work);
+Task<int>				childExit(pid_t pid);
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+
+/**
+ * @class RequestArena
+ * @brief Memory of the objects that live as long as one request.
+ *
+ * The response headers, the frames of the handler coroutines and whatever else a
+ * request allocates from HttpRequest::getArena() are bump-allocated here
+ * (std::pmr::monotonic_buffer_resource) and freed all at once by release(), when
+ * the parser moves on to the next request or is reset: nothing is freed one by one.
+ *
+ * The blocks of every arena come from one pool shared by all the threads
+ * (std::pmr::synchronized_pool_resource, which keeps a cache per thread): a block
+ * released by a request is handed to the next one instead of being returned to
+ * malloc, so a request allocates nothing from the system once the pool is warm.
+ *
+ * @note Not thread-safe: a request's arena is only used by the thread its handler
+ *       runs on at the time, loop or handler pool.
+ */
+class RequestArena{
+private:
+    static constexpr size_t FIRST_BLOCK = 8192;             ///< Enough for a typical request, later blocks double
+    static constexpr size_t LARGEST_POOLED_BLOCK = 65536;   ///< Larger blocks go straight to the system
+
+    std::pmr::monotonic_buffer_resource _resource;
+
+    static std::pmr::memory_resource*   blocks();
+
+public:
+    RequestArena() : _resource(FIRST_BLOCK, blocks()) {}
+    RequestArena(const RequestArena& other) = delete;
+    RequestArena& operator=(const RequestArena& other) = delete;
+
+    std::pmr::memory_resource*  resource()      { return &_resource; }
+    /// Free everything allocated so far, back to the pool.
+    void                        release()       { _resource.release(); }
+};
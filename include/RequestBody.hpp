@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/**
+ * @class RequestBody
+ * @brief The message body of a request, wherever the parser stored it.
+ *
+ * A body no larger than client_body_buffer_size stays in memory, in the parser's
+ * buffer (or, once decoded, in its chunked body); a larger one is spooled to an
+ * unlinked temporary file as it arrives (see SpoolFile). Handlers read both the same
+ * way through this interface, by offset, so a multipart upload or a CGI stdin never
+ * needs the whole body in memory.
+ *
+ * Like the rest of HttpRequest it owns nothing: it is valid until the parser moves
+ * on to the next request.
+ */
+class RequestBody{
+private:
+    static constexpr size_t FIND_BLOCK = 65536;     ///< Bytes of a file body searched at a time
+
+    std::string_view    _memory;                    ///< The body when it is in memory
+    int                 _fd = -1;                   ///< The spool file when it is not
+    size_t              _size = 0;
+
+public:
+    RequestBody() = default;
+    explicit RequestBody(std::string_view memory) : _memory(memory), _size(memory.size()) {}
+    RequestBody(int fd, size_t size) : _fd(fd), _size(size) {}
+
+    size_t              size() const                { return _size; }
+    bool                empty() const               { return _size == 0; }
+    bool                inMemory() const            { return _fd < 0; }
+    /// The bytes of an in-memory body (empty for a spooled one).
+    std::string_view    view() const                { return _memory; }
+    /// The spool file of a spooled body (-1 for an in-memory one); reads use pread, its offset is free.
+    int                 fd() const                  { return _fd; }
+
+    size_t              read(size_t offset, char* dst, size_t len) const;
+    std::string         slice(size_t offset, size_t len) const;
+    size_t              find(std::string_view needle, size_t from = 0) const;
+    bool                copyTo(int outFd, size_t offset, size_t len) const;
+};
+
+/**
+ * @class SpoolFile
+ * @brief Anonymous temporary file a large request body is written to.
+ *
+ * Created with O_TMPFILE in $TMPDIR (or /tmp), so it has no name and its space is
+ * reclaimed as soon as it is closed, whatever happens to the process; on a
+ * filesystem without O_TMPFILE it is created with mkostemp and unlinked at once.
+ * Move-only, closed by its destructor.
+ */
+class SpoolFile{
+private:
+    int     _fd = -1;
+    size_t  _size = 0;      ///< Bytes written
+
+public:
+    SpoolFile() = default;
+    SpoolFile(const SpoolFile& other) = delete;
+    SpoolFile& operator=(const SpoolFile& other) = delete;
+    SpoolFile(SpoolFile&& other) noexcept;
+    SpoolFile& operator=(SpoolFile&& other) noexcept;
+    ~SpoolFile() { close(); }
+
+    bool    open();
+    bool    write(const char* data, size_t len);
+    void    close();
+
+    bool    isOpen() const  { return _fd >= 0; }
+    int     fd() const      { return _fd; }
+    size_t  size() const    { return _size; }
+};
@@ -1,11 +1,17 @@
 #pragma once
 
 #include "ConfigBuilder.hpp"
+#include "Connection.hpp"
 #include "HttpRequestParser.hpp"
 #include "HttpResponseHandler.hpp"
+#include "Stats.hpp"
 
 #include <arpa/inet.h>
 #include <fcntl.h>
+#include <linux/filter.h>
+#include <sys/sendfile.h>
+#include <map>
+#include <optional>
 
 using namespace config;
 
@@ -17,7 +23,8 @@ class Server {
 			CLIENT_KEEP_ALIVE,
 			CLIENT_COMPLETE,
 			CLIENT_ERROR,
-			CLIENT_WRITING
+			CLIENT_WRITING,
+			CLIENT_PENDING		///< handler suspended (CGI, file I/O): call finishRequest once it is done
 		};
 
 		/// Possible results when starting the server.
@@ -28,18 +35,9 @@ class Server {
 			START_LISTEN_ERROR
 		};
 
-		/// Structure to hold data pending to be written to a client.
-		struct WriteBuffer {
-			std::string data;
-			size_t sent = 0;
-			bool keepAlive = false;
-
-			bool isComplete() const;
-			size_t remainingToSend() const;
-		};
-
 	private:
 		static constexpr int MAX_REQUESTS = 20;
+		static constexpr size_t MAX_IDLE_WRITE_BUFFER = 65536;	///< Larger write buffers are freed once sent
 		static constexpr int NOT_VALID_FD = -1;
 
 		//related to listening socket
@@ -49,17 +47,27 @@ class Server {
 		std::vector<config::ServerConfig>	_virtualHosts;		///< Configured virtual hosts
 		sockaddr_in							_addr;				///< Socket address structure
 
-		//related to clients
-		std::map<int, int>					_requestCount;		///< Count of requests per client
-		std::map<int, HttpParser>			_parsers;			///< HTTP parsers per client/
-		std::map<int, WriteBuffer>			_writeBuffers;		///< Pending write buffers per client
-
 		//HttpRequest + ServerConfig → HttpResponse
 		HttpResponseHandler					_httpHandler;		///< HTTP response handler
 
+		LoopStats*							_stats = nullptr;	///< Counters of the owning event loop (optional)
+		int									_busyPollUs = 0;	///< SO_BUSY_POLL of accepted sockets (0 = left to the system)
+		bool								_shedding = false;	///< Answer new requests with a 503 (owning loop overloaded)
+
 		//private helpers
-		const config::ServerConfig* matchVirtualHost(const std::string& hostHeader);
-		const config::ServerConfig* getDefaultVhost() const;
+		const config::ServerConfig* matchVirtualHost(std::string_view hostHeader);
+		ssize_t sendAvailable(int clientFd, WriteBuffer& buffer);
+		ClientStatus processRequest(Connection& conn);
+		ClientStatus answerRequest(Connection& conn);
+		ClientStatus admitBody(Connection& conn);
+		ClientStatus queueHandlerResponse(Connection& conn);
+		void queueResponse(Connection& conn, HttpResponse& response);
+		ClientStatus finishResponse(Connection& conn, bool keepAlive);
+		ClientStatus continuePipeline(Connection& conn, ClientStatus status);
+		ClientStatus flushResponses(Connection& conn, ClientStatus status);
+		void clearWriteBuffer(Connection& conn);
+		ClientStatus writeStatus(Connection& conn);
+		ClientStatus shedRequest(Connection& conn);
 		
 	public:
 		// lifecycle management of the server
@@ -71,19 +79,27 @@ class Server {
 		~Server();
 
 		// startup and shutdown of the server
-		StartResult start(void);
+		StartResult start(bool reusePort = false);
+		bool attachCpuSteering(const std::vector<int>& cpuOfSocket);
 		void shutdown(void);
 
-		// client connection handling
+		// client connection handling, the per-client state lives in the Connection
 		int  acceptConnection(void);
-		ClientStatus handleClient(int clientFd);
-		ClientStatus handleClientWrite(int clientFd);
+		void prepareClientSocket(int clientFd) const;
+		ClientStatus handleClient(Connection& conn);
+		ClientStatus handleClientWrite(Connection& conn);
+		ClientStatus finishRequest(Connection& conn);
 
-		// status checkers and cleaners
-		bool hasWriteBuffer(int clientFd) const;
-		void cleanMaps(int clientFd);
+		// same steps for a completion-based loop, which performs the recv/send itself
+		ClientStatus handleClientData(Connection& conn, const char* data, size_t len);
+		ClientStatus completeClientWrite(Connection& conn, size_t bytesSent);
 
 		//client info getters
 		int  getListenFd(void) const	{return _listenFd;};
 		int  getPort(void) const		{return _port;};
+		const config::ServerConfig* getDefaultVhost() const;
+
+		void setStats(LoopStats* stats)	{_stats = stats;};
+		void setBusyPoll(int usec)		{_busyPollUs = usec;};
+		void setShedding(bool shedding)	{_shedding = shedding;};
 };
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <ostream>
+#include <sys/types.h>
+
+/// Blocking filesystem operations whose latency is counted (see FsTimer).
+enum FsOp {
+	FS_RESOLVE,		///< mapping a URI to a canonical path
+	FS_STAT,
+	FS_ACCESS,
+	FS_INDEX,		///< probing a directory for its index file
+	FS_LIST,		///< reading a directory for autoindex
+	FS_OPEN,		///< opening a file to serve (sent with sendfile)
+	FS_WRITE,		///< writing an upload
+	FS_UNLINK,
+	FS_OP_COUNT
+};
+
+/**
+ * @struct LoopStats
+ * @brief Counters of one event loop (one worker thread or one worker process).
+ *
+ * Every field is a lock-free atomic so that the slot can live in memory shared
+ * between the master and forked workers: the owning loop only ever adds to it,
+ * the master only ever reads it.
+ */
+struct LoopStats {
+	std::atomic<pid_t>				pid;			///< Process running this loop (0 while the slot is unused)
+	std::atomic<unsigned long long>	connections;	///< Accepted client connections
+	std::atomic<unsigned long long>	requests;		///< Completely parsed requests
+	std::atomic<unsigned long long>	bytesIn;		///< Bytes received from clients
+	std::atomic<unsigned long long>	bytesOut;		///< Bytes sent to clients
+	std::atomic<unsigned long long>	restarts;		///< Times the master had to respawn this worker
+	std::atomic<long long>			handlerQueued;	///< Handlers of this loop waiting in the handler pool (queue depth)
+	std::atomic<unsigned long long>	handlerJobs;	///< Handler runs picked up by the handler pool
+	std::atomic<unsigned long long>	handlerSteals;	///< Of those, runs stolen from another pool thread's deque
+	std::atomic<unsigned long long>	busyPolls;		///< Event waits that returned at once to keep polling (busy_poll_us)
+	std::atomic<unsigned long long>	blockingWaits;	///< Event waits that could sleep
+	std::atomic<int>				cpu;			///< CPU the loop is pinned to (-1 when not pinned)
+	std::atomic<unsigned long long>	foreignCpu;		///< Accepted connections whose packets arrived on another CPU
+	std::atomic<unsigned long long>	lagMicros;		///< Smoothed loop lag: time an event waits behind the rest of its batch
+	std::atomic<unsigned long long>	maxLagMicros;	///< Longest single loop iteration
+	std::atomic<unsigned long long>	overloads;		///< Times the loop entered overload (overload_lag)
+	std::atomic<unsigned long long>	shed;			///< Requests answered 503 while overloaded
+	std::atomic<unsigned long long>	fsOps[FS_OP_COUNT];			///< Filesystem operations run for this loop, by FsOp
+	std::atomic<unsigned long long>	fsNanos[FS_OP_COUNT];		///< Their total latency
+	std::atomic<unsigned long long>	fsMaxNanos[FS_OP_COUNT];	///< Their worst latency
+};
+
+/**
+ * @class StatsTable
+ * @brief Fixed array of LoopStats placed in an anonymous shared mapping.
+ *
+ * The table is created by the master before any worker exists, so threads
+ * see it through plain memory and forked workers inherit the same pages
+ * (MAP_SHARED): counters written by a worker are visible to the master,
+ * which aggregates them on SIGUSR1 and at shutdown.
+ */
+class StatsTable {
+	private:
+		LoopStats*	_slots;
+		size_t		_count;
+
+	public:
+		explicit StatsTable(size_t count);
+		StatsTable(const StatsTable& other) = delete;
+		StatsTable& operator=(const StatsTable& other) = delete;
+		~StatsTable();
+
+		LoopStats&	slot(size_t index)		{ return _slots[index]; }
+		size_t		size(void) const		{ return _count; }
+		void		dump(std::ostream& out) const;
+
+		// SIGUSR1 asks for a dump; whoever supervises the loops polls the flag
+		static void	installDumpSignal(int wakeFd = -1);
+		static bool	consumeDumpRequest(void);
+};
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <concepts>
+#include <coroutine>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <memory_resource>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+template <typename T = void>
+class Task;
+
+/// A coroutine argument the frame can be allocated from: the request it serves (HttpRequest::getArena).
+template <typename A>
+concept FrameArena = requires(const A& a) {
+	{ a.getArena() } -> std::convertible_to<std::pmr::memory_resource*>;
+};
+
+namespace detail {
+	/// Resource of the first FrameArena argument, the heap when there is none.
+	inline std::pmr::memory_resource*	frameResource()	{ return std::pmr::new_delete_resource(); }
+	template <typename First, typename... Rest>
+	std::pmr::memory_resource*	frameResource(const First& first, const Rest&... rest) {
+		if constexpr (FrameArena<First>)
+			return first.getArena();
+		else
+			return frameResource(rest...);
+	}
+
+	/// Part of the promise shared by every Task<T>.
+	struct TaskPromiseBase {
+		std::coroutine_handle<>	continuation;	///< Coroutine awaiting this task, resumed when it finishes
+		std::function<void()>	onDone;			///< Called instead when a top-level task finishes
+		std::exception_ptr		exception;
+		TaskPromiseBase*		root = this;	///< Top-level task of the chain of awaits this one runs in
+		// kept by the root only, by its event loop (see Reactor::sendToHandlerPool, OffloadAwaitable)
+		bool					away = false;		///< a frame of the chain runs on the handler pool, or waits for offloaded work
+		bool					abandoned = false;	///< destroy the chain once it is back instead of resuming it
+
+		/// Resume whoever awaits the task (symmetric transfer, no stack growth).
+		struct FinalAwaiter {
+			bool await_ready() const noexcept	{ return false; }
+			template <typename Promise>
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+				TaskPromiseBase& promise = handle.promise();
+				if (promise.continuation)
+					return promise.continuation;
+				if (promise.onDone)
+					promise.onDone();
+				return std::noop_coroutine();
+			}
+			void await_resume() const noexcept {}
+		};
+
+		// frames are allocated from a memory resource kept after the frame, for operator
+		// delete: the heap here, the request's arena in ArenaTaskPromise
+		static void*	operator new(size_t size)					{ return allocateFrame(size, std::pmr::new_delete_resource()); }
+		static void		operator delete(void* frame, size_t size)	{ freeFrame(frame, size); }
+		static void*	allocateFrame(size_t size, std::pmr::memory_resource* resource) {
+			void* frame = resource->allocate(size + sizeof(resource), __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+			std::memcpy(static_cast<char*>(frame) + size, &resource, sizeof(resource));
+			return frame;
+		}
+		static void		freeFrame(void* frame, size_t size) {
+			std::pmr::memory_resource* resource;
+			std::memcpy(&resource, static_cast<char*>(frame) + size, sizeof(resource));
+			resource->deallocate(frame, size + sizeof(resource), __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+		}
+
+		std::suspend_always	initial_suspend() const noexcept	{ return {}; }
+		FinalAwaiter		final_suspend() const noexcept		{ return {}; }
+		void				unhandled_exception()				{ exception = std::current_exception(); }
+	};
+
+	template <typename T>
+	struct TaskPromise : TaskPromiseBase {
+		std::optional<T>	value;
+
+		Task<T>	get_return_object();
+		template <typename U>
+		void	return_value(U&& result)	{ value.emplace(std::forward<U>(result)); }
+		T		take() {
+			if (exception)
+				std::rethrow_exception(exception);
+			return std::move(*value);
+		}
+	};
+
+	template <>
+	struct TaskPromise<void> : TaskPromiseBase {
+		Task<void>	get_return_object();
+		void		return_void() const {}
+		void		take() const {
+			if (exception)
+				std::rethrow_exception(exception);
+		}
+	};
+
+	/**
+	 * @brief Promise of a Task<T> coroutine taking a request: its frame comes from the arena.
+	 *
+	 * The arena operator new is a plain member of a class templated on the coroutine's
+	 * parameters, declared with the operator delete the frame is freed with, so the
+	 * compiler sees them as a pair (a templated operator new next to the usual delete
+	 * trips -Wmismatched-new-delete). Adds no state: the frame is reached as a
+	 * TaskPromise<T> by Task<T>.
+	 */
+	template <typename T, typename... Args>
+	struct ArenaTaskPromise : TaskPromise<T> {
+		static void*	operator new(size_t size, const Args&... args)	{ return TaskPromiseBase::allocateFrame(size, frameResource(args...)); }
+		static void		operator delete(void* frame, size_t size)		{ TaskPromiseBase::freeFrame(frame, size); }
+	};
+}
+
+/// Coroutines returning a Task<T> with a FrameArena among their parameters use ArenaTaskPromise.
+template <typename T, typename... Args> requires (FrameArena<std::remove_cvref_t<Args>> || ...)
+struct std::coroutine_traits<Task<T>, Args...> {
+	using promise_type = detail::ArenaTaskPromise<T, std::remove_cvref_t<Args>...>;
+};
+
+/**
+ * @class Task
+ * @brief Lazily started coroutine producing a T.
+ *
+ * Inside a coroutine, `co_await task` runs the task and yields its result; the
+ * awaiting coroutine is suspended for as long as the task is (waiting on a socket,
+ * a pipe, a child process or offloaded file I/O, see Reactor.hpp).
+ *
+ * From plain code, start() runs the task up to its first suspension. When it did
+ * not finish (done() is false), onDone() registers what to do once it does, and
+ * result() then yields its value.
+ *
+ * @note the Task owns its coroutine frame: destroying a suspended Task cancels it,
+ *       every awaitable it was waiting on unregisters itself on destruction.
+ * @note a coroutine taking a request (a FrameArena) gets its frame from the request's
+ *       arena: the Task must be destroyed before the request is.
+ */
+template <typename T>
+class Task {
+	public:
+		using promise_type = detail::TaskPromise<T>;
+		using Handle = std::coroutine_handle<promise_type>;
+
+	private:
+		Handle	_handle;
+
+	public:
+		Task() = default;
+		explicit Task(Handle handle) : _handle(handle) {}
+		Task(const Task& other) = delete;
+		Task& operator=(const Task& other) = delete;
+		Task(Task&& other) noexcept : _handle(std::exchange(other._handle, nullptr)) {}
+		Task& operator=(Task&& other) noexcept {
+			if (this != &other){
+				if (_handle)
+					_handle.destroy();
+				_handle = std::exchange(other._handle, nullptr);
+			}
+			return *this;
+		}
+		~Task() {
+			if (_handle)
+				_handle.destroy();
+		}
+
+		// driving a top-level task from plain code
+		bool	valid() const						{ return static_cast<bool>(_handle); }
+		bool	done() const						{ return _handle && _handle.done(); }
+		void	start()								{ _handle.resume(); }
+		void	onDone(std::function<void()> fn)	{ _handle.promise().onDone = std::move(fn); }
+		T		result()							{ return _handle.promise().take(); }
+
+		// a frame of the task runs on another thread: it must not be destroyed now
+		bool						away() const	{ return _handle && _handle.promise().away; }
+		detail::TaskPromiseBase&	rootPromise()	{ return _handle.promise(); }
+		std::coroutine_handle<>		detach()		{ return std::exchange(_handle, nullptr); }
+
+		// awaiting from another Task coroutine
+		bool					await_ready() const noexcept	{ return false; }
+		template <typename Promise>
+		std::coroutine_handle<>	await_suspend(std::coroutine_handle<Promise> awaiting) noexcept {
+			_handle.promise().continuation = awaiting;
+			_handle.promise().root = awaiting.promise().root;
+			return _handle;
+		}
+		T						await_resume()					{ return _handle.promise().take(); }
+};
+
+namespace detail {
+	template <typename T>
+	Task<T> TaskPromise<T>::get_return_object() {
+		return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+	}
+
+	inline Task<void> TaskPromise<void>::get_return_object() {
+		return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+	}
+}
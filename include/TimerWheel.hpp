@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @struct TimerNode
+ * @brief Intrusive link of a timer, embedded in the object that owns the deadline.
+ *
+ * The wheel only links and unlinks nodes, it never allocates: arming, re-arming
+ * and cancelling a timer are all O(1) pointer updates.
+ */
+struct TimerNode {
+	TimerNode*	prev = nullptr;			///< Previous node in the slot list (nullptr when not armed)
+	TimerNode*	next = nullptr;			///< Next node in the slot list
+	uint64_t	expiresAt = 0;			///< Deadline, in wheel ticks
+	int			fd = -1;				///< File descriptor reported when the timer expires
+
+	bool		isArmed() const			{ return prev != nullptr; }
+};
+
+/**
+ * @class TimerWheel
+ * @brief Hierarchical timing wheel driven by a timerfd.
+ *
+ * Four levels of 64 slots: level 0 holds the timers due in the next 64 ticks,
+ * each higher level covers 64 times the range of the one below. When the
+ * level 0 index wraps, the current slot of level 1 is cascaded down (and so on),
+ * as in the classic Varghese & Lauck / Linux timer wheel.
+ *
+ * The timerfd is meant to be registered in the event loop: it fires every tick
+ * while at least one timer is armed and is disarmed when the wheel is empty.
+ * advance() then catches the wheel up with the monotonic clock, so a loop that
+ * was busy for a while still expires everything that became due.
+ *
+ * @note With TICK_MS = 100 the wheel spans 64^4 ticks (about 19 days);
+ *       longer delays are clamped to that range.
+ */
+class TimerWheel {
+	public:
+		static constexpr unsigned	TICK_MS = 100;
+
+	private:
+		static constexpr int		LEVELS = 4;
+		static constexpr int		SLOT_BITS = 6;
+		static constexpr int		SLOTS = 1 << SLOT_BITS;
+		static constexpr uint64_t	SLOT_MASK = SLOTS - 1;
+
+		TimerNode		_slots[LEVELS][SLOTS];	///< Sentinel heads of circular lists
+		uint64_t		_now;					///< Current tick
+		uint64_t		_startMs;				///< Monotonic time of tick 0
+		size_t			_armed;					///< Number of armed timers
+		int				_timerFd;				///< timerfd ticking while _armed > 0
+		bool			_ticking;				///< Whether the timerfd is currently armed
+
+		static uint64_t	monotonicMs(void);
+		void			link(TimerNode& node);
+		void			unlink(TimerNode& node);
+		void			cascade(int level);
+		void			setTicking(bool on);
+
+	public:
+		TimerWheel();
+		TimerWheel(const TimerWheel& other) = delete;
+		TimerWheel& operator=(const TimerWheel& other) = delete;
+		~TimerWheel();
+
+		int		open(void);
+		int		getFd(void) const		{ return _timerFd; }
+		size_t	size(void) const		{ return _armed; }
+
+		void	schedule(TimerNode& node, uint64_t delayMs);
+		void	cancel(TimerNode& node);
+		void	advance(std::vector<int>& expiredFds);
+};
@@ -1,10 +1,16 @@
 #pragma once
 
+#include "IoUring.hpp"
+#include "Reactor.hpp"
 #include "Server.hpp"
+#include "TimerWheel.hpp"
 #include "utils.hpp"
 
 #include <sys/epoll.h>
+#include <atomic>
+#include <cstdint>
 #include <csignal>
+#include <unordered_map>
 
 // using namespace config;
 using namespace utils;
@@ -22,54 +28,166 @@ using namespace utils;
  * - Initializes and runs multiple servers
  * - Dispatches epoll events
  * - Manages client lifecycles
- * - Handles idle connection cleanup
+ * - Enforces per-phase client deadlines (header, body, keep-alive, send)
+ *   with a timing wheel whose timerfd sits in the epoll set, so they fire
+ *   on schedule however busy the loop is
+ *
+ * @note Every fd in the epoll set carries a PollSource pointer in epoll_event.data.ptr
+ *       (a listener, the timer, or a Connection from the fd-indexed slab), so an event
+ *       is dispatched without any lookup. Suspended coroutines are the exception: their
+ *       frames can be freed by an earlier event of the batch, so they carry a tagged
+ *       registration id instead, looked up in _epollWaiters before anything is touched.
+ * @note With `event_backend io_uring` the loop is driven by completions instead
+ *       (see WebserverUring.cpp); epoll stays the fallback when the kernel refuses io_uring.
+ * @note With `edge_triggered on` listeners and clients are registered with EPOLLET.
+ *       Clients are then registered once for EPOLLIN|EPOLLOUT and never modified:
+ *       every handler drains its fd until EAGAIN, since an edge is only raised for new data.
+ * @note The loop measures its own lag (how long a ready event waits behind the rest of
+ *       its batch). With `overload_lag`, a loop whose smoothed lag goes above the limit
+ *       sheds load until it falls back under half of it: new requests get a prebuilt 503,
+ *       or with `overload_action pause` new connections are left in the listen backlog.
+ * @note Webserver is the Reactor of its loop: request handlers are coroutines that
+ *       suspend on CGI pipes, child exits and offloaded file I/O. A client whose handler
+ *       is suspended stops being read; its response is sent once the handler finishes,
+ *       after the batch of events that finished it. Closing a client destroys its handler,
+ *       once it is back when it was away (on the handler pool, or waiting for offloaded work).
  */
-class Webserver {
+class Webserver : public Reactor {
 	private:
-	    static constexpr int CONNECTION_TIMEOUT = 60;		//Maximum allowed idle time for a client connection (in seconds).
-
 		int 					_epollFd;					// epoll instance file descriptor 
 		bool					_running;					//
+		config::GlobalConfig	_global;					// Loop settings from the main context of the configuration
 		std::vector<Server> 	_servers;					// All running Server instances 
-		std::map<int, size_t> 	_listenFdToServerIndex;		// Maps listening socket fd to its Server index.
-		std::map<int, size_t>	_clientFdToServerIndex;		// Maps client socket fd to its Server index.
-		std::map<int, time_t>	_lastActivity;				// Tracks the last activity time for each client fd.
+		std::vector<PollSource>	_listenerSources;			// epoll data.ptr of each listening socket, by Server index
+		PollSource				_timerSource;				// epoll data.ptr of the timer wheel's timerfd
+		ConnectionSlab			_connections;				// Client state indexed by fd, reached from epoll data.ptr
+		TimerWheel				_timers;					// Client deadlines, ticking through a timerfd in the epoll set
+		IoUring					_ring;						// Completion ring when event_backend is io_uring (closed otherwise)
+		StatsTable*				_statsTable;				// Shared counters table (owned by the Master)
+		LoopStats*				_stats;						// This loop's slot in _statsTable
+		bool					_statsReporter;				// Whether this loop prints the table on SIGUSR1
+		PollSource				_signalSource;				// epoll data.ptr of the process-wide signal eventfd
+		uint64_t				_busyPollUntil;				// Monotonic ns until which an idle wait returns at once (busy_poll_us)
+		int						_cpu;						// CPU the loop's thread is pinned to (-1 when not pinned)
+		uint64_t				_iterationStart;			// Monotonic ns at which the current wait returned
+		uint64_t				_lagNs;						// Smoothed duration of a loop iteration (overload_lag)
+		bool					_overloaded;				// Shedding load until the lag is back down
+		bool					_acceptPaused;				// Listeners out of the epoll set / accepts cancelled
+		uint32_t				_listenerEvents;			// epoll events the listeners are registered with
+		uint32_t				_acceptGeneration;			// io_uring: generation of the multishot accepts in flight
+		std::vector<std::pair<Connection*, uint32_t>>	_readyClients;		// Clients whose handler finished, with their generation
+		std::vector<std::pair<Connection*, uint32_t>>	_finishingClients;	// The ones being answered by finishReadyHandlers
+		std::unordered_map<uint64_t, Waiter*>			_epollWaiters;		// epoll registrations of suspended coroutines, by id
+		std::unordered_map<uint64_t, Waiter*>			_uringWaiters;		// io_uring polls in flight for suspended coroutines, by id
+		uint64_t										_nextWaiterId;		// Source of Waiter::id, shared by both backends
 
 		//epoll and event handleing
-		bool isListeningSocket(int fd) const;
 		bool hasError(const epoll_event& event) const;
-		bool isFdWriting(int clientFd) const;
+		void dispatchClientEvent(Connection& conn, const epoll_event& event);
 
 		// new contectiong
-		void handleNewConnection(int listenFd);
+		void handleNewConnection(size_t serverIndex);
+		void noteIncomingCpu(int clientFd);
 
 		// client reading and writing
-		void handleClientRequest(int clientFd);
-		void handleClientWrite(int clientFd);
+		void handleClientRequest(Connection& conn);
+		void handleClientWrite(Connection& conn);
+		void resumeClient(Connection& conn, Server::ClientStatus status);
+
+		// coroutine handlers (Reactor)
+		int  registerWakeup(void);
+		void waitForHandler(Connection& conn);
+		void finishReadyHandlers(void);
+		void resumeWaiter(uint64_t id, uint32_t events);
+
+		// waiting for events
+		int  nextWaitTimeout(void);
+		void noteEvents(void);
+
+		// overload protection
+		void startIteration(void);
+		void measureLag(void);
+		void setOverloaded(bool overloaded);
+		void pauseAccepting(bool paused);
+		void pauseUringAccepts(bool paused);
 
 		//epoll event mofifying
-		void modifyClientEvents(int clientFd, uint32_t events);
+		void modifyClientEvents(Connection& conn, uint32_t events);
 
 		//timeout
-		void checkIdleConnections();
-		void sendTimeoutResponse(int clientFd);
+		int  registerTimer(void);
+		void armClientTimer(Connection& conn, ClientPhase phase);
+		void updateReadTimer(Connection& conn);
+		void expireTimers(void);
+		void sendTimeoutResponse(const Connection& conn);
+
+		//io_uring backend (WebserverUring.cpp)
+		int  setupUring(void);
+		int  runEpollLoop(void);
+		int  runUringLoop(void);
+		void handleUringCompletion(const io_uring_cqe& cqe);
+		void handleUringAccept(size_t serverIndex, const io_uring_cqe& cqe);
+		void handleUringRecv(Connection& conn, const io_uring_cqe& cqe);
+		void handleUringSend(Connection& conn, const io_uring_cqe& cqe);
+		void handleUringSendFile(Connection& conn, const io_uring_cqe& cqe);
+		void continueUringSend(Connection& conn, Server::ClientStatus status);
+		void applyUringStatus(Connection& conn, Server::ClientStatus status);
+		void submitUringRecv(Connection& conn);
+		void pauseUringRecv(Connection& conn);
+		void resumeUringRecv(Connection& conn);
+		void submitUringSend(Connection& conn);
+		void closeUringClient(Connection& conn);
+		void finishUringClose(Connection& conn);
+		void watchUring(Waiter& waiter, int fd, uint32_t events);
+		void unwatchUring(Waiter& waiter);
+		void handleUringWaiter(const io_uring_cqe& cqe);
+
+		//listening sockets registration
+		int  registerListeners(uint32_t extraEvents);
+		static void installSignalHandlers(void);
+		static bool isShutdownRequested(void);
 
 		//fd management and cleanign up
 		void addClientToPoll(int clientFd, size_t serverIndex);
 		void removeFdFromPoll(int fd);
-		void removeClientFd(int clientFd);
+		void removeClient(Connection& conn);
+		void closeClient(Connection& conn);
+		void drainLingeringClient(Connection& conn);
+		bool armLingerTimer(Connection& conn);
+		void releaseClient(Connection& conn);
 		void closeAllClients(void);
 	
 
 	public:
 		//constructors
-		explicit Webserver();
+		explicit Webserver(const config::GlobalConfig& global);
 		Webserver(const Webserver& other) = delete;
 		Webserver& operator=(const Webserver& other) = delete;
 		~Webserver();
 
+		// Reactor: one-shot readiness of fds awaited by request handlers
+		void watch(Waiter& waiter, int fd, uint32_t events) override;
+		void unwatch(Waiter& waiter) override;
+
 		// create server instances, runs main event loop, stops the websier and exits
-		int  createServers(const std::vector<config::ServerConfig>& config);
+		int  createServers(const std::vector<config::ServerConfig>& config, bool reusePort = false);
 		int  runWebserver(void);
 		void stopWebserver(void);
+
+		// prefork: the master only opens the sockets, each forked worker then builds its own epoll
+		int  openServers(const std::vector<config::ServerConfig>& config, bool reusePort = false);
+		int  becomeWorker(void);
+
+		// counters of this loop live in a slot of a table shared with the master
+		void attachStats(StatsTable& table, size_t slot, bool reporter);
+
+		// worker_cpu_affinity: pin the calling thread, which is to run this loop, and
+		// steer each SO_REUSEPORT group by receiving CPU (CPU of each loop, in group order)
+		int  pinToCpu(int cpu);
+		int  steerConnections(const std::vector<int>& cpuOfLoop);
+
+		// asks every event loop of the process to leave runWebserver, like SIGINT does
+		static void requestShutdown(void);
+		// eventfd written by the signal handlers of the process, -1 when it could not be created
+		static int  signalWakeFd(void);
 };
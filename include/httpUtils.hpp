@@ -11,16 +11,22 @@
 namespace fs = std::filesystem;
 
 namespace httpUtils {
-    bool                            isMethodAllowed(const config::LocationConfig* loc, const std::string& method);
+    constexpr size_t                HTTP_DATE_SIZE = 32;    ///< "Wed, 21 Oct 2015 07:28:00 GMT" and its terminator, with room to spare
+
+    bool                            isMethodAllowed(const config::LocationConfig* loc, std::string_view method);
     bool                            shouldKeepAlive(const HttpRequest& req);
+    bool                            containsNoCase(std::string_view text, std::string_view word);
 
     std::string                     trim_space(std::string str);
     std::string                     normalizeHeaderKey(const std::string& key);
-    std::string                     getMimeType(const std::string& path);
+    std::string_view                getMimeType(std::string_view path);
     std::string                     formatTime(std::time_t t);
+    size_t                          formatTime(std::time_t t, char* buf);
+    std::string_view                currentDate();
+    std::string                     locationPath(const config::LocationConfig* loc, const std::string& uri_raw);
     std::string                     mapUriToPath(const config::LocationConfig* loc, const std::string& uri_raw);
     std::string                     getIndexFile(const std::string& dirPath, const config::LocationConfig* lc);
 
-    const config::LocationConfig*   findLocationConfig(const config::ServerConfig* vh, const std::string& uri_raw, const std::string& method = "");
-    bool                            isCgiRequest(HttpRequest& request, const config::ServerConfig& vh);
+    const config::LocationConfig*   findLocationConfig(const config::ServerConfig* vh, std::string_view uri, std::string_view method = std::string_view());
+    bool                            isCgiRequest(const HttpRequest& request, const config::ServerConfig& vh);
 }
@@ -0,0 +1,142 @@
+#!/usr/bin/env python3
+"""
+Compare the epoll and io_uring event backends on the same keep-alive load.
+
+Starts ./webserv once per backend (the configuration is copied with an
+`event_backend` line in front), runs N keep-alive clients for D seconds and
+prints requests/s, p50/p99 latency and, when strace is installed, the number
+of syscalls per request made by the server.
+
+With --file-size, a file of that many bytes is written in --root (the root
+of the first server in the configuration) before the run, requested instead
+of --path, and removed afterwards.
+
+usage: python3 scriptsTests/bench_backends.py [config] [--conns N] [--duration S] [--path /]
+                                              [--file-size BYTES] [--root ./sites/static]
+run from the repository root, after make.
+"""
+import argparse, os, re, shutil, signal, socket, subprocess, sys, tempfile, threading, time
+
+def parse_args():
+    p = argparse.ArgumentParser()
+    p.add_argument("config", nargs="?", default="configuration/simple.conf")
+    p.add_argument("--conns", type=int, default=32)
+    p.add_argument("--duration", type=float, default=5.0)
+    p.add_argument("--path", default="/")
+    p.add_argument("--port", type=int, default=8080)
+    p.add_argument("--file-size", type=int, default=0)
+    p.add_argument("--root", default="./sites/static")
+    return p.parse_args()
+
+def read_response(sock, buf):
+    while b"\r\n\r\n" not in buf:
+        data = sock.recv(65536)
+        if not data:
+            raise ConnectionError("closed")
+        buf += data
+    head, rest = buf.split(b"\r\n\r\n", 1)
+    length = 0
+    for line in head.split(b"\r\n")[1:]:
+        name, _, value = line.partition(b":")
+        if name.strip().lower() == b"content-length":
+            length = int(value)
+    while len(rest) < length:
+        data = sock.recv(65536)
+        if not data:
+            raise ConnectionError("closed")
+        rest += data
+    return rest[length:]
+
+def client(port, path, deadline, latencies, reconnects):
+    request = ("GET %s HTTP/1.1\r\nHost: localhost\r\nConnection: keep-alive\r\n\r\n" % path).encode()
+    sock, buf = None, b""
+    while time.monotonic() < deadline:
+        try:
+            if sock is None:
+                sock = socket.create_connection(("127.0.0.1", port))
+                sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+                buf = b""
+            start = time.monotonic()
+            sock.sendall(request)
+            buf = read_response(sock, buf)
+            latencies.append(time.monotonic() - start)
+        except (OSError, ConnectionError):
+            # includes the server closing after its per-connection request limit
+            reconnects.append(1)
+            if sock:
+                sock.close()
+            sock = None
+    if sock:
+        sock.close()
+
+def percentile(values, p):
+    if not values:
+        return 0.0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+def run(backend, args):
+    with open(args.config) as f:
+        config = f.read()
+    conf = tempfile.NamedTemporaryFile("w", suffix=".conf", delete=False)
+    conf.write("event_backend %s;\n" % backend + config)
+    conf.close()
+    server = subprocess.Popen(["./webserv", conf.name], stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+    time.sleep(0.5)
+    tracer, trace_file = None, None
+    if shutil.which("strace"):
+        trace_file = tempfile.NamedTemporaryFile(suffix=".strace", delete=False).name
+        tracer = subprocess.Popen(["strace", "-c", "-f", "-p", str(server.pid), "-o", trace_file],
+                                  stderr=subprocess.DEVNULL)
+        time.sleep(0.5)
+    latencies, reconnects = [], []
+    deadline = time.monotonic() + args.duration
+    threads = [threading.Thread(target=client, args=(args.port, args.path, deadline, latencies, reconnects))
+               for _ in range(args.conns)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    syscalls = None
+    if tracer:
+        tracer.send_signal(signal.SIGINT)
+        tracer.wait()
+        with open(trace_file) as f:
+            match = re.search(r"^\s*100\.00\s+\S+\s+\S+\s+(\d+)", f.read(), re.M)
+            if match:
+                syscalls = int(match.group(1))
+        os.unlink(trace_file)
+    server.send_signal(signal.SIGINT)
+    _, stderr = server.communicate(timeout=10)
+    os.unlink(conf.name)
+    if b"falling back to epoll" in stderr:
+        print("%-9s io_uring unavailable, the server fell back to epoll" % backend)
+    n = len(latencies)
+    print("%-9s %8d req  %9.0f req/s  p50 %7.3f ms  p99 %7.3f ms  reconnects %d  syscalls/req %s" % (
+        backend, n, n / args.duration, percentile(latencies, 50) * 1000,
+        percentile(latencies, 99) * 1000, len(reconnects),
+        "%.2f" % (syscalls / n) if syscalls is not None and n else "n/a (needs strace)"))
+
+def main():
+    args = parse_args()
+    if not os.path.exists("./webserv"):
+        sys.exit("build webserv first (make)")
+    big_file = None
+    if args.file_size > 0:
+        fd, big_file = tempfile.mkstemp(prefix="bench_", suffix=".bin", dir=args.root)
+        with os.fdopen(fd, "wb") as f:
+            chunk = os.urandom(1 << 20)
+            left = args.file_size
+            while left > 0:
+                f.write(chunk[:left])
+                left -= len(chunk)
+        args.path = "/" + os.path.basename(big_file)
+    try:
+        for backend in ("epoll", "io_uring"):
+            run(backend, args)
+    finally:
+        if big_file:
+            os.unlink(big_file)
+
+if __name__ == "__main__":
+    main()
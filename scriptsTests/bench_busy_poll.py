@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+"""
+Measure what busy_poll_us buys: request latency with the loop sleeping in its
+event wait versus spinning on zero-timeout waits.
+
+Starts ./webserv once without busy polling and once per budget given with
+--budgets (the configuration is copied with `busy_poll_us` in front), then runs
+a few keep-alive clients that pause between requests, so that every request
+finds an idle loop: the case busy polling is for. Prints p50/p99/p99.9 latency
+and the CPU time the server burnt, which is the price.
+
+usage: python3 scriptsTests/bench_busy_poll.py [config] [--budgets 50,200] [--conns N]
+                                               [--duration S] [--gap-us U] [--so-busy-poll]
+run from the repository root, after make. Numbers only mean something with the
+loop on a dedicated core (worker_threads 1, no other load on it).
+"""
+import argparse, os, signal, socket, subprocess, sys, tempfile, threading, time
+
+def parse_args():
+    p = argparse.ArgumentParser()
+    p.add_argument("config", nargs="?", default="configuration/simple.conf")
+    p.add_argument("--budgets", default="50,200")
+    p.add_argument("--conns", type=int, default=1)
+    p.add_argument("--duration", type=float, default=5.0)
+    p.add_argument("--gap-us", type=int, default=100)
+    p.add_argument("--path", default="/")
+    p.add_argument("--port", type=int, default=8080)
+    p.add_argument("--so-busy-poll", action="store_true")
+    return p.parse_args()
+
+def read_response(sock, buf):
+    while b"\r\n\r\n" not in buf:
+        data = sock.recv(65536)
+        if not data:
+            raise ConnectionError("closed")
+        buf += data
+    head, rest = buf.split(b"\r\n\r\n", 1)
+    length = 0
+    for line in head.split(b"\r\n")[1:]:
+        name, _, value = line.partition(b":")
+        if name.strip().lower() == b"content-length":
+            length = int(value)
+    while len(rest) < length:
+        data = sock.recv(65536)
+        if not data:
+            raise ConnectionError("closed")
+        rest += data
+    return rest[length:]
+
+def client(port, path, deadline, gap, latencies):
+    request = ("GET %s HTTP/1.1\r\nHost: localhost\r\nConnection: keep-alive\r\n\r\n" % path).encode()
+    sock, buf = None, b""
+    while time.monotonic() < deadline:
+        try:
+            if sock is None:
+                sock = socket.create_connection(("127.0.0.1", port))
+                sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+                buf = b""
+            start = time.perf_counter()
+            sock.sendall(request)
+            buf = read_response(sock, buf)
+            latencies.append(time.perf_counter() - start)
+        except (OSError, ConnectionError):
+            if sock:
+                sock.close()
+            sock = None
+        # let the loop go idle before the next request
+        pause = time.perf_counter() + gap
+        while time.perf_counter() < pause:
+            pass
+    if sock:
+        sock.close()
+
+def percentile(values, p):
+    if not values:
+        return 0.0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+def cpu_seconds(pid):
+    with open("/proc/%d/stat" % pid) as f:
+        fields = f.read().rsplit(")", 1)[1].split()
+    return (int(fields[11]) + int(fields[12])) / os.sysconf("SC_CLK_TCK")
+
+def run(budget, args):
+    with open(args.config) as f:
+        config = f.read()
+    conf = tempfile.NamedTemporaryFile("w", suffix=".conf", delete=False)
+    if budget:
+        conf.write("busy_poll_us %d;\n" % budget)
+        if args.so_busy_poll:
+            conf.write("so_busy_poll on;\n")
+    conf.write(config)
+    conf.close()
+    server = subprocess.Popen(["./webserv", conf.name], stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+    time.sleep(0.5)
+    cpu_before = cpu_seconds(server.pid)
+    latencies = []
+    deadline = time.monotonic() + args.duration
+    threads = [threading.Thread(target=client, args=(args.port, args.path, deadline, args.gap_us / 1e6, latencies))
+               for _ in range(args.conns)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    cpu = cpu_seconds(server.pid) - cpu_before
+    server.send_signal(signal.SIGINT)
+    server.communicate(timeout=10)
+    os.unlink(conf.name)
+    label = "busy %dus" % budget if budget else "off"
+    print("%-11s %8d req  p50 %7.1f us  p99 %7.1f us  p99.9 %7.1f us  server cpu %5.1f%%" % (
+        label, len(latencies), percentile(latencies, 50) * 1e6, percentile(latencies, 99) * 1e6,
+        percentile(latencies, 99.9) * 1e6, 100 * cpu / args.duration))
+
+def main():
+    args = parse_args()
+    if not os.path.exists("./webserv"):
+        sys.exit("build webserv first (make)")
+    run(0, args)
+    for budget in args.budgets.split(","):
+        run(int(budget), args)
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,142 @@
+/*
+ * Count the bytes a body costs on its way through the server, per request.
+ *
+ * Request side: a POST is received into the parser (as recv does, straight into
+ * receiveBuffer) then parsed, admitted and handed to a handler; every byte
+ * allocated past the receive buffer itself is a copy of the body. Both an
+ * in-memory body and a spooled one (over client_body_buffer_size) are measured.
+ *
+ * Response side: a handler coroutine returns an HttpResponse built around a body
+ * it read, the server takes it from the Task, writes its head and queues it in the
+ * connection's write buffer; every byte allocated past the body read is a copy
+ * (the write buffer's own allocations, warm once the connection served a request,
+ * are not counted).
+ *
+ * Prints, per body size, the bytes allocated per request and that number divided
+ * by the body size (the number of copies of the body).
+ *
+ * usage: make copy_bench && ./copy_bench
+ */
+#include "Connection.hpp"
+#include "HttpRequestParser.hpp"
+#include "HttpResponse.hpp"
+#include "Task.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+
+// operator delete frees what this operator new malloc'ed
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+static size_t g_allocated = 0;      ///< Bytes allocated while counting
+static bool g_counting = false;
+
+void* operator new(size_t size){
+    if (g_counting)
+        g_allocated += size;
+    void* p = std::malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+/// Bytes allocated by fn.
+template <typename Fn>
+static size_t counted(Fn fn){
+    g_allocated = 0;
+    g_counting = true;
+    fn();
+    g_counting = false;
+    return g_allocated;
+}
+
+/// Receive len bytes of data into the parser the way the server's recv does; bytes allocated by parsing them.
+static size_t receive(HttpParser& parser, const char* data, size_t len){
+    size_t parsing = 0;
+    while (len > 0){
+        size_t room;
+        char* buffer = parser.receiveBuffer(room);
+        size_t n = len < room ? len : room;
+        std::memcpy(buffer, data, n);
+        parser.received(n);
+        data += n;
+        len -= n;
+        parsing += counted([&]{ parser.parseHttpRequest(); });
+        if (parser.awaitsBodyAdmission()){
+            parser.admitBody(SIZE_MAX);
+            parsing += counted([&]{ parser.parseHttpRequest(); });
+        }
+    }
+    return parsing;
+}
+
+static size_t requestCopies(size_t bodySize){
+    std::string head = "POST /upload HTTP/1.1\r\nHost: localhost\r\nContent-Type: application/octet-stream\r\n"
+                       "Content-Length: " + std::to_string(bodySize) + "\r\n\r\n";
+    std::string body(bodySize, 'x');
+    HttpParser parser;
+    size_t total = receive(parser, head.data(), head.size());
+    // the body arrives in reads of at most 64 KB, each parsed as it comes
+    for (size_t off = 0; off < bodySize; off += 65536)
+        total += receive(parser, body.data() + off, std::min<size_t>(65536, bodySize - off));
+    if (parser.getState() != DONE){
+        std::fprintf(stderr, "request of %zu bytes not parsed\n", bodySize);
+        std::exit(1);
+    }
+    total += counted([&]{
+        const HttpRequest& req = parser.getRequest();
+        RequestBody handed = req.getBody();     // what a handler or a CGI keeps
+        if (handed.size() != bodySize)
+            std::exit(1);
+    });
+    return total;
+}
+
+static Task<HttpResponse> handler(std::string body){
+    HttpResponse::Headers headers;
+    headers["Content-Type"] = "application/octet-stream";
+    co_return HttpResponse("HTTP/1.1", 200, "OK", std::move(body), std::move(headers), true, true);
+}
+
+static size_t responseCopies(size_t bodySize){
+    std::string body(bodySize, 'x');        // the file the handler read
+    WriteBuffer writeBuffer;
+    writeBuffer.data.reserve(4096);
+    writeBuffer.bodies.reserve(4);
+    writeBuffer.segments.reserve(4);
+    size_t total = counted([&]{
+        Task<HttpResponse> task = handler(std::move(body));
+        task.start();
+        HttpResponse response = task.result();
+        response.writeHead(writeBuffer.data);
+        writeBuffer.commitData();
+        writeBuffer.appendBody(response.releaseBody());
+    });
+    if (writeBuffer.remainingToSend() <= bodySize)
+        std::exit(1);
+    return total;
+}
+
+static void report(const char* name, size_t (*measure)(size_t)){
+    static const size_t SIZES[] = {1024, 65536, 1 << 20, 16 << 20};
+    std::printf("%s\n", name);
+    std::printf("  %10s %16s %10s\n", "body", "allocated B/req", "copies");
+    for (size_t size : SIZES){
+        size_t bytes = measure(size);
+        std::printf("  %10zu %16zu %10.2f\n", size, bytes, double(bytes) / size);
+    }
+}
+
+int main(){
+    HttpParser::setBodyBufferSize(SIZE_MAX);
+    report("request body, in memory", requestCopies);
+    HttpParser::setBodyBufferSize(16384);
+    report("request body, spooled", requestCopies);
+    report("response body", responseCopies);
+    return 0;
+}
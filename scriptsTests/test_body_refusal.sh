@@ -0,0 +1,170 @@
+#!/bin/bash
+
+# Bodies refused from their head (413, 417) still reach the client with their response:
+# the server answers with "Connection: close", shuts its sending side down and discards
+# the rest of the body before closing (lingering close), on both event backends.
+#   - a body far over client_max_body_size, sent without waiting       -> 413
+#   - the same with "Expect: 100-continue", body sent after the answer -> 413, no 100
+#   - an unsupported Expect                                             -> 417
+#   - a client that stops sending is closed after the lingering timeout (5 s)
+# Starts its own webserv (built in the repository root) on port 8091.
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+cd "$SCRIPT_DIR/.." || exit 1
+
+GREEN='\033[0;32m'
+BLUE='\033[0;34m'
+RED='\033[0;31m'
+NC='\033[0m'
+
+PORT=8091
+FAILED=0
+CONF=$(mktemp /tmp/webserv_refusal.XXXXXX.conf)
+SERVER_PID=
+
+if [ ! -x ./webserv ]; then
+    echo -e "${RED}ERROR: ./webserv not found, run make first${NC}"
+    exit 1
+fi
+
+stop_server() {
+    if [ -n "$SERVER_PID" ]; then
+        kill -INT "$SERVER_PID" 2>/dev/null
+        wait "$SERVER_PID" 2>/dev/null
+        SERVER_PID=
+    fi
+}
+trap 'stop_server; rm -f "$CONF"' EXIT
+
+# start_server <event backend>
+start_server() {
+    cat > "$CONF" <<EOF
+event_backend $1;
+server {
+    listen $PORT;
+    server_name localhost;
+    root ./sites/static;
+    client_max_body_size 1k;
+    location / {
+        allowed_methods GET POST;
+    }
+}
+EOF
+    ./webserv "$CONF" > /dev/null 2>&1 &
+    SERVER_PID=$!
+    for _ in $(seq 1 50); do
+        nc -z localhost $PORT 2>/dev/null && return 0
+        sleep 0.1
+    done
+    echo -e "${RED}ERROR: webserv did not start with event_backend $1${NC}"
+    exit 1
+}
+
+# refuse <body bytes> <extra header line or ""> <wait for the answer first: 0|1>
+# Sends a POST of that many bytes and prints what the client got: the status line,
+# "100" when an interim 100 Continue came first, and "closed" once the server closed.
+refuse() {
+    python3 - "$PORT" "$1" "$2" "$3" <<'EOF'
+import socket, sys
+port, size, extra, wait_first = int(sys.argv[1]), int(sys.argv[2]), sys.argv[3], sys.argv[4] == "1"
+head = "POST / HTTP/1.1\r\nHost: localhost\r\nContent-Length: %d\r\n%s\r\n" % (size, extra + "\r\n" if extra else "")
+sock = socket.create_connection(("127.0.0.1", port))
+sock.settimeout(10)
+result = []
+try:
+    sock.sendall(head.encode())
+    response = b""
+    if wait_first:
+        while b"\r\n\r\n" not in response:
+            data = sock.recv(65536)
+            if not data:
+                break
+            response += data
+    body = b"x" * 65536
+    left = size
+    while left > 0:
+        sent = sock.send(body[:left])
+        left -= sent
+    sock.shutdown(socket.SHUT_WR)
+    while True:
+        data = sock.recv(65536)
+        if not data:
+            break
+        response += data
+    if response.startswith(b"HTTP/1.1 100"):
+        result.append("100")
+        response = response.split(b"\r\n\r\n", 1)[1]
+    result.append(response.split(b"\r\n", 1)[0].decode())
+    if b"\r\nConnection: close\r\n" in response:
+        result.append("Connection: close")
+    result.append("closed")
+except OSError as e:
+    result.append("error: %s" % e)
+print(" | ".join(result))
+EOF
+}
+
+# check <description> <expected output> <output>
+check() {
+    if [ "$3" != "$2" ]; then
+        echo -e "${RED}✗ $1: expected \"$2\", got \"$3\"${NC}"
+        FAILED=$((FAILED + 1))
+        return
+    fi
+    echo -e "${GREEN}✓ $1: $2${NC}"
+}
+
+for backend in epoll io_uring; do
+    echo -e "${BLUE}================================================${NC}"
+    echo -e "${BLUE}  Refused bodies - event_backend $backend${NC}"
+    echo -e "${BLUE}================================================${NC}\n"
+    start_server "$backend"
+
+    REFUSED="HTTP/1.1 413 Payload Too Large | Connection: close | closed"
+
+    check "8 MB body sent at once" "$REFUSED" "$(refuse 8000000 "" 0)"
+    check "8 MB body after Expect: 100-continue" "$REFUSED" "$(refuse 8000000 "Expect: 100-continue" 1)"
+    check "8 MB body with Expect: 100-continue, sent at once" "$REFUSED" "$(refuse 8000000 "Expect: 100-continue" 0)"
+    check "unsupported Expect" "HTTP/1.1 417 Expectation Failed | Connection: close | closed" \
+        "$(refuse 100 "Expect: something-else" 1)"
+
+    # a client that stops sending halfway gets the refusal and the end of the response
+    # at once, and is closed for good after the lingering timeout (5 s): more of its
+    # body is then answered with a reset
+    result=$(python3 - "$PORT" <<'EOF'
+import socket, sys, time
+sock = socket.create_connection(("127.0.0.1", int(sys.argv[1])))
+sock.settimeout(3)
+sock.sendall(b"POST / HTTP/1.1\r\nHost: localhost\r\nContent-Length: 8000000\r\n\r\n" + b"x" * 100000)
+response = b""
+try:
+    while True:
+        data = sock.recv(65536)
+        if not data:
+            break
+        response += data
+    result = [response.split(b"\r\n", 1)[0].decode()]
+    time.sleep(7)
+    try:
+        for _ in range(2):
+            sock.sendall(b"x" * 1000)
+            time.sleep(0.2)
+        result.append("still open")
+    except OSError:
+        result.append("closed")
+    print(" | ".join(result))
+except OSError as e:
+    print("error: %s" % e)
+EOF
+)
+    check "stalled body" "HTTP/1.1 413 Payload Too Large | closed" "$result"
+
+    stop_server
+    echo
+done
+
+if [ $FAILED -ne 0 ]; then
+    echo -e "${RED}$FAILED test(s) failed${NC}"
+    exit 1
+fi
+echo -e "${GREEN}All body refusal tests passed${NC}"
@@ -0,0 +1,233 @@
+#!/bin/bash
+
+# Request bodies larger than client_body_buffer_size (16k here) are spooled to an
+# unlinked temporary file in $TMPDIR as they arrive, on both event backends:
+#   - raw, multipart and chunked multipart bodies reach the handler whole
+#   - the same for a CGI's stdin, with Content-Length and chunked
+#   - a body over the threshold holds a spool file while it is received, a smaller one does not
+#   - concurrent 20 MB uploads grow the peak memory of a fresh server by less than 10 MB
+# Starts its own webserv (built in the repository root) on port 8093.
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+cd "$SCRIPT_DIR/.." || exit 1
+
+GREEN='\033[0;32m'
+BLUE='\033[0;34m'
+RED='\033[0;31m'
+NC='\033[0m'
+
+PORT=8093
+FAILED=0
+CONF=$(mktemp /tmp/webserv_spooling.XXXXXX.conf)
+SPOOL_DIR=$(mktemp -d /tmp/webserv_spool.XXXXXX)
+UPLOAD_DIR=$(mktemp -d /tmp/webserv_uploads.XXXXXX)
+SERVER_PID=
+
+if [ ! -x ./webserv ]; then
+    echo -e "${RED}ERROR: ./webserv not found, run make first${NC}"
+    exit 1
+fi
+
+stop_server() {
+    if [ -n "$SERVER_PID" ]; then
+        kill -INT "$SERVER_PID" 2>/dev/null
+        wait "$SERVER_PID" 2>/dev/null
+        SERVER_PID=
+    fi
+}
+trap 'stop_server; rm -rf "$CONF" "$SPOOL_DIR" "$UPLOAD_DIR"' EXIT
+
+# start_server <event backend>
+start_server() {
+    cat > "$CONF" <<EOF
+event_backend $1;
+client_body_buffer_size 16k;
+server {
+    listen $PORT;
+    server_name localhost;
+    root ./sites/static;
+    client_max_body_size 100M;
+    location / {
+        allowed_methods GET POST;
+    }
+    location /uploads {
+        allowed_methods GET POST;
+        upload_dir $UPLOAD_DIR;
+    }
+    location /cgi-bin {
+        allowed_methods GET POST;
+        root ./sites/cgi/cgi-bin;
+        cgi_pass /usr/bin/python3;
+        cgi_ext .py;
+    }
+}
+EOF
+    TMPDIR="$SPOOL_DIR" ./webserv "$CONF" > /dev/null 2>&1 &
+    SERVER_PID=$!
+    for _ in $(seq 1 50); do
+        nc -z localhost $PORT 2>/dev/null && return 0
+        sleep 0.1
+    done
+    echo -e "${RED}ERROR: webserv did not start with event_backend $1${NC}"
+    exit 1
+}
+
+# post <target> <body bytes> <chunked: 0|1> <multipart file name or "">
+# POSTs that many random bytes (as the file of a multipart form when a name is given)
+# and prints the status code and what the handler saw: the size it reports, or whether
+# the uploaded file is identical to what was sent.
+post() {
+    python3 - "$PORT" "$UPLOAD_DIR" "$@" <<'EOF'
+import os, random, re, socket, sys
+port, upload_dir, target, size, chunked, name = int(sys.argv[1]), sys.argv[2], sys.argv[3], int(sys.argv[4]), sys.argv[5] == "1", sys.argv[6]
+# binary for uploads, text for the handlers that count characters
+payload = bytes(random.Random(size).choices(range(256) if name else b"abcdefghijklmnopqrstuvwxyz", k=size))
+body, content_type = payload, "application/octet-stream"
+if name:
+    boundary = "spooling%d" % size
+    body = (b"--%s\r\nContent-Disposition: form-data; name=\"file\"; filename=\"%s\"\r\n"
+            b"Content-Type: application/octet-stream\r\n\r\n" % (boundary.encode(), name.encode())
+            + payload + b"\r\n--%s--\r\n" % boundary.encode())
+    content_type = "multipart/form-data; boundary=" + boundary
+head = "POST %s HTTP/1.1\r\nHost: localhost\r\nContent-Type: %s\r\nConnection: close\r\n" % (target, content_type)
+if chunked:
+    head += "Transfer-Encoding: chunked\r\n\r\n"
+    body = b"".join(b"%x\r\n%s\r\n" % (len(body[i:i + 65536]), body[i:i + 65536]) for i in range(0, len(body), 65536)) + b"0\r\n\r\n"
+else:
+    head += "Content-Length: %d\r\n\r\n" % len(body)
+sock = socket.create_connection(("127.0.0.1", port))
+sock.settimeout(20)
+response = b""
+try:
+    sock.sendall(head.encode() + body)
+    while True:
+        data = sock.recv(65536)
+        if not data:
+            break
+        response += data
+except OSError as e:
+    print("error: %s" % e)
+    sys.exit()
+result = [(response.split(b" ", 2)[1:2] or [b"no response"])[0].decode()]
+if name:
+    path = os.path.join(upload_dir, name)
+    result.append("identical" if os.path.exists(path) and open(path, "rb").read() == payload else "differs")
+else:
+    received = re.search(rb"Received (\d+) bytes|Data Received:</span> <span class='value'>(\d+) bytes", response)
+    result.append("%s bytes" % (received.group(1) or received.group(2)).decode() if received else "no size")
+print(" | ".join(result))
+EOF
+}
+
+# spool_files <body bytes>
+# Starts sending a body of that size, and prints how many spool files the server holds
+# once a tenth of it has arrived, then the status code of the response to the whole body.
+spool_files() {
+    python3 - "$PORT" "$SERVER_PID" "$SPOOL_DIR" "$1" <<'EOF'
+import os, socket, sys, time
+port, pid, spool_dir, size = int(sys.argv[1]), sys.argv[2], sys.argv[3], int(sys.argv[4])
+sock = socket.create_connection(("127.0.0.1", port))
+sock.settimeout(10)
+sock.sendall(b"POST / HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\nContent-Length: %d\r\n\r\n" % size)
+sock.sendall(b"s" * (size // 10))
+time.sleep(0.5)
+files = 0
+for fd in os.listdir("/proc/%s/fd" % pid):
+    try:
+        files += os.readlink("/proc/%s/fd/%s" % (pid, fd)).startswith(spool_dir + "/")
+    except OSError:
+        pass
+sock.sendall(b"s" * (size - size // 10))
+response = b""
+while True:
+    data = sock.recv(65536)
+    if not data:
+        break
+    response += data
+print("%d | %s" % (files, (response.split(b" ", 2)[1:2] or [b"no response"])[0].decode()))
+EOF
+}
+
+# peak_growth <clients> <body bytes>
+# POSTs that many bodies at once and prints by how many MB the server's peak memory grew.
+peak_growth() {
+    python3 - "$PORT" "$SERVER_PID" "$1" "$2" <<'EOF'
+import socket, sys, threading
+port, pid, clients, size = int(sys.argv[1]), sys.argv[2], int(sys.argv[3]), int(sys.argv[4])
+def peak():
+    for line in open("/proc/%s/status" % pid):
+        if line.startswith("VmHWM:"):
+            return int(line.split()[1]) // 1024
+before = peak()
+def upload():
+    sock = socket.create_connection(("127.0.0.1", port))
+    sock.settimeout(30)
+    sock.sendall(b"POST / HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\nContent-Length: %d\r\n\r\n" % size)
+    chunk = b"m" * 65536
+    for _ in range(size // len(chunk)):
+        sock.sendall(chunk)
+    sock.sendall(b"m" * (size % len(chunk)))
+    while sock.recv(65536):
+        pass
+threads = [threading.Thread(target=upload) for _ in range(clients)]
+for thread in threads:
+    thread.start()
+for thread in threads:
+    thread.join()
+print(peak() - before)
+EOF
+}
+
+# check <description> <expected output> <output>
+check() {
+    if [ "$3" != "$2" ]; then
+        echo -e "${RED}✗ $1: expected \"$2\", got \"$3\"${NC}"
+        FAILED=$((FAILED + 1))
+        return
+    fi
+    echo -e "${GREEN}✓ $1: $2${NC}"
+}
+
+for backend in epoll io_uring; do
+    echo -e "${BLUE}================================================${NC}"
+    echo -e "${BLUE}  Body spooling - event_backend $backend${NC}"
+    echo -e "${BLUE}================================================${NC}\n"
+    start_server "$backend"
+
+    check "3 MB raw body" "201 | 3000000 bytes" "$(post / 3000000 0 "")"
+    check "5 byte raw body" "201 | 5 bytes" "$(post / 5 0 "")"
+    check "3 MB multipart upload" "200 | identical" "$(post /uploads 3000000 0 big.bin)"
+    check "5 KB multipart upload" "200 | identical" "$(post /uploads 5000 0 small.bin)"
+    check "3 MB chunked multipart upload" "200 | identical" "$(post /uploads 3000000 1 chunked.bin)"
+    check "2 MB body to a CGI" "200 | 2000000 bytes" "$(post /cgi-bin/test_chunked.py 2000000 0 "")"
+    check "2 MB chunked body to a CGI" "200 | 2000000 bytes" "$(post /cgi-bin/test_chunked.py 2000000 1 "")"
+
+    check "spool file while a 1 MB body arrives" "1 | 201" "$(spool_files 1000000)"
+    check "no spool file for a 10 KB body" "0 | 201" "$(spool_files 10000)"
+
+    # on a fresh server, so that the peak left by the bodies above does not hide this one
+    stop_server
+    start_server "$backend"
+    growth=$(peak_growth 4 20000000)
+    if [ -n "$growth" ] && [ "$growth" -lt 10 ]; then
+        echo -e "${GREEN}✓ 4 concurrent 20 MB bodies: peak memory grew by ${growth} MB${NC}"
+    else
+        echo -e "${RED}✗ 4 concurrent 20 MB bodies: peak memory grew by ${growth:-?} MB, expected under 10${NC}"
+        FAILED=$((FAILED + 1))
+    fi
+
+    if [ -n "$(ls -A "$SPOOL_DIR")" ]; then
+        echo -e "${RED}✗ spool files left in $SPOOL_DIR${NC}"
+        FAILED=$((FAILED + 1))
+    fi
+
+    stop_server
+    rm -f "$UPLOAD_DIR"/*
+    echo
+done
+
+if [ $FAILED -ne 0 ]; then
+    echo -e "${RED}$FAILED test(s) failed${NC}"
+    exit 1
+fi
+echo -e "${GREEN}All body spooling tests passed${NC}"
@@ -0,0 +1,117 @@
+#!/bin/bash
+
+# Chunked request bodies: chunk extensions, trailers, lines split across reads
+# and the limits of the chunked framing (run against configuration/webserv.conf)
+#   - a chunk size that does not fit in size_t           -> 413
+#   - a chunk-size line longer than 4 KB                  -> 400
+#   - a trailer section longer than 8 KB                  -> 431
+
+GREEN='\033[0;32m'
+BLUE='\033[0;34m'
+YELLOW='\033[1;33m'
+RED='\033[0;31m'
+NC='\033[0m'
+
+PORT=8081
+TARGET=/cgi-bin/test_chunked.py
+FAILED=0
+
+if ! nc -z localhost $PORT 2>/dev/null; then
+    echo -e "${RED}ERROR: Webserver is not running on port $PORT${NC}"
+    echo -e "${YELLOW}Please start webserv first: ./webserv configuration/webserv.conf${NC}"
+    exit 1
+fi
+
+HEAD="POST $TARGET HTTP/1.1\r\nHost: localhost:$PORT\r\nTransfer-Encoding: chunked\r\nConnection: close\r\n\r\n"
+
+# Print each argument as a separate write, pausing in between so that each
+# one reaches the server in a read of its own
+send_split() {
+    local first=1
+    for part in "$@"; do
+        if [ $first -eq 0 ]; then
+            sleep 0.3
+        fi
+        first=0
+        echo -ne "$part"
+    done
+}
+
+# check <description> <expected status> <response> [expected body size]
+check() {
+    local status
+    status=$(echo "$3" | head -n 1 | awk '{print $2}')
+    if [ "$status" != "$2" ]; then
+        echo -e "${RED}✗ $1: expected $2, got ${status:-no response}${NC}"
+        FAILED=$((FAILED + 1))
+        return
+    fi
+    if [ -n "$4" ] && ! echo "$3" | grep -q "Data Received:</span> <span class='value'>$4 bytes"; then
+        echo -e "${RED}✗ $1: $2, but the script did not receive $4 bytes${NC}"
+        FAILED=$((FAILED + 1))
+        return
+    fi
+    echo -e "${GREEN}✓ $1: $2${NC}"
+}
+
+EXT_4000=$(python3 -c "print('x' * 4000, end='')")
+EXT_5000=$(python3 -c "print('x' * 5000, end='')")
+FIELD_3000=$(python3 -c "print('v' * 3000, end='')")
+
+echo -e "${BLUE}================================================${NC}"
+echo -e "${BLUE}  Chunked Encoding - extensions and trailers${NC}"
+echo -e "${BLUE}================================================${NC}\n"
+
+response=$(send_split "$HEAD" "4;name=value\r\nWiki\r\n5;flag\r\npedia\r\n0;last=\"yes\"\r\n\r\n" | nc localhost $PORT)
+check "chunk extensions are ignored" 200 "$response" 9
+
+response=$(send_split "$HEAD" "1;$EXT_4000\r\nA\r\n0\r\n\r\n" | nc localhost $PORT)
+check "chunk-size line just under 4 KB" 200 "$response" 1
+
+response=$(send_split "$HEAD" "4\r\nWiki\r\n0\r\nX-Checksum: 5f3a\r\nX-Note: trailers are discarded\r\n\r\n" | nc localhost $PORT)
+check "trailer fields" 200 "$response" 4
+
+response=$(send_split "$HEAD" "4\r\nWiki\r\n0\r\nX-One: $FIELD_3000\r\nX-Two: $FIELD_3000\r\n\r\n" | nc localhost $PORT)
+check "trailer section just under 8 KB" 200 "$response" 4
+
+echo -e "\n${BLUE}================================================${NC}"
+echo -e "${BLUE}  Chunked Encoding - split across reads${NC}"
+echo -e "${BLUE}================================================${NC}\n"
+
+response=$(send_split "$HEAD" "4\r" "\nWiki\r" "\n5\r\npedia\r\n0\r\n\r" "\n" | nc localhost $PORT)
+check "CRLF split after CR" 200 "$response" 9
+
+response=$(send_split "$HEAD" "4" "\r\nWi" "ki" "\r\n0" "\r\n" "\r\n" | nc localhost $PORT)
+check "size line, data and last chunk split" 200 "$response" 4
+
+response=$(send_split "$HEAD" "4;na" "me=va" "lue\r\nWiki\r\n0\r\nX-Check" "sum: 5f3a\r" "\n\r\n" | nc localhost $PORT)
+check "extension and trailer field split" 200 "$response" 4
+
+echo -e "\n${BLUE}================================================${NC}"
+echo -e "${BLUE}  Chunked Encoding - limits${NC}"
+echo -e "${BLUE}================================================${NC}\n"
+
+response=$(send_split "$HEAD" "1ffffffffffffffff\r\nA\r\n0\r\n\r\n" | nc localhost $PORT)
+check "chunk size overflowing size_t" 413 "$response"
+
+response=$(send_split "$HEAD" "1fffff" "fffffffffff\r\n" | nc localhost $PORT)
+check "chunk size overflowing size_t, split" 413 "$response"
+
+response=$(send_split "$HEAD" "1;$EXT_5000\r\nA\r\n0\r\n\r\n" | nc localhost $PORT)
+check "chunk-size line over 4 KB" 400 "$response"
+
+response=$(send_split "$HEAD" "1;$EXT_4000" "$EXT_4000" | nc localhost $PORT)
+check "chunk-size line over 4 KB, split" 400 "$response"
+
+response=$(send_split "$HEAD" "4\r\nWiki\r\n0\r\nX-One: $FIELD_3000\r\nX-Two: $FIELD_3000\r\nX-Three: $FIELD_3000\r\n\r\n" | nc localhost $PORT)
+check "trailer section over 8 KB" 431 "$response"
+
+response=$(send_split "$HEAD" "4\r\nWiki\r\n0\r\n" "X-One: $FIELD_3000\r\n" "X-Two: $FIELD_3000\r\n" "X-Three: $FIELD_3000\r\n" "\r\n" | nc localhost $PORT)
+check "trailer section over 8 KB, split" 431 "$response"
+
+echo
+if [ $FAILED -ne 0 ]; then
+    echo -e "${RED}$FAILED test(s) failed${NC}"
+    exit 1
+fi
+echo -e "${GREEN}All chunked encoding tests passed${NC}"
@@ -0,0 +1,195 @@
+#!/bin/bash
+
+# Request head limits, at their defaults and at configured values
+#   - request line longer than the large_client_header_buffers size  -> 414
+#   - request-target longer than client_max_uri_size                 -> 414
+#   - header field longer than the large_client_header_buffers size  -> 431
+#   - head longer than all the large_client_header_buffers           -> 431
+#   - one more field than client_max_header_fields                   -> 431
+#   - a header field name longer than 1 KB                            -> 431
+#   - a field name repeated, in any case                              -> 400
+# Starts its own webserv (built in the repository root) on port 8090.
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+cd "$SCRIPT_DIR/.." || exit 1
+
+GREEN='\033[0;32m'
+BLUE='\033[0;34m'
+YELLOW='\033[1;33m'
+RED='\033[0;31m'
+NC='\033[0m'
+
+PORT=8090
+FAILED=0
+CONF=$(mktemp /tmp/webserv_limits.XXXXXX.conf)
+SERVER_PID=
+
+if [ ! -x ./webserv ]; then
+    echo -e "${RED}ERROR: ./webserv not found, run make first${NC}"
+    exit 1
+fi
+
+stop_server() {
+    if [ -n "$SERVER_PID" ]; then
+        kill -INT "$SERVER_PID" 2>/dev/null
+        wait "$SERVER_PID" 2>/dev/null
+        SERVER_PID=
+    fi
+}
+trap 'stop_server; rm -f "$CONF"' EXIT
+
+# start_server <main context directives>
+start_server() {
+    {
+        echo "$1"
+        echo "server {"
+        echo "    listen $PORT;"
+        echo "    server_name localhost;"
+        echo "    root ./sites/static;"
+        echo "    index index.html;"
+        echo "    location / {"
+        echo "        allowed_methods GET;"
+        echo "    }"
+        echo "}"
+    } > "$CONF"
+    ./webserv "$CONF" > /dev/null 2>&1 &
+    SERVER_PID=$!
+    for _ in $(seq 1 50); do
+        nc -z localhost $PORT 2>/dev/null && return 0
+        sleep 0.1
+    done
+    echo -e "${RED}ERROR: webserv did not start with:${NC}\n$1"
+    exit 1
+}
+
+# Print each argument as a separate write, pausing in between so that each
+# one reaches the server in a read of its own
+send_split() {
+    local first=1
+    for part in "$@"; do
+        if [ $first -eq 0 ]; then
+            sleep 0.3
+        fi
+        first=0
+        echo -ne "$part"
+    done
+}
+
+# check <description> <expected status> <response>
+check() {
+    local status
+    status=$(echo "$3" | head -n 1 | awk '{print $2}')
+    if [ "$status" != "$2" ]; then
+        echo -e "${RED}✗ $1: expected $2, got ${status:-no response}${NC}"
+        FAILED=$((FAILED + 1))
+        return
+    fi
+    echo -e "${GREEN}✓ $1: $2${NC}"
+}
+
+repeat() {
+    python3 -c "print('$1' * $2, end='')"
+}
+
+# fields <count> <value length>: that many "X-Field-i: vvv" lines
+fields() {
+    python3 -c "print(''.join('X-Field-%d: %s\\\\r\\\\n' % (i, 'v' * $2) for i in range($1)), end='')"
+}
+
+# run_limits <line size> <head size> <uri size> <field count>
+run_limits() {
+    local line=$1 head=$2 uri=$3 count=$4
+    local response field_value half
+
+    # a target of uri bytes is looked up (404), one more byte is refused
+    response=$(send_split "GET /$(repeat a $((uri - 1))) HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n" | nc localhost $PORT)
+    check "target of $uri bytes" 404 "$response"
+    response=$(send_split "GET /$(repeat a "$uri") HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n" | nc localhost $PORT)
+    check "target of $((uri + 1)) bytes" 414 "$response"
+
+    # a request line that never ends is refused once it is longer than a buffer
+    half=$(( (line + 2) / 2 ))
+    response=$(send_split "GET / " "$(repeat ' ' "$half")" "$(repeat ' ' "$half")" | nc localhost $PORT)
+    check "request line over $line bytes, split" 414 "$response"
+
+    # "X-Long: " and the value make a field of exactly line bytes
+    field_value=$(repeat v $((line - 8)))
+    response=$(send_split "GET / HTTP/1.1\r\nHost: localhost\r\nX-Long: $field_value\r\nConnection: close\r\n\r\n" | nc localhost $PORT)
+    check "header field of $line bytes" 200 "$response"
+    response=$(send_split "GET / HTTP/1.1\r\nHost: localhost\r\nX-Long: ${field_value}v\r\nConnection: close\r\n\r\n" | nc localhost $PORT)
+    check "header field of $((line + 1)) bytes" 431 "$response"
+    response=$(send_split "GET / HTTP/1.1\r\nHost: localhost\r\nX-Long: " "$field_value" "vvv" | nc localhost $PORT)
+    check "header field over $line bytes, split" 431 "$response"
+
+    # fields of half a buffer: as many as fit in the head, then enough to overflow it
+    local per_field=$((line / 2)) under over
+    under=$(( (head - 256) / (per_field + 2) ))
+    over=$(( head / (per_field + 2) + 1 ))
+    response=$(send_split "GET / HTTP/1.1\r\nHost: localhost\r\n$(fields "$under" $((per_field - 13)))Connection: close\r\n\r\n" | nc localhost $PORT)
+    check "head under $head bytes" 200 "$response"
+    response=$(send_split "GET / HTTP/1.1\r\nHost: localhost\r\n$(fields "$over" $((per_field - 13)))Connection: close\r\n\r\n" | nc localhost $PORT)
+    check "head over $head bytes" 431 "$response"
+    response=$(send_split "GET / HTTP/1.1\r\nHost: localhost\r\n" "$(fields "$over" $((per_field - 13)))" | nc localhost $PORT)
+    check "head over $head bytes, split" 431 "$response"
+
+    # Host, Connection and count - 2 more fields are accepted, one more is refused
+    response=$(send_split "GET / HTTP/1.1\r\nHost: localhost\r\n$(fields $((count - 2)) 1)Connection: close\r\n\r\n" | nc localhost $PORT)
+    check "$count header fields" 200 "$response"
+    response=$(send_split "GET / HTTP/1.1\r\nHost: localhost\r\n$(fields $((count - 1)) 1)Connection: close\r\n\r\n" | nc localhost $PORT)
+    check "$((count + 1)) header fields" 431 "$response"
+}
+
+echo -e "${BLUE}================================================${NC}"
+echo -e "${BLUE}  Head limits - defaults${NC}"
+echo -e "${BLUE}  (large_client_header_buffers 2 4k, client_max_uri_size 2k,${NC}"
+echo -e "${BLUE}   client_max_header_fields 64)${NC}"
+echo -e "${BLUE}================================================${NC}\n"
+
+start_server ""
+run_limits 4096 8192 2048 64
+
+echo -e "\n${YELLOW}A header field name may be 1 KB long${NC}"
+response=$(send_split "GET / HTTP/1.1\r\nHost: localhost\r\nX$(repeat n 1023): v\r\nConnection: close\r\n\r\n" | nc localhost $PORT)
+check "field name of 1024 bytes" 200 "$response"
+response=$(send_split "GET / HTTP/1.1\r\nHost: localhost\r\nX$(repeat n 1024): v\r\nConnection: close\r\n\r\n" | nc localhost $PORT)
+check "field name of 1025 bytes" 431 "$response"
+
+echo -e "\n${YELLOW}A header field may appear only once${NC}"
+for repeated in "Host: localhost" "Content-Length: 0" "content-length: 0" "Accept: */*" "x-field-3: w"; do
+    response=$(send_split "GET / HTTP/1.1\r\nHost: localhost\r\nContent-Length: 0\r\nAccept: */*\r\n$(fields 20 1)$repeated\r\nConnection: close\r\n\r\n" | nc localhost $PORT)
+    check "repeated \"${repeated%%:*}\"" 400 "$response"
+done
+stop_server
+
+echo -e "\n${BLUE}================================================${NC}"
+echo -e "${BLUE}  Head limits - configured${NC}"
+echo -e "${BLUE}  (large_client_header_buffers 3 2k, client_max_uri_size 1k,${NC}"
+echo -e "${BLUE}   client_max_header_fields 10)${NC}"
+echo -e "${BLUE}================================================${NC}\n"
+
+start_server "large_client_header_buffers 3 2k;
+client_max_uri_size 1k;
+client_max_header_fields 10;"
+run_limits 2048 6144 1024 10
+stop_server
+
+echo -e "\n${YELLOW}Invalid values are refused when the configuration is loaded${NC}"
+for directive in "client_max_header_fields 0;" "client_max_header_fields 129;" \
+                 "large_client_header_buffers 2 512;" "client_max_uri_size 0;"; do
+    echo "$directive server { listen $PORT; root ./sites/static; location / { allowed_methods GET; } }" > "$CONF"
+    timeout 2 ./webserv "$CONF" > /dev/null 2>&1
+    status=$?
+    if [ $status -eq 0 ] || [ $status -eq 124 ]; then
+        echo -e "${RED}✗ $directive was accepted${NC}"
+        FAILED=$((FAILED + 1))
+    else
+        echo -e "${GREEN}✓ $directive refused${NC}"
+    fi
+done
+
+echo
+if [ $FAILED -ne 0 ]; then
+    echo -e "${RED}$FAILED test(s) failed${NC}"
+    exit 1
+fi
+echo -e "${GREEN}All head limit tests passed${NC}"
@@ -0,0 +1,182 @@
+#!/bin/bash
+
+# HTTP/1.1 pipelining: several requests sent in one write are all answered, in order,
+# on both event backends. Each pipelined response must be the one the same request
+# gets on a connection of its own (Date aside).
+#   - GETs of several files in one write
+#   - a POST with a body between GETs
+#   - the same, cut in the middle of a request and sent in two writes
+#   - requests after "Connection: close", or after an error response, are not answered
+# Starts its own webserv (built in the repository root) on port 8092.
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+cd "$SCRIPT_DIR/.." || exit 1
+
+GREEN='\033[0;32m'
+BLUE='\033[0;34m'
+RED='\033[0;31m'
+NC='\033[0m'
+
+PORT=8092
+FAILED=0
+CONF=$(mktemp /tmp/webserv_pipelining.XXXXXX.conf)
+SERVER_PID=
+
+if [ ! -x ./webserv ]; then
+    echo -e "${RED}ERROR: ./webserv not found, run make first${NC}"
+    exit 1
+fi
+
+stop_server() {
+    if [ -n "$SERVER_PID" ]; then
+        kill -INT "$SERVER_PID" 2>/dev/null
+        wait "$SERVER_PID" 2>/dev/null
+        SERVER_PID=
+    fi
+}
+trap 'stop_server; rm -f "$CONF"' EXIT
+
+# start_server <event backend>
+start_server() {
+    cat > "$CONF" <<EOF
+event_backend $1;
+server {
+    listen $PORT;
+    server_name localhost;
+    root ./sites/static;
+    index index.html;
+    location / {
+        allowed_methods GET POST;
+    }
+}
+EOF
+    ./webserv "$CONF" > /dev/null 2>&1 &
+    SERVER_PID=$!
+    for _ in $(seq 1 50); do
+        nc -z localhost $PORT 2>/dev/null && return 0
+        sleep 0.1
+    done
+    echo -e "${RED}ERROR: webserv did not start with event_backend $1${NC}"
+    exit 1
+}
+
+# pipeline <split offset, 0 for one write> <request>...
+# Sends the requests (\r\n escapes allowed) back to back on one connection and prints
+# "N responses in order" when the responses read until the server closes are those
+# of each request sent alone, up to the first one answered with "Connection: close".
+pipeline() {
+    python3 - "$PORT" "$@" <<'EOF'
+import socket, sys, time
+port, split = int(sys.argv[1]), int(sys.argv[2])
+requests = [r.encode().decode("unicode_escape").encode("latin-1") for r in sys.argv[3:]]
+
+def read_response(sock, data):
+    """One response from data and the socket: (response, what follows it)."""
+    while b"\r\n\r\n" not in data:
+        more = sock.recv(65536)
+        if not more:
+            return None, data
+        data += more
+    head, rest = data.split(b"\r\n\r\n", 1)
+    length = 0
+    for line in head.split(b"\r\n")[1:]:
+        name, _, value = line.partition(b":")
+        if name.strip().lower() == b"content-length":
+            length = int(value)
+    while len(rest) < length:
+        more = sock.recv(65536)
+        if not more:
+            return None, data
+        rest += more
+    return head + b"\r\n\r\n" + rest[:length], rest[length:]
+
+def without_date(response):
+    return b"\r\n".join(l for l in response.split(b"\r\n") if not l.lower().startswith(b"date:"))
+
+expected = []
+for request in requests:
+    sock = socket.create_connection(("127.0.0.1", port))
+    sock.settimeout(10)
+    sock.sendall(request)
+    response, _ = read_response(sock, b"")
+    sock.close()
+    expected.append(without_date(response or b""))
+    if response is None or b"\r\nConnection: close\r\n" in response.split(b"\r\n\r\n", 1)[0] + b"\r\n":
+        break
+
+sock = socket.create_connection(("127.0.0.1", port))
+sock.settimeout(10)
+stream = b"".join(requests)
+try:
+    if split:
+        sock.sendall(stream[:split])
+        time.sleep(0.3)
+        sock.sendall(stream[split:])
+    else:
+        sock.sendall(stream)
+    received, data = [], b""
+    while True:
+        response, data = read_response(sock, data)
+        if response is None:
+            break
+        received.append(without_date(response))
+except OSError as e:
+    print("error: %s" % e)
+    sys.exit()
+for i, response in enumerate(received):
+    if i >= len(expected) or response != expected[i]:
+        print("response %d is %r" % (i + 1, response.split(b"\r\n", 1)[0].decode()))
+        sys.exit()
+if data or len(received) != len(expected):
+    print("%d responses, %d expected" % (len(received), len(expected)))
+    sys.exit()
+print("%d responses in order" % len(received))
+EOF
+}
+
+# check <description> <expected output> <output>
+check() {
+    if [ "$3" != "$2" ]; then
+        echo -e "${RED}✗ $1: expected \"$2\", got \"$3\"${NC}"
+        FAILED=$((FAILED + 1))
+        return
+    fi
+    echo -e "${GREEN}✓ $1: $2${NC}"
+}
+
+GET_INDEX="GET /index.html HTTP/1.1\r\nHost: localhost\r\n\r\n"
+GET_ABOUT="GET /about.html HTTP/1.1\r\nHost: localhost\r\n\r\n"
+GET_MISSING="GET /missing.html HTTP/1.1\r\nHost: localhost\r\n\r\n"
+GET_CONTACT_CLOSE="GET /contact.html HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n"
+POST_BODY="POST / HTTP/1.1\r\nHost: localhost\r\nContent-Length: 1000\r\n\r\n$(python3 -c "print('p' * 1000, end='')")"
+
+for backend in epoll io_uring; do
+    echo -e "${BLUE}================================================${NC}"
+    echo -e "${BLUE}  Pipelining - event_backend $backend${NC}"
+    echo -e "${BLUE}================================================${NC}\n"
+    start_server "$backend"
+
+    check "GETs in one write" "4 responses in order" \
+        "$(pipeline 0 "$GET_INDEX" "$GET_ABOUT" "$GET_INDEX" "$GET_CONTACT_CLOSE")"
+    check "POST between GETs in one write" "4 responses in order" \
+        "$(pipeline 0 "$GET_ABOUT" "$POST_BODY" "$GET_INDEX" "$GET_CONTACT_CLOSE")"
+    check "eight requests in one write" "8 responses in order" \
+        "$(pipeline 0 "$GET_INDEX" "$GET_ABOUT" "$GET_INDEX" "$GET_ABOUT" "$GET_ABOUT" "$GET_INDEX" "$GET_ABOUT" "$GET_CONTACT_CLOSE")"
+    check "request cut between two writes" "4 responses in order" \
+        "$(pipeline 60 "$GET_INDEX" "$POST_BODY" "$GET_ABOUT" "$GET_CONTACT_CLOSE")"
+    check "body cut between two writes" "4 responses in order" \
+        "$(pipeline 140 "$GET_INDEX" "$POST_BODY" "$GET_ABOUT" "$GET_CONTACT_CLOSE")"
+    check "nothing answered after Connection: close" "2 responses in order" \
+        "$(pipeline 0 "$GET_INDEX" "$GET_CONTACT_CLOSE" "$GET_ABOUT" "$GET_INDEX")"
+    check "nothing answered after a 404" "2 responses in order" \
+        "$(pipeline 0 "$GET_INDEX" "$GET_MISSING" "$GET_ABOUT" "$GET_CONTACT_CLOSE")"
+
+    stop_server
+    echo
+done
+
+if [ $FAILED -ne 0 ]; then
+    echo -e "${RED}$FAILED test(s) failed${NC}"
+    exit 1
+fi
+echo -e "${GREEN}All pipelining tests passed${NC}"
@@ -1,4 +1,8 @@
 #include "CGI.hpp"
+#include "Reactor.hpp"
+
+#include <csignal>
+#include <fcntl.h>
 
 /**
  * @brief Construct a new CGI::CGI object
@@ -7,29 +11,38 @@
  * @param lc 
  */
 CGI::CGI(const HttpRequest& req, const config::LocationConfig& lc)
-:_cgiPass(lc.cgiPass), _cgiExt(lc.cgiExt), _method(req.getMethod()), _query(""),
-_body(req.getBody()), _header(req.getHeaders()), _contentType(""), _serverName("")
+:_cgiPass(lc.cgiPass), _cgiExt(lc.cgiExt), _method(req.getMethod()), _query(req.getQuery()),
+_body(req.getBody()), _contentType(req.getHeader(HEADER_CONTENT_TYPE)), _serverName(req.getHeader(HEADER_HOST)),
+_pid(-1), _stdinFd(-1), _stdoutFd(-1)
 {
     std::string root = lc.root;
     if (root.ends_with("/"))
         root.erase(root.size() - 1);
-    std::string raw = req.getPath();
-    size_t pos = raw.find('?');
     std::string locationUri = lc.path;
     if(root.find(locationUri) != std::string::npos)
         root = "./sites/cgi" ;
-    if(pos != std::string::npos){
-        _scriptPath = root + raw.substr(0, pos);
-        _query = raw.substr(pos + 1);
-    }
-    else{
-        _scriptPath = root + raw;
-        _query = "";
-    }
-    if (_header.count("content-type"))
-        _contentType = _header.at("content-type");
-    if (_header.count("host"))
-        _serverName = _header.at("host");
+    _scriptPath = root;
+    _scriptPath += req.getPath();
+}
+
+/**
+ * @brief kill and reap a script still running, e.g. when its client went away
+ */
+CGI::~CGI()
+{
+	closeFd(_stdinFd);
+	closeFd(_stdoutFd);
+	if (_pid > 0){
+		kill(_pid, SIGKILL);
+		waitpid(_pid, NULL, 0);
+	}
+}
+
+void CGI::closeFd(int& fd)
+{
+	if (fd >= 0)
+		close(fd);
+	fd = -1;
 }
 
 bool CGI::isAllowedCgi()const
@@ -43,22 +56,67 @@ bool CGI::isAllowedCgi()const
 	return true;
 }
 
-std::string CGI::execute()
+/**
+ * @brief run the script and collect its output
+ *
+ * @return the raw output of the script, empty on failure
+ *
+ * @note the body is written and the output read through non-blocking pipes, both at
+ *       once: while the script runs the coroutine is suspended on whichever of them
+ *       can make progress, and the event loop keeps serving other clients. Its exit
+ *       is awaited the same way.
+ * @note a body spooled to a file is not written at all: the file is the script's stdin.
+ */
+Task<std::string> CGI::execute()
 {
 	int	stdin_pipe[2];
 	int stdout_pipe[2];
 
-	if(pipe(stdin_pipe) < 0 || pipe(stdout_pipe) < 0){
+	if(pipe(stdin_pipe) < 0){
+		std::cerr << "[CGI] pipe() failed: " << strerror(errno) << std::endl;
+		co_return "";
+	}
+	if(pipe(stdout_pipe) < 0){
 		std::cerr << "[CGI] pipe() failed: " << strerror(errno) << std::endl;
-		return "";
+		close(stdin_pipe[0]);
+		close(stdin_pipe[1]);
+		co_return "";
+	}
+	int childStdin = stdin_pipe[0];
+	if (!_body.inMemory()){
+		childStdin = _body.fd();
+		lseek(childStdin, 0, SEEK_SET);
 	}
+	// built before fork(): with several event loop threads the child must not allocate
+	std::vector<std::string> envStrings;
+	std::vector<char*> env;
+	envStrings.push_back("REQUEST_METHOD="+_method);
+	envStrings.push_back("QUERY_STRING="+_query);
+	envStrings.push_back("CONTENT_LENGTH="+std::to_string(_body.size()));
+	envStrings.push_back("SERVER_PROTOCOL=HTTP/1.1");
+	envStrings.push_back("SCRIPT_FILENAME="+_scriptPath);
+	envStrings.push_back("PATH_INFO="+_scriptPath);
+	envStrings.push_back("CONTENT_TYPE="+_contentType);
+	envStrings.push_back("SERVER_NAME="+_serverName);
+	envStrings.push_back("REDIRECT_STATUS=200");
+	for(auto& s : envStrings)
+		env.push_back(const_cast<char *>(s.c_str()));
+	env.push_back(NULL);
+	std::vector<char*> argv;
+	argv.push_back(const_cast<char *>(_cgiPass.c_str()));
+	argv.push_back(const_cast<char *>(_scriptPath.c_str()));
+	argv.push_back(NULL);
 	pid_t pid = fork();
 	if(pid < 0){
 		std::cerr << "[CGI] fork() failed: " << strerror(errno) << std::endl;
-		return "";
+		close(stdin_pipe[0]);
+		close(stdin_pipe[1]);
+		close(stdout_pipe[0]);
+		close(stdout_pipe[1]);
+		co_return "";
 	}
 	if(pid == 0){
-		if(dup2(stdin_pipe[0], STDIN_FILENO) < 0 || dup2(stdout_pipe[1], STDOUT_FILENO) < 0){
+		if(dup2(childStdin, STDIN_FILENO) < 0 || dup2(stdout_pipe[1], STDOUT_FILENO) < 0){
 			std::cerr << "[CGI] dup2() failed: " << strerror(errno) << std::endl;
 			_exit(42);
 		}
@@ -68,69 +126,67 @@ std::string CGI::execute()
 			if(fd != STDIN_FILENO && fd != STDOUT_FILENO && fd != STDERR_FILENO)
 				close(fd);
 		}
-		std::vector<std::string> envStrings;
-		std::vector<char*> env;
-		envStrings.push_back("REQUEST_METHOD="+_method);
-		envStrings.push_back("QUERY_STRING="+_query);
-		envStrings.push_back("CONTENT_LENGTH="+std::to_string(_body.size()));
-		envStrings.push_back("SERVER_PROTOCOL=HTTP/1.1");
-		envStrings.push_back("SCRIPT_FILENAME="+_scriptPath);
-		envStrings.push_back("PATH_INFO="+_scriptPath);
-		envStrings.push_back("CONTENT_TYPE="+_contentType);
-		envStrings.push_back("SERVER_NAME="+_serverName);
-		envStrings.push_back("REDIRECT_STATUS=200");
-		for(auto& s : envStrings)
-			env.push_back(const_cast<char *>(s.c_str()));
-		env.push_back(NULL);
-		std::vector<char*> argv;
-		argv.push_back(const_cast<char *>(_cgiPass.c_str()));
-		argv.push_back(const_cast<char *>(_scriptPath.c_str()));
-		argv.push_back(NULL);
 		execve(_cgiPass.c_str(), argv.data(), env.data());
 		std::cerr << "[CGI] execve failed: " << strerror(errno) << std::endl;
 		_exit(42);
 	}
-	else{
-		close(stdout_pipe[1]);
-		close(stdin_pipe[0]);
-		if(_method=="POST" && !_body.empty()){
-			size_t total = 0;
-			size_t len = _body.size();
-			while(total < len)
-			{
-				ssize_t written = write(stdin_pipe[1], _body.c_str() + total, len - total);
-				if(written < 0)
-				{
-					std::cerr << "[CGI] write() failed\n";
-					break;
-				}
-				total += written;
-			}
-		}
-		close(stdin_pipe[1]);
-		char buffer[4096];
-		std::string output;
-		ssize_t bytes;
-		while(true)
+	_pid = pid;
+	close(stdout_pipe[1]);
+	close(stdin_pipe[0]);
+	_stdinFd = stdin_pipe[1];
+	_stdoutFd = stdout_pipe[0];
+	fcntl(_stdinFd, F_SETFL, O_NONBLOCK);
+	fcntl(_stdoutFd, F_SETFL, O_NONBLOCK);
+	std::string_view body;
+	if(_method=="POST" && _body.inMemory())
+		body = _body.view();
+	size_t fed = 0;
+	if(fed == body.size())
+		closeFd(_stdinFd);
+	char buffer[4096];
+	std::string output;
+	while(true)
+	{
+		// the body is fed as far as the pipe takes it, the output read as it comes: a script
+		// writing before it has read all of its input never waits for the server
+		while(_stdinFd >= 0)
 		{
-			bytes = read(stdout_pipe[0], buffer, sizeof(buffer));
-			if(bytes > 0)
-				output.append(buffer, bytes);
-			else if (bytes == 0)
-				break;
-			else
-			{
-				std::cerr << "[CGI] read() failed\n";
+			ssize_t written = write(_stdinFd, body.data() + fed, body.size() - fed);
+			if(written >= 0)
+				fed += written;
+			else if(errno == EAGAIN || errno == EWOULDBLOCK)
 				break;
+			else if(errno != EINTR){
+				std::cerr << "[CGI] write() failed\n";
+				closeFd(_stdinFd);
 			}
+			if(fed == body.size())
+				closeFd(_stdinFd);
 		}
-		close(stdout_pipe[0]);
-		int status;
-		waitpid(pid, &status, 0);
-		if(WIFEXITED(status) && WEXITSTATUS(status) == 42){
-			std::cerr << "[CGI] child process failed"<<std::endl;
-			return "";
+		ssize_t bytes = read(_stdoutFd, buffer, sizeof(buffer));
+		if(bytes > 0)
+			output.append(buffer, bytes);
+		else if (bytes == 0)
+			break;
+		else if(errno == EAGAIN || errno == EWOULDBLOCK){
+			if(_stdinFd >= 0)
+				co_await writableOrPipeReadable(_stdinFd, _stdoutFd);
+			else
+				co_await pipeReadable(_stdoutFd);
+		}
+		else if(errno != EINTR)
+		{
+			std::cerr << "[CGI] read() failed\n";
+			break;
 		}
-		return output;
 	}
+	closeFd(_stdinFd);
+	closeFd(_stdoutFd);
+	int status = co_await childExit(_pid);
+	_pid = -1;
+	if(WIFEXITED(status) && WEXITSTATUS(status) == 42){
+		std::cerr << "[CGI] child process failed"<<std::endl;
+		co_return "";
+	}
+	co_return output;
 }
@@ -1,6 +1,22 @@
 #include "ConfigBuilder.hpp"
+#include "HttpRequest.hpp"
+
+#include <fstream>
+#include <sstream>
 
 namespace config{
+	static constexpr unsigned long DEFAULT_TIMEOUT_MS = 60 * 1000;
+	static constexpr int DEFAULT_FS_THREADS = 4;
+	static constexpr int DEFAULT_OPEN_FILE_CACHE = 0;
+	static constexpr int MAX_OPEN_FILE_CACHE = 65536;
+	static constexpr int MAX_BUSY_POLL_US = 100000;
+	static constexpr long DEFAULT_BODY_BUFFER_SIZE = 16 * 1024;
+	static constexpr int DEFAULT_HEADER_BUFFERS = 2;
+	static constexpr long DEFAULT_HEADER_BUFFER_SIZE = 4 * 1024;
+	static constexpr long DEFAULT_URI_MAX_SIZE = 2048;
+	static constexpr long MIN_HEADER_BUFFER_SIZE = 1024;
+	static constexpr int DEFAULT_HEADER_FIELDS = 64;
+
 	///< Return default maximum client body size
 	long ConfigBuilder::defaultClientMaxBodySize(){
 		long size = 1*1024*1024;
@@ -28,6 +44,91 @@ namespace config{
 		return num;
 	}
 
+	///< Parse a positive count like "4", or "auto" for the number of online CPUs
+	int ConfigBuilder::parseCountLiteral(const std::string& value, const std::string& directive, int max){
+		if (value == "auto"){
+			long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+			return cpus > 0 ? std::min(static_cast<int>(cpus), max) : 1;
+		}
+		for (size_t i = 0; i < value.size(); i++){
+			if (!isdigit(value[i]))
+				throw std::runtime_error("Invalid value in " + directive + ": " + value);
+		}
+		if (value.empty() || value.size() > 6 || std::stoi(value) < 1 || std::stoi(value) > max)
+			throw std::runtime_error("Invalid value in " + directive + ": " + value);
+		return std::stoi(value);
+	}
+
+	///< Parse an "on" / "off" switch
+	bool ConfigBuilder::parseSwitchLiteral(const std::string& value, const std::string& directive){
+		if (value == "on")
+			return true;
+		if (value == "off")
+			return false;
+		throw std::runtime_error("Expect on/off after " + directive);
+	}
+
+	///< Parse the value of event_backend
+	EventBackend ConfigBuilder::parseBackendLiteral(const std::string& value){
+		if (value == "epoll")
+			return BACKEND_EPOLL;
+		if (value == "io_uring")
+			return BACKEND_IO_URING;
+		throw std::runtime_error("Expect epoll/io_uring after event_backend");
+	}
+
+	///< Parse the value of overload_action
+	OverloadAction ConfigBuilder::parseOverloadActionLiteral(const std::string& value){
+		if (value == "reject")
+			return OVERLOAD_REJECT;
+		if (value == "pause")
+			return OVERLOAD_PAUSE;
+		throw std::runtime_error("Expect reject/pause after overload_action");
+	}
+
+	///< Parse worker_cpu_affinity: "off", "auto" (every CPU the process may run on, in order) or CPU numbers
+	std::vector<int> ConfigBuilder::parseAffinityLiteral(const std::vector<std::string>& values){
+		std::vector<int> cpus;
+		if (values.size() == 1 && values[0] == "off")
+			return cpus;
+		if (values.size() == 1 && values[0] == "auto"){
+			cpu_set_t allowed;
+			if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0)
+				throw std::runtime_error("worker_cpu_affinity auto: cannot read the CPUs of the process");
+			for (int cpu = 0; cpu < CPU_SETSIZE; cpu++){
+				if (CPU_ISSET(cpu, &allowed))
+					cpus.push_back(cpu);
+			}
+			return cpus;
+		}
+		for (size_t i = 0; i < values.size(); i++){
+			const std::string& value = values[i];
+			if (value.empty() || value.size() > 4 || value.find_first_not_of("0123456789") != std::string::npos
+				|| std::stoi(value) >= CPU_SETSIZE)
+				throw std::runtime_error("Invalid CPU in worker_cpu_affinity: " + value);
+			cpus.push_back(std::stoi(value));
+		}
+		return cpus;
+	}
+
+	///< Parse a duration like "60", "60s", "500ms" or "2m" into milliseconds
+	unsigned long ConfigBuilder::parseTimeLiteral(const std::string& value, const std::string& directive){
+		size_t digits = 0;
+		while (digits < value.size() && isdigit(value[digits]))
+			digits++;
+		if (digits == 0 || digits > 9)
+			throw std::runtime_error("Invalid time in " + directive + ": " + value);
+		unsigned long num = std::stoul(value.substr(0, digits));
+		std::string unit = value.substr(digits);
+		if (unit.empty() || unit == "s")
+			return num * 1000;
+		if (unit == "ms")
+			return num;
+		if (unit == "m")
+			return num * 60 * 1000;
+		throw std::runtime_error("Invalid time in " + directive + ": " + value);
+	}
+
 	///< Return default error pages mapping
 	std::map<int, std::string> ConfigBuilder::defaultErrorPages()
 	{
@@ -46,6 +147,28 @@ namespace config{
 		
 	}
 
+	/**
+	 * @brief Read every error page once, when the configuration is built
+	 *
+	 * @note error responses are made on the event loops, which must not block on a
+	 *       file: they take the page from here. A page that cannot be read is left
+	 *       out, and its responses get a generated body.
+	 */
+	std::map<int, std::string> ConfigBuilder::loadErrorPages(const std::map<int, std::string>& pages)
+	{
+		std::map<int, std::string> bodies;
+		for (std::map<int, std::string>::const_iterator it = pages.begin(); it != pages.end(); ++it){
+			std::ifstream file(it->second.c_str());
+			if (!file.is_open())
+				continue;
+			std::stringstream buffer;
+			buffer << file.rdbuf();
+			if (!buffer.str().empty())
+				bodies[it->first] = buffer.str();
+		}
+		return bodies;
+	}
+
 	///< Return default allowed methods
 	std::vector<std::string> ConfigBuilder::defaultMethods()
 	{
@@ -83,6 +206,7 @@ namespace config{
 		cfg.port = node.listen.second;
 		cfg.serverNames = node.serverNames;
 		cfg.errorPages = node.errorPages.empty() ? defaultErrorPages() : node.errorPages;
+		cfg.errorPageBodies = loadErrorPages(cfg.errorPages);
 		cfg.root = node.root.empty() ? "." : node.root;
 		cfg.index = node.index;
 		cfg.clientMaxBodySize = node.clientMaxBodySize.empty()
@@ -105,4 +229,90 @@ namespace config{
 		}
 		return cfgs;
 	}
+
+	/// Build the GlobalConfig from the main-context directives, applying defaults.
+	GlobalConfig ConfigBuilder::buildGlobal(const GlobalNode& node)
+	{
+		GlobalConfig global;
+		global.workerThreads = node.workerThreads.empty()
+									? 1
+									: parseCountLiteral(node.workerThreads, "worker_threads", 256);
+		global.workerProcesses = node.workerProcesses.empty()
+									? 1
+									: parseCountLiteral(node.workerProcesses, "worker_processes", 256);
+		global.edgeTriggered = node.edgeTriggered.empty()
+									? false
+									: parseSwitchLiteral(node.edgeTriggered, "edge_triggered");
+		global.headerTimeoutMs = node.headerTimeout.empty()
+									? DEFAULT_TIMEOUT_MS
+									: parseTimeLiteral(node.headerTimeout, "client_header_timeout");
+		global.bodyTimeoutMs = node.bodyTimeout.empty()
+									? DEFAULT_TIMEOUT_MS
+									: parseTimeLiteral(node.bodyTimeout, "client_body_timeout");
+		global.keepaliveTimeoutMs = node.keepaliveTimeout.empty()
+									? DEFAULT_TIMEOUT_MS
+									: parseTimeLiteral(node.keepaliveTimeout, "keepalive_timeout");
+		global.sendTimeoutMs = node.sendTimeout.empty()
+									? DEFAULT_TIMEOUT_MS
+									: parseTimeLiteral(node.sendTimeout, "send_timeout");
+		global.eventBackend = node.eventBackend.empty()
+									? BACKEND_EPOLL
+									: parseBackendLiteral(node.eventBackend);
+		global.handlerThreads = (node.handlerThreads.empty() || node.handlerThreads == "off")
+									? 0
+									: parseCountLiteral(node.handlerThreads, "handler_threads", 256);
+		global.fsThreads = node.fsThreads.empty()
+									? DEFAULT_FS_THREADS
+									: parseCountLiteral(node.fsThreads, "fs_threads", 256);
+		global.openFileCache = node.openFileCache.empty()
+									? DEFAULT_OPEN_FILE_CACHE
+									: node.openFileCache == "off"
+									? 0
+									: parseCountLiteral(node.openFileCache, "open_file_cache", MAX_OPEN_FILE_CACHE);
+		global.busyPollUs = (node.busyPollUs.empty() || node.busyPollUs == "off")
+									? 0
+									: parseCountLiteral(node.busyPollUs, "busy_poll_us", MAX_BUSY_POLL_US);
+		global.soBusyPoll = node.soBusyPoll.empty()
+									? false
+									: parseSwitchLiteral(node.soBusyPoll, "so_busy_poll");
+		global.cpuAffinity = parseAffinityLiteral(node.cpuAffinity);
+		global.overloadLagMs = (node.overloadLag.empty() || node.overloadLag == "off")
+									? 0
+									: parseTimeLiteral(node.overloadLag, "overload_lag");
+		global.overloadAction = node.overloadAction.empty()
+									? OVERLOAD_REJECT
+									: parseOverloadActionLiteral(node.overloadAction);
+		global.bodyBufferSize = node.bodyBufferSize.empty()
+									? DEFAULT_BODY_BUFFER_SIZE
+									: parseSizeLiteral(node.bodyBufferSize);
+		global.headerLineSize = DEFAULT_HEADER_BUFFER_SIZE;
+		global.headerSize = DEFAULT_HEADER_BUFFERS * DEFAULT_HEADER_BUFFER_SIZE;
+		if (!node.headerBuffers.empty()){
+			if (node.headerBuffers.size() != 2)
+				throw std::runtime_error("large_client_header_buffers expects a number and a size");
+			int count = parseCountLiteral(node.headerBuffers[0], "large_client_header_buffers", 64);
+			global.headerLineSize = parseSizeLiteral(node.headerBuffers[1]);
+			if (global.headerLineSize < MIN_HEADER_BUFFER_SIZE || global.headerLineSize > 1024 * 1024)
+				throw std::runtime_error("Invalid size in large_client_header_buffers");
+			global.headerSize = count * global.headerLineSize;
+		}
+		global.uriMaxSize = node.uriMaxSize.empty()
+									? DEFAULT_URI_MAX_SIZE
+									: parseSizeLiteral(node.uriMaxSize);
+		if (global.uriMaxSize < 1)
+			throw std::runtime_error("Invalid size in client_max_uri_size");
+		if (node.headerFields == "auto")
+			throw std::runtime_error("Invalid value in client_max_header_fields: auto");
+		global.headerFields = node.headerFields.empty()
+									? DEFAULT_HEADER_FIELDS
+									: parseCountLiteral(node.headerFields, "client_max_header_fields",
+										static_cast<int>(HttpRequest::MAX_HEADERS));
+		if (global.bodyBufferSize < 0)
+			throw std::runtime_error("Invalid size in client_body_buffer_size");
+		if (global.soBusyPoll && global.busyPollUs == 0)
+			throw std::runtime_error("so_busy_poll needs busy_poll_us");
+		if (global.workerThreads > 1 && global.workerProcesses > 1)
+			throw std::runtime_error("worker_threads and worker_processes cannot be combined");
+		return global;
+	}
 }
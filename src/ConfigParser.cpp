@@ -52,7 +52,27 @@ namespace config{
 		|| s == "upload_dir"
 		|| s == "client_max_body_size"
 		|| s == "allowed_methods"
-		|| s == "error_pages" ;
+		|| s == "error_pages"
+		|| s == "worker_threads"
+		|| s == "worker_processes"
+		|| s == "edge_triggered"
+		|| s == "client_header_timeout"
+		|| s == "client_body_timeout"
+		|| s == "keepalive_timeout"
+		|| s == "send_timeout"
+		|| s == "event_backend"
+		|| s == "handler_threads"
+		|| s == "fs_threads"
+		|| s == "open_file_cache"
+		|| s == "busy_poll_us"
+		|| s == "so_busy_poll"
+		|| s == "worker_cpu_affinity"
+		|| s == "overload_lag"
+		|| s == "overload_action"
+		|| s == "client_body_buffer_size"
+		|| s == "large_client_header_buffers"
+		|| s == "client_max_uri_size"
+		|| s == "client_max_header_fields" ;
 	}
 
 	// Parse a simple directive that expects a single value followed by a semicolon.
@@ -60,7 +80,7 @@ namespace config{
 	{
 		get();
 		Token valuetoken = get();
-		if (valuetoken.type != TK_IDENTIFIER && valuetoken.type != TK_STRING)
+		if (valuetoken.type != TK_IDENTIFIER && valuetoken.type != TK_STRING && valuetoken.type != TK_NUMBER)
 			throw std::runtime_error("Expect value after " + str);
 		expect(TK_SEMICOLON, "Expected ';'");
 		return valuetoken.value;
@@ -92,6 +112,24 @@ namespace config{
 		return results;
 	}
 
+	// Parse a directive that expects one or more words or numbers followed by a semicolon.
+	std::vector<std::string> Parser::parseValueListDirective(const std::string& str)
+	{
+		get();
+		std::vector<std::string> results;
+		while (true){
+			if (eof())
+				throw std::runtime_error("Unexpected EOF while parsing " + str);
+			Token tok = get();
+			if (tok.type == TK_SEMICOLON && !results.empty())
+				break;
+			if ((tok.type != TK_IDENTIFIER && tok.type != TK_NUMBER) || isKeyword(tok.value))
+				throw std::runtime_error(makeError("Expect value after " + str, tok.line, tok.col));
+			results.push_back(tok.value);
+		}
+		return results;
+	}
+
 	// Parse a server block from the token stream.
 	ServerNode Parser::parseServerBlock()
 	{
@@ -219,6 +257,54 @@ namespace config{
 		return location;
 	}
 
+	// Parse a directive of the main context (outside any server block).
+	void Parser::parseGlobalDirective()
+	{
+		Token token = peek();
+		if (token.value == "worker_threads")
+			_global.workerThreads = parseSimpleDirective("worker_threads");
+		else if (token.value == "worker_processes")
+			_global.workerProcesses = parseSimpleDirective("worker_processes");
+		else if (token.value == "edge_triggered")
+			_global.edgeTriggered = parseSimpleDirective("edge_triggered");
+		else if (token.value == "client_header_timeout")
+			_global.headerTimeout = parseSimpleDirective("client_header_timeout");
+		else if (token.value == "client_body_timeout")
+			_global.bodyTimeout = parseSimpleDirective("client_body_timeout");
+		else if (token.value == "keepalive_timeout")
+			_global.keepaliveTimeout = parseSimpleDirective("keepalive_timeout");
+		else if (token.value == "send_timeout")
+			_global.sendTimeout = parseSimpleDirective("send_timeout");
+		else if (token.value == "event_backend")
+			_global.eventBackend = parseSimpleDirective("event_backend");
+		else if (token.value == "handler_threads")
+			_global.handlerThreads = parseSimpleDirective("handler_threads");
+		else if (token.value == "fs_threads")
+			_global.fsThreads = parseSimpleDirective("fs_threads");
+		else if (token.value == "open_file_cache")
+			_global.openFileCache = parseSimpleDirective("open_file_cache");
+		else if (token.value == "busy_poll_us")
+			_global.busyPollUs = parseSimpleDirective("busy_poll_us");
+		else if (token.value == "so_busy_poll")
+			_global.soBusyPoll = parseSimpleDirective("so_busy_poll");
+		else if (token.value == "worker_cpu_affinity")
+			_global.cpuAffinity = parseValueListDirective("worker_cpu_affinity");
+		else if (token.value == "overload_lag")
+			_global.overloadLag = parseSimpleDirective("overload_lag");
+		else if (token.value == "overload_action")
+			_global.overloadAction = parseSimpleDirective("overload_action");
+		else if (token.value == "client_body_buffer_size")
+			_global.bodyBufferSize = parseSimpleDirective("client_body_buffer_size");
+		else if (token.value == "large_client_header_buffers")
+			_global.headerBuffers = parseValueListDirective("large_client_header_buffers");
+		else if (token.value == "client_max_uri_size")
+			_global.uriMaxSize = parseSimpleDirective("client_max_uri_size");
+		else if (token.value == "client_max_header_fields")
+			_global.headerFields = parseSimpleDirective("client_max_header_fields");
+		else
+			throw std::runtime_error(makeError("Expected 'server' block ", token.line, token.col));
+	}
+
 	// Parse the entire configuration file and return a list of server nodes.
 	std::vector<ServerNode> Parser::parse()
 	{
@@ -228,6 +314,8 @@ namespace config{
 			Token t = peek();
 			if (t.type == TK_IDENTIFIER && t.value == "server")
 				servers.push_back(parseServerBlock());
+			else if (t.type == TK_IDENTIFIER)
+				parseGlobalDirective();
 			else
 				throw std::runtime_error(makeError("Expected 'server' block ", t.line, t.col));
 		}
@@ -0,0 +1,168 @@
+#include "Connection.hpp"
+
+/// Queue bytes after the ones queued so far, copied into data.
+void WriteBuffer::append(std::string_view bytes){
+	data.append(bytes);
+	commitData();
+}
+
+/**
+ * @brief Queue what was appended to data directly (a response head) since the last segment
+ *
+ * @note a range following another range of data extends it: consecutive heads and
+ *       constant responses make one segment.
+ */
+void WriteBuffer::commitData(){
+	if (data.size() == dataQueued)
+		return;
+	size_t length = data.size() - dataQueued;
+	if (!segments.empty() && segments.back().kind == SEGMENT_DATA)
+		segments.back().length += length;
+	else
+		segments.push_back(Segment{SEGMENT_DATA, 0, dataQueued, length});
+	dataQueued = data.size();
+	queued += length;
+}
+
+/// Queue a body after the ones queued so far, without copying it.
+void WriteBuffer::appendBody(std::string body){
+	if (body.empty())
+		return;
+	queued += body.size();
+	segments.push_back(Segment{SEGMENT_BODY, bodies.size(), 0, body.size()});
+	bodies.push_back(std::move(body));
+}
+
+/// Queue a file body after the ones queued so far, the fd now owned by the buffer.
+void WriteBuffer::appendFile(FileBody file){
+	if (file.length() == 0)
+		return;
+	queued += file.length();
+	segments.push_back(Segment{SEGMENT_FILE, files.size(), 0, file.length()});
+	files.push_back(std::move(file));
+}
+
+/**
+ * @brief Point iov at the bytes not sent yet, in sending order, up to the next file body
+ *
+ * @param beforeFile set to whether a file body follows the gathered segments
+ * @return size_t the number of entries filled, at most max (0 when a file body is next)
+ * @note the pointers are valid until something is queued or the buffer is cleared
+ */
+size_t WriteBuffer::gather(iovec* iov, size_t max, bool* beforeFile) const {
+	size_t count = 0;
+	size_t i = current;
+	for (; i < segments.size() && count < max; i++){
+		const Segment& segment = segments[i];
+		if (segment.kind == SEGMENT_FILE)
+			break;
+		const char* base = segment.kind == SEGMENT_DATA ? data.data() + segment.offset : bodies[segment.index].data();
+		size_t skip = i == current ? currentSent : 0;
+		iov[count].iov_base = const_cast<char*>(base + skip);
+		iov[count].iov_len = segment.length - skip;
+		count++;
+	}
+	if (beforeFile)
+		*beforeFile = i < segments.size() && segments[i].kind == SEGMENT_FILE;
+	return count;
+}
+
+/**
+ * @brief The file body to send next, when the queue starts with one
+ *
+ * @param offset, length set to the region of the file not sent yet
+ * @return const FileBody* nullptr when the next bytes are in memory (gather)
+ */
+const FileBody* WriteBuffer::currentFile(off_t& offset, size_t& length) const {
+	if (current >= segments.size() || segments[current].kind != SEGMENT_FILE)
+		return nullptr;
+	const Segment& segment = segments[current];
+	const FileBody& file = files[segment.index];
+	offset = file.offset() + static_cast<off_t>(currentSent);
+	length = segment.length - currentSent;
+	return &file;
+}
+
+/// Account for bytes of the queue having been sent.
+void WriteBuffer::consume(size_t bytes){
+	sent += bytes;
+	while (bytes > 0 && current < segments.size()){
+		size_t left = segments[current].length - currentSent;
+		if (bytes < left){
+			currentSent += bytes;
+			return;
+		}
+		bytes -= left;
+		current++;
+		currentSent = 0;
+	}
+}
+
+/// Drop everything queued, closing the files; data keeps its allocation for the next heads.
+void WriteBuffer::clear(){
+	data.clear();
+	bodies.clear();
+	files.clear();
+	segments.clear();
+	current = 0;
+	currentSent = 0;
+	dataQueued = 0;
+	queued = 0;
+	sent = 0;
+}
+
+ReadPhase Connection::getReadPhase() const {
+	if (parser.isIdle())
+		return READ_IDLE;
+	return parser.isReadingBody() ? READ_BODY : READ_HEADERS;
+}
+
+/**
+ * @brief Take the slot of fd for a newly accepted client
+ *
+ * @return Connection* the reset connection; its address stays valid until the loop ends
+ */
+Connection* ConnectionSlab::acquire(int fd, size_t serverIndex){
+	size_t block = static_cast<size_t>(fd) / SLOTS_PER_BLOCK;
+	while (_blocks.size() <= block)
+		_blocks.push_back(std::make_unique<Connection[]>(SLOTS_PER_BLOCK));
+	Connection& conn = _blocks[block][fd % SLOTS_PER_BLOCK];
+	uint32_t generation = conn.generation + 1;
+	// the slot's input buffer is reused by its next client
+	HttpParser parser = std::move(conn.parser);
+	conn = Connection();
+	conn.parser = std::move(parser);
+	conn.kind = PollSource::SOURCE_CLIENT;
+	conn.fd = fd;
+	conn.serverIndex = serverIndex;
+	conn.generation = generation;
+	conn.active = true;
+	_active++;
+	return &conn;
+}
+
+/**
+ * @brief Give the slot back; the buffers are freed now rather than at the next acquire,
+ *        except for a standard-size parser buffer kept for the slot's next client
+ */
+void ConnectionSlab::release(Connection& conn){
+	if (!conn.active)
+		return;
+	conn.active = false;
+	conn.writing = false;
+	conn.pending = false;
+	conn.handler = Task<HttpResponse>();
+	conn.parser.reset();
+	conn.writeBuffer = WriteBuffer();
+	conn.pendingInput.clear();
+	conn.pendingInput.shrink_to_fit();
+	_active--;
+}
+
+Connection* ConnectionSlab::get(int fd){
+	size_t block = static_cast<size_t>(fd) / SLOTS_PER_BLOCK;
+	if (fd < 0 || block >= _blocks.size())
+		return nullptr;
+	Connection& conn = _blocks[block][fd % SLOTS_PER_BLOCK];
+	return conn.active ? &conn : nullptr;
+}
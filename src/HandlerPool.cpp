@@ -0,0 +1,104 @@
+#include "HandlerPool.hpp"
+#include "OffloadExecutor.hpp"
+
+#include <thread>
+
+std::atomic<size_t>			HandlerPool::_configuredThreads(0);
+thread_local Reactor*		HandlerPool::_home = nullptr;
+
+HandlerPool::HandlerPool(size_t threads) : _next(0), _queued(0){
+	for (size_t i = 0; i < threads; i++)
+		_workers.push_back(std::make_unique<Worker>());
+	for (size_t i = 0; i < threads; i++)
+		std::thread(&HandlerPool::run, this, i).detach();
+}
+
+void HandlerPool::configure(size_t threads){
+	_configuredThreads.store(threads, std::memory_order_relaxed);
+}
+
+bool HandlerPool::enabled(void){
+	return _configuredThreads.load(std::memory_order_relaxed) > 0;
+}
+
+HandlerPool& HandlerPool::instance(void){
+	// never destroyed: detached threads may still use it while the process exits
+	static HandlerPool* pool = new HandlerPool(_configuredThreads.load(std::memory_order_relaxed));
+	return *pool;
+}
+
+Reactor* HandlerPool::home(void){
+	return _home;
+}
+
+/**
+ * @brief Queue a coroutine on the next worker, round-robin (event loop side)
+ */
+void HandlerPool::submit(const HandlerJob& job){
+	Worker& worker = *_workers[_next.fetch_add(1, std::memory_order_relaxed) % _workers.size()];
+	if (job.stats)
+		job.stats->handlerQueued.fetch_add(1, std::memory_order_relaxed);
+	{
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		worker.jobs.push_back(job);
+	}
+	_queued.fetch_add(1, std::memory_order_release);
+	{
+		// taken so a worker between its last check and its wait cannot miss the notification
+		std::lock_guard<std::mutex> lock(_idleMutex);
+	}
+	_idle.notify_one();
+}
+
+/**
+ * @brief Find a job for a worker: its own oldest one, else another worker's newest one
+ *
+ * @param index the worker
+ * @param job filled when found
+ * @param stolen set when it came from another worker
+ * @return bool whether a job was found
+ */
+bool HandlerPool::take(size_t index, HandlerJob& job, bool& stolen){
+	for (size_t i = 0; i < _workers.size(); i++){
+		Worker& worker = *_workers[(index + i) % _workers.size()];
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		if (worker.jobs.empty())
+			continue;
+		stolen = i != 0;
+		if (stolen){
+			job = worker.jobs.back();
+			worker.jobs.pop_back();
+		}
+		else {
+			job = worker.jobs.front();
+			worker.jobs.pop_front();
+		}
+		_queued.fetch_sub(1, std::memory_order_relaxed);
+		return true;
+	}
+	return false;
+}
+
+void HandlerPool::run(size_t index){
+	while (true){
+		HandlerJob job;
+		bool stolen = false;
+		if (!take(index, job, stolen)){
+			std::unique_lock<std::mutex> lock(_idleMutex);
+			_idle.wait(lock, [this]{ return _queued.load(std::memory_order_acquire) > 0; });
+			continue;
+		}
+		if (job.stats){
+			job.stats->handlerQueued.fetch_sub(1, std::memory_order_relaxed);
+			job.stats->handlerJobs.fetch_add(1, std::memory_order_relaxed);
+			if (stolen)
+				job.stats->handlerSteals.fetch_add(1, std::memory_order_relaxed);
+		}
+		// runs until the coroutine suspends again, usually by posting itself back to its loop;
+		// file I/O awaited meanwhile runs inline and is timed for the job's loop
+		FsTimer::Scope scope(job.stats);
+		_home = job.owner;
+		job.handle.resume();
+		_home = nullptr;
+	}
+}
@@ -1,4 +1,16 @@
 #include "HttpRequestParser.hpp"
+#include "HttpScan.hpp"
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+size_t HttpParser::_bodyBufferSize = 16384;
+size_t HttpParser::_maxHeaderLine = 4096;
+size_t HttpParser::_maxHeaderSize = 8192;
+size_t HttpParser::_maxUriSize = 2048;
+size_t HttpParser::_maxHeaderFields = 64;
 
 /**
  * @brief validates the startline of a http request
@@ -10,45 +22,37 @@
  */
 bool HttpParser::validateStartLine()
 {
-    if (_req.getMethod() != "GET" && _req.getMethod() != "POST" && _req.getMethod() != "DELETE"){
+    if (_req.getMethodId() == METHOD_OTHER){
         _errStatus = 405;
         std::cout << "Method not allowed: " << _req.getMethod() << std::endl;
         return false;
     }
 
-    if (_req.getVersion() != "HTTP/1.1"){
+    if (_req.getVersionId() != VERSION_1_1){
         _errStatus = 400;
         std::cout << "Invalid HTTP version: " << _req.getVersion() << std::endl;
         return false;
     }
 
-    if (_req.getPath()[0] != '/'){
+    if (_req.getTarget()[0] != '/'){
         _errStatus = 400;
-        std::cout << "Path must not start with '/': " << _req.getPath() << std::endl;
+        std::cout << "Path must not start with '/': " << _req.getTarget() << std::endl;
         return false;
     }
 
-    if (_req.getPath().size() > 2048){
+    std::string_view target = _req.getTarget();
+    if (httpScan::kernels().findNonVisible(target.data(), target.size()) != target.size()){
         _errStatus = 400;
-        std::cout << "Request_URI too long" << _req.getPath() << std::endl;
+        std::cout << "Path must not have empty space or controling chars: " << target << std::endl;
         return false;
     }
-
-    for (size_t i = 0; i < _req.getPath().size(); ++i){
-        char c = _req.getPath()[i];
-        if (c < 31 || c == ' '){
-            _errStatus = 400;
-            std::cout << "Path must not have empty space or controling chars: " << _req.getPath() << std::endl;
-            return false;
-        }
-    }
     return true;
 }
 
 /**
  * @brief validates the headers of a http request
  *
- * @param HttpParser map headers within class HttpRequest nested in HttpParser
+ * @param HttpParser headers within class HttpRequest nested in HttpParser
  * @return true or false, on false, set the _errStatus the coresponding error code
  *
  * @note exxample of headers:
@@ -57,40 +61,40 @@ bool HttpParser::validateStartLine()
  * User-Agent: curl/7.81.0
  * Content-Type: application/x-www-form-urlencoded
  * Content-Length: 27
+ * @note a field name may appear only once: a repeated one, in any case, is refused
+ * @note known fields are matched by id (the first of each is indexed); other names are
+ *       compared with the unknown fields before them, at most client_max_header_fields
+ * @note sizes were checked as the head was received (checkHeadLimits)
  */
 bool    HttpParser::validateHeaders()
 {
     bool hasHost = false;
-    std::set<std::string> seenKeys;
-    size_t totalSize = 0;
 
-    for (std::map<std::string, std::string>::const_iterator it = _req.getHeaders().begin(); it != _req.getHeaders().end(); ++it)
+    for (size_t h = 0; h < _req.getHeaderCount(); ++h)
     {
-        const std::string& key = it->first;
-        const std::string& value = it->second;
-        totalSize += key.size() + value.size();
+        std::string_view key = _req.getHeaderName(h);
+        std::string_view value = _req.getHeaderValue(h);
 
-        if (totalSize > 8192){
-            _errStatus = 431;
-            std::cout << "Total header size to big" << std::endl;
+        if (key.empty()){
+            _errStatus = 400;
+            std::cout << "Empty header key" << std::endl;
             return false;
         }
 
-        if (key.size() > 1024 || value.size() > 4096){
-            _errStatus = 431;
-            std::cout << "Header field too large: " << key << std::endl;
+        if (httpScan::kernels().findNonToken(key.data(), key.size()) != key.size()){
+            _errStatus = 400;
+            std::cout << "Invalid header key: " << key << std::endl;
             return false;
         }
 
-        for (size_t i = 0; i < key.size(); ++i) {
-            if (!isgraph(key[i]) || key[i] == ':') {
-                _errStatus = 400;
-                std::cout << "Invalid header key: " << key << std::endl;
-                return false;
-            }
+        if (httpScan::kernels().findInvalidValue(value.data(), value.size()) != value.size()){
+            _errStatus = 400;
+            std::cout << "Invalid header value for: " << key << std::endl;
+            return false;
         }
 
-        if (key == "host"){
+        HttpHeaderId id = _req.getHeaderId(h);
+        if (id == HEADER_HOST){
             if (hasHost){
                 _errStatus = 400;
                 std::cout << "Multiple Host headers found." << std::endl;
@@ -99,15 +103,13 @@ bool    HttpParser::validateHeaders()
             hasHost = true;
         }
 
-        if (seenKeys.count(key)) {
+        if (isDuplicateHeader(h)){
             _errStatus = 400;
             std::cout << "Duplicate header key found: " << key << std::endl;
             return false;
         }
 
-        seenKeys.insert(key);
-        if (key == "content-length"){
-
+        if (id == HEADER_CONTENT_LENGTH){
             if (value.empty()){
                 _errStatus = 400;
                 std::cout << "Empty Content-Length value." << std::endl;
@@ -120,19 +122,16 @@ bool    HttpParser::validateHeaders()
                 return false;
             }
 
+            unsigned long long len = 0;
             for (size_t i = 0; i < value.length(); ++i){
-                if (!isdigit(value[i])){
+                if (!isdigit(static_cast<unsigned char>(value[i]))){
                     _errStatus = 400;
                     std::cout << "Non-digit character in Content-Length value." << std::endl;
                     return false;
                 }
-            }
-
-            long long len = atoll(value.c_str());
-            if (len < 0){
-                _errStatus = 400;
-                std::cout << "Negative Content-Length value." << std::endl;
-                return false;
+                // saturates: anything this large is refused below
+                if (len <= 1024ULL * 1024 * 1024)
+                    len = len * 10 + (value[i] - '0');
             }
 
             if (len > 1024 * 1024 * 100){
@@ -153,236 +152,677 @@ bool    HttpParser::validateHeaders()
     return true;
 }
 
+/// Whether header field h has the name of a field before it.
+bool    HttpParser::isDuplicateHeader(size_t h) const
+{
+    HttpHeaderId id = _req.getHeaderId(h);
+    if (id != HEADER_UNKNOWN)
+        return _req._known[id] != h + 1;
+    std::string_view key = _req.getHeaderName(h);
+    for (size_t i = 0; i < h; ++i){
+        if (_req.getHeaderId(i) == HEADER_UNKNOWN && httpHeaders::equalsNoCase(_req.getHeaderName(i), key))
+            return true;
+    }
+    return false;
+}
+
 /**
- * @brief validates the body of a http request
+ * @brief make the buffer hold at least size bytes, keeping what it holds
  *
- * @param HttpParser _body within class HttpRequest nested in HttpParser
- * @return true or false, on false, set the _errStatus the coresponding error code
+ * @param size offset the buffer must reach, counted from its current start
  *
- * @example example of body: username=John&password=1234
- * @note Post must have body, body must fullfill ContentLength, for GET / DELETE, it is not an error to have body
- * @note
- * - body string length has to be as long as the sontent-Length says
- * - here, i can not have this check because the body might be not fully received yet
- * - incomplete body is not an error during streaming)
+ * @note grows by doubling: a body read chunk by chunk is copied O(log n) times,
+ *       and only once when its Content-Length is known (see receiveBuffer)
+ * @note the bytes of requests already answered are dropped first, moving the current
+ *       one to the front: that is often room enough
  */
-bool HttpParser::validateBody(){
-    if (_req.getMethod() == "POST")
-    {
-        if (!_isChunked && _req.getBody().size() > _bodyLength){
-            _errStatus = 400;
-            std::cout << "POST request body length exceeds Content-Length." << std::endl; //here
-            return false;
+void HttpParser::reserve(size_t size)
+{
+    if (size <= _capacity)
+        return;
+    if (_start > 0){
+        size -= _start;
+        compact();
+        if (size <= _capacity)
+            return;
+    }
+    size_t capacity = std::max(std::max(_capacity * 2, INITIAL_CAPACITY), size);
+    std::unique_ptr<char[]> grown(new char[capacity]);
+    if (_size)
+        std::memcpy(grown.get(), _buffer.get(), _size);
+    _buffer = std::move(grown);
+    _capacity = capacity;
+}
+
+/**
+ * @brief move the current request to the front of the buffer
+ *
+ * @note the request's spans are relative to its start, only the parser's
+ *       own offsets move
+ */
+void HttpParser::compact()
+{
+    std::memmove(_buffer.get(), _buffer.get() + _start, _size - _start);
+    _size -= _start;
+    _pos -= _start;
+    _scanned -= _start;
+    _bodyStart -= _start;
+    _bodyEnd -= _start;
+    _start = 0;
+}
+
+/**
+ * @brief find the end of the line starting at from
+ *
+ * @return offset of the "\r\n" ending it, npos while it is incomplete
+ *
+ * @note resumes where the previous call stopped, so a line received in many
+ *       pieces is scanned once; a '\r' ending the buffer is looked at again,
+ *       its '\n' may be in the next read
+ */
+size_t HttpParser::findLineEnd(size_t from)
+{
+    size_t scan = std::max(from, _scanned);
+    if (scan < _size){
+        size_t end = scan + httpScan::kernels().findCrlf(_buffer.get() + scan, _size - scan);
+        if (end < _size){
+            _scanned = end + 2;
+            return end;
         }
     }
-    return true;
+    _scanned = _size > scan ? _size - 1 : scan;
+    return std::string::npos;
+}
+
+/**
+ * @brief apply the head limits to the line being received
+ *
+ * @param lineEnd offset of the "\r\n" ending the line, npos while it is incomplete:
+ *        then every byte received so far belongs to it
+ * @return false, with the state set to ERROR, once the line or the head is too long:
+ *         414 for the request line, 431 for a header field
+ *
+ * @note checked on each read, so a line is refused before its end is received
+ */
+bool HttpParser::checkHeadLimits(size_t lineEnd)
+{
+    size_t end = lineEnd == std::string::npos ? _size : lineEnd;
+    if (end - _pos <= _maxHeaderLine && end - _start <= _maxHeaderSize)
+        return true;
+    _errStatus = _state == START_LINE ? 414 : 431;
+    _state = ERROR;
+    std::cout << (_errStatus == 414 ? "Request line too long" : "Request head too large") << std::endl;
+    return false;
+}
+
+/// Set the head limits of every parser (large_client_header_buffers, client_max_uri_size, client_max_header_fields).
+void HttpParser::setHeaderLimits(size_t line, size_t head, size_t uri, size_t fields)
+{
+    _maxHeaderLine = line;
+    _maxHeaderSize = head;
+    _maxUriSize = uri;
+    _maxHeaderFields = std::min(fields, HttpRequest::MAX_HEADERS);
 }
 
 /**
  * @brief parse the startline of an HTTP request
  *
- * @param str startline
+ * @param start, end the line, without its "\r\n"
  * @return void
  *
- * @note iss : in stringstream
+ * @note fields are separated by runs of spaces or tabs; the target is split at its first '?'
  */
-void HttpParser::parseStartLine(const std::string& startline){
-    std::istringstream ss(startline);
-    std::vector<std::string> fields;
-    std::string tmp;
-
-    while (ss >> tmp)
-        fields.push_back(tmp);
-    if (fields.size() != 3){
+void HttpParser::parseStartLine(size_t start, size_t end){
+    HttpRequest::Span fields[3];
+    size_t count = 0;
+    size_t i = start;
+
+    while (i < end){
+        while (i < end && (_buffer[i] == ' ' || _buffer[i] == '\t'))
+            i++;
+        if (i == end)
+            break;
+        size_t fieldStart = i;
+        while (i < end && _buffer[i] != ' ' && _buffer[i] != '\t')
+            i++;
+        if (count == 3){
+            count++;
+            break;
+        }
+        fields[count].offset = fieldStart - _start;
+        fields[count].length = i - fieldStart;
+        count++;
+    }
+    if (count != 3){
         _errStatus = 400;
         _state = ERROR;
         return ;
     }
 
-    _req.setMethod(fields[0]);
-    _req.setPath(fields[1]);
-    _req.setVersion(fields[2]);
+    if (fields[1].length > _maxUriSize){
+        _errStatus = 414;
+        _state = ERROR;
+        std::cout << "Request-URI too long" << std::endl;
+        return ;
+    }
+
+    _req._method = fields[0];
+    _req._target = fields[1];
+    _req._version = fields[2];
+    const char* base = _buffer.get() + _start;
+    std::string_view method(base + fields[0].offset, fields[0].length);
+    std::string_view version(base + fields[2].offset, fields[2].length);
+    _req._methodId = method == "GET" ? METHOD_GET
+                   : method == "POST" ? METHOD_POST
+                   : method == "DELETE" ? METHOD_DELETE : METHOD_OTHER;
+    _req._versionId = version == "HTTP/1.1" ? VERSION_1_1
+                    : version == "HTTP/1.0" ? VERSION_1_0 : VERSION_OTHER;
+    _req._path = fields[1];
+    _req._query = HttpRequest::Span();
+    size_t question = httpScan::kernels().findByte(base + fields[1].offset, fields[1].length, '?');
+    if (question != fields[1].length){
+        _req._path.length = question;
+        _req._query.offset = fields[1].offset + _req._path.length + 1;
+        _req._query.length = fields[1].length - _req._path.length - 1;
+    }
     _state = HEADERS;
 }
 
 /**
  * @brief parse one header of an HTTP request
  *
- * @param string headerline
+ * @param start, end the line, without its "\r\n"
  * @return void
  *
- * @note first check if headers are done, if yes, the line is '\t\n', then change state to body or done
+ * @note first check if headers are done, if yes, the line is empty, then change state to body or done
+ * @note the name is interned (see httpHeaders) rather than lowercased; name and value are trimmed of spaces and tabs
+ * @note past HttpRequest::INLINE_HEADERS fields, the rest of the table is taken from the
+ *       request's arena, once, for as many fields as client_max_header_fields allows
  */
-void HttpParser::parseHeaderLine(const std::string& headerline){
-    if (headerline.empty())
-    {
-        const std::map<std::string, std::string>& headers = _req.getHeaders();
-
-        std::map<std::string, std::string>::const_iterator teIt = headers.find("transfer-encoding");
-        if (teIt != headers.end() && teIt->second.find("chunked") != std::string::npos){
-            _isChunked = true;
-            _currentChunkSize = 0;
-            _currentChunkRead = 0;
-            _state = BODY;
+void HttpParser::parseHeaderLine(size_t start, size_t end){
+    if (start == end){
+        finishHeaders();
+        return;
+    }
+    size_t colon = httpScan::kernels().findByte(_buffer.get() + start, end - start, ':');
+    if (colon == end - start)
+        return;
+    if (_req._headerCount == _maxHeaderFields){
+        _errStatus = 431;
+        _state = ERROR;
+        std::cout << "Too many header fields" << std::endl;
+        return;
+    }
+    size_t dd = start + colon;
+    size_t keyStart = start, keyEnd = dd;
+    size_t valueStart = dd + 1, valueEnd = end;
+    while (keyStart < keyEnd && (_buffer[keyStart] == ' ' || _buffer[keyStart] == '\t'))
+        keyStart++;
+    while (keyEnd > keyStart && (_buffer[keyEnd - 1] == ' ' || _buffer[keyEnd - 1] == '\t'))
+        keyEnd--;
+    while (valueStart < valueEnd && (_buffer[valueStart] == ' ' || _buffer[valueStart] == '\t'))
+        valueStart++;
+    while (valueEnd > valueStart && (_buffer[valueEnd - 1] == ' ' || _buffer[valueEnd - 1] == '\t'))
+        valueEnd--;
+    if (keyEnd - keyStart > MAX_HEADER_NAME){
+        _errStatus = 431;
+        _state = ERROR;
+        std::cout << "Header field name too long" << std::endl;
+        return;
+    }
+
+    if (_req._headerCount == HttpRequest::INLINE_HEADERS && !_req._moreHeaders){
+        size_t more = _maxHeaderFields - HttpRequest::INLINE_HEADERS;
+        void* table = arena()->allocate(more * sizeof(HttpRequest::Field), alignof(HttpRequest::Field));
+        _req._moreHeaders = static_cast<HttpRequest::Field*>(table);
+        std::uninitialized_default_construct_n(_req._moreHeaders, more);
+    }
+    HttpRequest::Field& field = _req._headerCount < HttpRequest::INLINE_HEADERS
+        ? _req._headers[_req._headerCount]
+        : _req._moreHeaders[_req._headerCount - HttpRequest::INLINE_HEADERS];
+    _req._headerCount++;
+    field.name.offset = keyStart - _start;
+    field.name.length = keyEnd - keyStart;
+    field.value.offset = valueStart - _start;
+    field.value.length = valueEnd - valueStart;
+    field.id = httpHeaders::lookup(std::string_view(_buffer.get() + keyStart, keyEnd - keyStart));
+    if (field.id != HEADER_UNKNOWN && !_req._known[field.id])
+        _req._known[field.id] = static_cast<uint8_t>(_req._headerCount);
+}
+
+/**
+ * @brief the empty line ending the head was reached: validate it and pick how the body is read
+ *
+ * @note the head is checked before any body byte is stored, so a bad request is refused
+ *       without receiving its body
+ */
+void HttpParser::finishHeaders(){
+    _req._base = _buffer.get() + _start;
+    _bodyStart = _pos;
+    if (!validateStartLine() || !validateHeaders()){
+        _state = ERROR;
+        return;
+    }
+
+    if (_req.getHeader(HEADER_TRANSFER_ENCODING).find("chunked") != std::string_view::npos){
+        _isChunked = true;
+        _chunkState = CHUNK_SIZE;
+        _bodyEnd = _bodyStart;
+        _state = BODY;
+        return;
+    }
+    _isChunked = false;
+    if (!_req.hasHeader(HEADER_CONTENT_LENGTH)){
+        _state = DONE;
+        return;
+    }
+    _state = BODY;
+}
+
+/**
+ * @brief let the body of the request whose head was just parsed be received
+ *
+ * @param maxBodySize limit of its location: a chunked body outgrowing it is answered 413
+ *
+ * @note called by the server once it has routed the request and accepted it; a body
+ *       larger than client_body_buffer_size gets its spool file here
+ */
+void HttpParser::admitBody(size_t maxBodySize)
+{
+    _bodyAdmitted = true;
+    _bodyLimit = maxBodySize;
+    if (!_isChunked && _bodyLength > _bodyBufferSize)
+        startSpool();
+}
+
+/**
+ * @brief create the spool file of a body larger than client_body_buffer_size
+ *
+ * @return false, with the state set to ERROR (500), when no temporary file can be created
+ */
+bool HttpParser::startSpool()
+{
+    if (_spool.open())
+        return true;
+    _errStatus = 500;
+    _state = ERROR;
+    std::cout << "Cannot create a temporary file for the request body" << std::endl;
+    return false;
+}
+
+/// Append body bytes to the spool file; false, with the state set to ERROR (500), when the write fails.
+bool HttpParser::spoolData(const char* data, size_t len)
+{
+    if (_spool.write(data, len))
+        return true;
+    _errStatus = 500;
+    _state = ERROR;
+    std::cout << "Cannot write the request body to its temporary file" << std::endl;
+    return false;
+}
+
+/**
+ * @brief keep len bytes of chunk data, found at _pos: moved down to the end of the
+ *        body decoded so far, or written to the spool file once the decoded body
+ *        outgrows client_body_buffer_size
+ *
+ * @note each byte of data is moved once: decoding is linear in the body size
+ */
+bool HttpParser::storeChunkData(size_t len)
+{
+    if (!_spool.isOpen() && _bodyEnd - _bodyStart + len > _bodyBufferSize){
+        if (!startSpool() || !spoolData(_buffer.get() + _bodyStart, _bodyEnd - _bodyStart))
+            return false;
+        _bodyEnd = _bodyStart;
+    }
+    if (_spool.isOpen()){
+        if (!spoolData(_buffer.get() + _pos, len))
+            return false;
+    }
+    else{
+        if (_bodyEnd != _pos)
+            std::memmove(_buffer.get() + _bodyEnd, _buffer.get() + _pos, len);
+        _bodyEnd += len;
+    }
+    _pos += len;
+    return true;
+}
+
+/**
+ * @brief drop the chunk framing parsed so far from the buffer, moving what is not
+ *        parsed yet right after the decoded body
+ *
+ * @note the buffer then only holds the head, the decoded body (while it is kept in
+ *       memory) and the part of a line not received whole yet, however many chunks
+ *       the body has
+ */
+void HttpParser::dropChunkBytes()
+{
+    size_t parsed = _pos - _bodyEnd;
+    if (parsed == 0)
+        return;
+    std::memmove(_buffer.get() + _bodyEnd, _buffer.get() + _pos, _size - _pos);
+    _size -= parsed;
+    _scanned = _scanned >= _pos ? _scanned - parsed : _bodyEnd;
+    _pos = _bodyEnd;
+}
+
+/**
+ * @brief parse a chunk-size line: 1*HEXDIG, then optional chunk extensions
+ *
+ * @param start, end the line, without its "\r\n"
+ *
+ * @note extensions (";name=value") are checked for forbidden characters and ignored
+ * @note a chunk that would take the body past the location's client_max_body_size is
+ *       answered 413 before its data is received
+ */
+void HttpParser::parseChunkSize(size_t start, size_t end)
+{
+    size_t size = 0;
+    size_t i = start;
+    while (i < end && std::isxdigit(static_cast<unsigned char>(_buffer[i]))){
+        char c = _buffer[i];
+        int digit = c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10;
+        if (size > (SIZE_MAX >> 4)){
+            _errStatus = 413;
+            _state = ERROR;
+            std::cout << "Chunk size too large." << std::endl;
             return;
         }
-        
-        std::map<std::string, std::string>::const_iterator it = headers.find("content-length");
-        if (it != headers.end()){
-            _bodyLength = std::stoi(it->second);
-            _isChunked = false;
-            _state = BODY;
-        }
-        else
-            _state = DONE;
+        size = (size << 4) | digit;
+        i++;
+    }
+    while (i < end && (_buffer[i] == ' ' || _buffer[i] == '\t'))
+        i++;
+    if (i == start || (i < end && _buffer[i] != ';')
+        || httpScan::kernels().findInvalidValue(_buffer.get() + i, end - i) != end - i){
+        _errStatus = 400;
+        _state = ERROR;
+        std::cout << "Invalid chunk size line." << std::endl;
         return;
     }
-    size_t dd = headerline.find(":");
-    if (dd == std::string::npos)
+    if (size > _bodyLimit - decodedSize()){
+        _errStatus = 413;
+        _state = ERROR;
+        std::cout << "Chunked body too large." << std::endl;
         return;
-    std::string key = headerline.substr(0, dd);
-    std::string value = headerline.substr(dd + 1);
-    key = trim_space(key);
-    value = trim_space(value);
-    key = normalizeHeaderKey(key);
-    _req.addHeader(key, value);
+    }
+    _chunkRemaining = size;
+    _chunkState = size ? CHUNK_DATA : CHUNK_TRAILER;
+}
+
+/**
+ * @brief parse a line of the trailer section that follows the last chunk
+ *
+ * @param start, end the line, without its "\r\n"
+ *
+ * @note the empty line ends the body; trailer fields are checked like header fields,
+ *       within MAX_TRAILER_SIZE, and discarded (RFC 9110 6.5.1)
+ */
+void HttpParser::parseTrailerLine(size_t start, size_t end)
+{
+    if (start == end){
+        _state = DONE;
+        return;
+    }
+    _trailerSize += end - start;
+    if (_trailerSize > MAX_TRAILER_SIZE){
+        _errStatus = 431;
+        _state = ERROR;
+        std::cout << "Trailer section too large." << std::endl;
+        return;
+    }
+    const char* line = _buffer.get() + start;
+    size_t length = end - start;
+    size_t colon = httpScan::kernels().findByte(line, length, ':');
+    if (colon == 0 || colon == length
+        || httpScan::kernels().findNonToken(line, colon) != colon
+        || httpScan::kernels().findInvalidValue(line + colon + 1, length - colon - 1) != length - colon - 1){
+        _errStatus = 400;
+        _state = ERROR;
+        std::cout << "Invalid trailer field." << std::endl;
+    }
 }
 
 /**
  * @brief parse chunked body of an HTTP request
  *
- * @param pos current position in buffer
  * @return void
  *
- * @note Parses Transfer-Encoding: chunked format
+ * @note Parses Transfer-Encoding: chunked format in one pass, resuming where the previous
+ *       call stopped; the chunks' data is kept by storeChunkData
  */
-void HttpParser::parseChunkedBody(size_t& pos)
+void HttpParser::parseChunkedBody()
 {
-    while (pos < _buffer.size())
+    while (_state == BODY)
     {
-        if (_currentChunkSize == 0)
+        if (_chunkState == CHUNK_DATA)
         {
-            size_t lineEnd = _buffer.find("\r\n", pos);
-            if (lineEnd == std::string::npos)
-                return;
-            
-            std::string chunkSizeLine = _buffer.substr(pos, lineEnd - pos);
-            pos = lineEnd + 2;
-            _currentChunkSize = std::strtoul(chunkSizeLine.c_str(), NULL, 16);
-            _currentChunkRead = 0;
-            
-            if (_currentChunkSize == 0)
-            {
-                if (pos + 1 < _buffer.size() && _buffer.substr(pos, 2) == "\r\n")
-                    pos += 2;
-                _state = DONE;
-                return;
-            }
-        }
-        
-        if (_currentChunkRead < _currentChunkSize)
-        {
-            size_t available = _buffer.size() - pos;
-            size_t toRead = std::min(available, _currentChunkSize - _currentChunkRead);
-            std::string newBody = _req.getBody();
-            newBody += _buffer.substr(pos, toRead);
-            _req.setBody(newBody);
-            pos += toRead;
-            _currentChunkRead += toRead;
-    
-            if (_currentChunkRead < _currentChunkSize)
+            size_t available = std::min(_size - _pos, _chunkRemaining);
+            if (available == 0 || !storeChunkData(available))
                 return;
+            _chunkRemaining -= available;
+            if (_chunkRemaining == 0)
+                _chunkState = CHUNK_DATA_END;
+            continue;
         }
-        
-        if (_currentChunkRead == _currentChunkSize)
+        if (_chunkState == CHUNK_DATA_END)
         {
-            if (pos + 1 >= _buffer.size())
+            if (_size - _pos < 2)
                 return;
-            if (_buffer.substr(pos, 2) == "\r\n")
+            if (_buffer[_pos] != '\r' || _buffer[_pos + 1] != '\n')
             {
-                pos += 2;
-                _currentChunkSize = 0;
-                _currentChunkRead = 0;
+                _errStatus = 400;
+                _state = ERROR;
+                return;
             }
-            else
+            _pos += 2;
+            _chunkState = CHUNK_SIZE;
+            continue;
+        }
+        size_t end = findLineEnd(_pos);
+        if (end == std::string::npos || end - _pos > MAX_CHUNK_LINE)
+        {
+            if (_size - _pos > MAX_CHUNK_LINE)
             {
+                _errStatus = 400;
                 _state = ERROR;
-                return;
+                std::cout << "Chunk line too long." << std::endl;
             }
+            return;
         }
+        size_t start = _pos;
+        _pos = end + 2;
+        if (_chunkState == CHUNK_SIZE)
+            parseChunkSize(start, end);
+        else
+            parseTrailerLine(start, end);
     }
 }
 
 /**
  * @brief parse body of an HTTP request
  *
- * @param str headerline
  * @return void
  *
- * @note iss : in stringstream
+ * @note the body stays where it was received: done once Content-Length bytes follow the head
+ * @note a spooled body is written out as it is received, and its bytes dropped from the buffer
  */
-void HttpParser::parseBody(size_t& pos)
+void HttpParser::parseBody()
 {
-    size_t              available = _buffer.size() - pos;
-    const std::string&  curBody = _req.getBody();
-    size_t              toRead = std::min(available, _bodyLength - curBody.size());
-    std::string         newBody = _req.getBody();     
-
-    newBody += _buffer.substr(pos, toRead);             
-    _req.setBody(newBody);
-    pos += toRead;
-    if (_req.getBody().size() >= _bodyLength)
+    if (_spool.isOpen()){
+        size_t available = std::min(_size - _bodyStart, _bodyLength - _spool.size());
+        if (!spoolData(_buffer.get() + _bodyStart, available))
+            return;
+        if (_spool.size() == _bodyLength){
+            _pos = _bodyStart + available;
+            _state = DONE;
+        }
+        else{
+            _size = _bodyStart;
+            _pos = _size;
+            _scanned = _size;
+        }
+        return;
+    }
+    if (_size - _bodyStart >= _bodyLength){
+        _pos = _bodyStart + _bodyLength;
         _state = DONE;
+    }
+    else
+        _pos = _size;
 }
 
 /**
- * @brief parse an HTTP request, including startline, headers and body
+ * @brief room to receive bytes into, at the end of the buffer
  *
- * @param str rawLine (the data rawLine might be ramdom pieces, not neccessarily a full line)
- * @return an HttpRequest object
+ * @param room set to the number of bytes that may be written there
+ * @return char* where to write them; report them with received()
  *
- * @note this one is going to called mamy times, basically whenever recv() some new bytes,
+ * @note once a body's length is known and admitted the buffer is sized for all of it at once, unless
+ *       it is spooled: then for SPOOL_RECEIVE bytes of it at most
  */
-HttpRequest HttpParser::parseHttpRequest(const std::string& rawLine)
+char* HttpParser::receiveBuffer(size_t& room)
 {
-    _buffer += rawLine;
+    size_t wanted = _size + MIN_RECEIVE;
+    bool sized = _state == BODY && _bodyAdmitted && !_isChunked;
+    if (sized && _spool.isOpen())
+        wanted = std::max(wanted, _size + std::min(SPOOL_RECEIVE, _bodyLength - _spool.size()));
+    else if (sized)
+        wanted = std::max(wanted, _bodyStart + _bodyLength);
+    reserve(wanted);
+    room = _capacity - _size;
+    return _buffer.get() + _size;
+}
+
+/// len bytes were written at receiveBuffer()
+void HttpParser::received(size_t len)
+{
+    _size += len;
+}
 
-    size_t pos = 0;
-    while (_state != DONE)
+/// Copy bytes received elsewhere (completion-based loop) into the buffer.
+void HttpParser::append(const char* data, size_t len)
+{
+    reserve(_size + len);
+    std::memcpy(_buffer.get() + _size, data, len);
+    _size += len;
+}
+
+/**
+ * @brief parse the bytes received since the last call: startline, headers and body
+ *
+ * @return void; getState() is DONE once getRequest() holds a whole request, ERROR with getErrStatus() set
+ *
+ * @note this one is going to called mamy times, basically whenever recv() some new bytes,
+ * @note empty lines before the request-line are skipped (RFC 9112 2.2), such as the
+ *       CRLF a client may send after the body of a previous request
+ * @note stops after the head of a request with a body, until admitBody(): check awaitsBodyAdmission()
+ */
+void HttpParser::parseHttpRequest()
+{
+    while (_state != DONE && _state != ERROR)
     {
         if (_state < BODY)
         {
-            size_t end = _buffer.find("\r\n", pos);
-            if (end == std::string::npos)
-                return HttpRequest();
-            std::string line = _buffer.substr(pos, end - pos);
-            pos = end + 2;
-            if (!line.empty() && line.back() == '\r')
-                line.pop_back();
-            if (_state == START_LINE){
-                parseStartLine(line);
-                if (_state == ERROR)
-                    return HttpRequest();
-            }
-            if (_state == HEADERS)
-                parseHeaderLine(line);
-        }
-        if (_state == BODY){
-            if (_isChunked)
-                parseChunkedBody(pos);
+            size_t end = findLineEnd(_pos);
+            if (!checkHeadLimits(end) || end == std::string::npos)
+                return;
+            size_t start = _pos;
+            _pos = end + 2;
+            if (_state == START_LINE && start == end)
+                _start = _pos;
+            else if (_state == START_LINE)
+                parseStartLine(start, end);
             else
-                parseBody(pos);
-            break;
+                parseHeaderLine(start, end);
+            continue;
         }
+        if (!_bodyAdmitted)
+            return;
+        if (_isChunked){
+            parseChunkedBody();
+            if (_state == BODY)
+                dropChunkBytes();
+        }
+        else
+            parseBody();
+        break;
     }
-    if (pos > 0)
-        _buffer.erase(0, pos);
-    if (_state == DONE) {
-        if (!validateStartLine() || !validateHeaders() || !validateBody()) {
-            _state = ERROR;
-            return HttpRequest();
+    if (_state == DONE){
+        _req._base = _buffer.get() + _start;
+        _req._arena = arena();
+        if (_spool.isOpen())
+            _req._body = RequestBody(_spool.fd(), _spool.size());
+        else if (_isChunked)
+            _req._body = RequestBody(std::string_view(_buffer.get() + _bodyStart, _bodyEnd - _bodyStart));
+        else
+            _req._body = RequestBody(std::string_view(_buffer.get() + _bodyStart, _bodyLength));
+    }
+}
+
+/**
+ * @brief get ready for the next request of the connection
+ *
+ * @note bytes received after the request are the beginning of the next one
+ *       (pipelining): they stay where they are and the next parse starts there.
+ *       The buffer is kept, so the next request costs no allocation, unless a
+ *       large body made it grow: then it is freed, or replaced by a standard one
+ *       holding those bytes, rather than held by an idle connection.
+ * @note everything allocated from the request's arena is freed at once: its handler
+ *       and response must be gone.
+ */
+void HttpParser::nextRequest()
+{
+    if (_pos == _size){
+        _size = 0;
+        _pos = 0;
+    }
+    if (_capacity > MAX_IDLE_CAPACITY){
+        size_t leftover = _size - _pos;
+        if (leftover == 0){
+            _buffer.reset();
+            _capacity = 0;
+        }
+        else if (leftover <= INITIAL_CAPACITY){
+            std::unique_ptr<char[]> smaller(new char[INITIAL_CAPACITY]);
+            std::memcpy(smaller.get(), _buffer.get() + _pos, leftover);
+            _buffer = std::move(smaller);
+            _capacity = INITIAL_CAPACITY;
+            _size = leftover;
+            _pos = 0;
         }
-        return _req;
     }
-    return HttpRequest();
+    _req = HttpRequest();
+    _errStatus = 0;
+    _state = START_LINE;
+    _start = _pos;
+    _scanned = _pos;
+    _bodyStart = _pos;
+    _bodyLength = 0;
+    _isChunked = false;
+    _bodyAdmitted = false;
+    _bodyLimit = SIZE_MAX;
+    _chunkState = CHUNK_SIZE;
+    _chunkRemaining = 0;
+    _bodyEnd = _pos;
+    _trailerSize = 0;
+    _spool.close();
+    if (_arena)
+        _arena->release();
+}
+
+/// Drop everything, received bytes included, for a new client.
+void HttpParser::reset()
+{
+    _pos = _size;
+    nextRequest();
+}
+
+/// The arena of the current request, created the first time a request needs one.
+std::pmr::memory_resource* HttpParser::arena()
+{
+    if (!_arena)
+        _arena = std::make_unique<RequestArena>();
+    return _arena->resource();
 }
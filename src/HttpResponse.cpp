@@ -1,64 +1,112 @@
 #include "HttpResponse.hpp"
+#include "httpUtils.hpp"
+
+#include <algorithm>
+#include <charconv>
+
+/// Status line of a standard status, as sent for HTTP/1.1.
+struct StatusLine {
+    int                 status;
+    std::string_view    reason;
+    std::string_view    line;
+};
+
+#define STATUS_LINE(code, reason) {code, reason, "HTTP/1.1 " #code " " reason "\r\n"}
+/// Sorted by status, for reasonPhrase and writeHead.
+static constexpr StatusLine STATUS_LINES[] = {
+    STATUS_LINE(200, "OK"),
+    STATUS_LINE(201, "Created"),
+    STATUS_LINE(204, "No Content"),
+    STATUS_LINE(301, "Moved Permanently"),
+    STATUS_LINE(400, "Bad Request"),
+    STATUS_LINE(403, "Forbidden"),
+    STATUS_LINE(404, "Not Found"),
+    STATUS_LINE(405, "Method Not Allowed"),
+    STATUS_LINE(408, "Request Timeout"),
+    STATUS_LINE(409, "Conflict"),
+    STATUS_LINE(413, "Payload Too Large"),
+    STATUS_LINE(414, "URI Too Long"),
+    STATUS_LINE(417, "Expectation Failed"),
+    STATUS_LINE(431, "Request Header Fields Too Large"),
+    STATUS_LINE(500, "Internal Server Error"),
+    STATUS_LINE(503, "Service Unavailable"),
+};
+#undef STATUS_LINE
+static_assert(std::is_sorted(std::begin(STATUS_LINES), std::end(STATUS_LINES),
+                [](const StatusLine& a, const StatusLine& b){ return a.status < b.status; }));
+
+static const StatusLine* findStatusLine(int status){
+    const StatusLine* it = std::lower_bound(std::begin(STATUS_LINES), std::end(STATUS_LINES), status,
+                                            [](const StatusLine& s, int code){ return s.status < code; });
+    return it != std::end(STATUS_LINES) && it->status == status ? it : nullptr;
+}
+
+/// Reason phrase of a standard status, empty for the others.
+std::string_view HttpResponse::reasonPhrase(int status){
+    const StatusLine* known = findStatusLine(status);
+    return known ? known->reason : std::string_view();
+}
+
+/// Header fields writeHead writes itself, whatever a handler set.
+static bool isComputedHeader(std::string_view name){
+    return httpHeaders::equalsNoCase(name, "Content-Length") || httpHeaders::equalsNoCase(name, "Date");
+}
 
 // --------------------
 //   Serialization
 // --------------------
 /**
- * @brief builds the HTTP response string
+ * @brief append the head of the response (status line, headers, empty line) to out
  *
- * @param void
- * @return a string representing the full HTTP response
+ * @param out the buffer the head is appended to, reused from one response to the next
  *
- * @note constructs the response string including status line, headers, and body
+ * @note the status line is a constant for a standard status, the Date is formatted once
+ *       per second (httpUtils::currentDate) and the fixed header block is appended as is:
+ *       only the map headers and Content-Length are formatted per response.
+ * @note Content-Length is the size of the body (of the file region for a file body),
+ *       not sent for 204 (RFC 9110 8.6).
  */
-std::string HttpResponse::buildResponseString(){
-    std::ostringstream response;
-    response << _version << " " << _status << " " << _reason << "\r\n";
-    bool hasContentLength = false;
+void HttpResponse::writeHead(std::string& out) const {
+    const StatusLine* known = findStatusLine(_status);
+    if (known && _version == "HTTP/1.1" && _reason == known->reason)
+        out.append(known->line);
+    else {
+        char code[16];
+        out.append(_version).append(" ");
+        out.append(code, std::to_chars(code, code + sizeof(code), _status).ptr);
+        out.append(" ").append(_reason).append("\r\n");
+    }
+    out.append("Date: ").append(httpUtils::currentDate()).append("\r\n");
+    out.append(_fixedHeaders);
 
+    bool hasConnection = false;
     for (const auto &header : _responseHeaders) {
-        if (header.first == "Content-Length")
-            hasContentLength = true;
-        response << header.first << ": " << header.second << "\r\n";
+        if (isComputedHeader(header.first))
+            continue;
+        if (httpHeaders::equalsNoCase(header.first, "Connection"))
+            hasConnection = true;
+        out.append(header.first).append(": ").append(header.second).append("\r\n");
     }
-
-    if (!hasContentLength)
-        response << "Content-Length: " << _body.size() << "\r\n";
-
-    if (_responseHeaders.find("Connection") == _responseHeaders.end()) {
-        if (_keepConnectionAlive)
-            response << "Connection: keep-alive\r\n";
-        else
-            response << "Connection: close\r\n";
+    if (_status != 204) {
+        char length[24];
+        out.append("Content-Length: ");
+        size_t bodySize = _file.isOpen() ? _file.length() : _body.size();
+        out.append(length, std::to_chars(length, length + sizeof(length), bodySize).ptr);
+        out.append("\r\n");
     }
-
-    response << "\r\n";
-    response << _body;
-    return response.str();
+    if (!hasConnection)
+        out.append(_keepConnectionAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n");
+    out.append("\r\n");
 }
 
-static const std::map<int, std::string> STATUS_REASON = {
-    {301, "Moved Permanently"},
-    {400, "Bad Request"},
-    {403, "Forbidden"},
-    {404, "Not Found"},
-    {405, "Method Not Allowed"},
-    {408, "Request Timeout"},
-    {413, "Payload Too Large"},
-    {414, "URI Too Long"},
-    {431, "Request Header Fields Too Large"},
-    {500, "Internal Server Error"},
-};
-
-std::string loadFile(const std::string& path)
-{
-    std::ifstream file(path.c_str());
-    if (!file.is_open())
-        return "";
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    return buffer.str();
-}
+/// Header lines of every error page.
+static constexpr std::string_view ERROR_HEADERS =
+    "Content-Type: text/html; charset=UTF-8\r\n"
+    "Cache-Control: no-cache, no-store, must-revalidate\r\n"
+    "Pragma: no-cache\r\n"
+    "Expires: 0\r\n"
+    "Server: webserv/1.0\r\n"
+    "X-Content-Type-Options: nosniff\r\n";
 
 /**
  * @brief   Generates an HTTP error response with the specified status code
@@ -67,8 +115,9 @@ std::string loadFile(const std::string& path)
  * @return  HttpResponse object representing the error response
  *
  * @note    This function creates a simple HTML error page corresponding to the given status code.
- *          If a static HTML file for the error exists in "static/errors/", it will be used as the body.
- *          Otherwise, a default HTML message will be generated.
+ *          The virtual host's error page for the status is used as the body, as read when the
+ *          configuration was built (ServerConfig::errorPageBodies): no file is read here, on the
+ *          event loop. Otherwise, a default HTML message will be generated.
  *
  * @example response:
    * HTTP/1.1 404 Not Found
@@ -79,18 +128,17 @@ std::string loadFile(const std::string& path)
  */
 HttpResponse makeErrorResponse(int status, const config::ServerConfig* vh)
 {
-   std::string reason;
-   if (STATUS_REASON.count(status))
-      reason = STATUS_REASON.at(status);
-   else {
+   std::string reason(HttpResponse::reasonPhrase(status));
+   if (reason.empty() || status < 300) {
       status = 500;
       reason = "Internal Server Error";
    }
 
    std::string body;
-   if (vh && vh->errorPages.count(status)){
-      std::string path = vh->errorPages.at(status);
-      body = loadFile(vh->errorPages.at(status));
+   if (vh){
+      std::map<int, std::string>::const_iterator page = vh->errorPageBodies.find(status);
+      if (page != vh->errorPageBodies.end())
+         body = page->second;
    }
 
    if (body.empty()) {
@@ -104,27 +152,23 @@ HttpResponse makeErrorResponse(int status, const config::ServerConfig* vh)
         "</html>";
     }
 
-    std::map<std::string, std::string> headers;
-    headers["Content-Type"] = "text/html; charset=UTF-8";
-    headers["Content-Length"] = std::to_string(body.size());
-    headers["Cache-Control"] = "no-cache, no-store, must-revalidate";
-    headers["Pragma"] = "no-cache";
-    headers["Expires"] = "0";
-    headers["Server"] = "webserv/1.0";
-    headers["X-Content-Type-Options"] = "nosniff";
-
-    return HttpResponse("HTTP/1.1", status, reason, body, headers, false, false);
+    HttpResponse response("HTTP/1.1", status, reason, std::move(body), HttpResponse::Headers(), false, false);
+    response.setFixedHeaders(ERROR_HEADERS);
+    return response;
 }
 
 HttpResponse makeRedirect301(const std::string& location, const config::ServerConfig* vh)
 {
    std::string body;
-   if (vh && vh->errorPages.count(301))
-      body = loadFile(vh->errorPages.at(301));
+   if (vh){
+      std::map<int, std::string>::const_iterator page = vh->errorPageBodies.find(301);
+      if (page != vh->errorPageBodies.end())
+         body = page->second;
+   }
    if (body.empty())
       body = "<h1>301 Moved Permanently</h1>";
-   std::map<std::string, std::string> headers;
+   HttpResponse::Headers headers;
    headers["Location"] = location;
 
-   return HttpResponse("HTTP/1.1", 301, "Moved Permanently", body, headers, false, true);
+   return HttpResponse("HTTP/1.1", 301, "Moved Permanently", std::move(body), std::move(headers), false, true);
 }
\ No newline at end of file
@@ -1,17 +1,44 @@
 
 #include "HttpResponseHandler.hpp"
+#include "OffloadExecutor.hpp"
 
-static bool extractMultipartFile(const HttpRequest& req, std::string& outFileData, std::string& outFileName)
+#include <fcntl.h>
+#include <optional>
+
+/// Header lines of every static file response.
+static constexpr std::string_view STATIC_FILE_HEADERS =
+   "Server: MiniWebserv/1.0\r\n"
+   "Cache-Control: no-cache, no-store, must-revalidate\r\n"
+   "Pragma: no-cache\r\n"
+   "Expires: 0\r\n";
+
+/// Longest part head read from a multipart body.
+static constexpr size_t MAX_PART_HEADERS = 8192;
+
+/// The file of a multipart/form-data body: its name, and where its data is in the body.
+struct MultipartFile {
+   std::string name;
+   size_t      offset = 0;
+   size_t      length = 0;
+};
+
+/**
+ * @brief locate the file of a multipart/form-data body
+ *
+ * @note the body is only searched, through RequestBody: a spooled one is read a
+ *       block at a time, and the data itself is never copied here
+ */
+static bool extractMultipartFile(const HttpRequest& req, MultipartFile& out)
 {
-	if (!req.getHeaders().count("content-type"))
+	if (!req.hasHeader(HEADER_CONTENT_TYPE))
 		return false;
 
-	std::string ct = req.getHeaders().at("content-type");
+	std::string_view ct = req.getHeader(HEADER_CONTENT_TYPE);
 	size_t bpos = ct.find("boundary=");
 	if (bpos == std::string::npos)
 		return false;
 
-	std::string boundary = ct.substr(bpos + 9);
+	std::string boundary(ct.substr(bpos + 9));
    size_t semiPos = boundary.find(";");
    if (semiPos != std::string::npos){
       boundary = boundary.substr(0, semiPos);
@@ -19,30 +46,30 @@ static bool extractMultipartFile(const HttpRequest& req, std::string& outFileDat
 
    boundary = httpUtils::trim_space(boundary);
    std::string marker = "--" + boundary;
-	const std::string& body = req.getBody();
+	const RequestBody& body = req.getBody();
 
 	size_t partStart = body.find(marker);
 	if (partStart == std::string::npos)
 		return false;
 	partStart += marker.size();
-	if (body.compare(partStart, 2, "\r\n") == 0)
+	if (body.slice(partStart, 2) == "\r\n")
 		partStart += 2;
 
    size_t headersEnd = body.find("\r\n\r\n", partStart);
-   if (headersEnd == std::string::npos)
+   if (headersEnd == std::string::npos || headersEnd - partStart > MAX_PART_HEADERS)
       return false;
     
-   std::string headers = body.substr(partStart, headersEnd - partStart);
+   std::string headers = body.slice(partStart, headersEnd - partStart);
    size_t filenamePos = headers.find("filename=\"");
    if (filenamePos != std::string::npos) {
       filenamePos += 10;
       size_t filenameEnd = headers.find("\"", filenamePos);
       if (filenameEnd != std::string::npos)
-         outFileName = headers.substr(filenamePos, filenameEnd - filenamePos);
+         out.name = headers.substr(filenamePos, filenameEnd - filenamePos);
    }
     
-   if (outFileName.empty())
-      outFileName = "upload_" + std::to_string(time(NULL)) + ".dat";
+   if (out.name.empty())
+      out.name = "upload_" + std::to_string(time(NULL)) + ".dat";
 
 	size_t dataStart = headersEnd + 4;
    size_t markerPos = body.find( marker, dataStart);
@@ -50,14 +77,131 @@ static bool extractMultipartFile(const HttpRequest& req, std::string& outFileDat
 		return false;
 
 	size_t dataEnd = markerPos;
-	if (dataEnd >= 2 && body.compare(dataEnd - 2, 2, "\r\n") == 0)
+	if (dataEnd >= dataStart + 2 && body.slice(dataEnd - 2, 2) == "\r\n")
 		dataEnd -= 2;
 
-	outFileData.assign(body.data() + dataStart, dataEnd - dataStart);
-
+	out.offset = dataStart;
+	out.length = dataEnd - dataStart;
 	return true;
 }
 
+/**
+ * @brief resolve the target of a GET: path mapping, stat, index file probe, permission, open
+ *
+ * @note every call here may block on a slow disk: run through offload(), each
+ *       operation timed for the loop's filesystem latency counters
+ */
+static FileLookup lookupStaticFile(const config::LocationConfig* lc, const std::string& uri)
+{
+   FileLookup found;
+   found.path = timedFs(FS_RESOLVE, [&]{ return httpUtils::mapUriToPath(lc, uri); });
+   if (timedFs(FS_STAT, [&]{ return stat(found.path.c_str(), &found.st); }) < 0) {
+      found.status = 404;
+      return found;
+   }
+   if (S_ISDIR(found.st.st_mode)) {
+      if (uri.empty() || uri.back() != '/') {
+         found.status = 301;
+         return found;
+      }
+      if (!httpUtils::isMethodAllowed(lc, "GET")) {
+         found.status = 405;
+         return found;
+      }
+      std::string index_file = timedFs(FS_INDEX, [&]{ return httpUtils::getIndexFile(found.path, lc); });
+      if (index_file.empty()) {
+         found.listDirectory = lc->autoindex;
+         if (!lc->autoindex)
+            found.status = 404;
+         return found;
+      }
+      found.path += "/" + index_file;
+      if (timedFs(FS_STAT, [&]{ return stat(found.path.c_str(), &found.st); }) < 0 || !S_ISREG(found.st.st_mode)) {
+         found.status = 404;
+         return found;
+      }
+   }
+   else if (!httpUtils::isMethodAllowed(lc, "GET")) {
+      found.status = 405;
+      return found;
+   }
+   if (timedFs(FS_ACCESS, [&]{ return access(found.path.c_str(), R_OK); }) < 0)
+      found.status = 403;
+   else if (!S_ISREG(found.st.st_mode) && !S_ISDIR(found.st.st_mode))
+      found.status = 403;
+   if (found.status || found.listDirectory)
+      return found;
+   // the file is only opened: the server sends it with sendfile, never reading it into memory
+   FsTimer timer(FS_OPEN);
+   int fd = open(found.path.c_str(), O_RDONLY | O_CLOEXEC);
+   if (fd < 0) {
+      found.status = 500;
+      return found;
+   }
+   found.file = std::make_shared<OpenFile>(fd);
+   // the size sent is the one of the file opened
+   if (fstat(fd, &found.st) < 0 || !S_ISREG(found.st.st_mode))
+      found.status = 500;
+   return found;
+}
+
+/**
+ * @brief what the target of a GET is on disk: from the open file cache when it is
+ *        there, otherwise looked up off the event loop (and cached)
+ *
+ * @note a cached target costs no filesystem call at all
+ */
+static Task<std::shared_ptr<const FileLookup>> findStaticFile(const config::LocationConfig* lc, const std::string& uri)
+{
+   std::shared_ptr<const FileLookup> found;
+   if (!OpenFileCache::enabled()) {
+      co_await offload([&]{ found = std::make_shared<const FileLookup>(lookupStaticFile(lc, uri)); });
+      co_return found;
+   }
+   OpenFileCache& cache = OpenFileCache::instance();
+   std::string key = httpUtils::locationPath(lc, uri);
+   found = cache.find(key, lc);
+   if (!found)
+      co_await offload([&]{ found = cache.load(key, lc, [&]{ return lookupStaticFile(lc, uri); }); });
+   co_return found;
+}
+
+/**
+ * @brief remove the target of a DELETE
+ *
+ * @return int 0 once removed, else the error status to answer
+ *
+ * @note blocking: run through offload()
+ */
+static int deleteStaticFile(const config::LocationConfig* lc, const std::string& uri)
+{
+   std::string fullpath = timedFs(FS_RESOLVE, [&]{ return httpUtils::mapUriToPath(lc, uri); });
+   struct stat st;
+   if (timedFs(FS_STAT, [&]{ return lstat(fullpath.c_str(), &st); }) < 0)
+      return 404;
+   if (S_ISLNK(st.st_mode))
+      return 403;
+   if (!S_ISREG(st.st_mode))
+      return 403;
+   if (timedFs(FS_UNLINK, [&]{ return unlink(fullpath.c_str()); }) < 0)
+   {
+      // file not existing
+      if (errno == ENOENT)
+         return 404;
+      // not access
+      if (errno == EACCES || errno == EPERM)
+         return 403;
+      // is dir or not empty dir
+      if (errno == EISDIR || errno == ENOTEMPTY)
+         return 409;
+      return 500;
+   }
+   // the next GET sees it gone, without waiting for the open file cache's inotify thread
+   if (OpenFileCache::enabled())
+      OpenFileCache::instance().invalidate(fs::path(fullpath).parent_path().string());
+   return 0;
+}
+
 // --------------------
 // Internal Utility Methods
 // --------------------
@@ -78,7 +222,7 @@ static bool extractMultipartFile(const HttpRequest& req, std::string& outFileDat
  * \r\n
  * <html>...</html>
  */
-HttpResponse HttpResponseHandler::parseCGIOutput(const std::string& out, const HttpRequest& req, const config::ServerConfig* vh){
+HttpResponse HttpResponseHandler::parseCGIOutput(std::string out, const HttpRequest& req, const config::ServerConfig* vh){
    size_t pos = out.find("\r\n\r\n");
    size_t sepLen = 4;
    if (pos == std::string::npos){
@@ -88,10 +232,11 @@ HttpResponse HttpResponseHandler::parseCGIOutput(const std::string& out, const H
          return makeErrorResponse(500, vh);
    }
    std::string headersString = out.substr(0, pos);
-   std::string bodyString = out.substr(pos + sepLen);
+   // the body is what remains of the output: moved down in place rather than copied out
+   std::string bodyString = std::move(out.erase(0, pos + sepLen));
    std::string statusCode = "200";
    std::string statusMsg = "OK";
-   std::map<std::string, std::string>  headersMap;
+   HttpResponse::Headers headersMap(req.getArena());
    std::istringstream ss(headersString);
    std::string       line;
 
@@ -109,14 +254,13 @@ HttpResponse HttpResponseHandler::parseCGIOutput(const std::string& out, const H
          statusMsg  = val.substr(space + 1);
       }
       else
-         headersMap[key] = val;
+         headersMap[std::pmr::string(key)] = val;
    }
 
-   headersMap["Content-Length"] = std::to_string(bodyString.size());
    if (headersMap.find("Content-Type") == headersMap.end())
       headersMap["Content-Type"] = "text/html; charset=UTF-8";
 
-   return HttpResponse("HTTP/1.1", std::stoi(statusCode), statusMsg, bodyString, headersMap, httpUtils::shouldKeepAlive(req), true);
+   return HttpResponse("HTTP/1.1", std::stoi(statusCode), statusMsg, std::move(bodyString), std::move(headersMap), httpUtils::shouldKeepAlive(req), true);
 }
 
 /**
@@ -131,56 +275,54 @@ HttpResponse HttpResponseHandler::parseCGIOutput(const std::string& out, const H
 HttpResponse HttpResponseHandler::generateAutoIndex(const std::string& dirPath, HttpRequest& req)
 {
     namespace fs = std::filesystem;
-    std::string body = "<html><head><title>Index of " + req.getPath() + "</title></head><body>";
-    body += "<h1>Index of " + req.getPath() + "</h1><ul>";
+    std::string path(req.getPath());
+    std::string body = "<html><head><title>Index of " + path + "</title></head><body>";
+    body += "<h1>Index of " + path + "</h1><ul>";
 
     for (const auto& entry : fs::directory_iterator(dirPath))
     {
         std::string name = entry.path().filename().string();
-        body += "<li><a href=\"" + req.getPath();
-        if (req.getPath().back() != '/')
+        body += "<li><a href=\"" + path;
+        if (path.back() != '/')
             body += "/";
         body += name + "\">" + name + "</a></li>";
     }
 
     body += "</ul></body></html>";
 
-    std::map<std::string, std::string> headers;
+    HttpResponse::Headers headers(req.getArena());
     headers["content-type"] = "text/html";
-    headers["content-length"] = std::to_string(body.size());
     headers["server"] = "MiniWebserv/1.0";
-    headers["date"] = httpUtils::formatTime(time(NULL));
 
-    return HttpResponse("HTTP/1.1", 200, "OK", body, headers, httpUtils::shouldKeepAlive(req), true);
+    return HttpResponse("HTTP/1.1", 200, "OK", std::move(body), std::move(headers), httpUtils::shouldKeepAlive(req), true);
 }
 
 // --------------------
 //  InternalHandlers for different HTTP methods
 // --------------------
-HttpResponse HttpResponseHandler::handleGET(HttpRequest& req, const config::ServerConfig* vh)
+Task<HttpResponse> HttpResponseHandler::handleGET(HttpRequest& req, const config::ServerConfig* vh)
 {
-   std::string fullUri = req.getPath();
-   std::string uri = fullUri;
-   size_t queryPos = fullUri.find('?');
-   if (queryPos != std::string::npos)
-      uri = fullUri.substr(0, queryPos);
+   std::string uri(req.getPath());
 
    if (httpUtils::isCgiRequest(req, *vh)){
       const config::LocationConfig* lc = httpUtils::findLocationConfig(vh, uri, "GET");
       if (!lc)
-         return makeErrorResponse(403, vh);
+         co_return makeErrorResponse(403, vh);
       CGI cgi(req, *lc);
       if (!cgi.isAllowedCgi())
-        return makeErrorResponse(403, vh);
-      std::string cgi_output = cgi.execute();
+        co_return makeErrorResponse(403, vh);
+      // the pipes and the child are watched by the event loop
+      co_await onEventLoop();
+      std::string cgi_output = co_await cgi.execute();
+      co_await onHandlerPool();
       if (cgi_output.empty() || cgi_output == "CGI_EXECUTE_FAILED")
-         return makeErrorResponse(500, vh);
-      return parseCGIOutput(cgi_output, req, vh);
+         co_return makeErrorResponse(500, vh);
+      co_return parseCGIOutput(std::move(cgi_output), req, vh);
    }
 
    const config::LocationConfig* lc = httpUtils::findLocationConfig(vh, uri, "GET");
    if (!lc)
-      return makeErrorResponse(404, vh);
+      co_return makeErrorResponse(404, vh);
 
    if (lc->path.length() > 1 && lc->path.back() == '/' && !uri.empty() && uri.back() != '/') {
       std::string locWithoutSlash = lc->path.substr(0, lc->path.length() - 1);
@@ -189,73 +331,46 @@ HttpResponse HttpResponseHandler::handleGET(HttpRequest& req, const config::Serv
    }
 
    if (!lc->redirect.empty())
-      return makeRedirect301(lc->redirect, vh);
-
-   std::string fullpath = httpUtils::mapUriToPath(lc, uri);
-   struct stat st;
-   if (stat(fullpath.c_str(), &st) == 0)
-   {
-      if (S_ISDIR(st.st_mode))
-      {
-         if (uri.empty() || uri.back() != '/')
-            return makeRedirect301(uri + "/", vh);
-         if (!httpUtils::isMethodAllowed(lc, "GET"))
-            return makeErrorResponse(405, vh);
-
-         std::string index_file = httpUtils::getIndexFile(fullpath, lc);
-         if (!index_file.empty()) {
-            fullpath += "/" + index_file;
-            if (stat(fullpath.c_str(), &st) < 0 || !S_ISREG(st.st_mode))
-               return makeErrorResponse(404, vh);
+      co_return makeRedirect301(lc->redirect, vh);
+
+   std::shared_ptr<const FileLookup> found = co_await findStaticFile(lc, uri);
+   if (found->status == 301)
+      co_return makeRedirect301(uri + "/", vh);
+   if (found->status)
+      co_return makeErrorResponse(found->status, vh);
+   const std::string& fullpath = found->path;
+   const struct stat& st = found->st;
+   if (found->listDirectory) {
+      std::optional<HttpResponse> listing;
+      co_await offload([&]{
+         FsTimer timer(FS_LIST);
+         try {
+            listing.emplace(generateAutoIndex(fullpath, req));
+         } catch (const std::exception& e) {
+            std::cerr << "autoindex failed: " << e.what() << std::endl;
          }
-         else
-         {
-            if (!lc->autoindex)
-               return makeErrorResponse(404, vh);
-            return generateAutoIndex(fullpath, req);
-         }
-      }
-      else if (!httpUtils::isMethodAllowed(lc, "GET"))
-         return makeErrorResponse(405, vh);
+      });
+      if (!listing)
+         co_return makeErrorResponse(500, vh);
+      co_return std::move(*listing);
    }
-   else
-      return makeErrorResponse(404, vh);
-   if (access(fullpath.c_str(), R_OK) < 0)
-      return makeErrorResponse(403, vh);
-   if (!S_ISREG(st.st_mode) && !S_ISDIR(st.st_mode))
-      return makeErrorResponse(403, vh);
-
-   std::string mime_type = httpUtils::getMimeType(fullpath);
-   bool forceDownload = (fullUri.find("?download") != std::string::npos);
-
-   std::ifstream ifs(fullpath.c_str(), std::ios::binary);
-   if (!ifs.is_open())
-      return makeErrorResponse(500, vh);
-
-   ifs.seekg(0, std::ios::end);
-   std::streamsize size = ifs.tellg();
-   if (size < 0)
-      return makeErrorResponse(500, vh);
-   ifs.seekg(0, std::ios::beg);
-   std::string body(size, '\0');
-   ifs.read(&body[0], size);
-   ifs.close();
-
-   std::map<std::string, std::string> headers;
+
+   std::string_view mime_type = httpUtils::getMimeType(fullpath);
+   bool forceDownload = req.getQuery().starts_with("download");
+
+   char lastModified[HTTP_DATE_SIZE];
+   HttpResponse::Headers headers(req.getArena());
    headers["Content-Type"] = mime_type;
-   headers["Content-Length"] = std::to_string(body.size());
-   headers["Server"] = "MiniWebserv/1.0";
-   headers["Last-Modified"] = formatTime(st.st_mtime);
-   headers["Date"] = formatTime(time(NULL));
-   headers["Cache-Control"] = "no-cache, no-store, must-revalidate";
-   headers["Pragma"] = "no-cache";
-   headers["Expires"] = "0";
+   headers["Last-Modified"] = std::string_view(lastModified, formatTime(st.st_mtime, lastModified));
    if (forceDownload) {
       size_t lastSlash = fullpath.find_last_of('/');
       std::string filename = (lastSlash != std::string::npos) ? fullpath.substr(lastSlash + 1) : "download";
       headers["content-disposition"] = "attachment; filename=\"" + filename + "\"";
    }
-   return HttpResponse("HTTP/1.1", 200, "OK", body, headers, shouldKeepAlive(req), true);
+   HttpResponse response("HTTP/1.1", 200, "OK", "", std::move(headers), shouldKeepAlive(req), true);
+   response.setFixedHeaders(STATIC_FILE_HEADERS);
+   response.setFileBody(FileBody(found->file, 0, static_cast<size_t>(st.st_size)));
+   co_return response;
 }
 
 /**
@@ -279,66 +394,78 @@ HttpResponse HttpResponseHandler::handleGET(HttpRequest& req, const config::Serv
    *
    * {"status":"success"}
  */
-HttpResponse HttpResponseHandler::handlePOST(HttpRequest& req, const config::ServerConfig* vh)
+Task<HttpResponse> HttpResponseHandler::handlePOST(HttpRequest& req, const config::ServerConfig* vh)
 {
-	std::string fullUri = req.getPath();
-	std::string uri = fullUri;
-	size_t queryPos = fullUri.find('?');
-	if (queryPos != std::string::npos) 
-		uri = fullUri.substr(0, queryPos);
+	std::string_view uri = req.getPath();
    const config::LocationConfig* lc = httpUtils::findLocationConfig(vh, uri, "POST");
    if (!lc)
-      return makeErrorResponse(403, vh);
+      co_return makeErrorResponse(403, vh);
    if (req.getBody().size() > lc->clientMaxBodySize)
-      return makeErrorResponse(413, vh);
+      co_return makeErrorResponse(413, vh);
 
 	if (httpUtils::isCgiRequest(req, *vh)){
 		const config::LocationConfig* lc = httpUtils::findLocationConfig(vh, uri, "POST");
 		if (!lc)
-			return makeErrorResponse(403, vh);
+			co_return makeErrorResponse(403, vh);
       if (!httpUtils::isMethodAllowed(lc, "POST"))
-         return makeErrorResponse(405, vh);
+         co_return makeErrorResponse(405, vh);
 
 		CGI cgi(req, *lc);
 		if (!cgi.isAllowedCgi())
-		   return makeErrorResponse(403, vh);
+		   co_return makeErrorResponse(403, vh);
 
-		std::string cgi_output = cgi.execute();
+		co_await onEventLoop();
+		std::string cgi_output = co_await cgi.execute();
+		co_await onHandlerPool();
 		if (cgi_output.empty() || cgi_output == "CGI_EXECUTE_FAILED")
-			return makeErrorResponse(500, vh);
-		return parseCGIOutput(cgi_output, req, vh);
+			co_return makeErrorResponse(500, vh);
+		co_return parseCGIOutput(std::move(cgi_output), req, vh);
 	}
 
    if (!httpUtils::isMethodAllowed(lc, "POST"))
-      return makeErrorResponse(405, vh);
+      co_return makeErrorResponse(405, vh);
 
-	std::string ct;
-	if (req.getHeaders().count("content-type"))
-		ct = req.getHeaders().at("content-type");
+	std::string_view ct = req.getHeader(HEADER_CONTENT_TYPE);
 	if (ct.find("multipart/form-data") != std::string::npos)
 	{
-		std::string fileData;
-      std::string fileName;
-		if (!extractMultipartFile(req, fileData, fileName))
-         return makeErrorResponse(400, vh);
-
+		MultipartFile file;
 		std::string fullPath = lc->upload_dir;
       if (!fullPath.empty() && fullPath.back() != '/')
          fullPath += "/";
-      if (access(fullPath.c_str(), W_OK) != 0)
-         return makeErrorResponse(403, vh);
-      fullPath += fileName;
-		std::ofstream ofs(fullPath.c_str(), std::ios::binary);
-		ofs.write(fileData.data(), fileData.size());
-		ofs.close();
-      std::string responseBody = "File uploaded successfully: " + fileName;
-      std::map<std::string, std::string> headers;
+      bool found = false;
+      bool writable = false;
+      bool written = false;
+      // a spooled body is searched and copied with blocking file I/O: all of it off the loop
+      co_await offload([&]{
+         found = extractMultipartFile(req, file);
+         if (!found)
+            return;
+         writable = timedFs(FS_ACCESS, [&]{ return access(fullPath.c_str(), W_OK); }) == 0;
+         if (!writable)
+            return;
+         fullPath += file.name;
+         FsTimer timer(FS_WRITE);
+         int fd = open(fullPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+         if (fd < 0)
+            return;
+         written = req.getBody().copyTo(fd, file.offset, file.length);
+         close(fd);
+         if (OpenFileCache::enabled())
+            OpenFileCache::instance().invalidate(fs::path(fullPath).parent_path().string());
+      });
+      if (!found)
+         co_return makeErrorResponse(400, vh);
+      if (!writable)
+         co_return makeErrorResponse(403, vh);
+      if (!written)
+         co_return makeErrorResponse(500, vh);
+      std::string responseBody = "File uploaded successfully: " + file.name;
+      HttpResponse::Headers headers(req.getArena());
       headers["Content-Type"] = "text/plain";
-      headers["Content-Length"] = std::to_string(responseBody.size());
-      return HttpResponse("HTTP/1.1", 200, "Created", responseBody, headers, httpUtils::shouldKeepAlive(req), true);
+      co_return HttpResponse("HTTP/1.1", 200, "Created", std::move(responseBody), std::move(headers), httpUtils::shouldKeepAlive(req), true);
 	}
 	std::string responseBody = "Received " + std::to_string(req.getBody().size()) + " bytes";
-	return HttpResponse("HTTP/1.1", 201, "Created", responseBody, std::map<std::string, std::string>(), httpUtils::shouldKeepAlive(req), true);
+	co_return HttpResponse("HTTP/1.1", 201, "Created", std::move(responseBody), HttpResponse::Headers(req.getArena()), httpUtils::shouldKeepAlive(req), true);
 }
 
 /**
@@ -361,46 +488,62 @@ HttpResponse HttpResponseHandler::handlePOST(HttpRequest& req, const config::Ser
    *
    * {"status":"success"}
  */
-HttpResponse HttpResponseHandler::handleDELETE(HttpRequest& req, const config::ServerConfig* vh){
-   std::string uri = req.getPath();
+Task<HttpResponse> HttpResponseHandler::handleDELETE(HttpRequest& req, const config::ServerConfig* vh){
+   std::string uri(req.getPath());
    const config::LocationConfig* lc = httpUtils::findLocationConfig(vh, uri, "DELETE");
    if (!lc)
-      return makeErrorResponse(404, vh);
+      co_return makeErrorResponse(404, vh);
 
    if (!httpUtils::isMethodAllowed(lc, "DELETE"))
-      return makeErrorResponse(405, vh);
-
-   std::string fullpath = httpUtils::mapUriToPath(lc, uri);
-   struct stat st;
-   if (lstat(fullpath.c_str(), &st) < 0)
-      return makeErrorResponse(404, vh);
-   if (S_ISLNK(st.st_mode))
-      return makeErrorResponse(403, vh);
-   if (!S_ISREG(st.st_mode))
-      return makeErrorResponse(403, vh);
-   if (unlink(fullpath.c_str()) < 0)
-   {
-      // file not existing
-      if (errno == ENOENT)
-         return makeErrorResponse(404, vh);
-      // not access
-      if (errno == EACCES || errno == EPERM)
-         return makeErrorResponse(403, vh);
-      // is dir or not empty dir
-      if (errno == EISDIR || errno == ENOTEMPTY)
-         return makeErrorResponse(409, vh);
-      return makeErrorResponse(500, vh);
-   }
+      co_return makeErrorResponse(405, vh);
 
-   std::map<std::string, std::string> headers;
-   headers["Content-Length"] = "0";
+   int status = 0;
+   co_await offload([&]{ status = deleteStaticFile(lc, uri); });
+   if (status)
+      co_return makeErrorResponse(status, vh);
 
-   return HttpResponse("HTTP/1.1", 204, "No Content", "", std::map<std::string, std::string>(), httpUtils::shouldKeepAlive(req), true);
+   co_return HttpResponse("HTTP/1.1", 204, "No Content", "", HttpResponse::Headers(req.getArena()), httpUtils::shouldKeepAlive(req), true);
 }
 
 // --------------------
 //   Public Handler Methods
 // --------------------
+Task<HttpResponse> HttpResponseHandler::handleMethod(HttpRequest& req, const config::ServerConfig* vh) {
+   switch (req.getMethodId()){
+      case METHOD_GET:
+         co_return co_await handleGET(req, vh);
+      case METHOD_POST:
+         co_return co_await handlePOST(req, vh);
+      case METHOD_DELETE:
+         co_return co_await handleDELETE(req, vh);
+      default:
+         co_return HttpResponse("HTTP/1.1", 405, "Method Not Allowed", "", {}, false, false);
+   }
+}
+
+/**
+ * @brief  Decide from its head alone whether the body of a request is worth receiving
+ *
+ * @param  req the HttpRequest, only its head parsed so far
+ * @param  vh pointer to the ServerConfig for the virtual host
+ * @param  maxBodySize set to the client_max_body_size of the location it is routed to
+ * @return 0 to receive the body, or the error status to answer right away
+ *
+ * @note   the route checks handlePOST makes before using the body (location, method),
+ *         so a request it would refuse is refused before its body is sent
+ */
+int HttpResponseHandler::checkBody(const HttpRequest& req, const config::ServerConfig* vh, size_t& maxBodySize) const {
+   const config::LocationConfig* lc = httpUtils::findLocationConfig(vh, req.getPath(), req.getMethod());
+   maxBodySize = lc ? lc->clientMaxBodySize : static_cast<size_t>(vh->clientMaxBodySize);
+   if (req.getMethodId() != METHOD_POST)
+      return 0;
+   if (!lc)
+      return 403;
+   if (!httpUtils::isMethodAllowed(lc, "POST"))
+      return 405;
+   return 0;
+}
+
 /**
  * @brief  Handles the HTTP request and generates the appropriate response
  *
@@ -409,15 +552,23 @@ HttpResponse HttpResponseHandler::handleDELETE(HttpRequest& req, const config::S
  * @return HttpResponse object representing the server's response
 
  * @note for the server to handle the request based on method type
+ * @note with handler_threads the work runs on the handler pool; the task always
+ *       finishes back on its event loop, even when the handler throws.
  */
-HttpResponse   HttpResponseHandler::handleRequest(HttpRequest& req, const config::ServerConfig* vh) {
+Task<HttpResponse> HttpResponseHandler::handleRequest(HttpRequest& req, const config::ServerConfig* vh) {
    if (!vh)
-      return HttpResponse("HTTP/1.1", 500, "Internal Server Error", "", {}, false, false);
-   if (req.getMethod() == "GET")
-     return handleGET(req, vh);
-   else if (req.getMethod() == "POST")
-      return handlePOST(req, vh);
-   else if (req.getMethod() == "DELETE")
-      return handleDELETE(req, vh);
-   return HttpResponse("HTTP/1.1", 405, "Method Not Allowed", "", {}, false, false);
+      co_return HttpResponse("HTTP/1.1", 500, "Internal Server Error", "", {}, false, false);
+   co_await onHandlerPool();
+   // constructed from the handler's, so its headers stay in the request's arena
+   std::optional<HttpResponse> response;
+   std::exception_ptr failure;
+   try {
+      response.emplace(co_await handleMethod(req, vh));
+   } catch (...) {
+      failure = std::current_exception();
+   }
+   co_await onEventLoop();
+   if (failure)
+      std::rethrow_exception(failure);
+   co_return std::move(*response);
 }
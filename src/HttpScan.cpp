@@ -0,0 +1,298 @@
+#include "HttpScan.hpp"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+# include <immintrin.h>
+# define HTTP_SCAN_X86 1
+#endif
+
+namespace httpScan {
+
+    // --------------------
+    //  Character classes
+    // --------------------
+    constexpr bool isTchar(unsigned char c){
+        if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))
+            return true;
+        for (const char* p = "!#$%&'*+-.^_`|~"; *p; p++){
+            if (c == static_cast<unsigned char>(*p))
+                return true;
+        }
+        return false;
+    }
+
+    constexpr bool isVisible(unsigned char c)       { return c > 0x20 && c < 0x7F; }
+    constexpr bool isValueChar(unsigned char c)     { return c == '\t' || (c >= 0x20 && c != 0x7F); }
+
+    template <bool (*Accept)(unsigned char)>
+    constexpr std::array<bool, 256> makeTable(){
+        std::array<bool, 256> table{};
+        for (int c = 0; c < 256; c++)
+            table[c] = Accept(static_cast<unsigned char>(c));
+        return table;
+    }
+
+    constexpr std::array<bool, 256> TOKEN_TABLE = makeTable<isTchar>();
+    constexpr std::array<bool, 256> VISIBLE_TABLE = makeTable<isVisible>();
+    constexpr std::array<bool, 256> VALUE_TABLE = makeTable<isValueChar>();
+
+    template <const std::array<bool, 256>& Table>
+    static size_t findRejected(const char* data, size_t len, size_t from = 0){
+        for (size_t i = from; i < len; i++){
+            if (!Table[static_cast<unsigned char>(data[i])])
+                return i;
+        }
+        return len;
+    }
+
+    // --------------------
+    //  Scalar
+    // --------------------
+    /// memchr is the portable baseline: libc vectorizes it where it can
+    static size_t findCrlfScalar(const char* data, size_t len){
+        size_t i = 0;
+        while (i + 1 < len){
+            const char* cr = static_cast<const char*>(std::memchr(data + i, '\r', len - i - 1));
+            if (!cr)
+                return len;
+            i = cr - data;
+            if (data[i + 1] == '\n')
+                return i;
+            i++;
+        }
+        return len;
+    }
+
+    static size_t findByteScalar(const char* data, size_t len, char c){
+        const char* found = static_cast<const char*>(std::memchr(data, c, len));
+        return found ? static_cast<size_t>(found - data) : len;
+    }
+
+    static size_t findNonTokenScalar(const char* data, size_t len)      { return findRejected<TOKEN_TABLE>(data, len); }
+    static size_t findNonVisibleScalar(const char* data, size_t len)    { return findRejected<VISIBLE_TABLE>(data, len); }
+    static size_t findInvalidValueScalar(const char* data, size_t len)  { return findRejected<VALUE_TABLE>(data, len); }
+
+    static const Kernels SCALAR = {
+        "scalar", findCrlfScalar, findByteScalar, findNonTokenScalar,
+        findNonVisibleScalar, findInvalidValueScalar
+    };
+
+#ifdef HTTP_SCAN_X86
+    // --------------------
+    //  SSE4.2: 16 bytes at a time, character classes as PCMPESTRI ranges
+    // --------------------
+    /**
+     * @brief first byte of data[i..len) inside one of the ranges, 16 bytes at a time
+     *
+     * @param ranges pairs of inclusive bounds, at most 8 pairs
+     * @note the tail shorter than 16 bytes is left to the caller (returned as the offset reached)
+     */
+    __attribute__((target("sse4.2")))
+    static size_t findInRangesSse42(const char* data, size_t len, size_t i, const char (&ranges)[16], int rangesLen){
+        __m128i set = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ranges));
+        for (; i + 16 <= len; i += 16){
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            int at = _mm_cmpestri(set, rangesLen, block, 16,
+                                  _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+            if (at != 16)
+                return i + at;
+        }
+        return i;
+    }
+
+    __attribute__((target("sse4.2")))
+    static size_t findCrlfSse42(const char* data, size_t len){
+        const __m128i cr = _mm_set1_epi8('\r');
+        const __m128i lf = _mm_set1_epi8('\n');
+        size_t i = 0;
+        for (; i + 17 <= len; i += 16){
+            __m128i here = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 1));
+            int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(here, cr), _mm_cmpeq_epi8(next, lf)));
+            if (mask)
+                return i + __builtin_ctz(mask);
+        }
+        return i + findCrlfScalar(data + i, len - i);
+    }
+
+    __attribute__((target("sse4.2")))
+    static size_t findByteSse42(const char* data, size_t len, char c){
+        const __m128i needle = _mm_set1_epi8(c);
+        size_t i = 0;
+        for (; i + 16 <= len; i += 16){
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+            if (mask)
+                return i + __builtin_ctz(mask);
+        }
+        return i + findByteScalar(data + i, len - i, c);
+    }
+
+    /// the exact complement of tchar needs 10 ranges, 8 fit: '|' and '~' are rechecked
+    __attribute__((target("sse4.2")))
+    static size_t findNonTokenSse42(const char* data, size_t len){
+        static const char ranges[16] = {
+            '\x00', ' ', '"', '"', '(', ')', ',', ',', '/', '/', ':', '@', '[', ']', '{', '\xff'
+        };
+        size_t i = 0;
+        while (true){
+            i = findInRangesSse42(data, len, i, ranges, 16);
+            if (i + 16 > len)
+                return findRejected<TOKEN_TABLE>(data, len, i);
+            if (!TOKEN_TABLE[static_cast<unsigned char>(data[i])])
+                return i;
+            i++;
+        }
+    }
+
+    __attribute__((target("sse4.2")))
+    static size_t findNonVisibleSse42(const char* data, size_t len){
+        static const char ranges[16] = { '\x00', ' ', '\x7f', '\xff' };
+        size_t i = findInRangesSse42(data, len, 0, ranges, 4);
+        return i + 16 <= len ? i : findRejected<VISIBLE_TABLE>(data, len, i);
+    }
+
+    __attribute__((target("sse4.2")))
+    static size_t findInvalidValueSse42(const char* data, size_t len){
+        static const char ranges[16] = { '\x00', '\x08', '\x0a', '\x1f', '\x7f', '\x7f' };
+        size_t i = findInRangesSse42(data, len, 0, ranges, 6);
+        return i + 16 <= len ? i : findRejected<VALUE_TABLE>(data, len, i);
+    }
+
+    static const Kernels SSE42 = {
+        "sse4.2", findCrlfSse42, findByteSse42, findNonTokenSse42,
+        findNonVisibleSse42, findInvalidValueSse42
+    };
+
+    // --------------------
+    //  AVX2: 32 bytes at a time, tchar as a nibble bitmap
+    // --------------------
+    /// for each low nibble, the high nibbles (0-7) making a tchar with it
+    constexpr std::array<uint8_t, 16> makeTokenNibbles(){
+        std::array<uint8_t, 16> bits{};
+        for (int lo = 0; lo < 16; lo++){
+            for (int hi = 0; hi < 8; hi++){
+                if (isTchar(static_cast<unsigned char>(hi << 4 | lo)))
+                    bits[lo] |= static_cast<uint8_t>(1 << hi);
+            }
+        }
+        return bits;
+    }
+
+    constexpr std::array<uint8_t, 16> TOKEN_NIBBLES = makeTokenNibbles();
+    constexpr std::array<uint8_t, 16> HIGH_NIBBLE_BIT = {
+        0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0, 0, 0, 0, 0, 0, 0, 0
+    };
+
+    __attribute__((target("avx2")))
+    static inline uint32_t crlfMask(const char* at){
+        __m256i here = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(at));
+        __m256i next = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(at + 1));
+        return _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(here, _mm256_set1_epi8('\r')),
+                                                     _mm256_cmpeq_epi8(next, _mm256_set1_epi8('\n'))));
+    }
+
+    __attribute__((target("avx2")))
+    static inline uint32_t nonTokenMask(const char* at){
+        const __m256i loBits = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(TOKEN_NIBBLES.data())));
+        const __m256i hiBits = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(HIGH_NIBBLE_BIT.data())));
+        const __m256i nibble = _mm256_set1_epi8(0x0f);
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(at));
+        __m256i lo = _mm256_shuffle_epi8(loBits, _mm256_and_si256(block, nibble));
+        __m256i hi = _mm256_shuffle_epi8(hiBits, _mm256_and_si256(_mm256_srli_epi16(block, 4), nibble));
+        return _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(lo, hi), _mm256_setzero_si256()));
+    }
+
+    __attribute__((target("avx2")))
+    static inline uint32_t nonVisibleMask(const char* at){
+        // signed compare: bytes >= 0x80 are negative, so below '!' as well
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(at));
+        return _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8('!'), block),
+                                                    _mm256_cmpeq_epi8(block, _mm256_set1_epi8(0x7f))));
+    }
+
+    __attribute__((target("avx2")))
+    static inline uint32_t invalidValueMask(const char* at){
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(at));
+        // controls are 0x00-0x1f: below ' ' and not negative (obs-text)
+        __m256i control = _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(' '), block),
+                                           _mm256_cmpgt_epi8(block, _mm256_set1_epi8(-1)));
+        control = _mm256_andnot_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('\t')), control);
+        return _mm256_movemask_epi8(_mm256_or_si256(control, _mm256_cmpeq_epi8(block, _mm256_set1_epi8(0x7f))));
+    }
+
+    /**
+     * @brief first position where Mask has a bit set, 32 bytes at a time
+     *
+     * @param Reach bytes Mask reads past the 32 it tests (1 for "\r\n")
+     * @note the last block is loaded overlapping the previous one rather than
+     *       finished byte by byte: bytes tested twice are known not to match.
+     *       Spans too short for one block (most header fields) go to Scalar.
+     */
+    template <uint32_t (*Mask)(const char*), size_t Reach, size_t (*Scalar)(const char*, size_t)>
+    __attribute__((target("avx2")))
+    static size_t findAvx2(const char* data, size_t len){
+        if (len < 32 + Reach)
+            return Scalar(data, len);
+        size_t i = 0;
+        for (; i + 32 + Reach <= len; i += 32){
+            uint32_t mask = Mask(data + i);
+            if (mask)
+                return i + __builtin_ctz(mask);
+        }
+        if (i + Reach == len)
+            return len;
+        i = len - 32 - Reach;
+        uint32_t mask = Mask(data + i);
+        return mask ? i + __builtin_ctz(mask) : len;
+    }
+
+    __attribute__((target("avx2")))
+    static size_t findByteAvx2(const char* data, size_t len, char c){
+        const __m256i needle = _mm256_set1_epi8(c);
+        size_t i = 0;
+        for (; i + 32 <= len; i += 32){
+            __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+            uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle));
+            if (mask)
+                return i + __builtin_ctz(mask);
+        }
+        return i + findByteScalar(data + i, len - i, c);
+    }
+
+    static const Kernels AVX2 = {
+        "avx2",
+        findAvx2<crlfMask, 1, findCrlfScalar>,
+        findByteAvx2,
+        findAvx2<nonTokenMask, 0, findNonTokenScalar>,
+        findAvx2<nonVisibleMask, 0, findNonVisibleScalar>,
+        findAvx2<invalidValueMask, 0, findInvalidValueScalar>
+    };
+#endif
+
+    /**
+     * @brief every kernel set this CPU can run, slowest first
+     */
+    std::vector<const Kernels*> supportedKernels(){
+        std::vector<const Kernels*> sets;
+        sets.push_back(&SCALAR);
+#ifdef HTTP_SCAN_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse4.2")){
+            sets.push_back(&SSE42);
+            if (__builtin_cpu_supports("avx2"))
+                sets.push_back(&AVX2);
+        }
+#endif
+        return sets;
+    }
+
+    /// The fastest kernel set of this CPU, chosen on first use.
+    const Kernels& kernels(){
+        static const Kernels* best = supportedKernels().back();
+        return *best;
+    }
+}
@@ -0,0 +1,315 @@
+#include "IoUring.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// ==========================================================
+// ring setup and teardown
+// ==========================================================
+/**
+ * @brief Create the ring and map its queues
+ *
+ * @param entries submission queue size (the completion queue gets four times as many,
+ *        multishot operations post several completions per submission)
+ * @return SUCCESS, or FAILURE when the kernel has no (usable) io_uring
+ */
+int IoUring::setup(unsigned entries){
+	io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL
+					| IORING_SETUP_COOP_TASKRUN | IORING_SETUP_SINGLE_ISSUER;
+	params.cq_entries = entries * 4;
+	_ringFd = syscall(__NR_io_uring_setup, entries, &params);
+	if (_ringFd < 0 && errno == EINVAL){
+		// older kernel: retry without the optional flags
+		memset(&params, 0, sizeof(params));
+		_ringFd = syscall(__NR_io_uring_setup, entries, &params);
+	}
+	if (_ringFd < 0)
+		return utils::FAILURE;
+
+	_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+	if (singleMmap)
+		_sqRingSize = _cqRingSize = std::max(_sqRingSize, _cqRingSize);
+	_sqRing = mmap(nullptr, _sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+					_ringFd, IORING_OFF_SQ_RING);
+	if (_sqRing == MAP_FAILED){
+		_sqRing = nullptr;
+		close();
+		return utils::FAILURE;
+	}
+	if (singleMmap)
+		_cqRing = _sqRing;
+	else {
+		_cqRing = mmap(nullptr, _cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+						_ringFd, IORING_OFF_CQ_RING);
+		if (_cqRing == MAP_FAILED){
+			_cqRing = nullptr;
+			close();
+			return utils::FAILURE;
+		}
+	}
+	_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+	void* sqes = mmap(nullptr, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+						_ringFd, IORING_OFF_SQES);
+	if (sqes == MAP_FAILED){
+		close();
+		return utils::FAILURE;
+	}
+	_sqes = static_cast<io_uring_sqe*>(sqes);
+
+	char* sq = static_cast<char*>(_sqRing);
+	_sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+	_sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+	_sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+	_sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+	_sqEntries = params.sq_entries;
+	_sqLocalTail = *_sqTail;
+	// SQE i always sits in array slot i
+	for (unsigned i = 0; i < _sqEntries; i++)
+		_sqArray[i] = i;
+
+	char* cq = static_cast<char*>(_cqRing);
+	_cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+	_cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+	_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+	_cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+	return utils::SUCCESS;
+}
+
+/**
+ * @brief Register a ring of count buffers of size bytes as buffer group `group`
+ *
+ * @note count must be a power of two. The kernel picks a buffer for each multishot
+ *       recv completion; the loop gives it back with recycleBuffer once consumed.
+ */
+int IoUring::setupBufferRing(uint16_t group, unsigned count, unsigned size){
+	_bufRingSize = count * sizeof(io_uring_buf);
+	void* ring = mmap(nullptr, _bufRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ring == MAP_FAILED)
+		return utils::FAILURE;
+	_bufRing = static_cast<io_uring_buf*>(ring);
+	_bufPool = new char[static_cast<size_t>(count) * size];
+	_bufCount = count;
+	_bufSize = size;
+	_bufGroup = group;
+	_bufTail = 0;
+
+	io_uring_buf_reg reg;
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = reinterpret_cast<uint64_t>(_bufRing);
+	reg.ring_entries = count;
+	reg.bgid = group;
+	if (syscall(__NR_io_uring_register, _ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+		return utils::FAILURE;
+	for (unsigned bid = 0; bid < count; bid++)
+		addBuffer(static_cast<uint16_t>(bid));
+	publishBuffers();
+	return utils::SUCCESS;
+}
+
+void IoUring::close(void){
+	if (_sqes)
+		munmap(_sqes, _sqesSize);
+	if (_cqRing && _cqRing != _sqRing)
+		munmap(_cqRing, _cqRingSize);
+	if (_sqRing)
+		munmap(_sqRing, _sqRingSize);
+	if (_ringFd >= 0)
+		::close(_ringFd);
+	if (_bufRing)
+		munmap(_bufRing, _bufRingSize);
+	delete[] _bufPool;
+	_sqes = nullptr;
+	_sqRing = _cqRing = nullptr;
+	_bufRing = nullptr;
+	_bufPool = nullptr;
+	_ringFd = -1;
+}
+
+IoUring::~IoUring(){
+	close();
+}
+
+// ==========================================================
+// submission and completion
+// ==========================================================
+/**
+ * @brief Hand out the next free SQE, cleared
+ *
+ * @note when the submission queue is full the pending SQEs are submitted first,
+ *       so callers never have to handle an exhausted queue.
+ */
+io_uring_sqe* IoUring::nextSqe(void){
+	while (_sqLocalTail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE) >= _sqEntries){
+		if (submit() < 0 && errno != EINTR && errno != EBUSY)
+			break;
+	}
+	io_uring_sqe* sqe = &_sqes[_sqLocalTail & _sqMask];
+	_sqLocalTail++;
+	memset(sqe, 0, sizeof(*sqe));
+	return sqe;
+}
+
+void IoUring::publishSqes(void){
+	__atomic_store_n(_sqTail, _sqLocalTail, __ATOMIC_RELEASE);
+}
+
+int IoUring::submit(void){
+	publishSqes();
+	unsigned pending = _sqLocalTail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+	if (pending == 0)
+		return 0;
+	return syscall(__NR_io_uring_enter, _ringFd, pending, 0, 0, nullptr, 0);
+}
+
+/**
+ * @brief Submit the pending SQEs and wait for at least waitNr completions
+ *
+ * @param timeoutMs negative to wait without a timeout
+ * @return number of SQEs submitted, -1 with errno set; ETIME (timeout) and EINTR
+ *         (signal) are expected and only mean the loop should look around and wait again.
+ */
+int IoUring::submitAndWait(unsigned waitNr, int timeoutMs){
+	publishSqes();
+	unsigned pending = _sqLocalTail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+	struct __kernel_timespec ts;
+	ts.tv_sec = timeoutMs / 1000;
+	ts.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000000;
+	io_uring_getevents_arg arg;
+	memset(&arg, 0, sizeof(arg));
+	arg.sigmask_sz = _NSIG / 8;
+	if (timeoutMs >= 0)
+		arg.ts = reinterpret_cast<uint64_t>(&ts);
+	return syscall(__NR_io_uring_enter, _ringFd, pending, waitNr,
+					IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+}
+
+io_uring_cqe* IoUring::peekCqe(void){
+	unsigned head = *_cqHead;
+	if (head == __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE))
+		return nullptr;
+	return &_cqes[head & _cqMask];
+}
+
+void IoUring::cqeSeen(void){
+	__atomic_store_n(_cqHead, *_cqHead + 1, __ATOMIC_RELEASE);
+}
+
+// ==========================================================
+// provided buffers
+// ==========================================================
+void IoUring::addBuffer(uint16_t bid){
+	// fields are set one by one: the ring tail overlays the resv field of entry 0
+	io_uring_buf& buf = _bufRing[_bufTail & (_bufCount - 1)];
+	buf.addr = reinterpret_cast<uint64_t>(bufferData(bid));
+	buf.len = _bufSize;
+	buf.bid = bid;
+	_bufTail++;
+}
+
+void IoUring::publishBuffers(void){
+	io_uring_buf_ring* ring = reinterpret_cast<io_uring_buf_ring*>(_bufRing);
+	__atomic_store_n(&ring->tail, _bufTail, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Give a buffer back to the kernel once its bytes have been consumed
+ */
+void IoUring::recycleBuffer(uint16_t bid){
+	addBuffer(bid);
+	publishBuffers();
+}
+
+// ==========================================================
+// operations
+// ==========================================================
+void IoUring::prepMultishotAccept(int fd, uint64_t userData){
+	io_uring_sqe* sqe = nextSqe();
+	sqe->opcode = IORING_OP_ACCEPT;
+	sqe->fd = fd;
+	sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+	sqe->accept_flags = SOCK_NONBLOCK;
+	sqe->user_data = userData;
+}
+
+void IoUring::prepMultishotRecv(int fd, uint64_t userData){
+	io_uring_sqe* sqe = nextSqe();
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = fd;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = _bufGroup;
+	sqe->user_data = userData;
+}
+
+/**
+ * @brief gathered send: msg (and the iovec array it points to) must stay valid until the completion
+ *
+ * @note MSG_WAITALL makes the kernel retry a short send itself; a send still cut
+ *       short (error, or a linked operation cancelled) is resubmitted by the caller.
+ */
+void IoUring::prepSendmsg(int fd, const msghdr* msg, uint64_t userData, uint8_t sqeFlags, int msgFlags){
+	io_uring_sqe* sqe = nextSqe();
+	sqe->opcode = IORING_OP_SENDMSG;
+	sqe->fd = fd;
+	sqe->addr = reinterpret_cast<uint64_t>(msg);
+	sqe->len = 1;
+	sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL | msgFlags;
+	sqe->flags = sqeFlags;
+	sqe->user_data = userData;
+}
+
+void IoUring::prepShutdown(int fd, int how, uint64_t userData){
+	io_uring_sqe* sqe = nextSqe();
+	sqe->opcode = IORING_OP_SHUTDOWN;
+	sqe->fd = fd;
+	sqe->len = how;
+	sqe->user_data = userData;
+}
+
+void IoUring::prepMultishotPoll(int fd, uint32_t events, uint64_t userData){
+	io_uring_sqe* sqe = nextSqe();
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fd;
+	sqe->poll32_events = events;
+	sqe->len = IORING_POLL_ADD_MULTI;
+	sqe->user_data = userData;
+}
+
+/// One-shot readiness poll: a single completion, with the ready events in res.
+void IoUring::prepPoll(int fd, uint32_t events, uint64_t userData){
+	io_uring_sqe* sqe = nextSqe();
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fd;
+	sqe->poll32_events = events;
+	sqe->user_data = userData;
+}
+
+/// Cancel the poll posted with targetUserData; it then completes with -ECANCELED.
+void IoUring::prepPollRemove(uint64_t targetUserData, uint64_t userData){
+	io_uring_sqe* sqe = nextSqe();
+	sqe->opcode = IORING_OP_POLL_REMOVE;
+	sqe->fd = -1;
+	sqe->addr = targetUserData;
+	sqe->user_data = userData;
+}
+
+/// Cancel any request posted with targetUserData (accept, recv...); it then completes with -ECANCELED.
+void IoUring::prepCancel(uint64_t targetUserData, uint64_t userData){
+	io_uring_sqe* sqe = nextSqe();
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = targetUserData;
+	sqe->user_data = userData;
+}
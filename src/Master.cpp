@@ -0,0 +1,231 @@
+#include "Master.hpp"
+#include "OffloadExecutor.hpp"
+#include "OpenFileCache.hpp"
+
+#include <chrono>
+
+static std::atomic<int> masterRunning(1);
+
+static void masterSignalHandler(int sig){
+	(void)sig;
+	masterRunning = 0;
+}
+
+static constexpr std::chrono::milliseconds SUPERVISE_INTERVAL(200);	// how often the master checks on its loops
+static constexpr time_t RESPAWN_BACKOFF = 1;							// minimal lifetime before a worker is respawned at once
+
+Master::Master(const config::GlobalConfig& global, const std::vector<config::ServerConfig>& configs)
+	: _global(global), _configs(configs),
+		_stats(static_cast<size_t>(std::max(global.workerThreads, global.workerProcesses))){
+	HandlerPool::configure(static_cast<size_t>(global.handlerThreads));
+	OffloadExecutor::configure(static_cast<size_t>(global.fsThreads));
+	OpenFileCache::configure(static_cast<size_t>(global.openFileCache));
+	HttpParser::setBodyBufferSize(static_cast<size_t>(global.bodyBufferSize));
+	HttpParser::setHeaderLimits(static_cast<size_t>(global.headerLineSize), static_cast<size_t>(global.headerSize),
+		static_cast<size_t>(global.uriMaxSize), static_cast<size_t>(global.headerFields));
+}
+
+/// CPU loop index is pinned to, -1 without worker_cpu_affinity.
+int Master::cpuOfLoop(size_t index) const {
+	if (_global.cpuAffinity.empty())
+		return -1;
+	return _global.cpuAffinity[index % _global.cpuAffinity.size()];
+}
+
+/**
+ * @brief Pin the calling thread, which is about to run loop index, to its CPU
+ *
+ * @note the offload and handler pools (and the open file cache's inotify thread) are
+ *       started first: threads inherit the affinity of the thread that creates them,
+ *       and the pools serve every loop of the process, so they must not end up on
+ *       one loop's CPU.
+ */
+void Master::pinLoop(Webserver& loop, size_t index){
+	int cpu = cpuOfLoop(index);
+	if (cpu < 0)
+		return;
+	OffloadExecutor::instance();
+	if (HandlerPool::enabled())
+		HandlerPool::instance();
+	if (OpenFileCache::enabled())
+		OpenFileCache::instance();
+	loop.pinToCpu(cpu);
+}
+
+// ==========================================================
+// one event loop in the calling thread
+// ==========================================================
+int Master::runSingleLoop(void){
+	Webserver miniNginx(_global);
+	StatsTable::installDumpSignal(Webserver::signalWakeFd());
+	miniNginx.attachStats(_stats, 0, true);
+	if (miniNginx.createServers(_configs) == FAILURE)
+		return returnErrorMessage(FAILED_TO_CREATE_SERVERS);
+	pinLoop(miniNginx, 0);
+	if (miniNginx.runWebserver() == FAILURE)
+		return returnErrorMessage(ERROR_RUNNING_SERVERS);
+	return SUCCESS;
+}
+
+// ==========================================================
+// one event loop per thread, listeners shared through SO_REUSEPORT
+// ==========================================================
+int Master::runThreadedLoops(void){
+	size_t count = static_cast<size_t>(_global.workerThreads);
+	std::vector<std::unique_ptr<Webserver>> loops;
+	for (size_t i = 0; i < count; i++){
+		loops.push_back(std::make_unique<Webserver>(_global));
+		loops.back()->attachStats(_stats, i, false);
+		if (loops.back()->createServers(_configs, true) == FAILURE)
+			return returnErrorMessage(FAILED_TO_CREATE_SERVERS);
+	}
+	StatsTable::installDumpSignal();
+	if (!_global.cpuAffinity.empty()){
+		// one program per group: attached through the first loop's listeners
+		std::vector<int> cpus;
+		for (size_t i = 0; i < count; i++)
+			cpus.push_back(cpuOfLoop(i));
+		loops[0]->steerConnections(cpus);
+	}
+
+	std::vector<int> results(count, SUCCESS);
+	std::atomic<size_t> finished(0);
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < count; i++){
+		threads.emplace_back([this, &loops, &results, &finished, i](){
+			try {
+				pinLoop(*loops[i], i);
+				results[i] = loops[i]->runWebserver();
+			}
+			catch (const std::exception& e){
+				std::cerr << "Error in event loop " << i << ": " << e.what() << std::endl;
+				results[i] = FAILURE;
+			}
+			if (results[i] == FAILURE)
+				Webserver::requestShutdown();
+			finished++;
+		});
+	}
+	std::cout << "Running " << count << " event loops" << std::endl;
+	while (finished < count){
+		std::this_thread::sleep_for(SUPERVISE_INTERVAL);
+		if (StatsTable::consumeDumpRequest())
+			_stats.dump(std::cout);
+	}
+	for (size_t i = 0; i < count; i++)
+		threads[i].join();
+	_stats.dump(std::cout);
+	for (size_t i = 0; i < count; i++){
+		if (results[i] == FAILURE)
+			return returnErrorMessage(ERROR_RUNNING_SERVERS);
+	}
+	return SUCCESS;
+}
+
+// ==========================================================
+// prefork: one event loop per process, supervised by the master
+// ==========================================================
+/**
+ * @brief Fork a worker that runs the event loop of the given slot
+ *
+ * @param listeners the master's Webserver, owning the already opened listening sockets
+ * @param slot index of the worker, and of its counters in the stats table
+ * @return pid_t the worker pid in the master, -1 if fork() failed. Never returns in the worker.
+ */
+pid_t Master::spawnWorker(Webserver& listeners, size_t slot){
+	pid_t pid = fork();
+	if (pid != 0)
+		return pid;
+	int code = FAILURE;
+	try {
+		listeners.attachStats(_stats, slot, false);
+		if (listeners.becomeWorker() == SUCCESS){
+			pinLoop(listeners, slot);
+			code = listeners.runWebserver();
+		}
+	}
+	catch (const std::exception& e){
+		std::cerr << "Error in worker " << slot << ": " << e.what() << std::endl;
+	}
+	listeners.stopWebserver();
+	exit(code);
+}
+
+void Master::stopWorkers(void){
+	for (size_t i = 0; i < _workers.size(); i++){
+		if (_workers[i] > 0)
+			kill(_workers[i], SIGTERM);
+	}
+	for (size_t i = 0; i < _workers.size(); i++){
+		if (_workers[i] > 0)
+			waitpid(_workers[i], NULL, 0);
+		_workers[i] = 0;
+	}
+}
+
+int Master::runWorkerProcesses(void){
+	size_t count = static_cast<size_t>(_global.workerProcesses);
+	Webserver listeners(_global);
+	if (listeners.openServers(_configs) == FAILURE)
+		return returnErrorMessage(FAILED_TO_CREATE_SERVERS);
+
+	signal(SIGINT, masterSignalHandler);
+	signal(SIGTERM, masterSignalHandler);
+	StatsTable::installDumpSignal();
+
+	_workers.assign(count, 0);
+	std::vector<time_t> startedAt(count, 0);
+	for (size_t i = 0; i < count; i++){
+		_workers[i] = spawnWorker(listeners, i);
+		startedAt[i] = time(NULL);
+		if (_workers[i] < 0){
+			std::cerr << "fork failed: " << strerror(errno) << std::endl;
+			stopWorkers();
+			return returnErrorMessage(FAILED_TO_CREATE_SERVERS);
+		}
+	}
+	std::cout << "Master " << getpid() << " running " << count << " worker processes" << std::endl;
+
+	while (masterRunning){
+		int status;
+		pid_t pid = waitpid(-1, &status, WNOHANG);
+		if (pid <= 0){
+			std::this_thread::sleep_for(SUPERVISE_INTERVAL);
+			if (StatsTable::consumeDumpRequest())
+				_stats.dump(std::cout);
+			continue;
+		}
+		for (size_t i = 0; i < count; i++){
+			if (_workers[i] != pid)
+				continue;
+			if (WIFSIGNALED(status))
+				std::cerr << "Worker " << i << " (pid " << pid << ") killed by signal " << WTERMSIG(status) << std::endl;
+			else
+				std::cerr << "Worker " << i << " (pid " << pid << ") exited with status " << WEXITSTATUS(status) << std::endl;
+			_workers[i] = 0;
+			if (!masterRunning)
+				break;
+			if (time(NULL) - startedAt[i] < RESPAWN_BACKOFF)
+				sleep(RESPAWN_BACKOFF);
+			_stats.slot(i).restarts.fetch_add(1, std::memory_order_relaxed);
+			_workers[i] = spawnWorker(listeners, i);
+			startedAt[i] = time(NULL);
+			if (_workers[i] < 0)
+				std::cerr << "Failed to respawn worker " << i << ": " << strerror(errno) << std::endl;
+		}
+	}
+	stopWorkers();
+	_stats.dump(std::cout);
+	return SUCCESS;
+}
+
+// ==========================================================
+// public API
+// ==========================================================
+int Master::run(void){
+	if (_global.workerProcesses > 1)
+		return runWorkerProcesses();
+	if (_global.workerThreads > 1)
+		return runThreadedLoops();
+	return runSingleLoop();
+}
@@ -0,0 +1,104 @@
+#include "OffloadExecutor.hpp"
+#include "Reactor.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+std::atomic<size_t>		OffloadExecutor::_configuredThreads(OffloadExecutor::DEFAULT_THREADS);
+thread_local LoopStats*	FsTimer::_target = nullptr;
+
+// ==========================================================
+// OffloadExecutor
+// ==========================================================
+OffloadExecutor::OffloadExecutor(size_t threads){
+	for (size_t i = 0; i < threads; i++)
+		std::thread(&OffloadExecutor::run, this).detach();
+}
+
+void OffloadExecutor::configure(size_t threads){
+	_configuredThreads.store(threads, std::memory_order_relaxed);
+}
+
+OffloadExecutor& OffloadExecutor::instance(void){
+	// never destroyed: detached threads may still use it while the process exits
+	static OffloadExecutor* executor = new OffloadExecutor(_configuredThreads.load(std::memory_order_relaxed));
+	return *executor;
+}
+
+/**
+ * @brief Queue a job (event loop side)
+ *
+ * @return bool false when the queue is full: the job was not taken, and its loop
+ *         is woken up once a thread takes a job off the queue
+ */
+bool OffloadExecutor::submit(std::shared_ptr<OffloadJob> job){
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_jobs.size() >= QUEUE_CAPACITY){
+			if (std::find(_refused.begin(), _refused.end(), job->owner) == _refused.end())
+				_refused.push_back(job->owner);
+			return false;
+		}
+		_jobs.push_back(std::move(job));
+	}
+	_ready.notify_one();
+	return true;
+}
+
+/// Stop waking a loop up that goes away.
+void OffloadExecutor::forget(Reactor* reactor){
+	std::lock_guard<std::mutex> lock(_mutex);
+	_refused.erase(std::remove(_refused.begin(), _refused.end(), reactor), _refused.end());
+}
+
+void OffloadExecutor::run(void){
+	while (true){
+		std::shared_ptr<OffloadJob> job;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_ready.wait(lock, [this]{ return !_jobs.empty(); });
+			job = std::move(_jobs.front());
+			_jobs.pop_front();
+			// under the lock: forget() returns once no thread refers to the loop
+			for (Reactor* reactor : _refused)
+				reactor->wakeUp();
+			_refused.clear();
+		}
+		if (!job->cancelled.load(std::memory_order_acquire)){
+			FsTimer::Scope scope(job->stats);
+			try {
+				job->work();
+			} catch (...) {
+				job->exception = std::current_exception();
+			}
+		}
+		job->owner->completeOffload(job);
+	}
+}
+
+// ==========================================================
+// FsTimer
+// ==========================================================
+FsTimer::FsTimer(FsOp op) : _op(op), _start(std::chrono::steady_clock::now()){
+}
+
+FsTimer::~FsTimer(){
+	if (!_target)
+		return;
+	unsigned long long nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+									std::chrono::steady_clock::now() - _start).count();
+	_target->fsOps[_op].fetch_add(1, std::memory_order_relaxed);
+	_target->fsNanos[_op].fetch_add(nanos, std::memory_order_relaxed);
+	unsigned long long max = _target->fsMaxNanos[_op].load(std::memory_order_relaxed);
+	while (nanos > max && !_target->fsMaxNanos[_op].compare_exchange_weak(max, nanos, std::memory_order_relaxed))
+		;
+}
+
+FsTimer::Scope::Scope(LoopStats* stats) : _previous(_target){
+	_target = stats;
+}
+
+FsTimer::Scope::~Scope(){
+	_target = _previous;
+}
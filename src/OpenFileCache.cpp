@@ -0,0 +1,245 @@
+#include "OpenFileCache.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sys/inotify.h>
+#include <thread>
+#include <unistd.h>
+
+std::atomic<size_t>		OpenFileCache::_configuredEntries(OpenFileCache::DEFAULT_ENTRIES);
+
+/// Events that change what a lookup in the directory would find.
+static constexpr uint32_t WATCH_EVENTS = IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_MOVED_FROM
+										| IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+OpenFile::~OpenFile(){
+	if (_fd >= 0)
+		close(_fd);
+}
+
+// ==========================================================
+// OpenFileCache
+// ==========================================================
+OpenFileCache::OpenFileCache(size_t capacity) : _capacity(capacity){
+	_inotifyFd = inotify_init1(IN_CLOEXEC);
+	if (_inotifyFd < 0){
+		std::cerr << "inotify unavailable (" << strerror(errno) << "), static file lookups are not cached" << std::endl;
+		return;
+	}
+	_watching.store(true, std::memory_order_relaxed);
+	std::thread(&OpenFileCache::run, this).detach();
+}
+
+void OpenFileCache::configure(size_t entries){
+	_configuredEntries.store(entries, std::memory_order_relaxed);
+}
+
+bool OpenFileCache::enabled(void){
+	return _configuredEntries.load(std::memory_order_relaxed) > 0;
+}
+
+OpenFileCache& OpenFileCache::instance(void){
+	// never destroyed: its detached thread may still use it while the process exits
+	static OpenFileCache* cache = new OpenFileCache(_configuredEntries.load(std::memory_order_relaxed));
+	return *cache;
+}
+
+/**
+ * @brief The lookup kept for key, when it was made for the same location
+ *
+ * @return std::shared_ptr<const FileLookup> null when not cached
+ * @note no system call: safe on the event loop
+ */
+std::shared_ptr<const FileLookup> OpenFileCache::find(const std::string& key, const void* owner){
+	std::lock_guard<std::mutex> lock(_mutex);
+	auto it = _index.find(key);
+	if (it == _index.end() || it->second->owner != owner)
+		return nullptr;
+	_lru.splice(_lru.begin(), _lru, it->second);
+	return it->second->lookup;
+}
+
+/**
+ * @brief Watch what a lookup of path depends on: path itself when it is a directory,
+ *        and the directory holding it (or its nearest existing ancestor)
+ *
+ * @param watches receives the descriptors watched, each counted as used until unwatch()
+ *        (or the entry keeping them) releases it
+ * @return bool false when a directory could not be watched (no inotify, too many watches):
+ *         the lookup must not be cached
+ * @note inotify_add_watch returns the same descriptor for a directory already watched,
+ *       under whichever name, so watching again costs no kernel resource.
+ * @note a watch is counted under the lock it is added with, so it cannot be removed
+ *       between inotify_add_watch and the count.
+ */
+bool OpenFileCache::watch(const std::string& path, std::vector<int>& watches){
+	if (!_watching.load(std::memory_order_relaxed))
+		return false;
+	std::lock_guard<std::mutex> lock(_watchMutex);
+	int wd = inotify_add_watch(_inotifyFd, path.c_str(), WATCH_EVENTS);
+	if (wd >= 0){
+		watches.push_back(wd);
+		_watchUsers[wd]++;
+	}
+	else if (errno != ENOENT && errno != ENOTDIR)
+		return false;
+	std::string dir = path;
+	while (true){
+		while (dir.size() > 1 && dir.back() == '/')
+			dir.pop_back();
+		size_t slash = dir.rfind('/');
+		if (slash == std::string::npos)
+			dir = ".";
+		else
+			dir.resize(slash == 0 ? 1 : slash);
+		wd = inotify_add_watch(_inotifyFd, dir.c_str(), WATCH_EVENTS);
+		if (wd >= 0){
+			watches.push_back(wd);
+			_watchUsers[wd]++;
+			return true;
+		}
+		if ((errno != ENOENT && errno != ENOTDIR) || dir == "." || dir == "/")
+			return false;
+	}
+}
+
+/// Release watches taken by watch(); the last user of a watch removes it.
+void OpenFileCache::unwatch(const std::vector<int>& watches){
+	if (watches.empty())
+		return;
+	std::lock_guard<std::mutex> lock(_watchMutex);
+	for (int wd : watches){
+		auto it = _watchUsers.find(wd);
+		if (it == _watchUsers.end() || --it->second > 0)
+			continue;
+		_watchUsers.erase(it);
+		// fails harmlessly when the directory is gone: the kernel removed the watch already
+		inotify_rm_watch(_inotifyFd, wd);
+	}
+}
+
+/**
+ * @brief Keep a lookup, with the watches it depends on
+ *
+ * @return bool false when it was not kept (an event was handled since changes): the
+ *         caller releases the watches then
+ */
+bool OpenFileCache::insert(const std::string& key, const void* owner, std::shared_ptr<const FileLookup> lookup,
+							std::vector<int>& watches, uint64_t changes){
+	std::vector<int> released;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_changes.load(std::memory_order_relaxed) != changes)
+			return false;
+		auto it = _index.find(key);
+		if (it != _index.end())
+			erase(it->second, released);
+		_lru.push_front(Entry{key, owner, std::move(lookup), watches});
+		_index.emplace(key, _lru.begin());
+		for (int wd : watches)
+			_dependents[wd].insert(&_lru.front());
+		while (_lru.size() > _capacity)
+			erase(std::prev(_lru.end()), released);
+	}
+	unwatch(released);
+	return true;
+}
+
+/// Remove an entry (lock held); its watches are added to released, for unwatch() once unlocked.
+void OpenFileCache::erase(Lru::iterator it, std::vector<int>& released){
+	for (int wd : it->watches){
+		auto dependents = _dependents.find(wd);
+		if (dependents == _dependents.end())
+			continue;
+		dependents->second.erase(&*it);
+		if (dependents->second.empty())
+			_dependents.erase(dependents);
+	}
+	released.insert(released.end(), it->watches.begin(), it->watches.end());
+	_index.erase(it->key);
+	_lru.erase(it);
+}
+
+/// Drop the entries depending on the directory watched as wd (lock held).
+void OpenFileCache::dropWatched(int wd, std::vector<int>& released){
+	auto dependents = _dependents.find(wd);
+	if (dependents == _dependents.end())
+		return;
+	std::vector<const Entry*> entries(dependents->second.begin(), dependents->second.end());
+	for (const Entry* entry : entries)
+		erase(_index.at(entry->key), released);
+}
+
+/// Drop every entry (lock held).
+void OpenFileCache::dropAll(std::vector<int>& released){
+	while (!_lru.empty())
+		erase(_lru.begin(), released);
+}
+
+/**
+ * @brief Drop what is cached about the files of directory, now
+ *
+ * @note for the server's own changes (uploads, DELETE), so the next request sees them
+ *       without waiting for the inotify thread to handle their events
+ * @note the directory is watched only to learn its descriptor, and released afterwards
+ */
+void OpenFileCache::invalidate(const std::string& directory){
+	if (!_watching.load(std::memory_order_relaxed))
+		return;
+	std::vector<int> watches;
+	{
+		std::lock_guard<std::mutex> lock(_watchMutex);
+		int wd = inotify_add_watch(_inotifyFd, directory.c_str(), WATCH_EVENTS);
+		if (wd >= 0){
+			watches.push_back(wd);
+			_watchUsers[wd]++;
+		}
+	}
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_changes.fetch_add(1, std::memory_order_release);
+		if (!watches.empty())
+			dropWatched(watches[0], watches);
+	}
+	unwatch(watches);
+}
+
+/// Inotify thread: drop the entries of the directories events are reported for.
+void OpenFileCache::run(void){
+	alignas(inotify_event) char buffer[16384];
+	std::vector<int> released;
+	while (true){
+		ssize_t len = read(_inotifyFd, buffer, sizeof(buffer));
+		if (len < 0 && errno == EINTR)
+			continue;
+		if (len <= 0){
+			std::cerr << "inotify read failed (" << strerror(errno) << "), open file cache flushed and stopped" << std::endl;
+			std::lock_guard<std::mutex> lock(_mutex);
+			_watching.store(false, std::memory_order_relaxed);
+			_changes.fetch_add(1, std::memory_order_release);
+			dropAll(released);
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			bool changed = false;
+			for (ssize_t off = 0; off < len;){
+				const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + off);
+				off += sizeof(inotify_event) + event->len;
+				// a watch removed by unwatch(): nothing changed on disk
+				if (event->mask == IN_IGNORED)
+					continue;
+				changed = true;
+				if (event->mask & IN_Q_OVERFLOW)
+					dropAll(released);
+				else
+					dropWatched(event->wd, released);
+			}
+			if (changed)
+				_changes.fetch_add(1, std::memory_order_release);
+		}
+		unwatch(released);
+		released.clear();
+	}
+}
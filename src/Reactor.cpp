@@ -0,0 +1,380 @@
+#include "Reactor.hpp"
+#include "OffloadExecutor.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+thread_local Reactor* Reactor::_current = nullptr;
+
+// ==========================================================
+// Reactor
+// ==========================================================
+Reactor::Reactor() : _wakeFd(-1), _completed(nullptr), _away(0), _refused(false), _poolStats(nullptr){
+	_wakeSource.kind = PollSource::SOURCE_WAKEUP;
+}
+
+Reactor::~Reactor(){
+	if (_current == this)
+		_current = nullptr;
+	if (_refused)
+		OffloadExecutor::instance().forget(this);
+	OffloadJob* job = _completed.exchange(nullptr, std::memory_order_acquire);
+	while (job){
+		OffloadJob* next = job->next;
+		job->self.reset();
+		job = next;
+	}
+	if (_wakeFd >= 0)
+		close(_wakeFd);
+}
+
+Reactor* Reactor::current(void){
+	return _current;
+}
+
+void Reactor::makeCurrent(void){
+	_current = this;
+}
+
+/**
+ * @brief Create the eventfd offload threads signal completions on
+ *
+ * @return int the eventfd, or -1
+ *
+ * @note opened by the process and thread that runs the loop: an eventfd
+ *       inherited through fork() would be shared with the master and every
+ *       sibling worker, which would then wake each other up.
+ */
+int Reactor::openWakeFd(void){
+	if (_wakeFd >= 0)
+		close(_wakeFd);
+	_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	_wakeSource.fd = _wakeFd;
+	return _wakeFd;
+}
+
+/**
+ * @brief Hand a job to the offload executor
+ *
+ * @note when the executor's queue is full the job waits in the overflow list, behind
+ *       the ones already there: the loop never runs blocking work itself.
+ */
+void Reactor::offload(std::shared_ptr<OffloadJob> job){
+	job->stats = _poolStats;
+	_away.fetch_add(1, std::memory_order_relaxed);
+	if (_overflow.empty() && OffloadExecutor::instance().submit(job))
+		return;
+	_refused = true;
+	_overflow.push_back(std::move(job));
+}
+
+/// Submit the jobs of the overflow list the executor has room for now, oldest first.
+void Reactor::submitOverflow(void){
+	while (!_overflow.empty() && OffloadExecutor::instance().submit(_overflow.front()))
+		_overflow.pop_front();
+}
+
+/**
+ * @brief Queue a finished job for its loop and wake the loop up (offload thread side)
+ *
+ * @note lock-free push; the loop takes the whole stack at once in drainOffloaded()
+ */
+void Reactor::completeOffload(std::shared_ptr<OffloadJob> job){
+	OffloadJob* node = job.get();
+	node->self = std::move(job);
+	OffloadJob* head = _completed.load(std::memory_order_relaxed);
+	do {
+		node->next = head;
+	} while (!_completed.compare_exchange_weak(head, node, std::memory_order_release, std::memory_order_relaxed));
+	wakeUp();
+	// last: once nothing is away, settleHandlers() lets the loop go
+	_away.fetch_sub(1, std::memory_order_release);
+}
+
+/// Make the loop run drainOffloaded() (any thread).
+void Reactor::wakeUp(void){
+	uint64_t one = 1;
+	ssize_t written = write(_wakeFd, &one, sizeof(one));
+	(void)written;
+}
+
+/**
+ * @brief Resume the coroutines whose offloaded work finished, or that came back
+ *        from the handler pool (loop side)
+ *
+ * @note also woken up by the offload executor when its queue has room again for
+ *       the overflow list.
+ */
+void Reactor::drainOffloaded(void){
+	uint64_t count;
+	while (read(_wakeFd, &count, sizeof(count)) > 0)
+		;
+	submitOverflow();
+	takeCompleted(true);
+	std::vector<Returned> returned;
+	{
+		std::lock_guard<std::mutex> lock(_returnedMutex);
+		returned.swap(_returned);
+	}
+	for (const Returned& frame : returned)
+		takeBack(frame, true);
+}
+
+/// Take back the jobs the offload threads completed, in completion order.
+void Reactor::takeCompleted(bool resume){
+	// pushed newest first: reversed
+	OffloadJob* stack = _completed.exchange(nullptr, std::memory_order_acquire);
+	OffloadJob* completed = nullptr;
+	while (stack){
+		OffloadJob* next = stack->next;
+		stack->next = completed;
+		completed = stack;
+		stack = next;
+	}
+	while (completed){
+		std::shared_ptr<OffloadJob> job = std::move(completed->self);
+		completed = completed->next;
+		if (!job->cancelled.load(std::memory_order_acquire))
+			takeBack(Returned(job->handle, job->root), resume);
+	}
+}
+
+/**
+ * @brief Take back a frame from the handler pool or from offloaded work: resume it,
+ *        or destroy its abandoned task
+ */
+void Reactor::takeBack(const Returned& returned, bool resume){
+	detail::TaskPromiseBase* root = returned.second;
+	root->away = false;
+	if (root->abandoned){
+		for (size_t i = 0; i < _abandoned.size(); i++){
+			if (_abandoned[i].root != root)
+				continue;
+			_abandoned[i].handle.destroy();
+			std::function<void()> release = std::move(_abandoned[i].release);
+			_abandoned[i] = std::move(_abandoned.back());
+			_abandoned.pop_back();
+			if (release)
+				release();
+			break;
+		}
+		return;
+	}
+	if (resume)
+		returned.first.resume();
+}
+
+void Reactor::sendToHandlerPool(std::coroutine_handle<> handle, detail::TaskPromiseBase* root){
+	root->away = true;
+	_away.fetch_add(1, std::memory_order_relaxed);
+	HandlerPool::instance().submit(HandlerJob{handle, this, _poolStats});
+}
+
+/// Hand a frame back to its loop and wake the loop up (handler pool side).
+void Reactor::returnFromHandlerPool(std::coroutine_handle<> handle, detail::TaskPromiseBase* root){
+	{
+		std::lock_guard<std::mutex> lock(_returnedMutex);
+		_returned.push_back(Returned(handle, root));
+	}
+	wakeUp();
+	// last: once nothing is away, settleHandlers() lets the loop go
+	_away.fetch_sub(1, std::memory_order_release);
+}
+
+/**
+ * @brief Wait for every frame on the handler pool, and every offloaded job, to come
+ *        back, without resuming them
+ *
+ * @note for shutdown: afterwards no pool or offload thread refers to this loop or
+ *       its clients, and every abandoned task is destroyed.
+ */
+void Reactor::settleHandlers(void){
+	while (_away.load(std::memory_order_acquire) != 0){
+		submitOverflow();
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	takeCompleted(false);
+	std::vector<Returned> returned;
+	{
+		std::lock_guard<std::mutex> lock(_returnedMutex);
+		returned.swap(_returned);
+	}
+	for (const Returned& frame : returned)
+		takeBack(frame, false);
+}
+
+// ==========================================================
+// awaitables
+// ==========================================================
+FdAwaitable::FdAwaitable(int fd, uint32_t events) : _events(events){
+	_waiter.kind = PollSource::SOURCE_WAITER;
+	_waiter.fd = fd;
+}
+
+FdAwaitable::~FdAwaitable(){
+	// destroyed while suspended: the coroutine was cancelled
+	if (_reactor)
+		_reactor->unwatch(_waiter);
+}
+
+void FdAwaitable::await_suspend(std::coroutine_handle<> handle){
+	_reactor = Reactor::current();
+	if (!_reactor)
+		throw std::logic_error("co_await on an fd outside an event loop");
+	_waiter.handle = handle;
+	_reactor->watch(_waiter, _waiter.fd, _events);
+}
+
+uint32_t FdAwaitable::await_resume(){
+	_reactor = nullptr;
+	return _waiter.revents;
+}
+
+FdEitherAwaitable::FdEitherAwaitable(int firstFd, uint32_t firstEvents, int secondFd, uint32_t secondEvents)
+	: _firstEvents(firstEvents), _secondEvents(secondEvents){
+	_first.kind = PollSource::SOURCE_WAITER;
+	_first.fd = firstFd;
+	_second.kind = PollSource::SOURCE_WAITER;
+	_second.fd = secondFd;
+}
+
+FdEitherAwaitable::~FdEitherAwaitable(){
+	// destroyed while suspended: the coroutine was cancelled
+	unwatchPending();
+}
+
+/// Unwatch the waiters not resumed: a resumed one was unregistered by the loop, and reports revents.
+void FdEitherAwaitable::unwatchPending(void){
+	if (!_reactor)
+		return;
+	if (_first.revents == 0)
+		_reactor->unwatch(_first);
+	if (_second.revents == 0)
+		_reactor->unwatch(_second);
+	_reactor = nullptr;
+}
+
+/**
+ * @note both waiters resume the same coroutine: the first event resumes it, and
+ *       await_resume unwatches the other before it can, even later in the same batch.
+ */
+void FdEitherAwaitable::await_suspend(std::coroutine_handle<> handle){
+	_reactor = Reactor::current();
+	if (!_reactor)
+		throw std::logic_error("co_await on an fd outside an event loop");
+	_first.handle = handle;
+	_first.revents = 0;
+	_second.handle = handle;
+	_second.revents = 0;
+	_reactor->watch(_first, _first.fd, _firstEvents);
+	_reactor->watch(_second, _second.fd, _secondEvents);
+}
+
+std::pair<uint32_t, uint32_t> FdEitherAwaitable::await_resume(){
+	unwatchPending();
+	return std::make_pair(_first.revents, _second.revents);
+}
+
+OffloadAwaitable::OffloadAwaitable(std::function<void()> work)
+	: _job(std::make_shared<OffloadJob>()){
+	_job->work = std::move(work);
+}
+
+/**
+ * @note the loop does not destroy a task while its job runs (it is away, see
+ *       Reactor::abandon): a job not back yet here is only forgotten, never waited for.
+ */
+OffloadAwaitable::~OffloadAwaitable(){
+	if (_submitted)
+		_job->cancelled.store(true, std::memory_order_release);
+}
+
+bool OffloadAwaitable::await_ready(){
+	if (Reactor::current())
+		return false;
+	_job->work();
+	return true;
+}
+
+void OffloadAwaitable::await_resume() const{
+	if (_job->exception)
+		std::rethrow_exception(_job->exception);
+}
+
+void OffloadAwaitable::suspend(std::coroutine_handle<> handle, detail::TaskPromiseBase* root){
+	root->away = true;
+	_job->handle = handle;
+	_job->root = root;
+	_job->owner = Reactor::current();
+	_job->owner->offload(_job);
+	_submitted = true;
+}
+
+HandlerPoolAwaitable onHandlerPool(void){
+	return HandlerPoolAwaitable();
+}
+
+EventLoopAwaitable onEventLoop(void){
+	return EventLoopAwaitable();
+}
+
+FdAwaitable readable(int fd){
+	return FdAwaitable(fd, EPOLLIN);
+}
+
+FdAwaitable writable(int fd){
+	return FdAwaitable(fd, EPOLLOUT);
+}
+
+/// readable, or closed by the writer (EOF)
+FdAwaitable pipeReadable(int fd){
+	return FdAwaitable(fd, EPOLLIN | EPOLLHUP);
+}
+
+/// writeFd writable, or readFd readable or closed by its writer (a child's stdin and stdout)
+FdEitherAwaitable writableOrPipeReadable(int writeFd, int readFd){
+	return FdEitherAwaitable(writeFd, EPOLLOUT, readFd, EPOLLIN | EPOLLHUP);
+}
+
+OffloadAwaitable offload(std::function<void()> work){
+	return OffloadAwaitable(std::move(work));
+}
+
+/**
+ * @brief Wait for a child process to exit without blocking the loop
+ *
+ * @return int the wait status, as filled by waitpid
+ *
+ * @note a pidfd becomes readable when the child exits; kernels without
+ *       pidfd_open (< 5.3) wait in an offload thread instead.
+ */
+Task<int> childExit(pid_t pid){
+	int status = 0;
+	int pidFd = syscall(SYS_pidfd_open, pid, 0);
+	if (pidFd < 0){
+		co_await offload([pid, &status]{
+			while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+				;
+		});
+		co_return status;
+	}
+	struct FdCloser {
+		int fd;
+		~FdCloser()	{ close(fd); }
+	} closer{pidFd};
+	while (true){
+		pid_t reaped = waitpid(pid, &status, WNOHANG);
+		if (reaped == pid || (reaped < 0 && errno != EINTR))
+			break;
+		if (reaped == 0)
+			co_await readable(pidFd);
+	}
+	co_return status;
+}
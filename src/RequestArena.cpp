@@ -0,0 +1,9 @@
+#include "RequestArena.hpp"
+
+/// The pool the blocks of every arena are taken from.
+std::pmr::memory_resource* RequestArena::blocks()
+{
+    static std::pmr::synchronized_pool_resource pool(
+        std::pmr::pool_options{0, LARGEST_POOLED_BLOCK}, std::pmr::new_delete_resource());
+    return &pool;
+}
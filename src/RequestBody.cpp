@@ -0,0 +1,183 @@
+#include "RequestBody.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * @brief copy up to len bytes of the body, from offset, to dst
+ *
+ * @return bytes copied, fewer than len only past the end of the body or on a read error
+ */
+size_t RequestBody::read(size_t offset, char* dst, size_t len) const
+{
+    if (offset >= _size)
+        return 0;
+    len = std::min(len, _size - offset);
+    if (inMemory()){
+        std::memcpy(dst, _memory.data() + offset, len);
+        return len;
+    }
+    size_t done = 0;
+    while (done < len){
+        ssize_t n = pread(_fd, dst + done, len - done, offset + done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        done += n;
+    }
+    return done;
+}
+
+/// Copy of len bytes of the body from offset, for small parts such as multipart headers.
+std::string RequestBody::slice(size_t offset, size_t len) const
+{
+    if (inMemory())
+        return offset < _size ? std::string(_memory.substr(offset, len)) : std::string();
+    std::string part(offset < _size ? std::min(len, _size - offset) : 0, '\0');
+    part.resize(read(offset, part.data(), part.size()));
+    return part;
+}
+
+/**
+ * @brief offset of the first occurrence of needle at or after from
+ *
+ * @return the offset, std::string::npos when absent
+ *
+ * @note a spooled body is searched FIND_BLOCK bytes at a time, consecutive blocks
+ *       overlapping by needle.size() - 1 bytes so a match across two is found
+ */
+size_t RequestBody::find(std::string_view needle, size_t from) const
+{
+    if (inMemory())
+        return _memory.find(needle, from);
+    if (needle.empty())
+        return from <= _size ? from : std::string::npos;
+    std::string block(FIND_BLOCK + needle.size() - 1, '\0');
+    size_t pos = from;
+    while (pos < _size && _size - pos >= needle.size()){
+        size_t len = read(pos, block.data(), block.size());
+        if (len < needle.size())
+            break;
+        size_t found = std::string_view(block.data(), len).find(needle);
+        if (found != std::string_view::npos)
+            return pos + found;
+        pos += len - needle.size() + 1;
+    }
+    return std::string::npos;
+}
+
+/**
+ * @brief write len bytes of the body, from offset, to outFd
+ *
+ * @return true once all of them are written
+ *
+ * @note a spooled body is copied by the kernel (copy_file_range) when both files
+ *       allow it, else through a bounded buffer: never loaded whole
+ */
+bool RequestBody::copyTo(int outFd, size_t offset, size_t len) const
+{
+    if (offset > _size || len > _size - offset)
+        return false;
+    if (inMemory()){
+        const char* data = _memory.data() + offset;
+        while (len > 0){
+            ssize_t n = ::write(outFd, data, len);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            data += n;
+            len -= n;
+        }
+        return true;
+    }
+    loff_t in = static_cast<loff_t>(offset);
+    while (len > 0){
+        ssize_t n = copy_file_range(_fd, &in, outFd, NULL, len, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        len -= n;
+    }
+    if (len == 0)
+        return true;
+    offset = static_cast<size_t>(in);
+    std::string block(std::min(len, FIND_BLOCK), '\0');
+    while (len > 0){
+        size_t got = read(offset, block.data(), std::min(len, block.size()));
+        if (got == 0)
+            return false;
+        RequestBody chunk(std::string_view(block.data(), got));
+        if (!chunk.copyTo(outFd, 0, got))
+            return false;
+        offset += got;
+        len -= got;
+    }
+    return true;
+}
+
+SpoolFile::SpoolFile(SpoolFile&& other) noexcept : _fd(other._fd), _size(other._size)
+{
+    other._fd = -1;
+    other._size = 0;
+}
+
+SpoolFile& SpoolFile::operator=(SpoolFile&& other) noexcept
+{
+    if (this != &other){
+        close();
+        _fd = other._fd;
+        _size = other._size;
+        other._fd = -1;
+        other._size = 0;
+    }
+    return *this;
+}
+
+/// Create the temporary file; false when none can be created (no space, no such directory).
+bool SpoolFile::open()
+{
+    close();
+    const char* dir = std::getenv("TMPDIR");
+    if (!dir || !*dir)
+        dir = "/tmp";
+    _fd = ::open(dir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (_fd < 0){
+        std::string path = std::string(dir) + "/webserv-body-XXXXXX";
+        _fd = mkostemp(path.data(), O_CLOEXEC);
+        if (_fd >= 0)
+            unlink(path.c_str());
+    }
+    return _fd >= 0;
+}
+
+/// Append len bytes; false on a write error (e.g. the disk is full).
+bool SpoolFile::write(const char* data, size_t len)
+{
+    while (len > 0){
+        ssize_t n = ::write(_fd, data, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        data += n;
+        len -= n;
+        _size += n;
+    }
+    return true;
+}
+
+/// Close the file, which frees its space.
+void SpoolFile::close()
+{
+    if (_fd >= 0)
+        ::close(_fd);
+    _fd = -1;
+    _size = 0;
+}
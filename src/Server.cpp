@@ -1,15 +1,5 @@
 #include "Server.hpp"
 
-/* ========================================== */
-/*  2 public helper methods for  WriteBuffer  */
-/* ========================================== */
-inline bool Server::WriteBuffer::isComplete() const {
-	return sent >= data.size();
-}
-inline size_t Server::WriteBuffer::remainingToSend() const {
-	return data.size() - sent;
-}
-
 /* ========================================== */
 /*  private helpers							  */
 /* ========================================== */
@@ -28,7 +18,7 @@ const config::ServerConfig* Server::getDefaultVhost() const {
  * @note This method searches through the configured virtual hosts to find one that matches
  *       the provided Host header. If no match is found, it returns the default virtual host if available.
  */
-const ServerConfig* Server::matchVirtualHost(const std::string& hostHeader){
+const ServerConfig* Server::matchVirtualHost(std::string_view hostHeader){
 	for(size_t i = 0; i < _virtualHosts.size(); i++){
 		for (size_t j = 0; j < _virtualHosts[i].serverNames.size(); j++){
 			if (_virtualHosts[i].serverNames[j] == hostHeader){
@@ -69,8 +59,8 @@ Server::Server(const std::string& host, int port, const std::vector<ServerConfig
 Server::Server(Server&& other) noexcept
 	: _host(std::move(other._host)), _listenFd(other._listenFd), _port(other._port),
 		 _virtualHosts(std::move(other._virtualHosts)), _addr(other._addr),
-		 	_requestCount(std::move(other._requestCount)), _parsers(std::move(other._parsers)),
-				 _writeBuffers(std::move(other._writeBuffers)), _httpHandler(std::move(other._httpHandler)){
+		 	_httpHandler(std::move(other._httpHandler)), _stats(other._stats),
+		 	_busyPollUs(other._busyPollUs){
 		other._listenFd = NOT_VALID_FD;
 }
 
@@ -85,7 +75,16 @@ Server::~Server(){
 /* ==================================== */
 /*  startup and shutdown of the server  */
 /* ==================================== */
-Server::StartResult Server::start(){
+/**
+ * @brief Open, bind and listen on the server socket
+ *
+ * @param reusePort set SO_REUSEPORT so several event loops can each own a listener on the same address
+ * @return Server::StartResult
+ *
+ * @note with SO_REUSEPORT the kernel load-balances incoming connections between
+ *       all sockets bound to the same host:port, so each loop accepts only its own share.
+ */
+Server::StartResult Server::start(bool reusePort){
 	_listenFd = socket(AF_INET, SOCK_STREAM, 0);
 	if (_listenFd < 0){
 		return Server::START_SOCKET_ERROR;
@@ -95,6 +94,10 @@ Server::StartResult Server::start(){
 		close (_listenFd);
 		return START_SOCKET_ERROR;
 	}
+	if (reusePort && setsockopt(_listenFd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0){
+		close (_listenFd);
+		return START_SOCKET_ERROR;
+	}
 	if (bind(_listenFd, (struct sockaddr *)&_addr, sizeof(_addr)) < 0){
 		close (_listenFd);
 		return START_BIND_ERROR;
@@ -111,6 +114,65 @@ Server::StartResult Server::start(){
 	return Server::START_SUCCESS;
 }
 
+static sock_filter bpfStatement(uint16_t code, uint32_t k){
+	sock_filter instruction = {code, 0, 0, k};
+	return instruction;
+}
+
+static sock_filter bpfJump(uint16_t code, uint32_t k, size_t jumpTrue, size_t jumpFalse){
+	sock_filter instruction = {code, static_cast<uint8_t>(jumpTrue), static_cast<uint8_t>(jumpFalse), k};
+	return instruction;
+}
+
+/**
+ * @brief Steer the connections of this listener's SO_REUSEPORT group by receiving CPU
+ *
+ * @param cpuOfSocket CPU of the loop owning each socket of the group, in group order
+ * @return bool false when refused: the group then keeps the kernel's hash
+ *
+ * @note A classic BPF program picks the socket of the loop pinned to the CPU that
+ *       received the SYN, so a connection is accepted, parsed and answered where its
+ *       packets land and its state stays in that core's cache. When several loops
+ *       share a CPU, the RX hash splits its connections between them; a CPU without
+ *       a loop returns an out of range index, which makes the kernel fall back to its hash.
+ *       The program belongs to the group: attaching it through one listener is enough.
+ */
+bool Server::attachCpuSteering(const std::vector<int>& cpuOfSocket){
+	std::map<int, std::vector<uint32_t>> socketsOfCpu;
+	for (size_t i = 0; i < cpuOfSocket.size(); i++)
+		socketsOfCpu[cpuOfSocket[i]].push_back(static_cast<uint32_t>(i));
+	std::vector<sock_filter> code;
+	for (std::map<int, std::vector<uint32_t>>::const_iterator it = socketsOfCpu.begin(); it != socketsOfCpu.end(); ++it){
+		const std::vector<uint32_t>& sockets = it->second;
+		// A = CPU; not this one: skip the block (jump offsets are 8 bits)
+		size_t blockLength = sockets.size() == 1 ? 1 : 2 * sockets.size() + 1;
+		if (blockLength > 255){
+			errno = E2BIG;
+			return false;
+		}
+		code.push_back(bpfStatement(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_CPU));
+		code.push_back(bpfJump(BPF_JMP | BPF_JEQ | BPF_K, it->first, 0, blockLength));
+		if (sockets.size() == 1){
+			code.push_back(bpfStatement(BPF_RET | BPF_K, sockets[0]));
+			continue;
+		}
+		code.push_back(bpfStatement(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_RXHASH));
+		code.push_back(bpfStatement(BPF_ALU | BPF_MOD | BPF_K, sockets.size()));
+		for (size_t j = 0; j + 1 < sockets.size(); j++){
+			code.push_back(bpfJump(BPF_JMP | BPF_JEQ | BPF_K, j, 0, 1));
+			code.push_back(bpfStatement(BPF_RET | BPF_K, sockets[j]));
+		}
+		code.push_back(bpfStatement(BPF_RET | BPF_K, sockets.back()));
+	}
+	code.push_back(bpfStatement(BPF_RET | BPF_K, 0xffffffff));
+	struct sock_fprog program;
+	program.len = static_cast<unsigned short>(code.size());
+	program.filter = code.data();
+	if (setsockopt(_listenFd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) < 0)
+		return false;
+	return true;
+}
+
 void Server::shutdown(){
 	if (_listenFd != NOT_VALID_FD){
 		std::cout << "Stopping servers listening on port: " << _port << std::endl;
@@ -126,11 +188,14 @@ void Server::shutdown(){
  * @brief Accept a new client connection
  * 
  * @return int the file descriptor of the accepted client socket, or NOT_VALID_FD on error
+ *
+ * @note accept4() hands the socket out already non-blocking, saving two fcntl() calls.
+ *       NOT_VALID_FD with errno EAGAIN means the accept queue is drained.
  */
 int  Server::acceptConnection(void){
 	struct sockaddr_in clientAddr;
 	socklen_t clientLen = sizeof(clientAddr);
-	int clientFd = accept(_listenFd, (struct sockaddr*)&clientAddr, &clientLen);
+	int clientFd = accept4(_listenFd, (struct sockaddr*)&clientAddr, &clientLen, SOCK_NONBLOCK);
 	if (clientFd < 0){
 		if (errno == EAGAIN || errno == EWOULDBLOCK){
 			return NOT_VALID_FD;
@@ -138,129 +203,415 @@ int  Server::acceptConnection(void){
 		std::cerr << "Accept error: " << strerror(errno) << std::endl;
 		return NOT_VALID_FD;
 	}
-	int flags = fcntl(clientFd, F_GETFL, 0);
-	if (flags < 0 || fcntl(clientFd, F_SETFL, flags | O_NONBLOCK) < 0){
-		close (clientFd);
-		return NOT_VALID_FD;
-	}
+	prepareClientSocket(clientFd);
 	return clientFd;
 }
 
 /**
- * @brief handles a client request on the given client file descriptor
+ * @brief Apply the per-socket options of an accepted client
  *
- * @param clientFd the file descriptor of the client socket
- * @return Server::ClientStatus indicating the status of the client connection after handling the request
+ * @note SO_BUSY_POLL lets a read on an empty socket spin on the NIC queue for
+ *       up to busy_poll_us instead of sleeping until the interrupt. Raising it above
+ *       net.core.busy_read needs CAP_NET_ADMIN: refused once, the error is reported
+ *       once and the sockets keep the system setting.
+ */
+void Server::prepareClientSocket(int clientFd) const {
+	static std::atomic<bool> busyPollRefused(false);
+	if (_busyPollUs <= 0 || busyPollRefused.load(std::memory_order_relaxed))
+		return;
+	if (setsockopt(clientFd, SOL_SOCKET, SO_BUSY_POLL, &_busyPollUs, sizeof(_busyPollUs)) < 0
+		&& !busyPollRefused.exchange(true))
+		std::cerr << "SO_BUSY_POLL refused (" << strerror(errno) << "), sockets keep net.core.busy_read" << std::endl;
+}
+
+/**
+ * @brief send as much of the queued responses as the socket accepts right now
+ *
+ * @return ssize_t bytes sent and consumed from buffer (possibly fewer than queued once
+ *         the socket buffer is full), -1 on a hard error
  *
- * @note This method reads data from the client socket, parses the HTTP request,
- *       matches the appropriate virtual host, generates an HTTP response, and sends it back to the client.
- *       It also manages connection persistence based on the response's keep-alive status.
+ * @note loops until everything is sent or writev() would block, so a large response
+ *       does not cost one epoll round-trip per socket buffer worth of data.
+ * @note heads and bodies are gathered, up to WriteBuffer::MAX_IOV segments per sendmsg:
+ *       a small response goes out in one call without being concatenated first.
+ * @note a file body goes from the page cache to the socket with sendfile, its head
+ *       sent just before with MSG_MORE so that both share their first packet. Pages
+ *       not cached yet are read by sendfile, on the loop's thread.
  */
-Server::ClientStatus Server::handleClient(int clientFd){
-	char buffer[8192];
-	ssize_t nBytes = recv(clientFd, buffer, sizeof(buffer), 0);
-	if (nBytes < 0)
-		return CLIENT_INCOMPLETE;
-	if (nBytes == 0){
-		cleanMaps(clientFd);
-		return CLIENT_ERROR;
+ssize_t Server::sendAvailable(int clientFd, WriteBuffer& buffer){
+	size_t total = 0;
+	while (!buffer.isComplete()){
+		ssize_t sent;
+		off_t offset;
+		size_t length;
+		if (const FileBody* file = buffer.currentFile(offset, length)){
+			sent = sendfile(clientFd, file->fd(), &offset, length);
+			// the file is shorter than when its Content-Length was sent: the response cannot be completed
+			if (sent == 0)
+				return -1;
+		}
+		else {
+			iovec iov[WriteBuffer::MAX_IOV];
+			bool beforeFile = false;
+			msghdr msg = msghdr();
+			msg.msg_iov = iov;
+			msg.msg_iovlen = buffer.gather(iov, WriteBuffer::MAX_IOV, &beforeFile);
+			sent = sendmsg(clientFd, &msg, beforeFile ? MSG_MORE : 0);
+		}
+		if (sent < 0){
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			return -1;
+		}
+		buffer.consume(sent);
+		total += sent;
 	}
-	if (_requestCount[clientFd] >= MAX_REQUESTS){
-		cleanMaps(clientFd);
+	if (_stats)
+		_stats->bytesOut.fetch_add(total, std::memory_order_relaxed);
+	return total;
+}
+
+/**
+ * @brief parse the bytes received from a client into its parser's buffer, and answer what they complete
+ *
+ * @param conn the client connection
+ * @return Server::ClientStatus indicating the status of the client connection afterwards
+ */
+Server::ClientStatus Server::processRequest(Connection& conn){
+	return continuePipeline(conn, answerRequest(conn));
+}
+
+/**
+ * @brief answer the next request of the connection's buffer, if it is complete
+ *
+ * @param conn the client connection
+ * @return Server::ClientStatus of the connection once the response is queued in writeBuffer
+ *
+ * @note matches the appropriate virtual host and generates an HTTP response, queued for the
+ *       caller to send. It also manages connection persistence based on the response's keep-alive status.
+ * @note the handler is a coroutine: when it suspends (CGI, file I/O) the request is kept in the
+ *       connection and CLIENT_PENDING is returned, the response is queued by finishRequest.
+ */
+Server::ClientStatus Server::answerRequest(Connection& conn){
+	if (conn.requestCount >= MAX_REQUESTS)
 		return CLIENT_COMPLETE;
+	HttpParser& parser = conn.parser;
+	parser.parseHttpRequest();
+	if (parser.awaitsBodyAdmission()){
+		ClientStatus admitted = admitBody(conn);
+		if (admitted != CLIENT_INCOMPLETE)
+			return admitted;
+		parser.parseHttpRequest();
 	}
-	HttpParser& parser = _parsers[clientFd];
-	std::string chunk(buffer, nBytes);
-	HttpRequest request = parser.parseHttpRequest(chunk);
 	if (parser.getState() == ERROR) {
 		HttpResponse error_res = makeErrorResponse(parser.getErrStatus(), getDefaultVhost());
-		std::string error_res_string = error_res.buildResponseString();
-		ssize_t sent = send(clientFd, error_res_string.c_str(), error_res_string.size(), 0);
-		if (sent <= 0){
-			cleanMaps(clientFd);
-			return CLIENT_ERROR;
-		}
-		cleanMaps(clientFd);
+		queueResponse(conn, error_res);
 		return CLIENT_ERROR;
 	}
 	if (parser.getState() != DONE)
 		return CLIENT_INCOMPLETE;
-	_requestCount[clientFd]++;
-	std::map<std::string, std::string> headers = request.getHeaders();
-	auto it = headers.find("host");
-	if (it == headers.end()){
-		cleanMaps(clientFd);
+	conn.requestCount++;
+	if (_stats)
+		_stats->requests.fetch_add(1, std::memory_order_relaxed);
+	if (_shedding)
+		return shedRequest(conn);
+	HttpRequest& request = parser.getRequest();
+	if (!request.hasHeader(HEADER_HOST))
 		return CLIENT_ERROR;
+	const ServerConfig* virtualHost = matchVirtualHost(request.getHeader(HEADER_HOST));
+	if (!virtualHost)
+		return CLIENT_ERROR;
+	conn.handler = _httpHandler.handleRequest(request, virtualHost);
+	conn.handler.start();
+	if (!conn.handler.done()){
+		conn.pending = true;
+		return CLIENT_PENDING;
+	}
+	return queueHandlerResponse(conn);
+}
+
+/**
+ * @brief route a request as soon as its head is complete, and refuse it before its body is received
+ *
+ * @param conn the client connection, its parser waiting for admitBody
+ * @return Server::ClientStatus CLIENT_INCOMPLETE when the body may be received, CLIENT_COMPLETE
+ *         once the refusal is queued (the connection is closed: its body is never parsed)
+ *
+ * @note a body the request's location would refuse (method, client_max_body_size) is refused
+ *       now rather than after the upload; a chunked one is limited as its chunks arrive.
+ * @note a client sending "Expect: 100-continue" waits for "100 Continue" before the body:
+ *       it is only sent when the body is admitted, and when none of it was sent already.
+ * @note the refusal says "Connection: close", and the client may still be sending the
+ *       body: the connection gets a lingering close (Webserver::closeClient).
+ */
+Server::ClientStatus Server::admitBody(Connection& conn){
+	static const char CONTINUE_RESPONSE[] = "HTTP/1.1 100 Continue\r\n\r\n";
+	HttpParser& parser = conn.parser;
+	const HttpRequest& request = parser.getRequest();
+	const ServerConfig* virtualHost = matchVirtualHost(request.getHeader(HEADER_HOST));
+	size_t maxBodySize = 0;
+	int status = virtualHost ? _httpHandler.checkBody(request, virtualHost, maxBodySize) : 500;
+	if (status == 0 && parser.getBodyLength() > maxBodySize)
+		status = 413;
+	std::string_view expect = request.getHeader(HEADER_EXPECT);
+	if (status == 0 && !expect.empty() && !httpHeaders::equalsNoCase(expect, "100-continue"))
+		status = 417;
+	if (status != 0){
+		HttpResponse refusal = makeErrorResponse(status, virtualHost ? virtualHost : getDefaultVhost());
+		queueResponse(conn, refusal);
+		conn.lingerOnClose = true;
+		return CLIENT_COMPLETE;
 	}
-	std::string hostHeader = it->second;
-	const ServerConfig* virtualHost = matchVirtualHost(hostHeader);
-	if (!virtualHost){
-		cleanMaps(clientFd);
+	parser.admitBody(maxBodySize);
+	if (!expect.empty() && !parser.hasBodyBytes())
+		conn.writeBuffer.append(std::string_view(CONTINUE_RESPONSE, sizeof(CONTINUE_RESPONSE) - 1));
+	return CLIENT_INCOMPLETE;
+}
+
+/**
+ * @brief queue the response of a handler that has completed, then answer the requests pipelined after it
+ *
+ * @param conn the client connection, its handler done
+ * @return Server::ClientStatus as for processRequest
+ */
+Server::ClientStatus Server::finishRequest(Connection& conn){
+	return continuePipeline(conn, queueHandlerResponse(conn));
+}
+
+Server::ClientStatus Server::queueHandlerResponse(Connection& conn){
+	bool keepAlive;
+	{
+		// the response and the handler's frames live in the request's arena, which
+		// finishResponse releases when it moves on to the next request
+		std::optional<HttpResponse> response;
+		try {
+			response.emplace(conn.handler.result());
+		} catch (const std::exception& e) {
+			std::cerr << "Request handler failed: " << e.what() << std::endl;
+			response.emplace(makeErrorResponse(500, getDefaultVhost()));
+		}
+		conn.handler = Task<HttpResponse>();
+		queueResponse(conn, *response);
+		keepAlive = response->isKeepAlive();
+	}
+	conn.pending = false;
+	return finishResponse(conn, keepAlive);
+}
+
+/**
+ * @brief answer a request of an overloaded loop without running its handler
+ *
+ * @return Server::ClientStatus CLIENT_COMPLETE: the connection is closed afterwards
+ *
+ * @note the response is a constant: shedding must cost less than serving, so
+ *       neither the handler, the virtual host nor an error page is involved.
+ */
+Server::ClientStatus Server::shedRequest(Connection& conn){
+	static const char OVERLOADED_RESPONSE[] =
+		"HTTP/1.1 503 Service Unavailable\r\n"
+		"Retry-After: 1\r\n"
+		"Content-Type: text/plain\r\n"
+		"Content-Length: 20\r\n"
+		"Connection: close\r\n"
+		"\r\n"
+		"Service Unavailable\n";
+	if (_stats)
+		_stats->shed.fetch_add(1, std::memory_order_relaxed);
+	conn.writeBuffer.append(std::string_view(OVERLOADED_RESPONSE, sizeof(OVERLOADED_RESPONSE) - 1));
+	return CLIENT_COMPLETE;
+}
+
+/**
+ * @brief queue a response behind the ones not sent yet
+ *
+ * @param conn the client connection
+ * @param response the response, its body moved out
+ *
+ * @note the head is written into the connection's write buffer and the body queued
+ *       after it as is: they are only put together by the writev that sends them.
+ *       A file body is queued as its fd, for sendfile.
+ */
+void Server::queueResponse(Connection& conn, HttpResponse& response){
+	WriteBuffer& buffer = conn.writeBuffer;
+	response.writeHead(buffer.data);
+	buffer.commitData();
+	buffer.appendBody(response.releaseBody());
+	buffer.appendFile(response.releaseFile());
+}
+
+/**
+ * @brief move on once a response is queued
+ *
+ * @param conn the client connection
+ * @param keepAlive whether the connection serves another request afterwards
+ * @return Server::ClientStatus CLIENT_KEEP_ALIVE, the parser then moved to the next request, or CLIENT_COMPLETE
+ */
+Server::ClientStatus Server::finishResponse(Connection& conn, bool keepAlive){
+	if (!keepAlive)
+		return CLIENT_COMPLETE;
+	conn.parser.nextRequest();
+	return CLIENT_KEEP_ALIVE;
+}
+
+/**
+ * @brief answer the requests pipelined in the connection's buffer, then send the queued responses
+ *
+ * @param conn the client connection
+ * @param status outcome of the request just answered
+ * @return Server::ClientStatus as for flushResponses
+ *
+ * @note a client may send requests without waiting for the responses (pipelining):
+ *       each complete request in the buffer is answered in turn, and all their
+ *       responses go out together, in one send, instead of one per round-trip.
+ */
+Server::ClientStatus Server::continuePipeline(Connection& conn, ClientStatus status){
+	while (status == CLIENT_KEEP_ALIVE && !conn.parser.isIdle())
+		status = answerRequest(conn);
+	return flushResponses(conn, status);
+}
+
+/**
+ * @brief send the queued responses, keeping in writeBuffer what the socket does not take at once
+ *
+ * @param conn the client connection
+ * @param status state of the connection once they are sent
+ * @return Server::ClientStatus CLIENT_WRITING while queued, status otherwise
+ *
+ * @note while a handler is pending, what is not sent waits for its response.
+ * @note after an error the responses are sent on a best-effort basis, as the connection is closed.
+ */
+Server::ClientStatus Server::flushResponses(Connection& conn, ClientStatus status){
+	WriteBuffer& buffer = conn.writeBuffer;
+	if (buffer.isComplete())
+		return status;
+	if (status == CLIENT_ERROR){
+		sendAvailable(conn.fd, buffer);
 		return CLIENT_ERROR;
 	}
-	HttpResponse response = _httpHandler.handleRequest(request, virtualHost);
-	std::string responseString = response.buildResponseString();
-	bool keepAlive = response.isKeepAlive();
-	ssize_t sent = send(clientFd, responseString.c_str(), responseString.size(), 0);
-	if (sent < 0)
-		sent = 0;
-	if ((size_t)sent < responseString.size()){
-		_writeBuffers[clientFd].data = responseString.substr(sent);
-		_writeBuffers[clientFd].sent = 0;
-		_writeBuffers[clientFd].keepAlive = keepAlive;
+	buffer.keepAlive = status != CLIENT_COMPLETE;
+	if (conn.deferSend){
+		if (status == CLIENT_PENDING)
+			return CLIENT_PENDING;
+		conn.writing = true;
 		return CLIENT_WRITING;
 	}
-	if (keepAlive){
-		_parsers[clientFd] = HttpParser();
-		return CLIENT_KEEP_ALIVE;
+	if (sendAvailable(conn.fd, buffer) < 0)
+		return CLIENT_ERROR;
+	if (buffer.isComplete()){
+		clearWriteBuffer(conn);
+		return status;
 	}
-	else {
-		cleanMaps(clientFd);
-		return CLIENT_COMPLETE;
+	if (status == CLIENT_PENDING)
+		return CLIENT_PENDING;
+	conn.writing = true;
+	return CLIENT_WRITING;
+}
+
+/// Empty the write buffer, keeping its allocation for the next responses unless a large one made it grow.
+void Server::clearWriteBuffer(Connection& conn){
+	WriteBuffer& buffer = conn.writeBuffer;
+	buffer.clear();
+	if (buffer.data.capacity() > MAX_IDLE_WRITE_BUFFER)
+		buffer.data.shrink_to_fit();
+	conn.writing = false;
+}
+
+/**
+ * @brief handles a client request on the given client connection
+ *
+ * @param conn the client connection
+ * @return Server::ClientStatus indicating the status of the client connection after handling the request
+ *
+ * @note reads until recv() would block (required with edge-triggered epoll, where no new
+ *       event is raised for bytes already waiting) and processes every chunk on the way.
+ *       Bytes are received straight into the connection's parser buffer.
+ *       Reading stops early once a response is pending: it resumes after the write completes,
+ *       or after finishRequest when the handler suspended (CLIENT_PENDING).
+ *       Every request a read completes is answered before the next read.
+ */
+Server::ClientStatus Server::handleClient(Connection& conn){
+	ClientStatus status = CLIENT_INCOMPLETE;
+	while (true){
+		size_t room;
+		char* buffer = conn.parser.receiveBuffer(room);
+		ssize_t nBytes = recv(conn.fd, buffer, room, 0);
+		if (nBytes < 0){
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return status;
+			return CLIENT_ERROR;
+		}
+		if (nBytes == 0)
+			return CLIENT_ERROR;
+		if (_stats)
+			_stats->bytesIn.fetch_add(nBytes, std::memory_order_relaxed);
+		conn.parser.received(nBytes);
+		status = processRequest(conn);
+		if (status != CLIENT_INCOMPLETE && status != CLIENT_KEEP_ALIVE)
+			return status;
 	}
 }
 
 /**
  * @brief Handle writing data to a client socket
  * 
- * @param clientFd The file descriptor of the client socket
+ * @param conn the client connection
  * @return Server::ClientStatus indicating the status of the write operation
  * 
- * @note This method attempts to send any remaining data in the write buffer to the client.
+ * @note This method sends the remaining data in the write buffer until it is empty or the socket is full.
  *       It manages connection persistence based on whether all data has been sent and the keep-alive status.
  */
-Server::ClientStatus Server::handleClientWrite(int clientFd) {
-	auto it = _writeBuffers.find(clientFd);
-	if (it == _writeBuffers.end())
+Server::ClientStatus Server::handleClientWrite(Connection& conn) {
+	if (!conn.writing)
 		return CLIENT_ERROR;
-	WriteBuffer& buffer = it->second;
-	const char* dataPtr = buffer.data.c_str() + buffer.sent;
-	size_t remaining = buffer.remainingToSend();
-	ssize_t bytesSent = send(clientFd, dataPtr, remaining, 0);
-	if (bytesSent < 0)
-		return CLIENT_WRITING;
-	buffer.sent += bytesSent;
-	if (buffer.isComplete()){
-		bool keepAlive = buffer.keepAlive;
-		_writeBuffers.erase(clientFd);
-		if (keepAlive)
-			_parsers[clientFd] = HttpParser();
-		else
-			cleanMaps(clientFd);
-		return keepAlive ? CLIENT_KEEP_ALIVE : CLIENT_COMPLETE;
-	}
-	return CLIENT_WRITING;
+	if (sendAvailable(conn.fd, conn.writeBuffer) < 0)
+		return CLIENT_ERROR;
+	return writeStatus(conn);
 }
 
-/* ==================================== */
-/*  client connection handling		    */
-/* ==================================== */
-void  Server::cleanMaps(int clientFd){
-	_parsers.erase(clientFd);
-	_requestCount.erase(clientFd);
-	_writeBuffers.erase(clientFd);
+/**
+ * @brief feed bytes a completion-based loop received for a client
+ *
+ * @param conn the client connection
+ * @param data, len the received bytes, copied into the connection's parser buffer
+ * @return Server::ClientStatus as for handleClient
+ */
+Server::ClientStatus Server::handleClientData(Connection& conn, const char* data, size_t len){
+	if (_stats)
+		_stats->bytesIn.fetch_add(len, std::memory_order_relaxed);
+	conn.parser.append(data, len);
+	return processRequest(conn);
 }
 
-bool Server::hasWriteBuffer(int clientFd) const {
-    return _writeBuffers.find(clientFd) != _writeBuffers.end();
-}
\ No newline at end of file
+/**
+ * @brief account for bytesSent bytes of the pending response having been written
+ *
+ * @param conn the client connection
+ * @param bytesSent bytes of writeBuffer accepted by the socket
+ * @return Server::ClientStatus CLIENT_WRITING while data remains, then keep-alive (incomplete when
+ *         part of the next request is already buffered) or complete
+ */
+Server::ClientStatus Server::completeClientWrite(Connection& conn, size_t bytesSent){
+	conn.writeBuffer.consume(bytesSent);
+	return writeStatus(conn);
+}
+
+/**
+ * @brief state of a connection whose queued responses were being written
+ *
+ * @return Server::ClientStatus as for completeClientWrite
+ */
+Server::ClientStatus Server::writeStatus(Connection& conn){
+	WriteBuffer& buffer = conn.writeBuffer;
+	if (!buffer.isComplete())
+		return CLIENT_WRITING;
+	bool keepAlive = buffer.keepAlive;
+	clearWriteBuffer(conn);
+	if (!keepAlive)
+		return CLIENT_COMPLETE;
+	// the responses were queued after every complete request: what remains is a partial one
+	return conn.parser.isIdle() ? CLIENT_KEEP_ALIVE : CLIENT_INCOMPLETE;
+}
@@ -0,0 +1,171 @@
+#include "Stats.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <map>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static volatile sig_atomic_t dumpRequested = 0;
+static volatile sig_atomic_t dumpWakeFd = -1;
+
+static const char* const FS_OP_NAMES[FS_OP_COUNT] = {
+	"resolve", "stat", "access", "index", "list", "open", "write", "unlink"
+};
+
+static void dumpSignalHandler(int sig){
+	(void)sig;
+	dumpRequested = 1;
+	if (dumpWakeFd >= 0){
+		int savedErrno = errno;
+		uint64_t one = 1;
+		ssize_t written = write(dumpWakeFd, &one, sizeof(one));
+		(void)written;
+		errno = savedErrno;
+	}
+}
+
+/**
+ * @brief Print count, average and worst latency of each filesystem operation seen
+ *
+ * @note nothing is printed when no operation was counted
+ */
+static void dumpFsLatency(std::ostream& out, const std::string& label, const unsigned long long* ops,
+							const unsigned long long* nanos, const unsigned long long* maxNanos){
+	bool any = false;
+	for (size_t op = 0; op < FS_OP_COUNT; op++){
+		if (!ops[op])
+			continue;
+		if (!any)
+			out << "[stats] " << label << " fs:";
+		any = true;
+		out << " " << FS_OP_NAMES[op] << "=" << ops[op]
+			<< "/avg " << nanos[op] / ops[op] / 1000 << "us/max " << maxNanos[op] / 1000 << "us";
+	}
+	if (any)
+		out << std::endl;
+}
+
+StatsTable::StatsTable(size_t count) : _slots(nullptr), _count(count){
+	void* mem = mmap(NULL, sizeof(LoopStats) * _count, PROT_READ | PROT_WRITE,
+						MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED)
+		throw std::runtime_error("Failed to map shared statistics");
+	_slots = static_cast<LoopStats*>(mem);
+	for (size_t i = 0; i < _count; i++)
+		new (&_slots[i]) LoopStats();
+	for (size_t i = 0; i < _count; i++)
+		_slots[i].cpu.store(-1, std::memory_order_relaxed);
+}
+
+StatsTable::~StatsTable(){
+	for (size_t i = 0; i < _count; i++)
+		_slots[i].~LoopStats();
+	munmap(_slots, sizeof(LoopStats) * _count);
+}
+
+/// Counters of the loops pinned to one CPU.
+struct CpuTotals {
+	unsigned long long	loops = 0;
+	unsigned long long	connections = 0;
+	unsigned long long	requests = 0;
+	unsigned long long	foreignCpu = 0;
+};
+
+/**
+ * @brief Print one line per loop followed by the aggregated totals, and per CPU
+ *        when loops are pinned (worker_cpu_affinity)
+ *
+ * @note counters are read with relaxed loads: the dump is a snapshot, not a transaction
+ */
+void StatsTable::dump(std::ostream& out) const {
+	unsigned long long connections = 0, requests = 0, bytesIn = 0, bytesOut = 0, handlerJobs = 0, handlerSteals = 0;
+	unsigned long long busyPolls = 0, blockingWaits = 0, maxLagMicros = 0, overloads = 0, shed = 0;
+	long long handlerQueued = 0;
+	unsigned long long fsOps[FS_OP_COUNT] = {}, fsNanos[FS_OP_COUNT] = {}, fsMaxNanos[FS_OP_COUNT] = {};
+	std::map<int, CpuTotals> cpus;
+	for (size_t i = 0; i < _count; i++){
+		const LoopStats& s = _slots[i];
+		out << "[stats] loop " << i << " pid " << s.pid.load(std::memory_order_relaxed)
+			<< ": connections=" << s.connections.load(std::memory_order_relaxed)
+			<< " requests=" << s.requests.load(std::memory_order_relaxed)
+			<< " bytes_in=" << s.bytesIn.load(std::memory_order_relaxed)
+			<< " bytes_out=" << s.bytesOut.load(std::memory_order_relaxed)
+			<< " restarts=" << s.restarts.load(std::memory_order_relaxed)
+			<< " handler_queued=" << s.handlerQueued.load(std::memory_order_relaxed)
+			<< " handler_jobs=" << s.handlerJobs.load(std::memory_order_relaxed)
+			<< " handler_steals=" << s.handlerSteals.load(std::memory_order_relaxed)
+			<< " busy_polls=" << s.busyPolls.load(std::memory_order_relaxed)
+			<< " blocking_waits=" << s.blockingWaits.load(std::memory_order_relaxed)
+			<< " lag_us=" << s.lagMicros.load(std::memory_order_relaxed)
+			<< " max_lag_us=" << s.maxLagMicros.load(std::memory_order_relaxed)
+			<< " overloads=" << s.overloads.load(std::memory_order_relaxed)
+			<< " shed=" << s.shed.load(std::memory_order_relaxed);
+		int cpu = s.cpu.load(std::memory_order_relaxed);
+		if (cpu >= 0){
+			out << " cpu=" << cpu << " foreign_cpu=" << s.foreignCpu.load(std::memory_order_relaxed);
+			CpuTotals& totals = cpus[cpu];
+			totals.loops++;
+			totals.connections += s.connections.load(std::memory_order_relaxed);
+			totals.requests += s.requests.load(std::memory_order_relaxed);
+			totals.foreignCpu += s.foreignCpu.load(std::memory_order_relaxed);
+		}
+		out << std::endl;
+		unsigned long long ops[FS_OP_COUNT], nanos[FS_OP_COUNT], maxNanos[FS_OP_COUNT];
+		for (size_t op = 0; op < FS_OP_COUNT; op++){
+			ops[op] = s.fsOps[op].load(std::memory_order_relaxed);
+			nanos[op] = s.fsNanos[op].load(std::memory_order_relaxed);
+			maxNanos[op] = s.fsMaxNanos[op].load(std::memory_order_relaxed);
+			fsOps[op] += ops[op];
+			fsNanos[op] += nanos[op];
+			fsMaxNanos[op] = std::max(fsMaxNanos[op], maxNanos[op]);
+		}
+		dumpFsLatency(out, "loop " + std::to_string(i), ops, nanos, maxNanos);
+		connections += s.connections.load(std::memory_order_relaxed);
+		requests += s.requests.load(std::memory_order_relaxed);
+		bytesIn += s.bytesIn.load(std::memory_order_relaxed);
+		bytesOut += s.bytesOut.load(std::memory_order_relaxed);
+		handlerQueued += s.handlerQueued.load(std::memory_order_relaxed);
+		handlerJobs += s.handlerJobs.load(std::memory_order_relaxed);
+		handlerSteals += s.handlerSteals.load(std::memory_order_relaxed);
+		busyPolls += s.busyPolls.load(std::memory_order_relaxed);
+		blockingWaits += s.blockingWaits.load(std::memory_order_relaxed);
+		maxLagMicros = std::max(maxLagMicros, s.maxLagMicros.load(std::memory_order_relaxed));
+		overloads += s.overloads.load(std::memory_order_relaxed);
+		shed += s.shed.load(std::memory_order_relaxed);
+	}
+	out << "[stats] total: connections=" << connections << " requests=" << requests
+		<< " bytes_in=" << bytesIn << " bytes_out=" << bytesOut << " handler_queued=" << handlerQueued
+		<< " handler_jobs=" << handlerJobs << " handler_steals=" << handlerSteals
+		<< " busy_polls=" << busyPolls << " blocking_waits=" << blockingWaits
+		<< " max_lag_us=" << maxLagMicros << " overloads=" << overloads << " shed=" << shed << std::endl;
+	dumpFsLatency(out, "total", fsOps, fsNanos, fsMaxNanos);
+	for (std::map<int, CpuTotals>::const_iterator it = cpus.begin(); it != cpus.end(); ++it){
+		out << "[stats] cpu " << it->first << ": loops=" << it->second.loops
+			<< " connections=" << it->second.connections << " requests=" << it->second.requests
+			<< " foreign_cpu=" << it->second.foreignCpu << std::endl;
+	}
+}
+
+/**
+ * @brief Dump on SIGUSR1
+ *
+ * @param wakeFd eventfd the handler writes to, so that a reporting loop blocked
+ *        in its event wait notices the request (-1 when the caller polls for it)
+ */
+void StatsTable::installDumpSignal(int wakeFd){
+	dumpWakeFd = wakeFd;
+	signal(SIGUSR1, dumpSignalHandler);
+}
+
+bool StatsTable::consumeDumpRequest(void){
+	if (!dumpRequested)
+		return false;
+	dumpRequested = 0;
+	return true;
+}
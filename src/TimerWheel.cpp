@@ -0,0 +1,162 @@
+#include "TimerWheel.hpp"
+
+#include <ctime>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+uint64_t TimerWheel::monotonicMs(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<uint64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+TimerWheel::TimerWheel() : _now(0), _startMs(monotonicMs()), _armed(0), _timerFd(-1), _ticking(false){
+	for (int level = 0; level < LEVELS; level++){
+		for (int slot = 0; slot < SLOTS; slot++){
+			_slots[level][slot].prev = &_slots[level][slot];
+			_slots[level][slot].next = &_slots[level][slot];
+		}
+	}
+}
+
+TimerWheel::~TimerWheel(){
+	if (_timerFd >= 0)
+		close(_timerFd);
+}
+
+/**
+ * @brief (Re)create the timerfd of this wheel
+ *
+ * @return int the new file descriptor, -1 on error
+ *
+ * @note a forked worker calls it again so that it does not share the master's timerfd
+ */
+int TimerWheel::open(void){
+	if (_timerFd >= 0)
+		close(_timerFd);
+	_timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	_ticking = false;
+	if (_timerFd >= 0 && _armed > 0)
+		setTicking(true);
+	return _timerFd;
+}
+
+void TimerWheel::setTicking(bool on){
+	if (_timerFd < 0 || _ticking == on)
+		return;
+	struct itimerspec spec = {};
+	if (on){
+		spec.it_interval.tv_nsec = TICK_MS * 1000000L;
+		spec.it_value.tv_nsec = TICK_MS * 1000000L;
+	}
+	timerfd_settime(_timerFd, 0, &spec, NULL);
+	_ticking = on;
+}
+
+// ==========================================================
+// slot lists
+// ==========================================================
+void TimerWheel::link(TimerNode& node){
+	uint64_t delta = node.expiresAt - _now;
+	int level = 0;
+	while (level < LEVELS - 1 && delta >= (uint64_t(1) << (SLOT_BITS * (level + 1))))
+		level++;
+	TimerNode& head = _slots[level][(node.expiresAt >> (SLOT_BITS * level)) & SLOT_MASK];
+	node.prev = head.prev;
+	node.next = &head;
+	head.prev->next = &node;
+	head.prev = &node;
+}
+
+void TimerWheel::unlink(TimerNode& node){
+	node.prev->next = node.next;
+	node.next->prev = node.prev;
+	node.prev = nullptr;
+	node.next = nullptr;
+}
+
+/**
+ * @brief Move the timers of the current slot of a level to the levels below
+ */
+void TimerWheel::cascade(int level){
+	TimerNode& head = _slots[level][(_now >> (SLOT_BITS * level)) & SLOT_MASK];
+	TimerNode* node = head.next;
+	head.prev = &head;
+	head.next = &head;
+	while (node != &head){
+		TimerNode* next = node->next;
+		if (node->expiresAt < _now)
+			node->expiresAt = _now;
+		link(*node);
+		node = next;
+	}
+}
+
+// ==========================================================
+// public API
+// ==========================================================
+/**
+ * @brief Arm (or re-arm) a timer to expire delayMs from now
+ *
+ * @note O(1): an armed node is simply moved to its new slot
+ */
+void TimerWheel::schedule(TimerNode& node, uint64_t delayMs){
+	if (_armed == 0)
+		_now = (monotonicMs() - _startMs) / TICK_MS;	// the wheel did not tick while empty
+	if (node.isArmed())
+		unlink(node);
+	else
+		_armed++;
+	uint64_t maxTicks = (uint64_t(1) << (SLOT_BITS * LEVELS)) - 1;
+	uint64_t ticks = (delayMs + TICK_MS - 1) / TICK_MS;
+	if (ticks == 0)
+		ticks = 1;
+	if (ticks > maxTicks)
+		ticks = maxTicks;
+	node.expiresAt = _now + ticks;
+	link(node);
+	setTicking(true);
+}
+
+void TimerWheel::cancel(TimerNode& node){
+	if (!node.isArmed())
+		return;
+	unlink(node);
+	_armed--;
+	if (_armed == 0)
+		setTicking(false);
+}
+
+/**
+ * @brief Consume the timerfd and expire every timer that became due
+ *
+ * @param expiredFds receives the fd of each expired timer; those timers are disarmed
+ *
+ * @note the wheel is advanced to the monotonic clock, not by the timerfd expiration
+ *       count, so ticks missed while the loop was busy are caught up as well.
+ */
+void TimerWheel::advance(std::vector<int>& expiredFds){
+	uint64_t expirations;
+	while (read(_timerFd, &expirations, sizeof(expirations)) > 0)
+		;
+	uint64_t target = (monotonicMs() - _startMs) / TICK_MS;
+	while (_now < target && _armed > 0){
+		_now++;
+		for (int level = 1; level < LEVELS; level++){
+			if ((_now & ((uint64_t(1) << (SLOT_BITS * level)) - 1)) != 0)
+				break;
+			cascade(level);
+		}
+		TimerNode& head = _slots[0][_now & SLOT_MASK];
+		while (head.next != &head){
+			TimerNode* node = head.next;
+			unlink(*node);
+			_armed--;
+			expiredFds.push_back(node->fd);
+		}
+	}
+	if (_now < target)
+		_now = target;
+	if (_armed == 0)
+		setTicking(false);
+}
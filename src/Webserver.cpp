@@ -1,110 +1,290 @@
 
 #include "Webserver.hpp"
 
-static volatile sig_atomic_t signalRunning = 1;
+#include <ctime>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
 
-// ==========================================================
-// epoll and event handling helpers
-// ==========================================================
-bool Webserver::isListeningSocket(int fd) const {
-	return _listenFdToServerIndex.find(fd) != _listenFdToServerIndex.end();
-}
+// atomic rather than volatile: with worker_threads every event loop thread polls it
+static std::atomic<int> signalRunning(1);
+// eventfd written by the signal handlers, in every loop's event set: loops wait without a timeout
+static std::atomic<int> signalWakeFd_(-1);
+static pid_t signalWakeOwner = 0;
 
-bool Webserver::isFdWriting(int clientFd) const {
-	auto it = _clientFdToServerIndex.find(clientFd);
-	if (it == _clientFdToServerIndex.end())
-		return false;
-	return _servers[it->second].hasWriteBuffer(clientFd);
+static constexpr int IDLE_WAIT_MS = 1000;	// wait bound when no signal eventfd could be created
+static constexpr int OVERLOAD_RECHECK_MS = 10;	// wait bound while overloaded, so the lag decays when idle
+static constexpr uint64_t LINGERING_TIME_MS = 30000;	// longest lingering close (nginx's lingering_time)
+static constexpr uint64_t LINGERING_TIMEOUT_MS = 5000;	// lingering close ended after this long without input (lingering_timeout)
+
+// epoll_event.data of a suspended coroutine: this bit and its registration id.
+// Every other source stores a PollSource pointer, which never has the top bit set
+// in user space, so a waiter's event is told apart without touching its frame.
+static constexpr uint64_t EPOLL_WAITER_TAG = static_cast<uint64_t>(1) << 63;
+
+static uint64_t monotonicNs(void){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return static_cast<uint64_t>(now.tv_sec) * 1000000000ULL + now.tv_nsec;
 }
 
+// ==========================================================
+// epoll and event handling helpers
+// ==========================================================
 bool Webserver::hasError(const epoll_event& event) const {
 	return (event.events & EPOLLHUP) ||
 		   (event.events & EPOLLERR) ||
 		   (event.events & EPOLLRDHUP);
 }
 
+/**
+ * @brief Route one epoll event to the read or write path of a client
+ *
+ * @note an earlier event of the same batch may have closed the client; its slot is
+ *       then inactive, or reused by a newer client accepted on the same fd, whose
+ *       handlers only find EAGAIN, so the stale event is harmless.
+ */
+void Webserver::dispatchClientEvent(Connection& conn, const epoll_event& event){
+	if (!conn.active || conn.retired)
+		return;
+	if (hasError(event)){
+		removeClient(conn);
+		return;
+	}
+	if (conn.lingering){
+		if (event.events & EPOLLIN)
+			drainLingeringClient(conn);
+		return;
+	}
+	if ((event.events & EPOLLIN) && !conn.writing && !conn.pending)
+		handleClientRequest(conn);
+	if ((event.events & EPOLLOUT) && conn.active && conn.writing)
+		handleClientWrite(conn);
+}
+
 // ==========================================================
 // new connection handling
 // ==========================================================
-void Webserver::handleNewConnection(int listenFd){
-	const auto& it = _listenFdToServerIndex.find(listenFd);
-	if (it == _listenFdToServerIndex.end())
-		return;
-	size_t serverIndex = it->second;
-	int clientFd = _servers[serverIndex].acceptConnection();
-	if (clientFd < 0)
+void Webserver::handleNewConnection(size_t serverIndex){
+	while (true){
+		int clientFd = _servers[serverIndex].acceptConnection();
+		if (clientFd < 0)
+			return;
+		if (_stats)
+			_stats->connections.fetch_add(1, std::memory_order_relaxed);
+		noteIncomingCpu(clientFd);
+		addClientToPoll(clientFd, serverIndex);
+	}
+}
+
+/**
+ * @brief Count a connection whose packets were received on another CPU than this loop's one
+ *
+ * @note only for a pinned loop; with steering on, a count that grows means the NIC
+ *       queues are not spread like the loops (or a CPU has no loop)
+ */
+void Webserver::noteIncomingCpu(int clientFd){
+	if (_cpu < 0 || !_stats)
 		return;
-	addClientToPoll(clientFd, serverIndex);
+	int cpu = -1;
+	socklen_t len = sizeof(cpu);
+	if (getsockopt(clientFd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) == 0 && cpu >= 0 && cpu != _cpu)
+		_stats->foreignCpu.fetch_add(1, std::memory_order_relaxed);
 }
 
 // ==========================================================
 // client reading and writing
 // ==========================================================
-void Webserver::handleClientRequest(int clientFd){
-	auto it = _clientFdToServerIndex.find(clientFd);
-	if (it == _clientFdToServerIndex.end())
-		return;
-	time_t now = time(NULL);
-	size_t serverIndex = it->second;
-	Server::ClientStatus status = _servers[serverIndex].handleClient(clientFd);
+void Webserver::handleClientRequest(Connection& conn){
+	Server::ClientStatus status = _servers[conn.serverIndex].handleClient(conn);
 	switch (status){
 	case Server::CLIENT_INCOMPLETE:
-		if (now - _lastActivity[clientFd] > CONNECTION_TIMEOUT){
-			std::cerr << "Connection timedout on Fd: " << clientFd << std::endl;
-			sendTimeoutResponse(clientFd);
-			removeClientFd(clientFd);
-			return;
-		}
-		_lastActivity[clientFd] = now;
+		updateReadTimer(conn);
 		break;
 	case Server::CLIENT_WRITING:
-		modifyClientEvents(clientFd, EPOLLOUT);
-		_lastActivity[clientFd] = now;
+		modifyClientEvents(conn, EPOLLOUT);
+		armClientTimer(conn, PHASE_SEND);
 		break;
 	case Server::CLIENT_KEEP_ALIVE:
-		_lastActivity[clientFd] = now;
+		armClientTimer(conn, PHASE_IDLE);
+		break;
+	case Server::CLIENT_PENDING:
+		// only a hang-up is of interest: it cancels the handler (and kills a CGI)
+		modifyClientEvents(conn, EPOLLRDHUP);
+		if (conn.active)
+			waitForHandler(conn);
 		break;
 	case Server::CLIENT_COMPLETE:
+		closeClient(conn);
+		break;
 	case Server::CLIENT_ERROR:
-		removeClientFd(clientFd);
+		removeClient(conn);
 		break;
 	}
 }
 
-void Webserver::handleClientWrite(int clientFd){
-	auto it = _clientFdToServerIndex.find(clientFd);
-	if (it == _clientFdToServerIndex.end())
-		return ;
-	size_t serverIndex = it->second;
-	Server::ClientStatus status = _servers[serverIndex].handleClientWrite(clientFd);
+void Webserver::handleClientWrite(Connection& conn){
+	resumeClient(conn, _servers[conn.serverIndex].handleClientWrite(conn));
+}
 
+/**
+ * @brief Carry on with a client once its response is written, or produced
+ *
+ * @param conn client
+ * @param status outcome of the write, or of Server::finishRequest (which also answers
+ *        the requests pipelined behind the one that was pending)
+ */
+void Webserver::resumeClient(Connection& conn, Server::ClientStatus status){
 	switch (status){
 	case Server::CLIENT_WRITING:
-		_lastActivity[clientFd] = time(NULL);
+		modifyClientEvents(conn, EPOLLOUT);
+		armClientTimer(conn, PHASE_SEND);
 		break;
 	case Server::CLIENT_KEEP_ALIVE:
-		modifyClientEvents(clientFd, EPOLLIN);
-		_lastActivity[clientFd] = time(NULL);
+	case Server::CLIENT_INCOMPLETE:
+		modifyClientEvents(conn, EPOLLIN);
+		if (status == Server::CLIENT_KEEP_ALIVE)
+			armClientTimer(conn, PHASE_IDLE);
+		else
+			updateReadTimer(conn);
+		// edge-triggered: bytes that arrived while writing raised their only edge back then
+		if (_global.edgeTriggered && conn.active)
+			handleClientRequest(conn);
 		break;
 	case Server::CLIENT_COMPLETE:
+		closeClient(conn);
+		break;
 	case Server::CLIENT_ERROR:
-		removeClientFd(clientFd);
+		removeClient(conn);
 		break;
-	case Server::CLIENT_INCOMPLETE:
+	case Server::CLIENT_PENDING:
+		// the next pipelined request suspended in turn
+		modifyClientEvents(conn, EPOLLRDHUP);
+		if (conn.active)
+			waitForHandler(conn);
 		break;
 	}
 }
 
+// ==========================================================
+// coroutine request handlers
+// ==========================================================
+int Webserver::registerWakeup(void){
+	int wakeFd = openWakeFd();
+	if (wakeFd < 0)
+		return FAILURE;
+	if (_ring.isOpen())
+		return SUCCESS;
+	struct epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.ptr = &_wakeSource;
+	if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, wakeFd, &ev) < 0)
+		return FAILURE;
+	if (_signalSource.fd < 0)
+		return SUCCESS;
+	// edge-triggered: never read, every write is a new edge for every loop of the process
+	ev.events = EPOLLIN | EPOLLET;
+	ev.data.ptr = &_signalSource;
+	if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, _signalSource.fd, &ev) < 0)
+		return FAILURE;
+	return SUCCESS;
+}
+
+/**
+ * @brief Park a client whose handler suspended until the handler finishes
+ *
+ * @note the send deadline already runs: a CGI that never answers is cut off
+ *       like a client that never reads.
+ */
+void Webserver::waitForHandler(Connection& conn){
+	armClientTimer(conn, PHASE_SEND);
+	Connection* client = &conn;
+	uint32_t generation = conn.generation;
+	conn.handler.onDone([this, client, generation]{
+		_readyClients.push_back(std::make_pair(client, generation));
+	});
+}
+
+/**
+ * @brief Send the responses whose handlers finished during the last batch
+ *
+ * @note handlers only finish from inside the loop (a resumed waiter or offload),
+ *       where the client may be in use up the stack; the response is therefore
+ *       picked up here, after the batch.
+ */
+void Webserver::finishReadyHandlers(void){
+	// swapped with a second list rather than moved out, so neither loses its capacity
+	_finishingClients.swap(_readyClients);
+	for (const auto& [conn, generation] : _finishingClients){
+		if (!conn->active || conn->generation != generation || !conn->pending || conn->closing)
+			continue;
+		Server::ClientStatus status = _servers[conn->serverIndex].finishRequest(*conn);
+		if (_ring.isOpen())
+			applyUringStatus(*conn, status);
+		else
+			resumeClient(*conn, status);
+	}
+	_finishingClients.clear();
+}
+
+void Webserver::watch(Waiter& waiter, int fd, uint32_t events){
+	if (_ring.isOpen()){
+		watchUring(waiter, fd, events);
+		return;
+	}
+	waiter.id = ++_nextWaiterId & ~EPOLL_WAITER_TAG;
+	struct epoll_event ev;
+	ev.events = events | EPOLLONESHOT;
+	ev.data.u64 = EPOLL_WAITER_TAG | waiter.id;
+	if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, fd, &ev) < 0
+		&& (errno != EEXIST || epoll_ctl(_epollFd, EPOLL_CTL_MOD, fd, &ev) < 0)){
+		std::cerr << "epoll_ctl failed on awaited fd " << fd << ": " << strerror(errno) << std::endl;
+		return;
+	}
+	_epollWaiters[waiter.id] = &waiter;
+}
+
+void Webserver::unwatch(Waiter& waiter){
+	if (_ring.isOpen()){
+		unwatchUring(waiter);
+		return;
+	}
+	if (_epollWaiters.erase(waiter.id) == 0)
+		return;
+	removeFdFromPoll(waiter.fd);
+}
+
+/**
+ * @brief Resume the coroutine an epoll event is for, by its registration id
+ *
+ * @note a client closed earlier in the batch destroyed its handler, and the
+ *       waiters in its frame, which unregistered themselves: their events
+ *       find no id in _epollWaiters and are skipped without touching the
+ *       freed frame.
+ */
+void Webserver::resumeWaiter(uint64_t id, uint32_t events){
+	auto it = _epollWaiters.find(id);
+	if (it == _epollWaiters.end())
+		return;
+	Waiter* waiter = it->second;
+	_epollWaiters.erase(it);
+	removeFdFromPoll(waiter->fd);
+	waiter->revents = events;
+	waiter->handle.resume();
+}
+
 // ==========================================================
 // epoll event modification
 // ==========================================================
-void Webserver::modifyClientEvents(int clientFd, uint32_t events){
+void Webserver::modifyClientEvents(Connection& conn, uint32_t events){
+	if (_global.edgeTriggered)
+		return;
 	struct epoll_event ev;
 	ev.events = events;
-	ev.data.fd = clientFd;
-	if (epoll_ctl(_epollFd, EPOLL_CTL_MOD, clientFd, &ev) < 0){
+	ev.data.ptr = static_cast<PollSource*>(&conn);
+	if (epoll_ctl(_epollFd, EPOLL_CTL_MOD, conn.fd, &ev) < 0){
 		std::cerr << "epoll_ctl MOD failed: " << strerror(errno) << std::endl;
-		removeClientFd(clientFd);
+		removeClient(conn);
 	}
 }
 
@@ -112,16 +292,17 @@ void Webserver::modifyClientEvents(int clientFd, uint32_t events){
 // file descriptor management and cleanup
 // ==========================================================
 void Webserver::addClientToPoll(int clientFd, size_t serverIndex){
+	Connection* conn = _connections.acquire(clientFd, serverIndex);
 	struct epoll_event ev;
-	ev.events = EPOLLIN;
-	ev.data.fd = clientFd;
+	ev.events = _global.edgeTriggered ? (EPOLLIN | EPOLLOUT | EPOLLET) : EPOLLIN;
+	ev.data.ptr = static_cast<PollSource*>(conn);
 	if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, clientFd, &ev) < 0){
-		close (clientFd);
 		std::cerr << strerror(errno) << std::endl;
+		_connections.release(*conn);
+		close (clientFd);
 		return;
 	}
-	_clientFdToServerIndex[clientFd] = serverIndex;
-	_lastActivity[clientFd] = time(NULL);
+	armClientTimer(*conn, PHASE_HEADERS);
 }
 
 void Webserver::removeFdFromPoll(int fd){
@@ -131,56 +312,189 @@ void Webserver::removeFdFromPoll(int fd){
 	}
 }
 
-void Webserver::removeClientFd(int clientFd){
-	_lastActivity.erase(clientFd);
-	const auto& it = _clientFdToServerIndex.find(clientFd);
-	if (it != _clientFdToServerIndex.end()){
-		size_t serverIndex = it->second;
-		_servers[serverIndex].cleanMaps(clientFd);
-		_clientFdToServerIndex.erase(it);
+void Webserver::removeClient(Connection& conn){
+	if (_ring.isOpen()){
+		closeUringClient(conn);
+		return;
 	}
-	removeFdFromPoll(clientFd);
-	close (clientFd);
+	int fd = conn.fd;
+	_timers.cancel(conn.timer);
+	removeFdFromPoll(fd);
+	releaseClient(conn);
 }
 
-void Webserver::closeAllClients(void){
-	for (const auto& [fd, serverIndex] : _clientFdToServerIndex){
-		(void)serverIndex;
-		close (fd);
+/**
+ * @brief Close a client whose last response is sent
+ *
+ * @note a client refused before its body was read (Server::admitBody) may still be
+ *       sending it, and closing a socket with unread input resets the connection: the
+ *       reset can destroy the refusal before the client read it. Such a client gets a
+ *       lingering close instead, as in nginx: the sending side is shut down, and its
+ *       input is discarded until it closes too, for LINGERING_TIME_MS at most and
+ *       LINGERING_TIMEOUT_MS without input.
+ */
+void Webserver::closeClient(Connection& conn){
+	if (!conn.lingerOnClose){
+		removeClient(conn);
+		return;
 	}
-	_clientFdToServerIndex.clear();
+	conn.lingerOnClose = false;
+	conn.lingering = true;
+	conn.lingerUntil = monotonicNs() + LINGERING_TIME_MS * 1000000;
+	armLingerTimer(conn);
+	if (_ring.isOpen()){
+		// the last send was linked to a shutdown of the sending side only (submitUringSend)
+		conn.pendingInput.clear();
+		resumeUringRecv(conn);
+		return;
+	}
+	shutdown(conn.fd, SHUT_WR);
+	modifyClientEvents(conn, EPOLLIN);
+	if (conn.active)
+		drainLingeringClient(conn);
+}
+
+/// Read and discard the input of a lingering client, until it closes or its time is over.
+void Webserver::drainLingeringClient(Connection& conn){
+	char discarded[8192];
+	while (true){
+		ssize_t nBytes = recv(conn.fd, discarded, sizeof(discarded), 0);
+		if (nBytes < 0 && errno == EINTR)
+			continue;
+		if (nBytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		if (nBytes <= 0 || monotonicNs() >= conn.lingerUntil){
+			removeClient(conn);
+			return;
+		}
+	}
+	if (!armLingerTimer(conn))
+		removeClient(conn);
+}
+
+/// Restart the deadline of a lingering client; false once its lingering time is over.
+bool Webserver::armLingerTimer(Connection& conn){
+	uint64_t now = monotonicNs();
+	if (now >= conn.lingerUntil)
+		return false;
+	uint64_t leftMs = (conn.lingerUntil - now) / 1000000 + 1;
+	conn.timer.fd = conn.fd;
+	conn.phase = PHASE_LINGER;
+	_timers.schedule(conn.timer, std::min(leftMs, LINGERING_TIMEOUT_MS));
+	return true;
+}
+
+/**
+ * @brief Close the fd of a closed client and free its slot
+ *
+ * @note a handler still away (on the handler pool, or waiting for offloaded work) may
+ *       use its request, which lives in the slot: the socket is only shut down, and the
+ *       slot and the fd are kept until the handler is back and destroyed. The fd stays
+ *       open meanwhile, so that no new client is given the same slot.
+ */
+void Webserver::releaseClient(Connection& conn){
+	if (conn.retired)
+		return;
+	if (conn.handler.away()){
+		conn.retired = true;
+		shutdown(conn.fd, SHUT_RDWR);
+		abandon(conn.handler, [this, &conn]{
+			conn.retired = false;
+			releaseClient(conn);
+		});
+		return;
+	}
+	int fd = conn.fd;
+	_connections.release(conn);
+	close (fd);
+}
+
+void Webserver::closeAllClients(void){
+	settleHandlers();
+	_connections.forEachActive([this](Connection& conn){
+		_timers.cancel(conn.timer);
+		close (conn.fd);
+		_connections.release(conn);
+	});
 }
 
 // ==========================================================
 // timeout management
 // ==========================================================
-void Webserver::checkIdleConnections(){
-	time_t now = time(NULL);
-	std::vector<int> toRemove;
-	for (const auto& [fd, lastTime] : _lastActivity){
-		if (now - lastTime > CONNECTION_TIMEOUT)
-			toRemove.push_back(fd);
-	}
-	for (int fd : toRemove){
-		std::cerr << "Idle connection timeout on fd: " << fd << std::endl;
-		if (!isFdWriting(fd))
-			sendTimeoutResponse(fd);
-		removeClientFd(fd);
-	}
+int Webserver::registerTimer(void){
+	int timerFd = _timers.open();
+	if (timerFd < 0)
+		return FAILURE;
+	_timerSource.kind = PollSource::SOURCE_TIMER;
+	_timerSource.fd = timerFd;
+	struct epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.ptr = &_timerSource;
+	if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, timerFd, &ev) < 0)
+		return FAILURE;
+	return SUCCESS;
 }
 
-void Webserver::sendTimeoutResponse(int clientFd){
-	std::string body;
-	std::ifstream file("sites/static/errors/408.html");
+/**
+ * @brief (Re)start the deadline of a client for the given phase
+ *
+ * @note O(1): the node embedded in the Connection is moved within the timer wheel,
+ *       nothing is allocated.
+ */
+void Webserver::armClientTimer(Connection& conn, ClientPhase phase){
+	unsigned long delayMs = _global.headerTimeoutMs;
+	if (phase == PHASE_BODY)
+		delayMs = _global.bodyTimeoutMs;
+	else if (phase == PHASE_IDLE)
+		delayMs = _global.keepaliveTimeoutMs;
+	else if (phase == PHASE_SEND)
+		delayMs = _global.sendTimeoutMs;
+	conn.timer.fd = conn.fd;
+	conn.phase = phase;
+	_timers.schedule(conn.timer, delayMs);
+}
 
-	if (file.is_open()){
-		std::stringstream buffer;
-		buffer << file.rdbuf();
-		body = buffer.str();
-		file.close();
+/**
+ * @brief Pick the deadline of a client after a read that did not complete a request
+ *
+ * @note the header deadline starts at the first byte of a request and is not
+ *       extended by later reads, so a client trickling its head byte by byte
+ *       (slowloris) is cut off on time. The body deadline is per read.
+ */
+void Webserver::updateReadTimer(Connection& conn){
+	ReadPhase phase = conn.getReadPhase();
+	if (phase == READ_BODY)
+		armClientTimer(conn, PHASE_BODY);
+	else if (phase == READ_HEADERS && conn.phase != PHASE_HEADERS)
+		armClientTimer(conn, PHASE_HEADERS);
+}
+
+void Webserver::expireTimers(void){
+	std::vector<int> expired;
+	_timers.advance(expired);
+	for (int fd : expired){
+		Connection* conn = _connections.get(fd);
+		if (!conn || !conn->active)
+			continue;
+		ClientPhase phase = conn->phase;
+		if (phase == PHASE_HEADERS || phase == PHASE_BODY){
+			std::cerr << "Request timeout on fd: " << fd << std::endl;
+			sendTimeoutResponse(*conn);
+		}
+		else if (phase == PHASE_SEND)
+			std::cerr << "Send timeout on fd: " << fd << std::endl;
+		removeClient(*conn);
+	}
+}
+
+/// Best-effort 408 to a client timed out, with the page of its server's default virtual host (read at startup).
+void Webserver::sendTimeoutResponse(const Connection& conn){
+	std::string body = "<h1>408 Request Timeout</h1>";
+	if (const config::ServerConfig* vh = _servers[conn.serverIndex].getDefaultVhost()){
+		std::map<int, std::string>::const_iterator page = vh->errorPageBodies.find(408);
+		if (page != vh->errorPageBodies.end())
+			body = page->second;
 	}
-	else
-		body = "<h1>408 Request Timeout</h1>";
 	std::string response = "HTTP/1.1 408 Request Timeout\r\n";
 	response += "Content-Length: " + std::to_string(body.size()) + "\r\n";
 	response += "Content-Type: text/html\r\n";
@@ -188,7 +502,7 @@ void Webserver::sendTimeoutResponse(int clientFd){
 	response += "\r\n";
 	response += body;
 
-	ssize_t sent = send(clientFd, response.c_str(), response.size(), 0);
+	ssize_t sent = send(conn.fd, response.c_str(), response.size(), 0);
 	if (sent <= 0)
 		return;
 }
@@ -196,15 +510,61 @@ void Webserver::sendTimeoutResponse(int clientFd){
 // ==========================================================
 // belows are public constructors
 // ==========================================================
+/// Wake every loop of the process up (async-signal-safe).
+static void wakeLoops(void){
+	int fd = signalWakeFd_.load(std::memory_order_relaxed);
+	if (fd < 0)
+		return;
+	int savedErrno = errno;
+	uint64_t one = 1;
+	ssize_t written = write(fd, &one, sizeof(one));
+	(void)written;
+	errno = savedErrno;
+}
+
 static void signalHandler(int sig){
 	(void)sig;
 	signalRunning = 0;
+	wakeLoops();
 }
 
-Webserver::Webserver() : _running(false){
+void Webserver::requestShutdown(void){
+	signalRunning = 0;
+	wakeLoops();
+}
+
+int Webserver::signalWakeFd(void){
+	return signalWakeFd_.load(std::memory_order_relaxed);
+}
+
+bool Webserver::isShutdownRequested(void){
+	return signalRunning == 0;
+}
+
+/**
+ * @note the signal eventfd is created once per process: a forked worker closes
+ *       the one inherited from the master, whose signals are not its business.
+ */
+void Webserver::installSignalHandlers(void){
+	if (signalWakeOwner != getpid()){
+		int inherited = signalWakeFd_.exchange(-1);
+		if (inherited >= 0)
+			close(inherited);
+		signalWakeFd_.store(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+		signalWakeOwner = getpid();
+	}
 	signal(SIGINT, signalHandler);
 	signal(SIGTERM, signalHandler);
 	signal(SIGPIPE, SIG_IGN);
+}
+
+Webserver::Webserver(const config::GlobalConfig& global)
+	: _running(false), _global(global), _statsTable(nullptr), _stats(nullptr), _statsReporter(false),
+	  _busyPollUntil(0), _cpu(-1), _iterationStart(0), _lagNs(0), _overloaded(false), _acceptPaused(false),
+	  _listenerEvents(0), _acceptGeneration(0), _nextWaiterId(0){
+	installSignalHandlers();
+	_signalSource.kind = PollSource::SOURCE_SIGNAL;
+	_signalSource.fd = signalWakeFd();
 	_epollFd = epoll_create1(0);
 	if (_epollFd < 0)
 		throw std::runtime_error("Failed to create epoll instance");
@@ -220,7 +580,7 @@ Webserver::~Webserver(){
 // belows are public APIs
 // create server instances, runs main event loop, stops the websier and exits
 // ==========================================================
-int Webserver::createServers(const std::vector<ServerConfig>& config){
+int Webserver::openServers(const std::vector<ServerConfig>& config, bool reusePort){
 	std::map<std::string, std::vector<config::ServerConfig>> bindGroups;
 	for (size_t i = 0; i < config.size(); i++){
 		const auto& block = config[i];
@@ -241,54 +601,297 @@ int Webserver::createServers(const std::vector<ServerConfig>& config){
 	}
 
 	for (size_t i = 0; i < _servers.size(); i++){
-		if (_servers[i].start() != Server::START_SUCCESS)
+		if (_servers[i].start(reusePort) != Server::START_SUCCESS)
 			return FAILURE;
-		int listenFd = _servers[i].getListenFd();
+		_servers[i].setStats(_stats);
+		if (_global.soBusyPoll)
+			_servers[i].setBusyPoll(_global.busyPollUs);
+	}
+
+	for (size_t i = 0; i < _servers.size(); i++)
+		std::cout << "Server successfully listening on port: " << _servers[i].getPort() << std::endl;
+	return SUCCESS;
+}
+
+int Webserver::registerListeners(uint32_t extraEvents){
+	// sized once: epoll keeps pointers into this vector
+	_listenerSources.assign(_servers.size(), PollSource());
+	for (size_t i = 0; i < _servers.size(); i++){
+		PollSource& source = _listenerSources[i];
+		source.kind = PollSource::SOURCE_LISTENER;
+		source.fd = _servers[i].getListenFd();
+		source.serverIndex = i;
 		struct epoll_event ev;
-		ev.events = EPOLLIN;
-		ev.data.fd = listenFd;
-		if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, listenFd, &ev) < 0)
+		ev.events = EPOLLIN | extraEvents;
+		if (_global.edgeTriggered)
+			ev.events |= EPOLLET;
+		_listenerEvents = ev.events;
+		ev.data.ptr = &source;
+		if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, source.fd, &ev) < 0)
 			return FAILURE;
-		_listenFdToServerIndex[listenFd] = i;
 	}
+	return SUCCESS;
+}
+
+int Webserver::createServers(const std::vector<ServerConfig>& config, bool reusePort){
+	if (openServers(config, reusePort) == FAILURE)
+		return FAILURE;
+	if (registerTimer() == FAILURE)
+		return FAILURE;
+	return registerListeners(0);
+}
+
+/**
+ * @brief Turn a freshly forked copy of the master's Webserver into an independent worker
+ *
+ * @return SUCCESS or FAILURE
+ *
+ * @note the epoll instance inherited through fork() is the master's one, so it is replaced.
+ *       The listening sockets are shared by all workers: EPOLLEXCLUSIVE makes the kernel
+ *       wake a single worker per incoming connection instead of the whole herd.
+ */
+int Webserver::becomeWorker(void){
+	installSignalHandlers();
+	_signalSource.fd = signalWakeFd();
+	signal(SIGCHLD, SIG_DFL);
+	signal(SIGUSR1, SIG_IGN);
+	if (_epollFd >= 0)
+		close(_epollFd);
+	_epollFd = epoll_create1(0);
+	if (_epollFd < 0)
+		return FAILURE;
+	if (registerTimer() == FAILURE)
+		return FAILURE;
+	return registerListeners(EPOLLEXCLUSIVE);
+}
 
+void Webserver::attachStats(StatsTable& table, size_t slot, bool reporter){
+	_statsTable = &table;
+	_stats = &table.slot(slot);
+	_statsReporter = reporter;
+	_stats->pid.store(getpid(), std::memory_order_relaxed);
+	setPoolStats(_stats);
 	for (size_t i = 0; i < _servers.size(); i++)
-		std::cout << "Server successfully listening on port: " << _servers[i].getPort() << std::endl;
+		_servers[i].setStats(_stats);
+}
+
+/**
+ * @brief Pin the calling thread to a CPU
+ *
+ * @return SUCCESS, or FAILURE (reported) when the CPU is not available to the process
+ */
+int Webserver::pinToCpu(int cpu){
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	if (err != 0){
+		std::cerr << "Cannot pin event loop to CPU " << cpu << ": " << strerror(err) << std::endl;
+		return FAILURE;
+	}
+	_cpu = cpu;
+	if (_stats)
+		_stats->cpu.store(cpu, std::memory_order_relaxed);
+	return SUCCESS;
+}
+
+/**
+ * @brief Steer every listener group of the process by receiving CPU
+ *
+ * @param cpuOfLoop CPU of each loop; loop i owns the i-th socket of every group
+ *        (listeners are opened loop after loop, see Master)
+ * @return SUCCESS or FAILURE (reported; the kernel's hash keeps spreading connections)
+ */
+int Webserver::steerConnections(const std::vector<int>& cpuOfLoop){
+	for (size_t i = 0; i < _servers.size(); i++){
+		if (!_servers[i].attachCpuSteering(cpuOfLoop)){
+			std::cerr << "Cannot steer connections of port " << _servers[i].getPort()
+					  << " by CPU: " << strerror(errno) << std::endl;
+			return FAILURE;
+		}
+	}
 	return SUCCESS;
 }
 
+/**
+ * @brief Run the event loop with the configured backend until shutdown
+ *
+ * @note io_uring falls back to epoll when the ring cannot be created
+ *       (old kernel, io_uring disabled by sysctl or seccomp).
+ */
 int Webserver::runWebserver(){
+	if (_global.eventBackend == config::BACKEND_IO_URING){
+		if (setupUring() == SUCCESS)
+			return runUringLoop();
+		std::cerr << "io_uring unavailable (" << strerror(errno) << "), falling back to epoll" << std::endl;
+	}
+	return runEpollLoop();
+}
+
+// ==========================================================
+// waiting for events
+// ==========================================================
+/**
+ * @brief Timeout of the next event wait, in ms
+ *
+ * @return int 0 while busy-polling, a short bound while overloaded, else -1 (block until an fd is ready)
+ *
+ * @note With busy_poll_us, a loop that just handled events polls again with a zero
+ *       timeout until busy_poll_us passed without any: a request arriving meanwhile
+ *       is picked up without the wake-up latency of a sleeping thread, at the price
+ *       of a core spinning. Afterwards, and without busy_poll_us, the loop sleeps
+ *       until an fd is ready: deadlines come from the timerfd, offloaded work and
+ *       handlers from the wake eventfd, shutdown and dump requests from the signal
+ *       eventfd, so nothing needs a periodic wake-up.
+ */
+int Webserver::nextWaitTimeout(void){
+	if (_busyPollUntil && monotonicNs() < _busyPollUntil){
+		if (_stats)
+			_stats->busyPolls.fetch_add(1, std::memory_order_relaxed);
+		return 0;
+	}
+	_busyPollUntil = 0;
+	if (_stats)
+		_stats->blockingWaits.fetch_add(1, std::memory_order_relaxed);
+	if (_overloaded)
+		return OVERLOAD_RECHECK_MS;
+	return _signalSource.fd >= 0 ? -1 : IDLE_WAIT_MS;
+}
+
+/// Events were handled: keep polling for busy_poll_us more.
+void Webserver::noteEvents(void){
+	if (_global.busyPollUs > 0)
+		_busyPollUntil = monotonicNs() + static_cast<uint64_t>(_global.busyPollUs) * 1000;
+}
+
+// ==========================================================
+// overload protection
+// ==========================================================
+void Webserver::startIteration(void){
+	_iterationStart = monotonicNs();
+}
+
+/**
+ * @brief Fold the iteration that just ended into the loop lag, and enter or leave overload
+ *
+ * @note an event ready when the wait returned is handled somewhere in the batch, and one
+ *       becoming ready meanwhile waits for the whole batch: the iteration's duration
+ *       bounds how long a ready event waits for the loop. It is smoothed over the last
+ *       few iterations (1/8 weight) so that one slow request does not trigger shedding,
+ *       and overload is only left under half the limit so that the loop does not flap.
+ */
+void Webserver::measureLag(void){
+	uint64_t took = monotonicNs() - _iterationStart;
+	_lagNs = _lagNs - _lagNs / 8 + took / 8;
+	if (_stats){
+		_stats->lagMicros.store(_lagNs / 1000, std::memory_order_relaxed);
+		if (took / 1000 > _stats->maxLagMicros.load(std::memory_order_relaxed))
+			_stats->maxLagMicros.store(took / 1000, std::memory_order_relaxed);
+	}
+	if (_global.overloadLagMs == 0)
+		return;
+	uint64_t limitNs = static_cast<uint64_t>(_global.overloadLagMs) * 1000000;
+	if (!_overloaded && _lagNs > limitNs)
+		setOverloaded(true);
+	else if (_overloaded && _lagNs < limitNs / 2)
+		setOverloaded(false);
+}
+
+/**
+ * @brief Start or stop shedding load, as overload_action says
+ */
+void Webserver::setOverloaded(bool overloaded){
+	_overloaded = overloaded;
+	if (overloaded){
+		if (_stats)
+			_stats->overloads.fetch_add(1, std::memory_order_relaxed);
+		std::cerr << "Event loop overloaded (lag " << _lagNs / 1000 << "us), "
+				  << (_global.overloadAction == config::OVERLOAD_PAUSE ? "pausing accepts" : "rejecting new requests")
+				  << std::endl;
+	}
+	else
+		std::cerr << "Event loop recovered (lag " << _lagNs / 1000 << "us)" << std::endl;
+	if (_global.overloadAction == config::OVERLOAD_PAUSE){
+		pauseAccepting(overloaded);
+		return;
+	}
+	for (size_t i = 0; i < _servers.size(); i++)
+		_servers[i].setShedding(overloaded);
+}
+
+/**
+ * @brief Stop or resume taking new connections; they wait in the listen backlog meanwhile
+ *
+ * @note listeners are removed from the epoll set rather than modified: EPOLL_CTL_MOD
+ *       is refused for the EPOLLEXCLUSIVE registrations of prefork workers.
+ */
+void Webserver::pauseAccepting(bool paused){
+	if (paused == _acceptPaused)
+		return;
+	_acceptPaused = paused;
+	if (_ring.isOpen()){
+		pauseUringAccepts(paused);
+		return;
+	}
+	for (size_t i = 0; i < _listenerSources.size(); i++){
+		PollSource& source = _listenerSources[i];
+		if (paused){
+			epoll_ctl(_epollFd, EPOLL_CTL_DEL, source.fd, NULL);
+			continue;
+		}
+		struct epoll_event ev;
+		ev.events = _listenerEvents;
+		ev.data.ptr = &source;
+		if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, source.fd, &ev) < 0)
+			std::cerr << "Cannot resume accepting on port " << _servers[i].getPort()
+					  << ": " << strerror(errno) << std::endl;
+	}
+}
+
+int Webserver::runEpollLoop(){
+	makeCurrent();
+	if (registerWakeup() == FAILURE)
+		return FAILURE;
 	_running = true;
 	const int MAX_EVENTS = 64;
 	struct epoll_event events[MAX_EVENTS];
 	while(_running && signalRunning){
-		int nfds = epoll_wait(_epollFd, events, MAX_EVENTS, 1000);
-		if (nfds < 0){
-			if (errno == EINTR)
-				continue;
+		int nfds = epoll_wait(_epollFd, events, MAX_EVENTS, nextWaitTimeout());
+		if (nfds < 0 && errno != EINTR)
 			return utils::FAILURE;
-		}
-		if (nfds == 0){
-			checkIdleConnections();
-			continue;
-		}
+		if (_statsReporter && StatsTable::consumeDumpRequest())
+			_statsTable->dump(std::cout);
+		startIteration();
+		if (nfds > 0)
+			noteEvents();
 		for (int i = 0; i < nfds; i++){
-			int fd = events[i].data.fd;
-			if (hasError(events[i])){
-				removeClientFd(fd);
+			if (events[i].data.u64 & EPOLL_WAITER_TAG){
+				resumeWaiter(events[i].data.u64 & ~EPOLL_WAITER_TAG, events[i].events);
 				continue;
 			}
-
-			if (events[i].events & EPOLLIN){
-				if (isListeningSocket(fd))
-					handleNewConnection(fd);
-				else if (!isFdWriting(fd))
-					handleClientRequest(fd);
+			PollSource* source = static_cast<PollSource*>(events[i].data.ptr);
+			switch (source->kind){
+			case PollSource::SOURCE_TIMER:
+				expireTimers();
+				break;
+			case PollSource::SOURCE_LISTENER:
+				if (events[i].events & EPOLLIN)
+					handleNewConnection(source->serverIndex);
+				break;
+			case PollSource::SOURCE_CLIENT:
+				dispatchClientEvent(*static_cast<Connection*>(source), events[i]);
+				break;
+			case PollSource::SOURCE_WAITER:	// registered by tagged id, handled above
+				break;
+			case PollSource::SOURCE_WAKEUP:
+				drainOffloaded();
+				break;
+			case PollSource::SOURCE_SIGNAL:
+				break;
 			}
-
-			if (events[i].events & EPOLLOUT)
-				handleClientWrite(fd);
 		}
+		finishReadyHandlers();
+		measureLag();
 	}
 	return SUCCESS;
 }
@@ -0,0 +1,431 @@
+#include "Webserver.hpp"
+
+#include <poll.h>
+
+// ==========================================================
+// io_uring backend
+//
+// The same Server logic as the epoll loop, fed by completions:
+// - one multishot accept per listener posts every new client
+// - one multishot recv per client picks its buffers from the ring's provided
+//   buffer group, so reads need neither a syscall nor a buffer per client
+// - responses are queued in the Connection (deferSend) and sent with one SQE;
+//   a response that ends the connection is linked to a shutdown, which then
+//   ends the recv, after which the fd is closed
+// - a client sending while its response is produced or sent has its recv cancelled
+//   until the response is out, as the epoll loop stops reading it meanwhile
+// - a loop pausing its accepts (overload_action pause) cancels them; the accepts
+//   posted on resume carry a new generation, so the last completions of the
+//   cancelled ones do not re-arm them
+// - coroutines awaiting an fd get a one-shot poll identified by a waiter id,
+//   offloaded work comes back through a multishot poll on the eventfd
+// All SQEs of one batch of completions go out with the next io_uring_enter.
+// ==========================================================
+
+namespace {
+	/// Operation a completion belongs to, in the top byte of its user_data.
+	enum UringOp {
+		OP_ACCEPT = 1,
+		OP_RECV,
+		OP_SEND,
+		OP_SHUTDOWN,
+		OP_TIMER,
+		OP_WAKEUP,
+		OP_WAITER,			///< user_data = op | waiter id (56 bits)
+		OP_POLL_REMOVE,
+		OP_SIGNAL,			///< the process-wide signal eventfd
+		OP_CANCEL,			///< cancellation of the accepts of a paused loop
+		OP_SEND_FILE		///< the socket is writable for the file body at the head of the write buffer
+	};
+
+	const unsigned	RING_ENTRIES = 1024;
+	const uint16_t	BUFFER_GROUP = 0;
+	const unsigned	BUFFER_COUNT = 512;			// power of two
+	const unsigned	BUFFER_SIZE = 8192;			// same chunk size as Server::handleClient
+
+	// user_data = op (8 bits) | generation (24 bits) | fd or server index (32 bits)
+	uint64_t packUserData(UringOp op, uint32_t generation, uint32_t id){
+		return (static_cast<uint64_t>(op) << 56)
+				| (static_cast<uint64_t>(generation & 0xFFFFFF) << 32) | id;
+	}
+	UringOp		userDataOp(uint64_t userData)			{ return static_cast<UringOp>(userData >> 56); }
+	uint32_t	userDataGeneration(uint64_t userData)	{ return (userData >> 32) & 0xFFFFFF; }
+	uint32_t	userDataId(uint64_t userData)			{ return static_cast<uint32_t>(userData); }
+
+	const uint64_t	WAITER_ID_MASK = (static_cast<uint64_t>(1) << 56) - 1;
+
+	uint64_t	packWaiterData(UringOp op, uint64_t waiterId)	{ return (static_cast<uint64_t>(op) << 56) | (waiterId & WAITER_ID_MASK); }
+}
+
+int Webserver::setupUring(void){
+	if (_ring.setup(RING_ENTRIES) == FAILURE)
+		return FAILURE;
+	if (_ring.setupBufferRing(BUFFER_GROUP, BUFFER_COUNT, BUFFER_SIZE) == FAILURE){
+		_ring.close();
+		return FAILURE;
+	}
+	return SUCCESS;
+}
+
+int Webserver::runUringLoop(void){
+	for (size_t i = 0; i < _servers.size(); i++)
+		_ring.prepMultishotAccept(_servers[i].getListenFd(), packUserData(OP_ACCEPT, _acceptGeneration, i));
+	_ring.prepMultishotPoll(_timers.getFd(), POLLIN, packUserData(OP_TIMER, 0, 0));
+	makeCurrent();
+	if (registerWakeup() == FAILURE)
+		return FAILURE;
+	_ring.prepMultishotPoll(getWakeFd(), POLLIN, packUserData(OP_WAKEUP, 0, 0));
+	if (_signalSource.fd >= 0)
+		_ring.prepMultishotPoll(_signalSource.fd, POLLIN, packUserData(OP_SIGNAL, 0, 0));
+	_running = true;
+	while (_running && !isShutdownRequested()){
+		// busy-polling waits for no completion: the enter only submits and runs pending completion work
+		int timeoutMs = nextWaitTimeout();
+		if (_ring.submitAndWait(timeoutMs == 0 ? 0 : 1, timeoutMs) < 0
+			&& errno != EINTR && errno != ETIME && errno != EBUSY){
+			std::cerr << "io_uring_enter failed: " << strerror(errno) << std::endl;
+			return FAILURE;
+		}
+		if (_statsReporter && StatsTable::consumeDumpRequest())
+			_statsTable->dump(std::cout);
+		startIteration();
+		bool completed = false;
+		while (io_uring_cqe* cqe = _ring.peekCqe()){
+			io_uring_cqe completion = *cqe;
+			_ring.cqeSeen();
+			handleUringCompletion(completion);
+			completed = true;
+		}
+		if (completed)
+			noteEvents();
+		finishReadyHandlers();
+		measureLag();
+	}
+	return SUCCESS;
+}
+
+void Webserver::handleUringCompletion(const io_uring_cqe& cqe){
+	UringOp op = userDataOp(cqe.user_data);
+	if (op == OP_ACCEPT){
+		handleUringAccept(userDataId(cqe.user_data), cqe);
+		return;
+	}
+	if (op == OP_TIMER){
+		expireTimers();
+		if (!(cqe.flags & IORING_CQE_F_MORE))
+			_ring.prepMultishotPoll(_timers.getFd(), POLLIN, packUserData(OP_TIMER, 0, 0));
+		return;
+	}
+	if (op == OP_WAKEUP){
+		drainOffloaded();
+		if (!(cqe.flags & IORING_CQE_F_MORE))
+			_ring.prepMultishotPoll(getWakeFd(), POLLIN, packUserData(OP_WAKEUP, 0, 0));
+		return;
+	}
+	if (op == OP_SIGNAL){
+		if (!(cqe.flags & IORING_CQE_F_MORE))
+			_ring.prepMultishotPoll(_signalSource.fd, POLLIN, packUserData(OP_SIGNAL, 0, 0));
+		return;
+	}
+	if (op == OP_WAITER){
+		handleUringWaiter(cqe);
+		return;
+	}
+	if (op == OP_POLL_REMOVE || op == OP_CANCEL)
+		return;
+	Connection* conn = _connections.get(userDataId(cqe.user_data));
+	if (!conn || (conn->generation & 0xFFFFFF) != userDataGeneration(cqe.user_data)){
+		// cannot happen while fds stay open until their last completion, but never leak a buffer
+		if (cqe.flags & IORING_CQE_F_BUFFER)
+			_ring.recycleBuffer(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+		return;
+	}
+	switch (op){
+	case OP_RECV:
+		handleUringRecv(*conn, cqe);
+		break;
+	case OP_SEND:
+		handleUringSend(*conn, cqe);
+		break;
+	case OP_SEND_FILE:
+		handleUringSendFile(*conn, cqe);
+		break;
+	case OP_SHUTDOWN:
+		conn->shutdownInFlight = false;
+		// the linked send came up short: it is resubmitted together with a new shutdown
+		if (cqe.res < 0 && conn->closing && conn->recvArmed)
+			shutdown(conn->fd, SHUT_RDWR);
+		break;
+	default:
+		break;
+	}
+	if (conn->active && conn->closing)
+		finishUringClose(*conn);
+}
+
+/**
+ * @note a client accepted by a cancelled accept, just before its cancellation, is still served
+ */
+void Webserver::handleUringAccept(size_t serverIndex, const io_uring_cqe& cqe){
+	bool current = userDataGeneration(cqe.user_data) == (_acceptGeneration & 0xFFFFFF);
+	if (!(cqe.flags & IORING_CQE_F_MORE) && current && !_acceptPaused)
+		_ring.prepMultishotAccept(_servers[serverIndex].getListenFd(),
+									packUserData(OP_ACCEPT, _acceptGeneration, serverIndex));
+	if (cqe.res < 0){
+		if (cqe.res != -EAGAIN && cqe.res != -ECANCELED)
+			std::cerr << "Accept error: " << strerror(-cqe.res) << std::endl;
+		return;
+	}
+	if (_stats)
+		_stats->connections.fetch_add(1, std::memory_order_relaxed);
+	_servers[serverIndex].prepareClientSocket(cqe.res);
+	noteIncomingCpu(cqe.res);
+	Connection* conn = _connections.acquire(cqe.res, serverIndex);
+	conn->deferSend = true;
+	armClientTimer(*conn, PHASE_HEADERS);
+	submitUringRecv(*conn);
+}
+
+/**
+ * @brief Cancel the multishot accepts, or post new ones
+ */
+void Webserver::pauseUringAccepts(bool paused){
+	for (size_t i = 0; i < _servers.size(); i++){
+		if (paused)
+			_ring.prepCancel(packUserData(OP_ACCEPT, _acceptGeneration, i), packUserData(OP_CANCEL, 0, 0));
+		else
+			_ring.prepMultishotAccept(_servers[i].getListenFd(), packUserData(OP_ACCEPT, _acceptGeneration, i));
+	}
+	if (paused)
+		_acceptGeneration++;
+}
+
+/**
+ * @brief Feed one multishot recv completion to the Server
+ *
+ * @note bytes arriving while a response is being produced or sent are kept aside
+ *       and fed once the response is complete, and the recv is cancelled: as with the
+ *       epoll loop, which stops reading meanwhile, further input waits in the socket
+ *       and the TCP window holds the client back. Only the completions already
+ *       posted when the cancellation runs are kept aside: at most what the socket
+ *       had received, which the epoll loop would leave in the kernel.
+ */
+void Webserver::handleUringRecv(Connection& conn, const io_uring_cqe& cqe){
+	if (!(cqe.flags & IORING_CQE_F_MORE))
+		conn.recvArmed = false;
+	if (cqe.res == -ENOBUFS || cqe.res == -ECANCELED){
+		// every provided buffer is in use, or the recv was paused: post it again unless paused
+		if (!conn.closing && !conn.recvArmed && !conn.recvPaused)
+			submitUringRecv(conn);
+		return;
+	}
+	if (cqe.res <= 0){
+		closeUringClient(conn);
+		return;
+	}
+	uint16_t bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+	const char* data = _ring.bufferData(bid);
+	if (!conn.closing){
+		if (conn.lingering){
+			// lingering close: the input is discarded, each read extends the deadline
+			if (!armLingerTimer(conn))
+				closeUringClient(conn);
+		}
+		else if (conn.writing || conn.pending){
+			conn.pendingInput.append(data, cqe.res);
+			pauseUringRecv(conn);
+		}
+		else
+			applyUringStatus(conn, _servers[conn.serverIndex].handleClientData(conn, data, cqe.res));
+	}
+	_ring.recycleBuffer(bid);
+	if (!conn.closing && !conn.recvArmed && !conn.recvPaused)
+		submitUringRecv(conn);
+}
+
+void Webserver::handleUringSend(Connection& conn, const io_uring_cqe& cqe){
+	conn.sendInFlight = false;
+	if (conn.closing)
+		return;
+	if (cqe.res < 0){
+		closeUringClient(conn);
+		return;
+	}
+	if (_stats)
+		_stats->bytesOut.fetch_add(cqe.res, std::memory_order_relaxed);
+	continueUringSend(conn, _servers[conn.serverIndex].completeClientWrite(conn, cqe.res));
+}
+
+/**
+ * @brief The socket is writable: send the file body at the head of the write buffer
+ *
+ * @note io_uring has no sendfile operation: the file is sent with sendfile(2) once a
+ *       poll reports the socket writable, as far as it accepts (Server::handleClientWrite).
+ */
+void Webserver::handleUringSendFile(Connection& conn, const io_uring_cqe& cqe){
+	conn.sendInFlight = false;
+	if (conn.closing)
+		return;
+	if (cqe.res < 0 || (cqe.res & (POLLERR | POLLHUP))){
+		closeUringClient(conn);
+		return;
+	}
+	continueUringSend(conn, _servers[conn.serverIndex].handleClientWrite(conn));
+}
+
+/// Carry on once some of the write buffer was sent: with the input received meanwhile, once all of it was.
+void Webserver::continueUringSend(Connection& conn, Server::ClientStatus status){
+	if ((status == Server::CLIENT_KEEP_ALIVE || status == Server::CLIENT_INCOMPLETE) && !conn.pendingInput.empty()){
+		armClientTimer(conn, PHASE_IDLE);
+		std::string input;
+		input.swap(conn.pendingInput);
+		status = _servers[conn.serverIndex].handleClientData(conn, input.data(), input.size());
+	}
+	applyUringStatus(conn, status);
+}
+
+void Webserver::applyUringStatus(Connection& conn, Server::ClientStatus status){
+	switch (status){
+	case Server::CLIENT_INCOMPLETE:
+		updateReadTimer(conn);
+		resumeUringRecv(conn);
+		break;
+	case Server::CLIENT_WRITING:
+		armClientTimer(conn, PHASE_SEND);
+		if (!conn.sendInFlight)
+			submitUringSend(conn);
+		break;
+	case Server::CLIENT_KEEP_ALIVE:
+		armClientTimer(conn, PHASE_IDLE);
+		resumeUringRecv(conn);
+		break;
+	case Server::CLIENT_PENDING:
+		waitForHandler(conn);
+		break;
+	case Server::CLIENT_COMPLETE:
+		closeClient(conn);
+		break;
+	case Server::CLIENT_ERROR:
+		closeUringClient(conn);
+		break;
+	}
+}
+
+void Webserver::submitUringRecv(Connection& conn){
+	_ring.prepMultishotRecv(conn.fd, packUserData(OP_RECV, conn.generation, conn.fd));
+	conn.recvArmed = true;
+}
+
+/**
+ * @brief Stop reading a client until its response is sent: cancel its multishot recv
+ *
+ * @note the recv ends with -ECANCELED (or with a last completion already posted),
+ *       after which it is not posted again while paused.
+ */
+void Webserver::pauseUringRecv(Connection& conn){
+	if (conn.recvPaused)
+		return;
+	conn.recvPaused = true;
+	if (conn.recvArmed)
+		_ring.prepCancel(packUserData(OP_RECV, conn.generation, conn.fd), packUserData(OP_CANCEL, 0, 0));
+}
+
+/// Read again once the client is back to reading; a recv still ending re-arms itself (handleUringRecv).
+void Webserver::resumeUringRecv(Connection& conn){
+	if (!conn.recvPaused)
+		return;
+	conn.recvPaused = false;
+	if (!conn.closing && !conn.recvArmed)
+		submitUringRecv(conn);
+}
+
+/**
+ * @brief Post the unsent part of the pending responses
+ *
+ * @note heads and bodies are gathered into the connection's iovec array (WriteBuffer::gather)
+ *       and sent by one sendmsg, up to WriteBuffer::MAX_IOV segments; a completion that
+ *       leaves some unsent posts the next ones. A file body waits for a writable poll
+ *       instead (handleUringSendFile).
+ * @note the last response of a connection is linked to a shutdown: both go out
+ *       in the same submission, and the shutdown only runs once the send is complete.
+ *       Before a lingering close only the sending side is shut down (closeClient).
+ */
+void Webserver::submitUringSend(Connection& conn){
+	const WriteBuffer& buffer = conn.writeBuffer;
+	off_t offset;
+	size_t length;
+	if (buffer.currentFile(offset, length)){
+		_ring.prepPoll(conn.fd, POLLOUT, packUserData(OP_SEND_FILE, conn.generation, conn.fd));
+		conn.sendInFlight = true;
+		return;
+	}
+	bool beforeFile = false;
+	size_t count = buffer.gather(conn.sendIov, WriteBuffer::MAX_IOV, &beforeFile);
+	size_t gathered = 0;
+	for (size_t i = 0; i < count; i++)
+		gathered += conn.sendIov[i].iov_len;
+	// only the send of the end of the queue may be followed by the shutdown
+	bool last = !buffer.keepAlive && gathered == buffer.remainingToSend();
+	conn.sendMsg = msghdr();
+	conn.sendMsg.msg_iov = conn.sendIov;
+	conn.sendMsg.msg_iovlen = count;
+	// a head followed by a file body is held back to share its first packet (Server::sendAvailable)
+	_ring.prepSendmsg(conn.fd, &conn.sendMsg, packUserData(OP_SEND, conn.generation, conn.fd),
+						last ? IOSQE_IO_LINK : 0, beforeFile ? MSG_MORE : 0);
+	conn.sendInFlight = true;
+	if (last){
+		_ring.prepShutdown(conn.fd, conn.lingerOnClose ? SHUT_WR : SHUT_RDWR, packUserData(OP_SHUTDOWN, conn.generation, conn.fd));
+		conn.shutdownInFlight = true;
+	}
+}
+
+/**
+ * @brief Start closing a client: shutting the socket down ends its posted operations
+ *
+ * @note the fd itself is closed by finishUringClose once the last of them completed,
+ *       so it cannot be reused while the kernel still refers to it.
+ */
+void Webserver::closeUringClient(Connection& conn){
+	if (conn.closing)
+		return;
+	conn.closing = true;
+	_timers.cancel(conn.timer);
+	// a lingering client's posted shutdown only shuts the sending side: it leaves the recv armed
+	if (!conn.shutdownInFlight || conn.lingering)
+		shutdown(conn.fd, SHUT_RDWR);
+}
+
+void Webserver::finishUringClose(Connection& conn){
+	if (conn.recvArmed || conn.sendInFlight || conn.shutdownInFlight)
+		return;
+	releaseClient(conn);
+}
+
+// ==========================================================
+// suspended coroutines
+// ==========================================================
+void Webserver::watchUring(Waiter& waiter, int fd, uint32_t events){
+	waiter.id = ++_nextWaiterId & WAITER_ID_MASK;
+	_uringWaiters[waiter.id] = &waiter;
+	_ring.prepPoll(fd, events, packWaiterData(OP_WAITER, waiter.id));
+}
+
+/**
+ * @note the poll completes later with -ECANCELED; its id is unknown by then,
+ *       so the completion is dropped.
+ */
+void Webserver::unwatchUring(Waiter& waiter){
+	if (_uringWaiters.erase(waiter.id) == 0)
+		return;
+	_ring.prepPollRemove(packWaiterData(OP_WAITER, waiter.id), packWaiterData(OP_POLL_REMOVE, 0));
+}
+
+void Webserver::handleUringWaiter(const io_uring_cqe& cqe){
+	auto it = _uringWaiters.find(cqe.user_data & WAITER_ID_MASK);
+	if (it == _uringWaiters.end())
+		return;
+	Waiter* waiter = it->second;
+	_uringWaiters.erase(it);
+	waiter->revents = cqe.res < 0 ? static_cast<uint32_t>(POLLERR) : static_cast<uint32_t>(cqe.res);
+	waiter->handle.resume();
+}
@@ -2,15 +2,25 @@
 
 namespace httpUtils{
 
+   // Helper: Extension of the last path component, dot included (as fs::path::extension, without building a path)
+   static std::string_view extensionOf(std::string_view path) {
+      size_t slash = path.rfind('/');
+      std::string_view name = slash == std::string_view::npos ? path : path.substr(slash + 1);
+      size_t dot = name.rfind('.');
+      if (dot == std::string_view::npos || dot == 0 || name == "..")
+         return std::string_view();
+      return name.substr(dot);
+   }
+
    // Helper: Check if path has common CGI extension
-   static bool isCgiExtension(const std::string& path) {
-      std::string ext = fs::path(path).extension().string();
+   static bool isCgiExtension(std::string_view path) {
+      std::string_view ext = extensionOf(path);
       return ext == ".php" || ext == ".py" || ext == ".sh" ||
              ext == ".cgi" || ext == ".pl" || ext == ".rb";
    }
 
    // Helper: Check if path is in common CGI directory
-   static bool isCgiDirectory(const std::string& path) {
+   static bool isCgiDirectory(std::string_view path) {
       return path.find("/cgi-bin/") != std::string::npos ||
              path.find("/cgi/") != std::string::npos ||
              path.rfind("/cgi-bin", 0) == 0 ||
@@ -18,7 +28,7 @@ namespace httpUtils{
    }
 
    // Helper: Check if path matches extension-based location
-   static bool matchesExtensionLocation(const std::string& path, const config::LocationConfig& loc) {
+   static bool matchesExtensionLocation(std::string_view path, const config::LocationConfig& loc) {
       if (loc.path.empty() || loc.path[0] != '.'){
          return false;
       }
@@ -27,7 +37,7 @@ namespace httpUtils{
    }
 
    // Helper: Check if path matches directory-based location
-   static bool matchesDirectoryLocation(const std::string& path, const config::LocationConfig& loc) {
+   static bool matchesDirectoryLocation(std::string_view path, const config::LocationConfig& loc) {
       if (loc.path.empty() || loc.path[0] == '.'){
          return false;
       }
@@ -40,20 +50,16 @@ namespace httpUtils{
    }
 
    /**
-    * @brief 
+    * @brief Whether the request is to be answered by a CGI script
     * 
-    * @param request 
-    * @param vh 
+    * @param request the request; its path, without the query
+    * @param vh the virtual host
     * @return true 
     * @return false 
     */
-   bool isCgiRequest(HttpRequest& request, const config::ServerConfig& vh){
-      std::string path = request.getPath();
-      std::string method = request.getMethod();
-      size_t queryPos = path.find('?');
-      if (queryPos != std::string::npos) {
-         path = path.substr(0, queryPos);
-      }
+   bool isCgiRequest(const HttpRequest& request, const config::ServerConfig& vh){
+      std::string_view path = request.getPath();
+      std::string_view method = request.getMethod();
       for (size_t i = 0; i < vh.locations.size(); i++){
          const config::LocationConfig& loc = vh.locations[i];
          if (loc.cgiPass.empty() && loc.cgiExt.empty()){
@@ -73,7 +79,7 @@ namespace httpUtils{
             }
          }
       }
-      if (method == "GET" || method == "POST") {
+      if (request.getMethodId() == METHOD_GET || request.getMethodId() == METHOD_POST) {
          if (isCgiExtension(path) || isCgiDirectory(path)) {
             return true;
          }
@@ -90,7 +96,7 @@ namespace httpUtils{
     *
     * @note used to validate if a request method is permitted for a specific location
     */
-   bool isMethodAllowed(const config::LocationConfig* loc, const std::string& method){
+   bool isMethodAllowed(const config::LocationConfig* loc, std::string_view method){
       if (!loc)
          return false;
       for (std::vector<std::string>::const_iterator it = loc->methods.begin(); it != loc->methods.end(); ++it){
@@ -116,19 +122,30 @@ namespace httpUtils{
     * Connection: KeEp-AlIvE
     */
    bool shouldKeepAlive(const HttpRequest& req){
-      std::string version = req.getVersion();
-      const std::map<std::string, std::string>& headers = req.getHeaders();
+      std::string_view connValue = req.getHeader(HEADER_CONNECTION);
+      if (containsNoCase(connValue, "close"))
+         return false;
+      if (containsNoCase(connValue, "keep-alive"))
+         return true;
+      return true;
+   }
 
-      auto it = headers.find("connection");
-      if (it != headers.end()) {
-         std::string connValue = it->second;
-         std::transform(connValue.begin(), connValue.end(), connValue.begin(), ::tolower);
-         if (connValue.find("close") != std::string::npos)
-            return false;
-         if (connValue.find("keep-alive") != std::string::npos)
+   /**
+    * @brief Whether text contains word, ignoring ASCII case
+    *
+    * @note no lowercased copy: header values are matched where they were received
+    */
+   bool containsNoCase(std::string_view text, std::string_view word){
+      if (word.size() > text.size())
+         return false;
+      for (size_t i = 0; i + word.size() <= text.size(); i++){
+         size_t j = 0;
+         while (j < word.size() && std::tolower(static_cast<unsigned char>(text[i + j])) == std::tolower(static_cast<unsigned char>(word[j])))
+            j++;
+         if (j == word.size())
             return true;
       }
-      return true;
+      return false;
    }
 
    /**
@@ -156,15 +173,15 @@ namespace httpUtils{
     * @brief  Gets the MIME type based on the file extension
     *
     * @param string the file path
-    * @return string the corresponding MIME type
+    * @return string the corresponding MIME type (static storage, nothing allocated)
     *
     * @note             MIME type: Multipurpose Internet Mail Extension type:
     * @example_format:  type / subtype
     * @example          text/html
     */
-   std::string getMimeType(const std::string& path)
+   std::string_view getMimeType(std::string_view path)
    {
-      static const std::map<std::string, std::string> mimeMap =
+      static const std::map<std::string, std::string, std::less<>> mimeMap =
       {
          {".html","text/html"},
          {".htm","text/html"},
@@ -177,9 +194,9 @@ namespace httpUtils{
          {".gif","image/gif"},
          {".txt","text/plain"}
       };
-      auto ext = fs::path(path).extension().string();                         // get file extension
+      auto ext = extensionOf(path);                                           // get file extension
       auto it = mimeMap.find(ext);                                            // lookup in map
-      return it != mimeMap.end() ? it->second : "application/octet-stream";   // default MIME
+      return it != mimeMap.end() ? std::string_view(it->second) : "application/octet-stream";   // default MIME
    }
 
    /**
@@ -191,9 +208,63 @@ namespace httpUtils{
     * @note Example output: "Wed, 21 Oct 2015 07:28:00 GMT", used for Last-Modified header
     */
    std::string formatTime(std::time_t t) {
-      std::ostringstream ss;
-      ss << std::put_time(std::gmtime(&t), "%a, %d %b %Y %H:%M:%S GMT");
-      return ss.str();
+      char buf[HTTP_DATE_SIZE];
+      return std::string(buf, formatTime(t, buf));
+   }
+
+   /// Same, into buf (at least HTTP_DATE_SIZE bytes); returns the length written.
+   size_t formatTime(std::time_t t, char* buf) {
+      std::tm tm;
+      gmtime_r(&t, &tm);   // reentrant: event loops may run in several threads
+      return std::strftime(buf, HTTP_DATE_SIZE, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+   }
+
+   /**
+    * @brief  The current time as a Date header value
+    * @return string_view valid until the calling thread's next call
+    *
+    * @note formatted at most once per second and per thread, so that every response
+    *       can carry a Date without paying for a gmtime and a strftime each
+    */
+   std::string_view currentDate() {
+      thread_local std::time_t formatted = -1;
+      thread_local char buf[HTTP_DATE_SIZE];
+      thread_local size_t len = 0;
+      std::time_t now = time(NULL);
+      if (now != formatted) {
+         len = formatTime(now, buf);
+         formatted = now;
+      }
+      return std::string_view(buf, len);
+   }
+
+   // Helper: the URI relative to the location it matched, without its leading '/'
+   static std::string_view relativeToLocation(const config::LocationConfig* loc, std::string_view uri_raw)
+   {
+      std::string_view rel = uri_raw;
+      if (rel.find(loc->path) == 0)
+         rel.remove_prefix(loc->path.length());
+      if (!rel.empty() && rel[0] == '/')
+         rel.remove_prefix(1);
+      return rel;
+   }
+
+   /**
+    * @brief   The path a request URI maps to in the location's root, as written
+    *
+    * @param   loc pointer to the LocationConfig
+    * @param   uri_raw the request URI
+    * @return  string root + "/" + the URI relative to the location
+    *
+    * @note    no system call (nothing resolved, unlike mapUriToPath): the open file cache key
+    */
+   std::string locationPath(const config::LocationConfig* loc, const std::string& uri_raw)
+   {
+      std::string_view rel = relativeToLocation(loc, uri_raw);
+      std::string path;
+      path.reserve(loc->root.size() + 1 + rel.size());
+      path.append(loc->root).append("/").append(rel);
+      return path;
    }
 
    /**
@@ -209,16 +280,11 @@ namespace httpUtils{
     */
    std::string mapUriToPath(const config::LocationConfig* loc, const std::string& uri_raw)
    {
-      std::string rel = uri_raw;
-      if (rel.find(loc->path) == 0)
-         rel = rel.substr(loc->path.length());
-      if (!rel.empty() && rel[0] == '/')
-         rel = rel.substr(1);
-
-      fs::path full = fs::absolute(loc->root) / rel;
+      fs::path full = fs::absolute(loc->root) / relativeToLocation(loc, uri_raw);
 
+      // a name the filesystem refuses (too long...) is left for stat() to report
       std::error_code ec;
-      if (fs::exists(full))
+      if (fs::exists(full, ec))
       {
          fs::path canon = fs::canonical(full, ec);
          if (!ec)
@@ -252,20 +318,15 @@ namespace httpUtils{
     * @brief Finds the best/longest matching LocationConfig for a given URI
     *
     * @param vh pointer to the ServerConfig (virtual host)
-    * @param uri_raw the request URI
+    * @param uri the request path, without its query
     * @param method the HTTP method (optional, used for extension-based location matching)
     * @return  const pointer to the best matching LocationConfig, or NULL if none found
     *
     * @note  used to map request URIs to server location blocks based on longest prefix match
     *        Extension-based locations (starting with .) only match if method is allowed
     */
-   const config::LocationConfig* findLocationConfig(const config::ServerConfig* vh, const std::string& uri_raw, const std::string& method)
+   const config::LocationConfig* findLocationConfig(const config::ServerConfig* vh, std::string_view uri, std::string_view method)
    {
-      std::string uri = uri_raw;
-      size_t qpos = uri.find('?');
-      if (qpos != std::string::npos)
-         uri = uri.substr(0, qpos);
-
       const config::LocationConfig* best = nullptr;
       const config::LocationConfig* extMatch = nullptr;
       size_t bestLen = 0;
@@ -301,7 +362,7 @@ namespace httpUtils{
             }
          }
          else if (loc.path.length() > 1 && loc.path.back() == '/') {
-            std::string locWithoutSlash = loc.path.substr(0, loc.path.length() - 1);
+            std::string_view locWithoutSlash(loc.path.data(), loc.path.length() - 1);
             if (uri == locWithoutSlash) {
                if (loc.path.length() > bestLen) {
                   best = &loc;
@@ -1,26 +1,15 @@
-#include "Webserver.hpp"
+#include "Master.hpp"
 
 int main(int argc, char **argv){
 	try {
-		std::vector<ServerConfig> configs;
-		if (argc == 1){
-			Parser parser(DEFAULT_CONFIG_PATH);
-			std::vector<ServerNode> servers = parser.parse();
-			configs = ConfigBuilder::build(servers);
-		}
-		else if (argc == 2){
-			Parser parser(argv[1]);
-			std::vector<ServerNode> servers = parser.parse();
-			configs = ConfigBuilder::build(servers);
-		}
-		else
+		if (argc > 2)
 			return returnErrorMessage(WRONG_ARGUMENTS);
-		Webserver miniNginx;
-		if (miniNginx.createServers(configs) == FAILURE)
-			return returnErrorMessage(FAILED_TO_CREATE_SERVERS);
-		if (miniNginx.runWebserver() == FAILURE)
-			return returnErrorMessage(ERROR_RUNNING_SERVERS);
-		return SUCCESS;
+		Parser parser(argc == 2 ? argv[1] : DEFAULT_CONFIG_PATH);
+		std::vector<ServerNode> servers = parser.parse();
+		std::vector<ServerConfig> configs = ConfigBuilder::build(servers);
+		GlobalConfig global = ConfigBuilder::buildGlobal(parser.getGlobal());
+		Master master(global, configs);
+		return master.run();
 	} 
 	catch (const std::exception& e){
 		std::cerr << "Error: " << e.what() << std::endl;